@@ -0,0 +1,379 @@
+#include "ddg/address.h"
+
+#include <netdb.h>
+#include <stddef.h>
+#include <string.h>
+#include <sstream>
+
+#include "ddg/log.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+// Address
+Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
+  if (addr == nullptr) {
+    return nullptr;
+  }
+
+  Address::ptr result;
+  switch (addr->sa_family) {
+    case AF_INET:
+      result.reset(
+          new IPv4Address(*reinterpret_cast<const sockaddr_in*>(addr)));
+      break;
+    case AF_INET6:
+      result.reset(
+          new IPv6Address(*reinterpret_cast<const sockaddr_in6*>(addr)));
+      break;
+    case AF_UNIX: {
+      UnixAddress::ptr unix_addr(new UnixAddress);
+      memcpy(unix_addr->getAddr(), addr,
+             std::min<size_t>(addrlen, sizeof(sockaddr_un)));
+      unix_addr->setAddrLen(addrlen);
+      result = unix_addr;
+      break;
+    }
+    default:
+      result.reset(new UnknownAddress(*addr));
+      break;
+  }
+  return result;
+}
+
+bool Address::Lookup(std::vector<Address::ptr>& result,
+                     const std::string& host, int family, int type,
+                     int protocol) {
+  addrinfo hints, *results, *next;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_flags = 0;
+  hints.ai_family = family;
+  hints.ai_socktype = type;
+  hints.ai_protocol = protocol;
+
+  std::string node;
+  const char* service = nullptr;
+
+  // [ipv6]:port
+  if (!host.empty() && host[0] == '[') {
+    const char* endipv6 = static_cast<const char*>(
+        memchr(host.c_str() + 1, ']', host.size() - 1));
+    if (endipv6) {
+      if (*(endipv6 + 1) == ':') {
+        service = endipv6 + 2;
+      }
+      node = host.substr(1, endipv6 - host.c_str() - 1);
+    }
+  }
+
+  // host:port, 只有一个':'才认为带了端口
+  if (node.empty()) {
+    service =
+        static_cast<const char*>(memchr(host.c_str(), ':', host.size()));
+    if (service) {
+      size_t rest = host.c_str() + host.size() - service - 1;
+      if (!memchr(service + 1, ':', rest)) {
+        node = host.substr(0, service - host.c_str());
+        ++service;
+      } else {
+        service = nullptr;
+      }
+    }
+  }
+
+  if (node.empty()) {
+    node = host;
+  }
+
+  int error = getaddrinfo(node.c_str(), service, &hints, &results);
+  if (error) {
+    DDG_LOG_DEBUG(g_logger)
+        << "Address::Lookup getaddress(" << host << ", " << family << ", "
+        << type << ") err = " << error << " errstr = " << gai_strerror(error);
+    return false;
+  }
+
+  next = results;
+  while (next) {
+    result.push_back(Create(next->ai_addr, next->ai_addrlen));
+    next = next->ai_next;
+  }
+
+  freeaddrinfo(results);
+  return !result.empty();
+}
+
+Address::ptr Address::LookupAny(const std::string& host, int family, int type,
+                                int protocol) {
+  std::vector<Address::ptr> result;
+  if (Lookup(result, host, family, type, protocol)) {
+    return result[0];
+  }
+  return nullptr;
+}
+
+IPAddress::ptr Address::LookupAnyIPAddress(const std::string& host,
+                                           int family, int type,
+                                           int protocol) {
+  std::vector<Address::ptr> result;
+  if (Lookup(result, host, family, type, protocol)) {
+    for (auto& i : result) {
+      IPAddress::ptr v = std::dynamic_pointer_cast<IPAddress>(i);
+      if (v) {
+        return v;
+      }
+    }
+  }
+  return nullptr;
+}
+
+int Address::getFamily() const {
+  return getAddr()->sa_family;
+}
+
+std::string Address::toString() const {
+  std::stringstream ss;
+  insert(ss);
+  return ss.str();
+}
+
+bool Address::operator<(const Address& rhs) const {
+  socklen_t minlen = std::min(getAddrLen(), rhs.getAddrLen());
+  int result = memcmp(getAddr(), rhs.getAddr(), minlen);
+  if (result < 0) {
+    return true;
+  } else if (result > 0) {
+    return false;
+  }
+  return getAddrLen() < rhs.getAddrLen();
+}
+
+bool Address::operator==(const Address& rhs) const {
+  return getAddrLen() == rhs.getAddrLen() &&
+         memcmp(getAddr(), rhs.getAddr(), getAddrLen()) == 0;
+}
+
+bool Address::operator!=(const Address& rhs) const {
+  return !(*this == rhs);
+}
+
+// IPAddress
+IPAddress::ptr IPAddress::Create(const char* address, uint16_t port) {
+  addrinfo hints, *results;
+  memset(&hints, 0, sizeof(addrinfo));
+
+  hints.ai_flags = AI_NUMERICHOST;
+  hints.ai_family = AF_UNSPEC;
+
+  int error = getaddrinfo(address, nullptr, &hints, &results);
+  if (error) {
+    DDG_LOG_DEBUG(g_logger) << "IPAddress::Create(" << address << ", " << port
+                            << ") error = " << error
+                            << " errstr = " << gai_strerror(error);
+    return nullptr;
+  }
+
+  IPAddress::ptr result = std::dynamic_pointer_cast<IPAddress>(
+      Address::Create(results->ai_addr, results->ai_addrlen));
+  if (result) {
+    result->setPort(port);
+  }
+  freeaddrinfo(results);
+  return result;
+}
+
+// IPv4Address
+IPv4Address::ptr IPv4Address::Create(const char* address, uint16_t port) {
+  IPv4Address::ptr rt(new IPv4Address);
+  rt->m_addr.sin_port = htons(port);
+  int result = inet_pton(AF_INET, address, &rt->m_addr.sin_addr);
+  if (result <= 0) {
+    DDG_LOG_DEBUG(g_logger) << "IPv4Address::Create(" << address << ", "
+                            << port << ") rt = " << result
+                            << " errno = " << errno << " " << strerror(errno);
+    return nullptr;
+  }
+  return rt;
+}
+
+IPv4Address::IPv4Address(const sockaddr_in& address) : m_addr(address) {}
+
+IPv4Address::IPv4Address(uint32_t address, uint16_t port) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sin_family = AF_INET;
+  m_addr.sin_port = htons(port);
+  m_addr.sin_addr.s_addr = htonl(address);
+}
+
+const sockaddr* IPv4Address::getAddr() const {
+  return reinterpret_cast<const sockaddr*>(&m_addr);
+}
+
+sockaddr* IPv4Address::getAddr() {
+  return reinterpret_cast<sockaddr*>(&m_addr);
+}
+
+socklen_t IPv4Address::getAddrLen() const {
+  return sizeof(m_addr);
+}
+
+std::ostream& IPv4Address::insert(std::ostream& os) const {
+  char buf[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &m_addr.sin_addr, buf, sizeof(buf));
+  os << buf << ":" << ntohs(m_addr.sin_port);
+  return os;
+}
+
+uint32_t IPv4Address::getPort() const {
+  return ntohs(m_addr.sin_port);
+}
+
+void IPv4Address::setPort(uint16_t port) {
+  m_addr.sin_port = htons(port);
+}
+
+// IPv6Address
+IPv6Address::ptr IPv6Address::Create(const char* address, uint16_t port) {
+  IPv6Address::ptr rt(new IPv6Address);
+  rt->m_addr.sin6_port = htons(port);
+  int result = inet_pton(AF_INET6, address, &rt->m_addr.sin6_addr);
+  if (result <= 0) {
+    DDG_LOG_DEBUG(g_logger) << "IPv6Address::Create(" << address << ", "
+                            << port << ") rt = " << result
+                            << " errno = " << errno << " " << strerror(errno);
+    return nullptr;
+  }
+  return rt;
+}
+
+IPv6Address::IPv6Address() {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sin6_family = AF_INET6;
+}
+
+IPv6Address::IPv6Address(const sockaddr_in6& address) : m_addr(address) {}
+
+IPv6Address::IPv6Address(const uint8_t address[16], uint16_t port) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sin6_family = AF_INET6;
+  m_addr.sin6_port = htons(port);
+  memcpy(&m_addr.sin6_addr.s6_addr, address, 16);
+}
+
+const sockaddr* IPv6Address::getAddr() const {
+  return reinterpret_cast<const sockaddr*>(&m_addr);
+}
+
+sockaddr* IPv6Address::getAddr() {
+  return reinterpret_cast<sockaddr*>(&m_addr);
+}
+
+socklen_t IPv6Address::getAddrLen() const {
+  return sizeof(m_addr);
+}
+
+std::ostream& IPv6Address::insert(std::ostream& os) const {
+  char buf[INET6_ADDRSTRLEN];
+  inet_ntop(AF_INET6, &m_addr.sin6_addr, buf, sizeof(buf));
+  os << "[" << buf << "]:" << ntohs(m_addr.sin6_port);
+  return os;
+}
+
+uint32_t IPv6Address::getPort() const {
+  return ntohs(m_addr.sin6_port);
+}
+
+void IPv6Address::setPort(uint16_t port) {
+  m_addr.sin6_port = htons(port);
+}
+
+// UnixAddress
+static const size_t kMaxPathLen = sizeof(sockaddr_un::sun_path) - 1;
+
+UnixAddress::UnixAddress() {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sun_family = AF_UNIX;
+  m_length = offsetof(sockaddr_un, sun_path) + kMaxPathLen;
+}
+
+UnixAddress::UnixAddress(const std::string& path) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sun_family = AF_UNIX;
+  m_length = path.size() + 1;
+
+  if (!path.empty() && path[0] == '\0') {
+    --m_length;  // 抽象命名空间不需要结尾的'\0'
+  }
+
+  if (m_length > sizeof(m_addr.sun_path)) {
+    throw std::logic_error("UnixAddress path too long");
+  }
+
+  memcpy(m_addr.sun_path, path.c_str(), m_length);
+  m_length += offsetof(sockaddr_un, sun_path);
+}
+
+const sockaddr* UnixAddress::getAddr() const {
+  return reinterpret_cast<const sockaddr*>(&m_addr);
+}
+
+sockaddr* UnixAddress::getAddr() {
+  return reinterpret_cast<sockaddr*>(&m_addr);
+}
+
+socklen_t UnixAddress::getAddrLen() const {
+  return m_length;
+}
+
+void UnixAddress::setAddrLen(socklen_t len) {
+  m_length = len;
+}
+
+std::string UnixAddress::getPath() const {
+  std::stringstream ss;
+  if (m_length > offsetof(sockaddr_un, sun_path) &&
+      m_addr.sun_path[0] == '\0') {
+    ss << "\\0"
+       << std::string(m_addr.sun_path + 1,
+                      m_length - offsetof(sockaddr_un, sun_path) - 1);
+  } else {
+    ss << m_addr.sun_path;
+  }
+  return ss.str();
+}
+
+std::ostream& UnixAddress::insert(std::ostream& os) const {
+  return os << getPath();
+}
+
+// UnknownAddress
+UnknownAddress::UnknownAddress(int family) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sa_family = family;
+}
+
+UnknownAddress::UnknownAddress(const sockaddr& addr) : m_addr(addr) {}
+
+const sockaddr* UnknownAddress::getAddr() const {
+  return &m_addr;
+}
+
+sockaddr* UnknownAddress::getAddr() {
+  return &m_addr;
+}
+
+socklen_t UnknownAddress::getAddrLen() const {
+  return sizeof(m_addr);
+}
+
+std::ostream& UnknownAddress::insert(std::ostream& os) const {
+  os << "[UnknownAddress family = " << m_addr.sa_family << "]";
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const Address& addr) {
+  return addr.insert(os);
+}
+
+}  // namespace ddg
@@ -0,0 +1,177 @@
+#ifndef DDG_ADDRESS_H_
+#define DDG_ADDRESS_H_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ddg {
+
+class IPAddress;
+
+/**
+ * @brief 网络地址的基类
+ */
+class Address {
+ public:
+  using ptr = std::shared_ptr<Address>;
+
+  // 根据sockaddr创建对应的地址, 未知的family返回UnknownAddress
+  static Address::ptr Create(const sockaddr* addr, socklen_t addrlen);
+
+  // host格式: www.baidu.com, www.baidu.com:80, 127.0.0.1:80, [::1]:80
+  static bool Lookup(std::vector<Address::ptr>& result,
+                     const std::string& host, int family = AF_INET,
+                     int type = 0, int protocol = 0);
+
+  static Address::ptr LookupAny(const std::string& host, int family = AF_INET,
+                                int type = 0, int protocol = 0);
+
+  static std::shared_ptr<IPAddress> LookupAnyIPAddress(
+      const std::string& host, int family = AF_INET, int type = 0,
+      int protocol = 0);
+
+  virtual ~Address() {}
+
+  int getFamily() const;
+
+  virtual const sockaddr* getAddr() const = 0;
+
+  virtual sockaddr* getAddr() = 0;
+
+  virtual socklen_t getAddrLen() const = 0;
+
+  virtual std::ostream& insert(std::ostream& os) const = 0;
+
+  std::string toString() const;
+
+  bool operator<(const Address& rhs) const;
+
+  bool operator==(const Address& rhs) const;
+
+  bool operator!=(const Address& rhs) const;
+};
+
+class IPAddress : public Address {
+ public:
+  using ptr = std::shared_ptr<IPAddress>;
+
+  // address可以是ipv4或者ipv6的数字地址
+  static IPAddress::ptr Create(const char* address, uint16_t port = 0);
+
+  virtual uint32_t getPort() const = 0;
+
+  virtual void setPort(uint16_t port) = 0;
+};
+
+class IPv4Address : public IPAddress {
+ public:
+  using ptr = std::shared_ptr<IPv4Address>;
+
+  static IPv4Address::ptr Create(const char* address, uint16_t port = 0);
+
+  explicit IPv4Address(const sockaddr_in& address);
+
+  explicit IPv4Address(uint32_t address = INADDR_ANY, uint16_t port = 0);
+
+  const sockaddr* getAddr() const override;
+
+  sockaddr* getAddr() override;
+
+  socklen_t getAddrLen() const override;
+
+  std::ostream& insert(std::ostream& os) const override;
+
+  uint32_t getPort() const override;
+
+  void setPort(uint16_t port) override;
+
+ private:
+  sockaddr_in m_addr;
+};
+
+class IPv6Address : public IPAddress {
+ public:
+  using ptr = std::shared_ptr<IPv6Address>;
+
+  static IPv6Address::ptr Create(const char* address, uint16_t port = 0);
+
+  IPv6Address();
+
+  explicit IPv6Address(const sockaddr_in6& address);
+
+  IPv6Address(const uint8_t address[16], uint16_t port = 0);
+
+  const sockaddr* getAddr() const override;
+
+  sockaddr* getAddr() override;
+
+  socklen_t getAddrLen() const override;
+
+  std::ostream& insert(std::ostream& os) const override;
+
+  uint32_t getPort() const override;
+
+  void setPort(uint16_t port) override;
+
+ private:
+  sockaddr_in6 m_addr;
+};
+
+class UnixAddress : public Address {
+ public:
+  using ptr = std::shared_ptr<UnixAddress>;
+
+  UnixAddress();
+
+  // 以'\0'开头的path表示抽象命名空间
+  explicit UnixAddress(const std::string& path);
+
+  const sockaddr* getAddr() const override;
+
+  sockaddr* getAddr() override;
+
+  socklen_t getAddrLen() const override;
+
+  void setAddrLen(socklen_t len);
+
+  std::string getPath() const;
+
+  std::ostream& insert(std::ostream& os) const override;
+
+ private:
+  sockaddr_un m_addr;
+  socklen_t m_length;
+};
+
+class UnknownAddress : public Address {
+ public:
+  using ptr = std::shared_ptr<UnknownAddress>;
+
+  explicit UnknownAddress(int family);
+
+  explicit UnknownAddress(const sockaddr& addr);
+
+  const sockaddr* getAddr() const override;
+
+  sockaddr* getAddr() override;
+
+  socklen_t getAddrLen() const override;
+
+  std::ostream& insert(std::ostream& os) const override;
+
+ private:
+  sockaddr m_addr;
+};
+
+std::ostream& operator<<(std::ostream& os, const Address& addr);
+
+}  // namespace ddg
+
+#endif
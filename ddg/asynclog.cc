@@ -0,0 +1,235 @@
+#include "ddg/asynclog.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <set>
+
+namespace ddg {
+
+// 一次write给底层appender的最大字节数
+static const size_t kMaxBatchSize = 1024 * 1024;
+
+// 都不释放, 避免退出时和LoggerManager的析构顺序问题
+static Mutex* s_appenders_mutex = new Mutex;
+static std::set<AsyncLogAppender*>* s_appenders = nullptr;
+
+const uint32_t AsyncLogAppender::kDefaultQueueSize;
+
+AsyncLogAppender::Overflow AsyncLogAppender::OverflowFromString(
+    const std::string& str) {
+  if (str == "drop") {
+    return DROP;
+  }
+  if (str == "drop_report") {
+    return DROP_REPORT;
+  }
+  return BLOCK;
+}
+
+std::string AsyncLogAppender::OverflowToString(Overflow overflow) {
+  switch (overflow) {
+    case DROP:
+      return "drop";
+    case DROP_REPORT:
+      return "drop_report";
+    default:
+      return "block";
+  }
+}
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr appender,
+                                   uint32_t queue_size, Overflow overflow)
+    : m_appender(appender), m_overflow(overflow) {
+  uint64_t size = 2;
+  while (size < queue_size) {
+    size <<= 1;
+  }
+  std::vector<Slot> slots(size);
+  m_slots.swap(slots);
+  m_mask = size - 1;
+  for (uint64_t i = 0; i < size; ++i) {
+    m_slots[i].seq.store(i, std::memory_order_relaxed);
+  }
+  m_formatter = appender->getFormatter();
+
+  m_thread.reset(new Thread("async_log", [this]() { run(); }));
+  Mutex::Lock lock(s_appenders_mutex);
+  if (!s_appenders) {
+    s_appenders = new std::set<AsyncLogAppender*>;
+    atexit(&AsyncLogAppender::FlushAll);
+  }
+  s_appenders->insert(this);
+}
+
+AsyncLogAppender::~AsyncLogAppender() {
+  {
+    Mutex::Lock lock(s_appenders_mutex);
+    s_appenders->erase(this);
+  }
+  m_stopping = true;
+  m_sleeping = false;
+  m_sem.post();
+  m_thread->join();
+  flush();
+}
+
+void AsyncLogAppender::FlushAll() {
+  Mutex::Lock lock(s_appenders_mutex);
+  for (auto appender : *s_appenders) {
+    appender->flush();
+  }
+}
+
+void AsyncLogAppender::log(Logger::ptr logger, LogLevel::Level level,
+                           LogEvent::ptr event) {
+  if (level < m_level.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // 格式化到线程局部的缓冲区, 再拷贝到队列里复用的slot, 都不用分配内存
+  static thread_local LogStream t_buffer(LogEvent::kMaxContentSize + 4096);
+  t_buffer.reset();
+  getFormatter()->format(t_buffer, logger, level, event);
+  // FATAL之后进程多半要退出了, 不能丢, 写完立即刷下去
+  bool fatal = level >= LogLevel::FATAL;
+  if (!push(t_buffer.data(), t_buffer.size(),
+            fatal || m_overflow == BLOCK)) {
+    ++m_dropped;
+    ++m_droppedTotal;
+    return;
+  }
+  if (fatal) {
+    flush();
+  }
+}
+
+void AsyncLogAppender::write(const char* data, size_t len) {
+  push(data, len, true);
+}
+
+void AsyncLogAppender::flush() {
+  {
+    MutexType::Lock lock(m_consumeMutex);
+    consume();
+  }
+  m_appender->flush();
+}
+
+bool AsyncLogAppender::push(const char* data, size_t len, bool block) {
+  uint64_t pos = m_tail.load(std::memory_order_relaxed);
+  Slot* slot = nullptr;
+  while (true) {
+    slot = &m_slots[pos & m_mask];
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(seq - pos);
+    if (diff == 0) {
+      if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // 满了
+      if (!block) {
+        return false;
+      }
+      wakeup();
+      sched_yield();
+      pos = m_tail.load(std::memory_order_relaxed);
+    } else {
+      pos = m_tail.load(std::memory_order_relaxed);
+    }
+  }
+  slot->data.assign(data, len);
+  slot->seq.store(pos + 1, std::memory_order_release);
+  wakeup();
+  return true;
+}
+
+size_t AsyncLogAppender::consume() {
+  size_t n = 0;
+  m_batch.clear();
+  while (true) {
+    Slot& slot = m_slots[m_head & m_mask];
+    if (slot.seq.load(std::memory_order_acquire) != m_head + 1) {
+      break;
+    }
+    m_batch.append(slot.data);
+    slot.data.clear();
+    slot.seq.store(m_head + m_slots.size(), std::memory_order_release);
+    ++m_head;
+    ++n;
+    if (m_batch.size() >= kMaxBatchSize) {
+      m_appender->write(m_batch.data(), m_batch.size());
+      m_batch.clear();
+    }
+  }
+  uint64_t dropped = m_dropped.exchange(0);
+  if (dropped && m_overflow == DROP_REPORT) {
+    m_batch += "AsyncLogAppender dropped " + std::to_string(dropped) +
+               " log records\n";
+  }
+  if (!m_batch.empty()) {
+    m_appender->write(m_batch.data(), m_batch.size());
+  }
+  return n;
+}
+
+void AsyncLogAppender::wakeup() {
+  // 和run里先置m_sleeping再检查队列配对, 保证不会漏掉唤醒
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed) &&
+      m_sleeping.exchange(false)) {
+    m_sem.post();
+  }
+}
+
+void AsyncLogAppender::run() {
+  while (true) {
+    size_t n = 0;
+    bool empty = true;
+    {
+      MutexType::Lock lock(m_consumeMutex);
+      n = consume();
+    }
+    if (n) {
+      m_appender->flush();
+      continue;
+    }
+    if (m_stopping) {
+      break;
+    }
+    m_sleeping = true;
+    {
+      MutexType::Lock lock(m_consumeMutex);
+      Slot& slot = m_slots[m_head & m_mask];
+      empty = slot.seq.load(std::memory_order_acquire) != m_head + 1;
+    }
+    // 睡下之前又有了日志, 自己把标记清掉; 被生产者清掉的话会有一次post
+    if (!empty && m_sleeping.exchange(false)) {
+      continue;
+    }
+    m_sem.wait();
+  }
+}
+
+std::string AsyncLogAppender::toYamlString() const {
+  YAML::Node node = YAML::Load(m_appender->toYamlString());
+  {
+    RWMutexType::ReadLock lock(m_rwmutex);
+    node["level"] = LogLevel::ToString(m_level);
+    if (m_formatter) {
+      node["formatter"] = m_formatter->getPattern();
+    }
+  }
+  node["async"] = true;
+  node["queue_size"] = m_slots.size();
+  node["overflow"] = OverflowToString(m_overflow);
+  std::stringstream ss;
+  ss << node;
+  return ss.str();
+}
+
+std::string AsyncLogAppender::toString() const {
+  return toYamlString();
+}
+
+}  // namespace ddg
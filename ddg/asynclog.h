@@ -0,0 +1,110 @@
+#ifndef DDG_ASYNCLOG_H_
+#define DDG_ASYNCLOG_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/log.h"
+#include "ddg/mutex.h"
+#include "ddg/thread.h"
+
+namespace ddg {
+
+/**
+ * @brief 异步日志, 包装另一个LogAppender
+ *
+ * 调用线程只负责格式化, 把结果放进一个有界的MPSC环形队列; 后台线程批量
+ * 取出后一次性write给被包装的appender, 磁盘慢的时候不会卡住业务线程.
+ *
+ * 队列满时按Overflow处理. FATAL日志写入后立即在调用线程里刷到底层,
+ * 进程正常退出(exit)时也会把队列里剩下的日志刷完
+ */
+class AsyncLogAppender : public LogAppender {
+ public:
+  using ptr = std::shared_ptr<AsyncLogAppender>;
+  using MutexType = Mutex;
+
+  enum Overflow {
+    // 等待后台线程腾出位置
+    BLOCK = 0,
+    // 直接丢弃
+    DROP = 1,
+    // 丢弃, 并在输出里记一行丢了多少条
+    DROP_REPORT = 2,
+  };
+
+  static Overflow OverflowFromString(const std::string& str);
+  static std::string OverflowToString(Overflow overflow);
+
+  static const uint32_t kDefaultQueueSize = 8192;
+
+  /**
+   * @param appender 实际输出的appender
+   * @param queue_size 队列能放的日志条数, 向上取整到2的幂
+   */
+  AsyncLogAppender(LogAppender::ptr appender,
+                   uint32_t queue_size = kDefaultQueueSize,
+                   Overflow overflow = BLOCK);
+
+  ~AsyncLogAppender();
+
+  void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
+           LogEvent::ptr event) override;
+
+  void write(const char* data, size_t len) override;
+
+  // 把队列里的日志都交给底层appender并flush, 可以在任意线程调用
+  void flush() override;
+
+  std::string toYamlString() const override;
+
+  std::string toString() const override;
+
+  LogAppender::ptr getAppender() const { return m_appender; }
+
+  Overflow getOverflow() const { return m_overflow; }
+
+  // 累计丢弃的日志条数
+  uint64_t getDropped() const { return m_droppedTotal; }
+
+  // 进程退出时调用, 刷完所有AsyncLogAppender
+  static void FlushAll();
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    std::string data;
+  };
+
+  // 多个生产者并发push, 不阻塞时队列满了返回false
+  bool push(const char* data, size_t len, bool block);
+
+  // 取出队列里所有的日志写给底层appender, 需要持有m_consumeMutex
+  size_t consume();
+
+  void wakeup();
+
+  void run();
+
+ private:
+  LogAppender::ptr m_appender;
+  Overflow m_overflow;
+  std::vector<Slot> m_slots;
+  uint64_t m_mask;
+  std::atomic<uint64_t> m_tail{0};
+  MutexType m_consumeMutex;
+  uint64_t m_head = 0;  // 只在m_consumeMutex下访问
+  std::string m_batch;
+  std::atomic<uint64_t> m_dropped{0};
+  std::atomic<uint64_t> m_droppedTotal{0};
+  std::atomic<bool> m_sleeping{false};
+  std::atomic<bool> m_stopping{false};
+  Semphore m_sem;
+  std::unique_ptr<Thread> m_thread;
+};
+
+}  // namespace ddg
+
+#endif
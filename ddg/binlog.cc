@@ -0,0 +1,657 @@
+#include "ddg/binlog.h"
+
+#include <ctype.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include "ddg/config.h"
+#include "ddg/macro.h"
+#include "ddg/mutex.h"
+#include "ddg/thread.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_binlog_buffer_size =
+    Config::Lookup<uint32_t>("binlog.buffer_size", 1024 * 1024,
+                             "binlog per thread buffer size");
+
+/**
+ * 文件格式, 整数都是本机字节序:
+ *   "DDGBLOG1" | 开始时间(u64 纳秒)
+ *   'S' | id(u32) | level(u8) | line(i32) | logger | file | fmt | types
+ *   'C' | 线程号(u64) | 长度(u32) | 记录...
+ * 字符串是u16长度加内容, types是u8个数加每个参数的ArgType.
+ * 记录是id(u32) | 时间(u64) | 协程号(u64) | 参数, 字符串参数是u32长度加内容
+ */
+static const char kMagic[] = "DDGBLOG1";
+static const size_t kMagicSize = 8;
+
+const uint32_t BinLog::kMaxStringSize;
+const size_t BinLog::kHeaderSize;
+
+std::atomic<bool> BinLog::s_open{false};
+
+BinLogBuffer::BinLogBuffer(size_t capacity, uint64_t thread_id)
+    : m_threadId(thread_id) {
+  uint64_t size = 4096;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  m_data = new char[size];
+  m_mask = size - 1;
+}
+
+BinLogBuffer::~BinLogBuffer() { delete[] m_data; }
+
+BinLogBuffer::Cursor BinLogBuffer::reserve(size_t size) {
+  DDG_ASSERT_MSG(size <= getCapacity(), "binlog record too large");
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+  // 先用缓存的m_tail判断, 不够了再去读消费者的位置
+  while (head + size - m_cachedTail > getCapacity()) {
+    m_cachedTail = m_tail.load(std::memory_order_acquire);
+    if (head + size - m_cachedTail > getCapacity()) {
+      sched_yield();
+    }
+  }
+  return Cursor{m_data, m_mask, head};
+}
+
+size_t BinLogBuffer::consume(std::string& out) {
+  uint64_t tail = m_tail.load(std::memory_order_relaxed);
+  uint64_t head = m_head.load(std::memory_order_acquire);
+  size_t n = head - tail;
+  if (!n) {
+    return 0;
+  }
+  size_t off = tail & m_mask;
+  size_t first = std::min<size_t>(n, m_mask + 1 - off);
+  out.append(m_data + off, first);
+  out.append(m_data, n - first);
+  m_tail.store(head, std::memory_order_release);
+  return n;
+}
+
+namespace {
+
+// 线程退出时释放缓冲区, 还有数据没写的标记一下, 由Drain写完后释放
+struct ThreadBuffer {
+  BinLogBuffer* buffer = nullptr;
+  ~ThreadBuffer();
+};
+
+struct BinLogState {
+  // 保护sites和buffers
+  Mutex mutex;
+  std::vector<BinLog::Site> sites;
+  std::vector<BinLogBuffer*> buffers;
+
+  // 保护下面的写文件状态, 同一时间只有一个线程在写
+  Mutex write_mutex;
+  std::ofstream file;
+  size_t written_sites = 0;
+  std::string chunks;
+  std::string out;
+
+  std::unique_ptr<Thread> thread;
+  std::atomic<bool> stopping{false};
+};
+
+}  // namespace
+
+// 不释放, 进程退出时可能还有线程在打日志
+static BinLogState* s_state = new BinLogState;
+static thread_local ThreadBuffer t_buffer;
+
+ThreadBuffer::~ThreadBuffer() {
+  if (!buffer) {
+    return;
+  }
+  BinLogState* st = s_state;
+  // 持有write_mutex时没有Drain在取数据, Close之后缓冲区都是空的
+  Mutex::Lock write_lock(st->write_mutex);
+  if (!buffer->empty()) {
+    buffer->close();
+    return;
+  }
+  Mutex::Lock lock(st->mutex);
+  st->buffers.erase(
+      std::find(st->buffers.begin(), st->buffers.end(), buffer));
+  delete buffer;
+}
+
+template <class T>
+static void Append(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void AppendString(std::string& out, const std::string& str) {
+  uint16_t len = std::min<size_t>(str.size(), UINT16_MAX);
+  Append(out, len);
+  out.append(str.data(), len);
+}
+
+// 把所有缓冲区里的记录写到文件, 需要持有write_mutex, 返回写的字节数
+static size_t Drain() {
+  BinLogState* st = s_state;
+  std::vector<BinLogBuffer*> buffers;
+  {
+    Mutex::Lock lock(st->mutex);
+    buffers = st->buffers;
+  }
+  st->chunks.clear();
+  std::vector<BinLogBuffer*> dead;
+  for (auto buffer : buffers) {
+    // 先看是否关闭再取, 关闭之后取完的就不会再有数据了
+    bool closed = buffer->isClosed();
+    size_t pos = st->chunks.size();
+    Append(st->chunks, 'C');
+    Append(st->chunks, buffer->getThreadId());
+    Append(st->chunks, uint32_t(0));
+    size_t n = buffer->consume(st->chunks);
+    if (n) {
+      uint32_t len = n;
+      memcpy(&st->chunks[pos + 1 + 8], &len, sizeof(len));
+    } else {
+      st->chunks.resize(pos);
+    }
+    if (closed) {
+      dead.push_back(buffer);
+    }
+  }
+
+  // 取到的记录用到的调用点都已经登记过了, 写在chunk前面
+  st->out.clear();
+  {
+    Mutex::Lock lock(st->mutex);
+    for (; st->written_sites < st->sites.size(); ++st->written_sites) {
+      const BinLog::Site& site = st->sites[st->written_sites];
+      Append(st->out, 'S');
+      Append(st->out, uint32_t(st->written_sites + 1));
+      Append(st->out, uint8_t(site.level));
+      Append(st->out, site.line);
+      AppendString(st->out, site.logger);
+      AppendString(st->out, site.file);
+      AppendString(st->out, site.fmt);
+      Append(st->out, uint8_t(site.types.size()));
+      st->out += site.types;
+    }
+    for (auto buffer : dead) {
+      st->buffers.erase(
+          std::find(st->buffers.begin(), st->buffers.end(), buffer));
+      delete buffer;
+    }
+  }
+  size_t n = st->out.size() + st->chunks.size();
+  if (n) {
+    st->file.write(st->out.data(), st->out.size());
+    st->file.write(st->chunks.data(), st->chunks.size());
+    st->file.flush();
+  }
+  return n;
+}
+
+static bool HasWriters() {
+  Mutex::Lock lock(s_state->mutex);
+  for (auto buffer : s_state->buffers) {
+    if (buffer->isWriting()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void Run() {
+  BinLogState* st = s_state;
+  while (!st->stopping) {
+    size_t n = 0;
+    {
+      Mutex::Lock lock(st->write_mutex);
+      n = Drain();
+    }
+    if (!n) {
+      usleep(1000);
+    }
+  }
+}
+
+bool BinLog::Open(const std::string& file) {
+  Close();
+  BinLogState* st = s_state;
+  {
+    Mutex::Lock lock(st->write_mutex);
+    st->file.open(file, std::ios::binary | std::ios::trunc);
+    if (!st->file) {
+      DDG_LOG_ERROR(g_logger) << "BinLog::Open " << file << " failed";
+      st->file.close();
+      st->file.clear();
+      return false;
+    }
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t start = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    st->file.write(kMagic, kMagicSize);
+    st->file.write(reinterpret_cast<const char*>(&start), sizeof(start));
+    st->written_sites = 0;
+  }
+  st->stopping = false;
+  st->thread.reset(new Thread("binlog", &Run));
+  s_open = true;
+  return true;
+}
+
+void BinLog::Close() {
+  BinLogState* st = s_state;
+  if (!s_open.exchange(false)) {
+    return;
+  }
+  st->stopping = true;
+  st->thread->join();
+  st->thread.reset();
+  Mutex::Lock lock(st->write_mutex);
+  // 关闭前已经通过检查的生产者还在写, 边取边等它们提交,
+  // 缓冲区满了它们也不会卡在reserve里
+  while (true) {
+    bool writing = HasWriters();
+    Drain();
+    if (!writing) {
+      break;
+    }
+    sched_yield();
+  }
+  st->file.close();
+}
+
+void BinLog::Flush() {
+  if (!IsOpen()) {
+    return;
+  }
+  Mutex::Lock lock(s_state->write_mutex);
+  Drain();
+}
+
+uint32_t BinLog::Register(const Logger::ptr& logger, BinLogSite& site,
+                          const std::string& types) {
+  BinLogState* st = s_state;
+  Mutex::Lock lock(st->mutex);
+  uint32_t id = site.id.load(std::memory_order_relaxed);
+  if (id) {
+    return id;
+  }
+  st->sites.push_back(
+      Site{logger->getName(), site.level, site.file, site.line, site.fmt,
+           types});
+  id = st->sites.size();
+  site.id.store(id, std::memory_order_release);
+  return id;
+}
+
+BinLogBuffer* BinLog::GetThreadBuffer() {
+  if (!t_buffer.buffer) {
+    t_buffer.buffer =
+        new BinLogBuffer(g_binlog_buffer_size->getValue(), GetThreadId());
+    Mutex::Lock lock(s_state->mutex);
+    s_state->buffers.push_back(t_buffer.buffer);
+  }
+  return t_buffer.buffer;
+}
+
+// BinLogReader
+template <class T>
+static bool Read(const char*& p, const char* end, T& v) {
+  if (end - p < static_cast<ssize_t>(sizeof(T))) {
+    return false;
+  }
+  memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+static bool ReadString(const char*& p, const char* end, std::string& str) {
+  uint16_t len = 0;
+  if (!Read(p, end, len) || end - p < len) {
+    return false;
+  }
+  str.assign(p, len);
+  p += len;
+  return true;
+}
+
+bool BinLogReader::open(const std::string& file) {
+  std::ifstream ifs(file, std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  m_data.assign(std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>());
+  m_sites.clear();
+  m_chunk = m_chunkEnd = nullptr;
+  m_error = false;
+  if (m_data.size() < kMagicSize + 8 ||
+      m_data.compare(0, kMagicSize, kMagic) != 0) {
+    m_error = true;
+    return false;
+  }
+  memcpy(&m_startTime, &m_data[kMagicSize], sizeof(m_startTime));
+  m_pos = kMagicSize + sizeof(m_startTime);
+  return true;
+}
+
+bool BinLogReader::readSite(const char*& p, const char* end) {
+  uint32_t id = 0;
+  uint8_t level = 0;
+  uint8_t argc = 0;
+  BinLog::Site site;
+  if (!Read(p, end, id) || !Read(p, end, level) ||
+      !Read(p, end, site.line) || !ReadString(p, end, site.logger) ||
+      !ReadString(p, end, site.file) || !ReadString(p, end, site.fmt) ||
+      !Read(p, end, argc) || end - p < argc) {
+    return false;
+  }
+  // 同一个文件里id从1开始连续编号
+  if (id != m_sites.size() + 1) {
+    return false;
+  }
+  site.level = static_cast<LogLevel::Level>(level);
+  site.types.assign(p, argc);
+  p += argc;
+  m_sites.push_back(site);
+  return true;
+}
+
+bool BinLogReader::next(Record& record) {
+  const char* end = m_data.data() + m_data.size();
+  while (!m_error) {
+    if (m_chunk < m_chunkEnd) {
+      uint32_t id = 0;
+      if (!Read(m_chunk, m_chunkEnd, id) || !id || id > m_sites.size() ||
+          !Read(m_chunk, m_chunkEnd, record.time) ||
+          !Read(m_chunk, m_chunkEnd, record.fiber_id)) {
+        break;
+      }
+      bool ok = true;
+      record.site = &m_sites[id - 1];
+      record.thread_id = m_threadId;
+      record.message = Render(*record.site, m_chunk, m_chunkEnd, ok);
+      if (!ok) {
+        break;
+      }
+      return true;
+    }
+    const char* p = m_data.data() + m_pos;
+    if (p == end) {
+      return false;
+    }
+    char tag = *p++;
+    if (tag == 'S') {
+      if (!readSite(p, end)) {
+        break;
+      }
+    } else if (tag == 'C') {
+      uint32_t len = 0;
+      if (!Read(p, end, m_threadId) || !Read(p, end, len) || end - p < len) {
+        break;
+      }
+      m_chunk = p;
+      m_chunkEnd = p + len;
+      p += len;
+    } else {
+      break;
+    }
+    m_pos = p - m_data.data();
+  }
+  m_error = true;
+  return false;
+}
+
+namespace {
+
+struct Arg {
+  uint8_t type = 0;
+  int64_t i = 0;
+  uint64_t u = 0;
+  double d = 0;
+  std::string s;
+
+  long long asInt() const {
+    switch (type) {
+      case BinLog::INT32:
+      case BinLog::INT64:
+        return i;
+      case BinLog::DOUBLE:
+        return d;
+      case BinLog::STRING:
+        return atoll(s.c_str());
+      default:
+        return u;
+    }
+  }
+
+  double asDouble() const {
+    switch (type) {
+      case BinLog::DOUBLE:
+        return d;
+      case BinLog::STRING:
+        return atof(s.c_str());
+      default:
+        return asInt();
+    }
+  }
+
+  std::string asString() const {
+    switch (type) {
+      case BinLog::STRING:
+        return s;
+      case BinLog::DOUBLE:
+        return std::to_string(d);
+      case BinLog::INT32:
+      case BinLog::INT64:
+        return std::to_string(i);
+      default:
+        return std::to_string(u);
+    }
+  }
+};
+
+}  // namespace
+
+static void AppendFormat(std::string& out, const char* fmt, ...) {
+  char buf[256];
+  va_list al;
+  va_start(al, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, al);
+  va_end(al);
+  if (len < 0) {
+    return;
+  }
+  if (static_cast<size_t>(len) < sizeof(buf)) {
+    out.append(buf, len);
+    return;
+  }
+  std::string tmp(len + 1, '\0');
+  va_start(al, fmt);
+  vsnprintf(&tmp[0], tmp.size(), fmt, al);
+  va_end(al);
+  out.append(tmp.data(), len);
+}
+
+static bool ReadArgs(const std::string& types, const char*& p,
+                     const char* end, std::vector<Arg>& args) {
+  args.resize(types.size());
+  for (size_t i = 0; i < types.size(); ++i) {
+    Arg& arg = args[i];
+    arg.type = types[i];
+    bool ok = false;
+    switch (arg.type) {
+      case BinLog::INT32: {
+        int32_t v = 0;
+        ok = Read(p, end, v);
+        arg.i = v;
+        break;
+      }
+      case BinLog::UINT32: {
+        uint32_t v = 0;
+        ok = Read(p, end, v);
+        arg.u = v;
+        break;
+      }
+      case BinLog::INT64:
+        ok = Read(p, end, arg.i);
+        break;
+      case BinLog::UINT64:
+      case BinLog::POINTER:
+        ok = Read(p, end, arg.u);
+        break;
+      case BinLog::DOUBLE:
+        ok = Read(p, end, arg.d);
+        break;
+      case BinLog::STRING: {
+        uint32_t len = 0;
+        ok = Read(p, end, len) && end - p >= len;
+        if (ok) {
+          arg.s.assign(p, len);
+          p += len;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string BinLogReader::Render(const BinLog::Site& site, const char*& data,
+                                 const char* end, bool& ok) {
+  static thread_local std::vector<Arg> t_args;
+  std::string out;
+  ok = ReadArgs(site.types, data, end, t_args);
+  if (!ok) {
+    return out;
+  }
+  size_t next = 0;
+  const std::string& fmt = site.fmt;
+  for (size_t i = 0; i < fmt.size(); ++i) {
+    if (fmt[i] != '%') {
+      out.push_back(fmt[i]);
+      continue;
+    }
+    if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+      out.push_back('%');
+      ++i;
+      continue;
+    }
+    // 重新拼出一个不带长度修饰的格式, 按记录下来的参数类型输出
+    size_t begin = i++;
+    std::string spec = "%";
+    while (i < fmt.size() && strchr("-+ #0", fmt[i])) {
+      spec.push_back(fmt[i++]);
+    }
+    bool dot = false;
+    while (i < fmt.size() &&
+           (isdigit(fmt[i]) || fmt[i] == '*' || (fmt[i] == '.' && !dot))) {
+      dot = dot || fmt[i] == '.';
+      if (fmt[i] == '*') {
+        spec += next < t_args.size() ? std::to_string(t_args[next++].asInt())
+                                     : "0";
+      } else {
+        spec.push_back(fmt[i]);
+      }
+      ++i;
+    }
+    while (i < fmt.size() && strchr("hljztLq", fmt[i])) {
+      ++i;
+    }
+    if (i >= fmt.size()) {
+      out.append(fmt, begin, std::string::npos);
+      break;
+    }
+    char conv = fmt[i];
+    if (conv == 'n') {
+      continue;
+    }
+    if (!strchr("diouxXcfFeEgGaAsp", conv) || next >= t_args.size()) {
+      out.append(fmt, begin, i - begin + 1);
+      continue;
+    }
+    const Arg& arg = t_args[next++];
+    switch (conv) {
+      case 'd':
+      case 'i':
+        AppendFormat(out, (spec + "lld").c_str(), arg.asInt());
+        break;
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X':
+        AppendFormat(out, (spec + "ll" + conv).c_str(),
+                     static_cast<unsigned long long>(arg.asInt()));
+        break;
+      case 'c':
+        AppendFormat(out, (spec + "c").c_str(),
+                     static_cast<int>(arg.asInt()));
+        break;
+      case 's':
+        AppendFormat(out, (spec + "s").c_str(), arg.asString().c_str());
+        break;
+      case 'p':
+        AppendFormat(out, (spec + "p").c_str(),
+                     reinterpret_cast<void*>(arg.asInt()));
+        break;
+      default:
+        AppendFormat(out, (spec + conv).c_str(), arg.asDouble());
+        break;
+    }
+  }
+  return out;
+}
+
+bool BinLogReader::Decode(const std::string& file, std::ostream& os,
+                          const std::string& pattern) {
+  LogFormatter::ptr formatter;
+  try {
+    formatter.reset(new LogFormatter(pattern));
+  } catch (std::invalid_argument&) {
+    return false;
+  }
+  BinLogReader reader;
+  if (!reader.open(file)) {
+    return false;
+  }
+  std::vector<Record> records;
+  Record record;
+  while (reader.next(record)) {
+    records.push_back(std::move(record));
+  }
+  // 各个线程的记录按chunk交错, 同一线程内有序, 稳定排序后整体按时间排列
+  std::stable_sort(records.begin(), records.end(),
+                   [](const Record& a, const Record& b) {
+                     return a.time < b.time;
+                   });
+  std::map<std::string, Logger::ptr> loggers;
+  for (auto& r : records) {
+    Logger::ptr& logger = loggers[r.site->logger];
+    if (!logger) {
+      logger.reset(new Logger(r.site->logger));
+    }
+    uint64_t start = reader.getStartTime();
+    uint64_t elapse = r.time > start ? (r.time - start) / 1000 : 0;
+    LogEvent::ptr event(new LogEvent(
+        logger, r.site->level, r.site->file.c_str(), r.site->line, elapse,
+        r.thread_id, r.fiber_id, r.time / 1000000000,
+        r.time % 1000000000));
+    event->getSS().write(r.message.data(), r.message.size());
+    formatter->format(os, logger, r.site->level, event);
+  }
+  return !reader.isError();
+}
+
+}  // namespace ddg
@@ -0,0 +1,430 @@
+#ifndef DDG_BINLOG_H_
+#define DDG_BINLOG_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ddg/log.h"
+#include "ddg/noncopyable.h"
+
+/**
+ * 二进制日志, 用法和DDG_LOG_FMT_*一样, fmt必须是字符串常量:
+ *   DDG_BINLOG_INFO(g_logger, "recv %d bytes from %s", n, addr.c_str());
+ *
+ * 每个调用点第一次执行时把fmt/文件/行号/参数类型登记一次, 之后只把编号,
+ * 时间和参数的原始字节写进当前线程的环形缓冲区, 由后台线程写到文件里,
+ * 格式化放到离线的解码工具(binlog_decode)里做. logger的名字也是登记时
+ * 记下的, 同一个调用点要用同一个logger.
+ * BinLog::Open之前按普通日志输出
+ */
+#define DDG_BINLOG_LEVEL(logger, level, fmt, ...)                         \
+  do {                                                                    \
+    if (DDG_LOG_ENABLED(level) && logger->getLevel() <= level) {          \
+      static ddg::BinLogSite ddg_binlog_site(level, __FILE__, __LINE__,   \
+                                             fmt);                        \
+      ddg::BinLog::Log(logger, ddg_binlog_site, ##__VA_ARGS__);           \
+    }                                                                     \
+  } while (0)
+
+#define DDG_BINLOG_DEBUG(logger, fmt, ...) \
+  DDG_BINLOG_LEVEL(logger, ddg::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+
+#define DDG_BINLOG_INFO(logger, fmt, ...) \
+  DDG_BINLOG_LEVEL(logger, ddg::LogLevel::INFO, fmt, ##__VA_ARGS__)
+
+#define DDG_BINLOG_WARN(logger, fmt, ...) \
+  DDG_BINLOG_LEVEL(logger, ddg::LogLevel::WARN, fmt, ##__VA_ARGS__)
+
+#define DDG_BINLOG_ERROR(logger, fmt, ...) \
+  DDG_BINLOG_LEVEL(logger, ddg::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+
+#define DDG_BINLOG_FATAL(logger, fmt, ...) \
+  DDG_BINLOG_LEVEL(logger, ddg::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+namespace ddg {
+
+// 调用点的静态信息, 常量初始化, 不需要加锁
+struct BinLogSite {
+  constexpr BinLogSite(LogLevel::Level level, const char* file, int32_t line,
+                       const char* fmt)
+      : level(level), file(file), line(line), fmt(fmt), id(0) {}
+
+  LogLevel::Level level;
+  const char* file;
+  int32_t line;
+  const char* fmt;
+  std::atomic<uint32_t> id;  // 0表示还没有登记
+};
+
+// 每个线程一个的单生产者单消费者环形缓冲区, 位置一直递增, 用的时候取模
+class BinLogBuffer : NonCopyable {
+ public:
+  // 往缓冲区里写, 跨过末尾时分两段拷贝
+  struct Cursor {
+    char* data;
+    uint64_t mask;
+    uint64_t pos;
+
+    void put(const void* src, size_t n) {
+      size_t off = pos & mask;
+      size_t first = std::min<size_t>(n, mask + 1 - off);
+      memcpy(data + off, src, first);
+      memcpy(data, static_cast<const char*>(src) + first, n - first);
+      pos += n;
+    }
+  };
+
+  BinLogBuffer(size_t capacity, uint64_t thread_id);
+
+  ~BinLogBuffer();
+
+  // 生产者: 等到有size字节的空间, 返回写的位置
+  Cursor reserve(size_t size);
+
+  // 生产者: 写完之后提交
+  void commit(const Cursor& cursor) {
+    m_head.store(cursor.pos, std::memory_order_release);
+  }
+
+  // 生产者: 写一条记录的前后标记, BinLog::Close等正在写的记录提交
+  void beginWrite() { m_writing.store(true); }
+  void endWrite() { m_writing.store(false, std::memory_order_release); }
+
+  bool isWriting() const { return m_writing.load(); }
+
+  /**
+   * @brief 消费者: 取出所有已经提交的数据, 都是完整的记录
+   * @param[out] out 追加到末尾
+   * @return 取出的字节数
+   */
+  size_t consume(std::string& out);
+
+  uint64_t getThreadId() const { return m_threadId; }
+
+  size_t getCapacity() const { return m_mask + 1; }
+
+  // 线程退出时还有没取走的数据就设置, 取空之后由Drain释放
+  void close() { m_closed = true; }
+
+  bool isClosed() const { return m_closed; }
+
+  bool empty() const {
+    return m_head.load(std::memory_order_acquire) ==
+           m_tail.load(std::memory_order_relaxed);
+  }
+
+ private:
+  char* m_data;
+  uint64_t m_mask;
+  uint64_t m_threadId;
+  std::atomic<bool> m_closed{false};
+  // 生产者和消费者各自写的位置分开, 避免在一个缓存行上来回抢
+  char m_pad0[64];
+  std::atomic<uint64_t> m_head{0};
+  uint64_t m_cachedTail = 0;  // 生产者看到的m_tail
+  std::atomic<bool> m_writing{false};
+  char m_pad1[64];
+  std::atomic<uint64_t> m_tail{0};
+};
+
+// 参数的类型和二进制编码
+template <class T, class Enable = void>
+struct BinLogArg {
+  static_assert(sizeof(T) == 0, "unsupported binlog argument type");
+};
+
+class BinLog : NonCopyable {
+ public:
+  enum ArgType : uint8_t {
+    INT32 = 1,
+    UINT32 = 2,
+    INT64 = 3,
+    UINT64 = 4,
+    DOUBLE = 5,
+    STRING = 6,
+    POINTER = 7,
+  };
+
+  // 字符串参数最多记录的长度
+  static const uint32_t kMaxStringSize = 4096;
+
+  // 每条记录的头: 调用点编号, 时间(纳秒), 协程号
+  static const size_t kHeaderSize = 4 + 8 + 8;
+
+  // 调用点登记的信息, 也是文件里字典的内容
+  struct Site {
+    std::string logger;
+    LogLevel::Level level;
+    std::string file;
+    int32_t line;
+    std::string fmt;
+    std::string types;  // 每个参数一个ArgType
+  };
+
+  /**
+   * @brief 开始写二进制日志到file, 已经打开的会先关掉
+   */
+  static bool Open(const std::string& file);
+
+  // 把所有线程缓冲区里的日志写完, 关闭文件, 之后回到普通日志
+  static void Close();
+
+  // 把所有线程缓冲区里的日志写到文件
+  static void Flush();
+
+  static bool IsOpen() { return s_open.load(std::memory_order_relaxed); }
+
+  template <class... Args>
+  static void Log(const Logger::ptr& logger, BinLogSite& site,
+                  const Args&... args) {
+    uint32_t id = site.id.load(std::memory_order_acquire);
+    if (!id) {
+      id = Register(logger, site,
+                    TypeList<typename std::decay<Args>::type...>());
+    }
+    if (IsOpen()) {
+      BinLogBuffer* buffer = GetThreadBuffer();
+      // 先标记在写再确认还开着: Close要么看到标记等这条写完,
+      // 要么这里看到已经关闭
+      buffer->beginWrite();
+      if (s_open.load()) {
+        BinLogBuffer::Cursor cursor =
+            buffer->reserve(kHeaderSize + ArgsSize(args...));
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t time = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        uint64_t fiber_id = GetFiberId();
+        cursor.put(&id, sizeof(id));
+        cursor.put(&time, sizeof(time));
+        cursor.put(&fiber_id, sizeof(fiber_id));
+        WriteArgs(cursor, args...);
+        buffer->commit(cursor);
+        buffer->endWrite();
+        return;
+      }
+      buffer->endWrite();
+    }
+    LogEventWrap(logger, site.level, site.file, site.line, GetThreadId(),
+                 GetFiberId())
+        .getEvent()
+        ->format(site.fmt, Printable(args)...);
+  }
+
+ private:
+  static uint32_t Register(const Logger::ptr& logger, BinLogSite& site,
+                           const std::string& types);
+
+  static BinLogBuffer* GetThreadBuffer();
+
+  template <class... Args>
+  static std::string TypeList() {
+    const char types[] = {static_cast<char>(BinLogArg<Args>::kType)..., 0};
+    return std::string(types, sizeof...(Args));
+  }
+
+  static size_t ArgsSize() { return 0; }
+
+  template <class T, class... Rest>
+  static size_t ArgsSize(const T& v, const Rest&... rest) {
+    return BinLogArg<typename std::decay<T>::type>::Size(v) +
+           ArgsSize(rest...);
+  }
+
+  static void WriteArgs(BinLogBuffer::Cursor& cursor) {}
+
+  template <class T, class... Rest>
+  static void WriteArgs(BinLogBuffer::Cursor& cursor, const T& v,
+                        const Rest&... rest) {
+    BinLogArg<typename std::decay<T>::type>::Write(cursor, v);
+    WriteArgs(cursor, rest...);
+  }
+
+  // 没有打开时按printf输出, std::string要转成const char*
+  template <class T>
+  static const T& Printable(const T& v) {
+    return v;
+  }
+
+  static const char* Printable(const std::string& v) { return v.c_str(); }
+
+ private:
+  static std::atomic<bool> s_open;
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<std::is_integral<T>::value &&
+                                            std::is_signed<T>::value &&
+                                            sizeof(T) <= 4>::type> {
+  static const uint8_t kType = BinLog::INT32;
+  static size_t Size(T) { return 4; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    int32_t x = v;
+    cursor.put(&x, 4);
+  }
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<std::is_integral<T>::value &&
+                                            !std::is_signed<T>::value &&
+                                            sizeof(T) <= 4>::type> {
+  static const uint8_t kType = BinLog::UINT32;
+  static size_t Size(T) { return 4; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    uint32_t x = v;
+    cursor.put(&x, 4);
+  }
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<std::is_integral<T>::value &&
+                                            std::is_signed<T>::value &&
+                                            sizeof(T) == 8>::type> {
+  static const uint8_t kType = BinLog::INT64;
+  static size_t Size(T) { return 8; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    int64_t x = v;
+    cursor.put(&x, 8);
+  }
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<std::is_integral<T>::value &&
+                                            !std::is_signed<T>::value &&
+                                            sizeof(T) == 8>::type> {
+  static const uint8_t kType = BinLog::UINT64;
+  static size_t Size(T) { return 8; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    uint64_t x = v;
+    cursor.put(&x, 8);
+  }
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+  static const uint8_t kType = BinLog::INT64;
+  static size_t Size(T) { return 8; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    int64_t x = static_cast<int64_t>(v);
+    cursor.put(&x, 8);
+  }
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<
+                        std::is_floating_point<T>::value &&
+                        sizeof(T) <= sizeof(double)>::type> {
+  static const uint8_t kType = BinLog::DOUBLE;
+  static size_t Size(T) { return 8; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    double x = v;
+    cursor.put(&x, 8);
+  }
+};
+
+// 字符串: 4字节长度 + 内容
+template <class T>
+struct BinLogArg<T, typename std::enable_if<
+                        std::is_same<T, const char*>::value ||
+                        std::is_same<T, char*>::value>::type> {
+  static const uint8_t kType = BinLog::STRING;
+  static uint32_t Length(const char* v) {
+    return v ? strnlen(v, BinLog::kMaxStringSize) : 0;
+  }
+  static size_t Size(const char* v) { return 4 + Length(v); }
+  static void Write(BinLogBuffer::Cursor& cursor, const char* v) {
+    uint32_t len = Length(v);
+    cursor.put(&len, 4);
+    cursor.put(v, len);
+  }
+};
+
+template <>
+struct BinLogArg<std::string> {
+  static const uint8_t kType = BinLog::STRING;
+  static uint32_t Length(const std::string& v) {
+    return std::min<size_t>(v.size(), BinLog::kMaxStringSize);
+  }
+  static size_t Size(const std::string& v) { return 4 + Length(v); }
+  static void Write(BinLogBuffer::Cursor& cursor, const std::string& v) {
+    uint32_t len = Length(v);
+    cursor.put(&len, 4);
+    cursor.put(v.data(), len);
+  }
+};
+
+template <class T>
+struct BinLogArg<T, typename std::enable_if<
+                        std::is_pointer<T>::value &&
+                        !std::is_same<T, const char*>::value &&
+                        !std::is_same<T, char*>::value>::type> {
+  static const uint8_t kType = BinLog::POINTER;
+  static size_t Size(T) { return 8; }
+  static void Write(BinLogBuffer::Cursor& cursor, T v) {
+    uint64_t x = reinterpret_cast<uintptr_t>(v);
+    cursor.put(&x, 8);
+  }
+};
+
+/**
+ * @brief 读二进制日志文件, 还原成普通的LogEvent
+ */
+class BinLogReader : NonCopyable {
+ public:
+  struct Record {
+    const BinLog::Site* site = nullptr;
+    uint64_t thread_id = 0;
+    uint64_t fiber_id = 0;
+    uint64_t time = 0;  // 纳秒
+    std::string message;
+  };
+
+  bool open(const std::string& file);
+
+  /**
+   * @brief 按文件里的顺序读下一条, 同一个线程的日志是有序的
+   * @return 读完或者文件损坏时返回false, 损坏时isError为true
+   */
+  bool next(Record& record);
+
+  bool isError() const { return m_error; }
+
+  // BinLog::Open的时间, 纳秒, %r从这里算
+  uint64_t getStartTime() const { return m_startTime; }
+
+  /**
+   * @brief 把文件按pattern(LogFormatter的格式)输出成文本, 按时间排序
+   */
+  static bool Decode(const std::string& file, std::ostream& os,
+                     const std::string& pattern);
+
+  // 按printf的格式和记录下来的参数输出
+  static std::string Render(const BinLog::Site& site, const char*& data,
+                            const char* end, bool& ok);
+
+ private:
+  bool readSite(const char*& p, const char* end);
+
+ private:
+  std::string m_data;
+  size_t m_pos = 0;
+  uint64_t m_startTime = 0;
+  // Record里保存了指针, 不能用vector
+  std::deque<BinLog::Site> m_sites;
+  // 当前chunk
+  uint64_t m_threadId = 0;
+  const char* m_chunk = nullptr;
+  const char* m_chunkEnd = nullptr;
+  bool m_error = false;
+};
+
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,670 @@
+#include "ddg/bytearray.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include "ddg/config.h"
+#include "ddg/endian.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_bytearray_pool_size =
+    Config::Lookup<uint32_t>("bytearray.pool_size", 64,
+                             "bytearray per thread cached node count");
+
+/**
+ * @brief 内存块的线程缓存
+ *
+ * 节点头和数据放在同一次malloc里, 释放时放回当前线程的空闲链表,
+ * 只缓存最常用的一种块大小, 其它大小直接走malloc/free
+ */
+class NodePool {
+ public:
+  ~NodePool() {
+    while (m_free) {
+      ByteArray::Node* next = m_free->next;
+      free(m_free);
+      m_free = next;
+    }
+  }
+
+  ByteArray::Node* alloc(size_t size) {
+    if (size == m_size && m_free) {
+      ByteArray::Node* node = m_free;
+      m_free = node->next;
+      --m_count;
+      node->next = nullptr;
+      return node;
+    }
+    void* mem = malloc(sizeof(ByteArray::Node) + size);
+    if (DDG_UNLIKELY(!mem)) {
+      throw std::bad_alloc();
+    }
+    ByteArray::Node* node = new (mem) ByteArray::Node;
+    node->ptr = reinterpret_cast<char*>(node + 1);
+    node->size = size;
+    return node;
+  }
+
+  void dealloc(ByteArray::Node* node) {
+    if (m_count == 0 && m_size != node->size) {
+      m_size = node->size;
+    }
+    if (node->size != m_size ||
+        m_count >= g_bytearray_pool_size->getValue()) {
+      free(node);
+      return;
+    }
+    node->next = m_free;
+    m_free = node;
+    ++m_count;
+  }
+
+ private:
+  ByteArray::Node* m_free = nullptr;
+  size_t m_size = 0;
+  uint32_t m_count = 0;
+};
+
+static thread_local NodePool t_node_pool;
+
+ByteArray::Node* ByteArray::NewNode(size_t size) {
+  return t_node_pool.alloc(size);
+}
+
+void ByteArray::FreeNode(Node* node) {
+  t_node_pool.dealloc(node);
+}
+
+ByteArray::ByteArray(size_t base_size)
+    : m_baseSize(base_size),
+      m_position(0),
+      m_capacity(base_size),
+      m_size(0),
+      m_endian(DDG_BIG_ENDIAN),
+      m_root(NewNode(base_size)),
+      m_tail(m_root),
+      m_readCur(m_root),
+      m_writeCur(m_root) {}
+
+ByteArray::~ByteArray() {
+  Node* tmp = m_root;
+  while (tmp) {
+    m_root = tmp->next;
+    FreeNode(tmp);
+    tmp = m_root;
+  }
+}
+
+bool ByteArray::isLittleEndian() const {
+  return m_endian == DDG_LITTLE_ENDIAN;
+}
+
+void ByteArray::setIsLittleEndian(bool val) {
+  m_endian = val ? DDG_LITTLE_ENDIAN : DDG_BIG_ENDIAN;
+}
+
+#define XX(value)                   \
+  if (m_endian != DDG_BYTE_ORDER) { \
+    value = ByteSwap(value);        \
+  }                                 \
+  write(&value, sizeof(value));
+
+void ByteArray::writeFint8(int8_t value) {
+  write(&value, sizeof(value));
+}
+
+void ByteArray::writeFuint8(uint8_t value) {
+  write(&value, sizeof(value));
+}
+
+void ByteArray::writeFint16(int16_t value) {
+  XX(value);
+}
+
+void ByteArray::writeFuint16(uint16_t value) {
+  XX(value);
+}
+
+void ByteArray::writeFint32(int32_t value) {
+  XX(value);
+}
+
+void ByteArray::writeFuint32(uint32_t value) {
+  XX(value);
+}
+
+void ByteArray::writeFint64(int64_t value) {
+  XX(value);
+}
+
+void ByteArray::writeFuint64(uint64_t value) {
+  XX(value);
+}
+
+#undef XX
+
+static uint32_t EncodeZigzag32(int32_t v) {
+  return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+static uint64_t EncodeZigzag64(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int32_t DecodeZigzag32(uint32_t v) {
+  return static_cast<int32_t>((v >> 1) ^ -(v & 1));
+}
+
+static int64_t DecodeZigzag64(uint64_t v) {
+  return static_cast<int64_t>((v >> 1) ^ -(v & 1));
+}
+
+void ByteArray::writeInt32(int32_t value) {
+  writeUint32(EncodeZigzag32(value));
+}
+
+void ByteArray::writeUint32(uint32_t value) {
+  uint8_t tmp[5];
+  uint8_t i = 0;
+  while (value >= 0x80) {
+    tmp[i++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  tmp[i++] = value;
+  write(tmp, i);
+}
+
+void ByteArray::writeInt64(int64_t value) {
+  writeUint64(EncodeZigzag64(value));
+}
+
+void ByteArray::writeUint64(uint64_t value) {
+  uint8_t tmp[10];
+  uint8_t i = 0;
+  while (value >= 0x80) {
+    tmp[i++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  tmp[i++] = value;
+  write(tmp, i);
+}
+
+void ByteArray::writeFloat(float value) {
+  uint32_t v;
+  memcpy(&v, &value, sizeof(value));
+  writeFuint32(v);
+}
+
+void ByteArray::writeDouble(double value) {
+  uint64_t v;
+  memcpy(&v, &value, sizeof(value));
+  writeFuint64(v);
+}
+
+void ByteArray::writeStringF16(const std::string& value) {
+  writeFuint16(value.size());
+  write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringF32(const std::string& value) {
+  writeFuint32(value.size());
+  write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringF64(const std::string& value) {
+  writeFuint64(value.size());
+  write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringVint(const std::string& value) {
+  writeUint64(value.size());
+  write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringWithoutLength(const std::string& value) {
+  write(value.c_str(), value.size());
+}
+
+int8_t ByteArray::readFint8() {
+  int8_t v;
+  read(&v, sizeof(v));
+  return v;
+}
+
+uint8_t ByteArray::readFuint8() {
+  uint8_t v;
+  read(&v, sizeof(v));
+  return v;
+}
+
+#define XX(type)                    \
+  type v;                           \
+  read(&v, sizeof(v));              \
+  if (m_endian == DDG_BYTE_ORDER) { \
+    return v;                       \
+  } else {                          \
+    return ByteSwap(v);             \
+  }
+
+int16_t ByteArray::readFint16() {
+  XX(int16_t);
+}
+
+uint16_t ByteArray::readFuint16() {
+  XX(uint16_t);
+}
+
+int32_t ByteArray::readFint32() {
+  XX(int32_t);
+}
+
+uint32_t ByteArray::readFuint32() {
+  XX(uint32_t);
+}
+
+int64_t ByteArray::readFint64() {
+  XX(int64_t);
+}
+
+uint64_t ByteArray::readFuint64() {
+  XX(uint64_t);
+}
+
+#undef XX
+
+int32_t ByteArray::readInt32() {
+  return DecodeZigzag32(readUint32());
+}
+
+uint32_t ByteArray::readUint32() {
+  uint32_t result = 0;
+  for (int i = 0; i < 32; i += 7) {
+    uint8_t b = readFuint8();
+    if (b < 0x80) {
+      result |= static_cast<uint32_t>(b) << i;
+      break;
+    }
+    result |= static_cast<uint32_t>(b & 0x7F) << i;
+  }
+  return result;
+}
+
+int64_t ByteArray::readInt64() {
+  return DecodeZigzag64(readUint64());
+}
+
+uint64_t ByteArray::readUint64() {
+  uint64_t result = 0;
+  for (int i = 0; i < 64; i += 7) {
+    uint8_t b = readFuint8();
+    if (b < 0x80) {
+      result |= static_cast<uint64_t>(b) << i;
+      break;
+    }
+    result |= static_cast<uint64_t>(b & 0x7F) << i;
+  }
+  return result;
+}
+
+float ByteArray::readFloat() {
+  uint32_t v = readFuint32();
+  float value;
+  memcpy(&value, &v, sizeof(v));
+  return value;
+}
+
+double ByteArray::readDouble() {
+  uint64_t v = readFuint64();
+  double value;
+  memcpy(&value, &v, sizeof(v));
+  return value;
+}
+
+#define XX(len)                                \
+  std::string buff;                            \
+  if (len > getReadSize()) {                   \
+    throw std::out_of_range("not enough len"); \
+  }                                            \
+  buff.resize(len);                            \
+  if (len) {                                   \
+    read(&buff[0], len);                       \
+  }                                            \
+  return buff;
+
+std::string ByteArray::readStringF16() {
+  uint16_t len = readFuint16();
+  XX(len);
+}
+
+std::string ByteArray::readStringF32() {
+  uint32_t len = readFuint32();
+  XX(len);
+}
+
+std::string ByteArray::readStringF64() {
+  uint64_t len = readFuint64();
+  XX(len);
+}
+
+std::string ByteArray::readStringVint() {
+  uint64_t len = readUint64();
+  XX(len);
+}
+
+#undef XX
+
+void ByteArray::clear() {
+  m_position = m_size = 0;
+  m_capacity = m_baseSize;
+  Node* tmp = m_root->next;
+  while (tmp) {
+    Node* next = tmp->next;
+    FreeNode(tmp);
+    tmp = next;
+  }
+  m_root->next = nullptr;
+  m_tail = m_readCur = m_writeCur = m_root;
+}
+
+void ByteArray::write(const void* buf, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  addCapacity(size);
+
+  size_t npos = m_size % m_baseSize;
+  size_t ncap = m_writeCur->size - npos;
+  size_t bpos = 0;
+  const char* src = static_cast<const char*>(buf);
+
+  while (size > 0) {
+    size_t n = ncap >= size ? size : ncap;
+    memcpy(m_writeCur->ptr + npos, src + bpos, n);
+    m_size += n;
+    bpos += n;
+    size -= n;
+    if (n == ncap) {
+      m_writeCur = m_writeCur->next;
+      if (m_writeCur) {
+        ncap = m_writeCur->size;
+      }
+      npos = 0;
+    }
+  }
+}
+
+void ByteArray::read(void* buf, size_t size) {
+  if (size > getReadSize()) {
+    throw std::out_of_range("not enough len");
+  }
+  if (!m_readCur) {
+    // 上次读到了块的末尾, 之后才追加了新块
+    m_readCur = locate(m_position);
+  }
+
+  size_t npos = m_position % m_baseSize;
+  size_t ncap = m_readCur->size - npos;
+  size_t bpos = 0;
+  char* dst = static_cast<char*>(buf);
+
+  while (size > 0) {
+    size_t n = ncap >= size ? size : ncap;
+    memcpy(dst + bpos, m_readCur->ptr + npos, n);
+    m_position += n;
+    bpos += n;
+    size -= n;
+    if (n == ncap) {
+      m_readCur = m_readCur->next;
+      if (m_readCur) {
+        ncap = m_readCur->size;
+      }
+      npos = 0;
+    }
+  }
+}
+
+void ByteArray::read(void* buf, size_t size, size_t position) const {
+  if (position > m_size || size > m_size - position) {
+    throw std::out_of_range("not enough len");
+  }
+
+  Node* cur = locate(position);
+  size_t npos = position % m_baseSize;
+  size_t ncap = cur->size - npos;
+  size_t bpos = 0;
+  char* dst = static_cast<char*>(buf);
+
+  while (size > 0) {
+    size_t n = ncap >= size ? size : ncap;
+    memcpy(dst + bpos, cur->ptr + npos, n);
+    bpos += n;
+    size -= n;
+    if (n == ncap) {
+      cur = cur->next;
+      if (cur) {
+        ncap = cur->size;
+      }
+      npos = 0;
+    }
+  }
+}
+
+ByteArray::Node* ByteArray::locate(size_t position) const {
+  Node* cur = m_root;
+  size_t index = position / m_baseSize;
+  while (index-- && cur) {
+    cur = cur->next;
+  }
+  return cur;
+}
+
+void ByteArray::setPosition(size_t v) {
+  if (v > m_size) {
+    throw std::out_of_range("set_position out of range");
+  }
+  m_position = v;
+  m_readCur = locate(v);
+}
+
+void ByteArray::skip(size_t size) {
+  if (size > getReadSize()) {
+    throw std::out_of_range("not enough len");
+  }
+  setPosition(m_position + size);
+}
+
+void ByteArray::discardRead() {
+  if (m_position == m_size) {
+    clear();
+    return;
+  }
+
+  while (m_position >= m_baseSize) {
+    Node* node = m_root;
+    m_root = node->next;
+    FreeNode(node);
+    m_position -= m_baseSize;
+    m_size -= m_baseSize;
+    m_capacity -= m_baseSize;
+  }
+}
+
+bool ByteArray::writeToFile(const std::string& name) const {
+  std::ofstream ofs;
+  ofs.open(name, std::ios::trunc | std::ios::binary);
+  if (!ofs) {
+    DDG_LOG_ERROR(g_logger) << "writeToFile name = " << name
+                            << " error, errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+
+  std::vector<iovec> iovs;
+  getReadBuffers(iovs);
+  for (auto& i : iovs) {
+    ofs.write(static_cast<const char*>(i.iov_base), i.iov_len);
+  }
+  return true;
+}
+
+bool ByteArray::readFromFile(const std::string& name) {
+  std::ifstream ifs;
+  ifs.open(name, std::ios::binary);
+  if (!ifs) {
+    DDG_LOG_ERROR(g_logger) << "readFromFile name = " << name
+                            << " error, errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+
+  while (!ifs.eof()) {
+    std::vector<iovec> iovs;
+    getWriteBuffers(iovs, m_baseSize);
+    size_t total = 0;
+    for (auto& i : iovs) {
+      ifs.read(static_cast<char*>(i.iov_base), i.iov_len);
+      total += ifs.gcount();
+      if (!ifs) {
+        break;
+      }
+    }
+    commitWrite(total);
+  }
+  return true;
+}
+
+void ByteArray::addCapacity(size_t size) {
+  if (size == 0) {
+    return;
+  }
+  size_t old_cap = getCapacity();
+  if (old_cap >= size) {
+    return;
+  }
+
+  size = size - old_cap;
+  size_t count = size / m_baseSize + ((size % m_baseSize) ? 1 : 0);
+  Node* first = nullptr;
+  for (size_t i = 0; i < count; ++i) {
+    Node* node = NewNode(m_baseSize);
+    if (!first) {
+      first = node;
+    }
+    m_tail->next = node;
+    m_tail = node;
+    m_capacity += m_baseSize;
+  }
+
+  if (old_cap == 0) {
+    m_writeCur = first;
+  }
+}
+
+std::string ByteArray::toString() const {
+  std::string str;
+  str.resize(getReadSize());
+  if (str.empty()) {
+    return str;
+  }
+  read(&str[0], str.size(), m_position);
+  return str;
+}
+
+std::string ByteArray::toHexString() const {
+  std::string str = toString();
+  std::stringstream ss;
+
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (i > 0 && i % 32 == 0) {
+      ss << std::endl;
+    }
+    ss << std::setw(2) << std::setfill('0') << std::hex
+       << static_cast<int>(static_cast<uint8_t>(str[i])) << " ";
+  }
+
+  return ss.str();
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers,
+                                   uint64_t len) const {
+  return getReadBuffers(buffers, len, m_position);
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len,
+                                   uint64_t position) const {
+  if (position > m_size) {
+    return 0;
+  }
+  len = len > m_size - position ? m_size - position : len;
+  if (len == 0) {
+    return 0;
+  }
+
+  uint64_t size = len;
+  size_t npos = position % m_baseSize;
+  Node* cur = locate(position);
+  size_t ncap = cur->size - npos;
+  iovec iov;
+
+  while (len > 0) {
+    size_t n = ncap >= len ? len : ncap;
+    iov.iov_base = cur->ptr + npos;
+    iov.iov_len = n;
+    buffers.push_back(iov);
+    len -= n;
+    cur = cur->next;
+    if (cur) {
+      ncap = cur->size;
+    }
+    npos = 0;
+  }
+  return size;
+}
+
+uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers,
+                                    uint64_t len) {
+  if (len == 0) {
+    return 0;
+  }
+  addCapacity(len);
+  uint64_t size = len;
+
+  size_t npos = m_size % m_baseSize;
+  Node* cur = m_writeCur;
+  size_t ncap = cur->size - npos;
+  iovec iov;
+
+  while (len > 0) {
+    size_t n = ncap >= len ? len : ncap;
+    iov.iov_base = cur->ptr + npos;
+    iov.iov_len = n;
+    buffers.push_back(iov);
+    len -= n;
+    cur = cur->next;
+    if (cur) {
+      ncap = cur->size;
+    }
+    npos = 0;
+  }
+  return size;
+}
+
+void ByteArray::commitWrite(size_t size) {
+  if (size > getCapacity()) {
+    throw std::out_of_range("commit_write out of range");
+  }
+  m_size += size;
+  m_writeCur = m_size == m_capacity ? nullptr : locate(m_size);
+}
+
+}  // namespace ddg
@@ -0,0 +1,163 @@
+#ifndef DDG_BYTEARRAY_H_
+#define DDG_BYTEARRAY_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/noncopyable.h"
+
+namespace ddg {
+
+/**
+ * @brief 由固定大小内存块串起来的字节缓冲区
+ *
+ * 写操作追加在尾部(getSize), 读操作从读位置(getPosition)开始消费,
+ * 两者互不影响, 所以可以一边从socket收数据一边解析.
+ * getReadBuffers/getWriteBuffers直接导出内存块的iovec, 配合readv/writev
+ * 或者Socket的iovec接口使用, 不需要额外的拷贝
+ */
+class ByteArray : public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<ByteArray>;
+
+  struct Node {
+    char* ptr = nullptr;
+    Node* next = nullptr;
+    size_t size = 0;
+  };
+
+  explicit ByteArray(size_t base_size = 4096);
+
+  ~ByteArray();
+
+  // 固定长度
+  void writeFint8(int8_t value);
+  void writeFuint8(uint8_t value);
+  void writeFint16(int16_t value);
+  void writeFuint16(uint16_t value);
+  void writeFint32(int32_t value);
+  void writeFuint32(uint32_t value);
+  void writeFint64(int64_t value);
+  void writeFuint64(uint64_t value);
+
+  // 变长编码(varint), 有符号数先做zigzag
+  void writeInt32(int32_t value);
+  void writeUint32(uint32_t value);
+  void writeInt64(int64_t value);
+  void writeUint64(uint64_t value);
+
+  void writeFloat(float value);
+  void writeDouble(double value);
+
+  // 长度分别用uint16/uint32/uint64/varint表示
+  void writeStringF16(const std::string& value);
+  void writeStringF32(const std::string& value);
+  void writeStringF64(const std::string& value);
+  void writeStringVint(const std::string& value);
+  void writeStringWithoutLength(const std::string& value);
+
+  // 数据不够时抛出std::out_of_range
+  int8_t readFint8();
+  uint8_t readFuint8();
+  int16_t readFint16();
+  uint16_t readFuint16();
+  int32_t readFint32();
+  uint32_t readFuint32();
+  int64_t readFint64();
+  uint64_t readFuint64();
+
+  int32_t readInt32();
+  uint32_t readUint32();
+  int64_t readInt64();
+  uint64_t readUint64();
+
+  float readFloat();
+  double readDouble();
+
+  std::string readStringF16();
+  std::string readStringF32();
+  std::string readStringF64();
+  std::string readStringVint();
+
+  // 清空数据, 只保留一个内存块
+  void clear();
+
+  void write(const void* buf, size_t size);
+
+  void read(void* buf, size_t size);
+
+  // 从position开始读, 不改变读位置
+  void read(void* buf, size_t size, size_t position) const;
+
+  size_t getPosition() const { return m_position; }
+
+  void setPosition(size_t v);
+
+  // 跳过size个可读字节
+  void skip(size_t size);
+
+  // 把已经读完的内存块还给内存池
+  void discardRead();
+
+  bool writeToFile(const std::string& name) const;
+
+  bool readFromFile(const std::string& name);
+
+  size_t getBaseSize() const { return m_baseSize; }
+
+  size_t getReadSize() const { return m_size - m_position; }
+
+  size_t getSize() const { return m_size; }
+
+  bool isLittleEndian() const;
+
+  void setIsLittleEndian(bool val);
+
+  // 可读数据拷贝成字符串, 不改变读位置
+  std::string toString() const;
+
+  std::string toHexString() const;
+
+  // 导出可读数据的iovec, 不改变读位置, 返回导出的字节数
+  uint64_t getReadBuffers(std::vector<iovec>& buffers,
+                          uint64_t len = ~0ull) const;
+
+  uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len,
+                          uint64_t position) const;
+
+  // 在尾部预留len字节并导出iovec, 写入数据后调用commitWrite
+  uint64_t getWriteBuffers(std::vector<iovec>& buffers, uint64_t len);
+
+  // 确认通过getWriteBuffers写入了size字节
+  void commitWrite(size_t size);
+
+ private:
+  void addCapacity(size_t size);
+
+  size_t getCapacity() const { return m_capacity - m_size; }
+
+  Node* locate(size_t position) const;
+
+  static Node* NewNode(size_t size);
+
+  static void FreeNode(Node* node);
+
+ private:
+  size_t m_baseSize;   // 每个内存块的大小
+  size_t m_position;   // 读位置
+  size_t m_capacity;   // 总容量
+  size_t m_size;       // 写位置, 也就是数据的总长度
+  int8_t m_endian;     // 默认大端(网络序)
+  Node* m_root;        // 第一个内存块
+  Node* m_tail;        // 最后一个内存块
+  Node* m_readCur;     // 读位置所在的内存块
+  Node* m_writeCur;    // 写位置所在的内存块, 写满时为nullptr
+};
+
+}  // namespace ddg
+
+#endif
@@ -29,7 +29,8 @@ ConfigVarBase::ptr Config::LookupBase(const std::string& name) {
 }
 
 // Config
-const std::string Config::kValidSet = "abcdefghijklmnopqrstuvwxyz._0123456789";
+const char* const Config::kValidSet =
+    "abcdefghijklmnopqrstuvwxyz._0123456789";
 
 void Config::ListAllMember(
     const std::string& prefix, const YAML::Node& node,
@@ -177,7 +177,8 @@ class Config {
 
   using VisitCallback = std::function<void(ConfigVarBase::ptr)>;
 
-  static const std::string kValidSet;
+  // 常量初始化, 保证其他编译单元的静态变量初始化时也能使用
+  static const char* const kValidSet;
 
   template <class T>
   static ConfigVarPtr<T> Lookup(const std::string& name, const T& default_value,
@@ -0,0 +1,65 @@
+#ifndef DDG_ENDIAN_H_
+#define DDG_ENDIAN_H_
+
+#include <byteswap.h>
+#include <endian.h>
+#include <stdint.h>
+#include <type_traits>
+
+#define DDG_LITTLE_ENDIAN 1
+#define DDG_BIG_ENDIAN 2
+
+#if BYTE_ORDER == BIG_ENDIAN
+#define DDG_BYTE_ORDER DDG_BIG_ENDIAN
+#else
+#define DDG_BYTE_ORDER DDG_LITTLE_ENDIAN
+#endif
+
+namespace ddg {
+
+template <class T>
+typename std::enable_if<sizeof(T) == sizeof(uint8_t), T>::type ByteSwap(
+    T value) {
+  return value;
+}
+
+template <class T>
+typename std::enable_if<sizeof(T) == sizeof(uint16_t), T>::type ByteSwap(
+    T value) {
+  return static_cast<T>(bswap_16(static_cast<uint16_t>(value)));
+}
+
+template <class T>
+typename std::enable_if<sizeof(T) == sizeof(uint32_t), T>::type ByteSwap(
+    T value) {
+  return static_cast<T>(bswap_32(static_cast<uint32_t>(value)));
+}
+
+template <class T>
+typename std::enable_if<sizeof(T) == sizeof(uint64_t), T>::type ByteSwap(
+    T value) {
+  return static_cast<T>(bswap_64(static_cast<uint64_t>(value)));
+}
+
+// 只在小端机器上交换, 用于主机序和网络序(大端)之间的转换
+template <class T>
+T ByteSwapOnLittleEndian(T value) {
+#if DDG_BYTE_ORDER == DDG_LITTLE_ENDIAN
+  return ByteSwap(value);
+#else
+  return value;
+#endif
+}
+
+template <class T>
+T ByteSwapOnBigEndian(T value) {
+#if DDG_BYTE_ORDER == DDG_BIG_ENDIAN
+  return ByteSwap(value);
+#else
+  return value;
+#endif
+}
+
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,109 @@
+#include "ddg/fdmanager.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ddg/hook.h"
+
+namespace ddg {
+
+FdCtx::FdCtx(int fd)
+    : m_isInit(false),
+      m_isSocket(false),
+      m_sysNonblock(false),
+      m_userNonblock(false),
+      m_isClosed(false),
+      m_fd(fd) {
+  init();
+}
+
+FdCtx::~FdCtx() {}
+
+bool FdCtx::init() {
+  if (m_isInit) {
+    return true;
+  }
+
+  struct stat fd_stat;
+  if (fstat(m_fd, &fd_stat) == -1) {
+    m_isInit = false;
+    m_isSocket = false;
+  } else {
+    m_isInit = true;
+    m_isSocket = S_ISSOCK(fd_stat.st_mode);
+  }
+
+  // socket统一在内核层设置为非阻塞, 阻塞语义由hook模拟
+  if (m_isSocket) {
+    int flags = fcntl_f(m_fd, F_GETFL, 0);
+    if (!(flags & O_NONBLOCK)) {
+      fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+    m_sysNonblock = true;
+  } else {
+    m_sysNonblock = false;
+  }
+
+  m_userNonblock = false;
+  m_isClosed = false;
+  return m_isInit;
+}
+
+void FdCtx::setTimeout(int type, uint64_t v) {
+  if (type == SO_RCVTIMEO) {
+    m_recvTimeout = v;
+  } else {
+    m_sendTimeout = v;
+  }
+}
+
+uint64_t FdCtx::getTimeout(int type) const {
+  if (type == SO_RCVTIMEO) {
+    return m_recvTimeout;
+  }
+  return m_sendTimeout;
+}
+
+FdManager::FdManager() {
+  m_datas.resize(64);
+}
+
+FdCtx::ptr FdManager::get(int fd, bool auto_create) {
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  RWMutexType::ReadLock lock(m_mutex);
+  if (static_cast<size_t>(fd) >= m_datas.size()) {
+    if (!auto_create) {
+      return nullptr;
+    }
+  } else {
+    if (m_datas[fd] || !auto_create) {
+      return m_datas[fd];
+    }
+  }
+  lock.unlock();
+
+  RWMutexType::WriteLock lock2(m_mutex);
+  if (static_cast<size_t>(fd) >= m_datas.size()) {
+    m_datas.resize(fd * 1.5);
+  }
+  if (!m_datas[fd]) {
+    m_datas[fd] = std::make_shared<FdCtx>(fd);
+  }
+  return m_datas[fd];
+}
+
+void FdManager::del(int fd) {
+  RWMutexType::WriteLock lock(m_mutex);
+  if (fd < 0 || static_cast<size_t>(fd) >= m_datas.size()) {
+    return;
+  }
+  m_datas[fd].reset();
+}
+
+}  // namespace ddg
@@ -0,0 +1,88 @@
+#ifndef DDG_FDMANAGER_H_
+#define DDG_FDMANAGER_H_
+
+#include <memory>
+#include <vector>
+
+#include "ddg/mutex.h"
+#include "ddg/singleton.h"
+
+namespace ddg {
+
+/**
+ * @brief 文件句柄上下文, 记录是否是socket、是否阻塞以及读写超时
+ */
+class FdCtx : public std::enable_shared_from_this<FdCtx> {
+ public:
+  using ptr = std::shared_ptr<FdCtx>;
+
+  explicit FdCtx(int fd);
+
+  ~FdCtx();
+
+  bool isInit() const { return m_isInit; }
+
+  bool isSocket() const { return m_isSocket; }
+
+  bool isClosed() const { return m_isClosed; }
+
+  void setClosed(bool v) { m_isClosed = v; }
+
+  // 用户主动设置的非阻塞
+  void setUserNonblock(bool v) { m_userNonblock = v; }
+
+  bool getUserNonblock() const { return m_userNonblock; }
+
+  // hook内部设置的非阻塞
+  void setSysNonblock(bool v) { m_sysNonblock = v; }
+
+  bool getSysNonblock() const { return m_sysNonblock; }
+
+  // type: SO_RCVTIMEO 或者 SO_SNDTIMEO, 单位毫秒
+  void setTimeout(int type, uint64_t v);
+
+  uint64_t getTimeout(int type) const;
+
+ private:
+  bool init();
+
+ private:
+  bool m_isInit : 1;
+  bool m_isSocket : 1;
+  bool m_sysNonblock : 1;
+  bool m_userNonblock : 1;
+  bool m_isClosed : 1;
+  int m_fd;
+  uint64_t m_recvTimeout = ~0ull;
+  uint64_t m_sendTimeout = ~0ull;
+};
+
+class FdManager {
+ public:
+  using RWMutexType = RWMutex;
+
+  FdManager();
+
+  // auto_create为true时, 不存在则创建
+  FdCtx::ptr get(int fd, bool auto_create = false);
+
+  void del(int fd);
+
+ private:
+  RWMutexType m_mutex;
+  std::vector<FdCtx::ptr> m_datas;
+};
+
+// 不析构: close()总要查FdManager, 进程退出时其他静态对象的析构函数里
+// 还会close文件, 那时它必须还在
+class FdMgr {
+ public:
+  static FdManager* GetInstance() {
+    static FdManager* s_instance = new FdManager;
+    return s_instance;
+  }
+};
+
+}  // namespace ddg
+
+#endif
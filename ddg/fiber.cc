@@ -147,20 +147,34 @@ void Fiber::reset(Callback cb) {
   m_state = State::INIT;
 }
 
-void Fiber::swapIn() {
+// 没有调度器的线程直接swapIn时, 切回线程的主协程
+static Fiber* MainFiber() {
+  Fiber* main = Scheduler::GetMainFiber();
+  return main ? main : t_threadFiber.get();
+}
+
+Fiber::State::Type Fiber::swapIn() {
   SetThis(this);
   DDG_ASSERT(m_state != State::EXEC);
   m_state = State::EXEC;
 
-  if (swapcontext(&Scheduler::GetMainFiber()->m_ctx,
+  if (swapcontext(&MainFiber()->m_ctx,
                   &m_ctx)) {  // 从主MainFiber调入m_ctx
     DDG_ASSERT_MSG(false, "swapcontext");
   }
+  // YieldToHold切出去时状态还是EXEC, 回到这里才算真正挂起. 改成HOLD之后
+  // 别的线程就可能唤醒它, 所以先取出状态再改
+  State::Type state = m_state;
+  if (state == State::EXEC) {
+    state = State::HOLD;
+    m_state = State::HOLD;
+  }
+  return state;
 }
 
 void Fiber::swapOut() {
-  SetThis(Scheduler::GetMainFiber());
-  if (swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx)) {
+  SetThis(MainFiber());
+  if (swapcontext(&m_ctx, &MainFiber()->m_ctx)) {
     DDG_ASSERT_MSG(false, "swapcontext")
   }
 }
@@ -171,6 +185,9 @@ void Fiber::call() {
   if (swapcontext(&t_threadFiber->m_ctx, &m_ctx)) {
     DDG_ASSERT_MSG(false, "swapcontext");
   }
+  if (m_state == State::EXEC) {
+    m_state = State::HOLD;
+  }
 }
 
 void Fiber::back() {
@@ -221,7 +238,8 @@ void Fiber::YieldToReady() {
 void Fiber::YieldToHold() {
   Fiber::ptr cur = GetThis();
   DDG_ASSERT(cur->m_state == State::EXEC);
-  cur->m_state = State::HOLD;
+  // 状态保持EXEC, 切出去之后由swapIn/call改成HOLD. 否则别的线程在swapOut
+  // 完成之前唤醒它, 调度器看到HOLD就会在另一个线程上切进一个还在运行的协程
   cur->swapOut();
 }
 
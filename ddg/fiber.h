@@ -63,8 +63,12 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
 
   void reset(Callback cb);
 
-  // 切换到运行态
-  void swapIn();
+  /**
+   * @brief 切换到运行态
+   * @return 切回来时的状态, YieldToHold切回来的是HOLD. 返回之后协程
+   *         可能已经被别的线程唤醒, 不能再用getState判断
+   */
+  State::Type swapIn();
 
   // 切换到后台
   void swapOut();
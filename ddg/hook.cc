@@ -0,0 +1,489 @@
+#include "ddg/hook.h"
+
+#include <dlfcn.h>
+#include <stdarg.h>
+
+#include "ddg/config.h"
+#include "ddg/fdmanager.h"
+#include "ddg/fiber.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<int>::ptr g_tcp_connect_timeout =
+    Config::Lookup<int>("tcp.connect.timeout", 5000, "tcp connect timeout");
+
+static thread_local bool t_hook_enable = false;
+
+#define HOOK_FUN(XX) \
+  XX(sleep)          \
+  XX(usleep)         \
+  XX(nanosleep)      \
+  XX(socket)         \
+  XX(connect)        \
+  XX(accept)         \
+  XX(accept4)        \
+  XX(read)           \
+  XX(readv)          \
+  XX(recv)           \
+  XX(recvfrom)       \
+  XX(recvmsg)        \
+  XX(recvmmsg)       \
+  XX(write)          \
+  XX(writev)         \
+  XX(send)           \
+  XX(sendto)         \
+  XX(sendmsg)        \
+  XX(sendmmsg)       \
+  XX(sendfile)       \
+  XX(close)          \
+  XX(fcntl)          \
+  XX(ioctl)          \
+  XX(getsockopt)     \
+  XX(setsockopt)
+
+static void HookInit() {
+  static bool is_inited = false;
+  if (is_inited) {
+    return;
+  }
+#define XX(name) \
+  name##_f = reinterpret_cast<name##_fun>(dlsym(RTLD_NEXT, #name));
+  HOOK_FUN(XX);
+#undef XX
+  is_inited = true;
+}
+
+static uint64_t s_connect_timeout = -1;
+
+struct HookIniter {
+  HookIniter() {
+    HookInit();
+    s_connect_timeout = g_tcp_connect_timeout->getValue();
+
+    g_tcp_connect_timeout->addListener([](const int& old_value,
+                                          const int& new_value) {
+      DDG_LOG_INFO(g_logger) << "tcp connect timeout changed from "
+                             << old_value << " to " << new_value;
+      s_connect_timeout = new_value;
+    });
+  }
+};
+
+static HookIniter s_hook_initer;
+
+bool IsHookEnable() {
+  return t_hook_enable;
+}
+
+void SetHookEnable(bool flag) {
+  t_hook_enable = flag;
+}
+
+}  // namespace ddg
+
+// 在当前协程中执行io, 如果会阻塞就把fd挂到IOManager上并让出协程,
+// 超时时间由setsockopt设置的SO_RCVTIMEO/SO_SNDTIMEO决定
+template <class OriginFun, class... Args>
+static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
+                     uint32_t event, int timeout_so, Args&&... args) {
+  if (!ddg::IsHookEnable()) {
+    return fun(fd, std::forward<Args>(args)...);
+  }
+
+  ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(fd);
+  if (!ctx) {
+    return fun(fd, std::forward<Args>(args)...);
+  }
+
+  if (ctx->isClosed()) {
+    errno = EBADF;
+    return -1;
+  }
+
+  if (!ctx->isSocket() || ctx->getUserNonblock()) {
+    return fun(fd, std::forward<Args>(args)...);
+  }
+
+  uint64_t to = ctx->getTimeout(timeout_so);
+
+  while (true) {
+    ssize_t n = fun(fd, args...);
+    while (n == -1 && errno == EINTR) {
+      n = fun(fd, args...);
+    }
+
+    if (n != -1 || errno != EAGAIN) {
+      return n;
+    }
+
+    ddg::IOManager* iom = ddg::IOManager::GetThis();
+    if (!iom) {
+      return n;
+    }
+
+    int ret = iom->waitEvent(fd, static_cast<ddg::IOManager::Event>(event), to);
+    if (DDG_UNLIKELY(ret == -1)) {
+      DDG_LOG_ERROR(ddg::g_logger)
+          << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
+      return -1;
+    }
+
+    if (ret == ddg::IOManager::WAIT_TIMEOUT) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    if (ctx->isClosed()) {  // 等待期间fd被其他协程关闭了
+      errno = EBADF;
+      return -1;
+    }
+  }
+}
+
+extern "C" {
+
+#define XX(name) name##_fun name##_f = nullptr;
+HOOK_FUN(XX);
+#undef XX
+
+// 判断当前能否把阻塞转化为让出协程
+static bool CanYield() {
+  if (!ddg::IsHookEnable() || !ddg::IOManager::GetThis()) {
+    return false;
+  }
+  ddg::Fiber* main_fiber = ddg::Scheduler::GetMainFiber();
+  return main_fiber && ddg::Fiber::GetThis().get() != main_fiber;
+}
+
+static void SleepInFiber(uint64_t ms) {
+  ddg::Fiber::ptr fiber = ddg::Fiber::GetThis();
+  ddg::IOManager* iom = ddg::IOManager::GetThis();
+  // 回到原来的线程上唤醒, 不让协程在线程间漂移
+  uint64_t thread = ddg::GetThreadId();
+  iom->addTimer(ms, [iom, fiber, thread]() { iom->schedule(fiber, thread); });
+  ddg::Fiber::YieldToHold();
+}
+
+unsigned int sleep(unsigned int seconds) {
+  if (!CanYield()) {
+    return sleep_f(seconds);
+  }
+  SleepInFiber(seconds * 1000ull);
+  return 0;
+}
+
+int usleep(useconds_t usec) {
+  if (!CanYield()) {
+    return usleep_f(usec);
+  }
+  SleepInFiber(usec / 1000);
+  return 0;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+  if (!CanYield()) {
+    return nanosleep_f(req, rem);
+  }
+  SleepInFiber(req->tv_sec * 1000ull + req->tv_nsec / 1000 / 1000);
+  return 0;
+}
+
+int socket(int domain, int type, int protocol) {
+  if (!ddg::IsHookEnable()) {
+    return socket_f(domain, type, protocol);
+  }
+  int fd = socket_f(domain, type, protocol);
+  if (fd == -1) {
+    return fd;
+  }
+  ddg::FdMgr::GetInstance()->get(fd, true);
+  return fd;
+}
+
+int connect_with_timeout(int fd, const struct sockaddr* addr,
+                         socklen_t addrlen, uint64_t timeout_ms) {
+  if (!ddg::IsHookEnable()) {
+    return connect_f(fd, addr, addrlen);
+  }
+
+  ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(fd);
+  if (!ctx) {
+    return connect_f(fd, addr, addrlen);
+  }
+
+  if (ctx->isClosed()) {
+    errno = EBADF;
+    return -1;
+  }
+
+  if (!ctx->isSocket() || ctx->getUserNonblock()) {
+    return connect_f(fd, addr, addrlen);
+  }
+
+  int n = connect_f(fd, addr, addrlen);
+  if (n == 0) {
+    return 0;
+  } else if (n != -1 || errno != EINPROGRESS) {
+    return n;
+  }
+
+  ddg::IOManager* iom = ddg::IOManager::GetThis();
+  if (!iom) {
+    return n;
+  }
+
+  int ret = iom->waitEvent(fd, ddg::IOManager::WRITE, timeout_ms);
+  if (ret == ddg::IOManager::WAIT_TIMEOUT) {
+    errno = ETIMEDOUT;
+    return -1;
+  } else if (ret == -1) {
+    // 注册事件失败, errno是epoll_ctl留下的, 连接结果未知
+    DDG_LOG_ERROR(ddg::g_logger) << "connect addEvent(" << fd << ", WRITE)";
+    return -1;
+  }
+
+  int error = 0;
+  socklen_t len = sizeof(int);
+  if (getsockopt_f(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+    return -1;
+  }
+
+  if (!error) {
+    return 0;
+  }
+  errno = error;
+  return -1;
+}
+
+int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+  return connect_with_timeout(sockfd, addr, addrlen, ddg::s_connect_timeout);
+}
+
+int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
+  int fd = do_io(s, accept_f, "accept", ddg::IOManager::READ, SO_RCVTIMEO,
+                 addr, addrlen);
+  if (fd >= 0 && ddg::IsHookEnable()) {
+    ddg::FdMgr::GetInstance()->get(fd, true);
+  }
+  return fd;
+}
+
+int accept4(int s, struct sockaddr* addr, socklen_t* addrlen, int flags) {
+  int fd = do_io(s, accept4_f, "accept4", ddg::IOManager::READ, SO_RCVTIMEO,
+                 addr, addrlen, flags);
+  if (fd >= 0 && ddg::IsHookEnable()) {
+    ddg::FdMgr::GetInstance()->get(fd, true);
+  }
+  return fd;
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+  return do_io(fd, read_f, "read", ddg::IOManager::READ, SO_RCVTIMEO, buf,
+               count);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+  return do_io(fd, readv_f, "readv", ddg::IOManager::READ, SO_RCVTIMEO, iov,
+               iovcnt);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+  return do_io(sockfd, recv_f, "recv", ddg::IOManager::READ, SO_RCVTIMEO, buf,
+               len, flags);
+}
+
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags,
+                 struct sockaddr* src_addr, socklen_t* addrlen) {
+  return do_io(sockfd, recvfrom_f, "recvfrom", ddg::IOManager::READ,
+               SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+  return do_io(sockfd, recvmsg_f, "recvmsg", ddg::IOManager::READ,
+               SO_RCVTIMEO, msg, flags);
+}
+
+int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen,
+             int flags, struct timespec* timeout) {
+  return do_io(sockfd, recvmmsg_f, "recvmmsg", ddg::IOManager::READ,
+               SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+  return do_io(fd, write_f, "write", ddg::IOManager::WRITE, SO_SNDTIMEO, buf,
+               count);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+  return do_io(fd, writev_f, "writev", ddg::IOManager::WRITE, SO_SNDTIMEO,
+               iov, iovcnt);
+}
+
+ssize_t send(int s, const void* msg, size_t len, int flags) {
+  return do_io(s, send_f, "send", ddg::IOManager::WRITE, SO_SNDTIMEO, msg,
+               len, flags);
+}
+
+ssize_t sendto(int s, const void* msg, size_t len, int flags,
+               const struct sockaddr* to, socklen_t tolen) {
+  return do_io(s, sendto_f, "sendto", ddg::IOManager::WRITE, SO_SNDTIMEO, msg,
+               len, flags, to, tolen);
+}
+
+ssize_t sendmsg(int s, const struct msghdr* msg, int flags) {
+  return do_io(s, sendmsg_f, "sendmsg", ddg::IOManager::WRITE, SO_SNDTIMEO,
+               msg, flags);
+}
+
+int sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen,
+             int flags) {
+  return do_io(sockfd, sendmmsg_f, "sendmmsg", ddg::IOManager::WRITE,
+               SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+  return do_io(out_fd, sendfile_f, "sendfile", ddg::IOManager::WRITE,
+               SO_SNDTIMEO, in_fd, offset, count);
+}
+
+int close(int fd) {
+  // hook关掉时也要删除FdCtx, 否则复用这个fd的新文件会拿到旧的状态
+  ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(fd);
+  if (ctx) {
+    ctx->setClosed(true);
+    ddg::IOManager* iom = ddg::IOManager::GetThis();
+    if (iom) {
+      iom->cancelAll(fd);  // 唤醒所有等待这个fd的协程
+    }
+    ddg::FdMgr::GetInstance()->del(fd);
+  }
+  return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ... /* arg */) {
+  va_list va;
+  va_start(va, cmd);
+  switch (cmd) {
+    case F_SETFL: {
+      int arg = va_arg(va, int);
+      va_end(va);
+      ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(fd);
+      if (!ctx || ctx->isClosed() || !ctx->isSocket()) {
+        return fcntl_f(fd, cmd, arg);
+      }
+      ctx->setUserNonblock(arg & O_NONBLOCK);
+      if (ctx->getSysNonblock()) {
+        arg |= O_NONBLOCK;
+      } else {
+        arg &= ~O_NONBLOCK;
+      }
+      return fcntl_f(fd, cmd, arg);
+    }
+    case F_GETFL: {
+      va_end(va);
+      int arg = fcntl_f(fd, cmd);
+      ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(fd);
+      if (!ctx || ctx->isClosed() || !ctx->isSocket()) {
+        return arg;
+      }
+      // 对用户隐藏hook设置的非阻塞
+      if (ctx->getUserNonblock()) {
+        return arg | O_NONBLOCK;
+      }
+      return arg & ~O_NONBLOCK;
+    }
+    case F_DUPFD:
+    case F_DUPFD_CLOEXEC:
+    case F_SETFD:
+    case F_SETOWN:
+    case F_SETSIG:
+    case F_SETLEASE:
+    case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+    case F_SETPIPE_SZ:
+#endif
+    {
+      int arg = va_arg(va, int);
+      va_end(va);
+      return fcntl_f(fd, cmd, arg);
+    }
+    case F_GETFD:
+    case F_GETOWN:
+    case F_GETSIG:
+    case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+    case F_GETPIPE_SZ:
+#endif
+    {
+      va_end(va);
+      return fcntl_f(fd, cmd);
+    }
+    case F_SETLK:
+    case F_SETLKW:
+    case F_GETLK: {
+      struct flock* arg = va_arg(va, struct flock*);
+      va_end(va);
+      return fcntl_f(fd, cmd, arg);
+    }
+    case F_GETOWN_EX:
+    case F_SETOWN_EX: {
+      struct f_owner_exlock* arg = va_arg(va, struct f_owner_exlock*);
+      va_end(va);
+      return fcntl_f(fd, cmd, arg);
+    }
+    default:
+      va_end(va);
+      return fcntl_f(fd, cmd);
+  }
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+  va_list va;
+  va_start(va, request);
+  void* arg = va_arg(va, void*);
+  va_end(va);
+
+  if (request == FIONBIO) {
+    bool user_nonblock = !!*static_cast<int*>(arg);
+    ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(d);
+    if (!ctx || ctx->isClosed() || !ctx->isSocket()) {
+      return ioctl_f(d, request, arg);
+    }
+    ctx->setUserNonblock(user_nonblock);
+    // 和F_SETFL一样, hook设置的非阻塞不能被用户清掉
+    int value = ctx->getSysNonblock() ? 1 : user_nonblock;
+    return ioctl_f(d, request, &value);
+  }
+  return ioctl_f(d, request, arg);
+}
+
+int getsockopt(int sockfd, int level, int optname, void* optval,
+               socklen_t* optlen) {
+  return getsockopt_f(sockfd, level, optname, optval, optlen);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void* optval,
+               socklen_t optlen) {
+  if (!ddg::IsHookEnable()) {
+    return setsockopt_f(sockfd, level, optname, optval, optlen);
+  }
+
+  if (level == SOL_SOCKET &&
+      (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)) {
+    ddg::FdCtx::ptr ctx = ddg::FdMgr::GetInstance()->get(sockfd);
+    if (ctx) {
+      const timeval* tv = static_cast<const timeval*>(optval);
+      // 内核里{0, 0}表示不超时
+      ctx->setTimeout(optname, tv->tv_sec || tv->tv_usec
+                                   ? tv->tv_sec * 1000 + tv->tv_usec / 1000
+                                   : ~0ull);
+    }
+  }
+  return setsockopt_f(sockfd, level, optname, optval, optlen);
+}
+}
@@ -0,0 +1,295 @@
+#include "ddg/hotrestart.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "ddg/config.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/mutex.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_hot_restart_drain_timeout =
+    Config::Lookup<uint64_t>("hot_restart.drain_timeout", 30 * 1000,
+                             "hot restart old process drain timeout(ms)");
+
+static ConfigVar<uint64_t>::ptr g_hot_restart_ready_timeout =
+    Config::Lookup<uint64_t>("hot_restart.ready_timeout", 30 * 1000,
+                             "hot restart wait new process ready timeout(ms)");
+
+// 一条消息最多带的fd数, 内核限制是253
+static const size_t kMaxFdsPerMsg = 250;
+
+static const char kReady = 'R';
+
+static HotRestart::MutexType s_inherited_mutex;
+static std::vector<Socket::ptr> s_inherited;
+
+// 发送fds, 数据部分是发完这一批之后还剩多少个
+static bool SendFds(Socket::ptr conn, const std::vector<int>& fds) {
+  size_t pos = 0;
+  do {
+    size_t n = std::min(kMaxFdsPerMsg, fds.size() - pos);
+    uint32_t remain = fds.size() - pos - n;
+    iovec iov;
+    iov.iov_base = &remain;
+    iov.iov_len = sizeof(remain);
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFdsPerMsg));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (n) {
+      msg.msg_control = &control[0];
+      msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+      cmsghdr* c = CMSG_FIRSTHDR(&msg);
+      c->cmsg_level = SOL_SOCKET;
+      c->cmsg_type = SCM_RIGHTS;
+      c->cmsg_len = CMSG_LEN(sizeof(int) * n);
+      memcpy(CMSG_DATA(c), &fds[pos], sizeof(int) * n);
+    }
+    if (::sendmsg(conn->getSocket(), &msg, MSG_NOSIGNAL) !=
+        sizeof(remain)) {
+      DDG_LOG_ERROR(g_logger) << "hot restart sendmsg fail errno = " << errno
+                              << " errstr = " << strerror(errno);
+      return false;
+    }
+    pos += n;
+  } while (pos < fds.size());
+  return true;
+}
+
+static bool RecvFds(Socket::ptr conn, std::vector<int>& fds) {
+  uint32_t remain = 0;
+  do {
+    iovec iov;
+    iov.iov_base = &remain;
+    iov.iov_len = sizeof(remain);
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFdsPerMsg));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control[0];
+    msg.msg_controllen = control.size();
+    ssize_t rt = ::recvmsg(conn->getSocket(), &msg, MSG_CMSG_CLOEXEC);
+    if (rt != sizeof(remain)) {
+      DDG_LOG_ERROR(g_logger) << "hot restart recvmsg rt = " << rt
+                              << " errno = " << errno
+                              << " errstr = " << strerror(errno);
+      return false;
+    }
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      const int* p = reinterpret_cast<const int*>(CMSG_DATA(c));
+      fds.insert(fds.end(), p, p + n);
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+      DDG_LOG_ERROR(g_logger) << "hot restart recvmsg control truncated";
+      return false;
+    }
+  } while (remain);
+  return true;
+}
+
+HotRestart::HotRestart(const std::string& path, IOManager* iom)
+    : m_path(path), m_iom(iom), m_handedOff(false) {
+  DDG_ASSERT(m_iom);
+}
+
+HotRestart::~HotRestart() {
+  close();
+}
+
+void HotRestart::close() {
+  if (m_listener) {
+    m_listener->close();
+  }
+  if (m_conn) {
+    m_conn->close();
+  }
+}
+
+void HotRestart::addServer(TcpServer::ptr server) {
+  m_servers.push_back(server);
+}
+
+bool HotRestart::inherit(uint64_t timeout_ms) {
+  Socket::ptr conn = Socket::CreateUnixTCPSocket();
+  if (!conn->connect(std::make_shared<UnixAddress>(m_path), timeout_ms)) {
+    DDG_LOG_INFO(g_logger) << "hot restart no old process on " << m_path;
+    return false;
+  }
+  conn->setRecvTimeout(timeout_ms);
+  std::vector<int> fds;
+  bool ok = RecvFds(conn, fds);
+  for (int fd : fds) {
+    Socket::ptr sock = ok ? Socket::CreateFromFd(fd) : nullptr;
+    if (!sock) {
+      ::close(fd);
+      continue;
+    }
+    DDG_LOG_INFO(g_logger) << "hot restart inherit " << *sock;
+    MutexType::Lock lock(s_inherited_mutex);
+    s_inherited.push_back(sock);
+  }
+  if (!ok) {
+    CloseInherited();
+    conn->close();
+    return false;
+  }
+  m_conn = conn;
+  return true;
+}
+
+bool HotRestart::ready(uint64_t timeout_ms) {
+  size_t unused = CloseInherited();
+  if (unused) {
+    DDG_LOG_WARN(g_logger) << "hot restart close " << unused
+                           << " inherited sockets of addresses not served";
+  }
+  if (!m_conn) {
+    return false;
+  }
+  Socket::ptr conn = m_conn;
+  m_conn.reset();
+  if (conn->send(&kReady, 1) != 1) {
+    conn->close();
+    return false;
+  }
+  // 旧进程先关监听再关控制连接, 读到EOF之后path就可以重新bind了
+  conn->setRecvTimeout(timeout_ms);
+  char buf[16];
+  int rt = 0;
+  while ((rt = conn->recv(buf, sizeof(buf))) > 0) {
+  }
+  conn->close();
+  return rt == 0;
+}
+
+bool HotRestart::listen() {
+  Socket::ptr sock = Socket::CreateUnixTCPSocket();
+  if (!sock->bind(std::make_shared<UnixAddress>(m_path)) ||
+      !sock->listen()) {
+    DDG_LOG_ERROR(g_logger) << "hot restart listen " << m_path
+                            << " fail errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+  m_listener = sock;
+  m_iom->schedule(std::bind(&HotRestart::onAccept, shared_from_this()));
+  return true;
+}
+
+void HotRestart::onAccept() {
+  Socket::ptr listener = m_listener;
+  while (!m_handedOff) {
+    Socket::ptr conn = listener->accept();
+    if (!conn) {
+      if (!listener->isValid()) {
+        break;
+      }
+      continue;
+    }
+    if (handoff(conn)) {
+      break;
+    }
+  }
+}
+
+bool HotRestart::handoff(Socket::ptr conn) {
+  std::vector<int> fds;
+  for (auto& server : m_servers) {
+    for (auto& sock : server->getSocks()) {
+      fds.push_back(sock->getSocket());
+    }
+  }
+  DDG_LOG_INFO(g_logger) << "hot restart hand off " << fds.size()
+                         << " listening sockets";
+  if (!SendFds(conn, fds)) {
+    conn->close();
+    return false;
+  }
+
+  // 新进程在ready之前挂掉的话继续服务, 等下一个
+  conn->setRecvTimeout(g_hot_restart_ready_timeout->getValue());
+  char c = 0;
+  if (conn->recv(&c, 1) != 1 || c != kReady) {
+    DDG_LOG_WARN(g_logger) << "hot restart new process not ready, "
+                           << "keep serving";
+    conn->close();
+    return false;
+  }
+
+  m_handedOff = true;
+  m_listener->close();
+  conn->close();
+  drain();
+  return true;
+}
+
+void HotRestart::drain() {
+  uint64_t timeout = g_hot_restart_drain_timeout->getValue();
+  for (auto& server : m_servers) {
+    server->stop(timeout);
+  }
+  DDG_LOG_INFO(g_logger) << "hot restart stop accepting, drain timeout = "
+                         << timeout << "ms";
+
+  // 超时后stop会shutdown剩下的连接, 再多等一会儿让它们关掉
+  uint64_t deadline = GetCurrentMilliSecond() + timeout + 1000;
+  auto self = shared_from_this();
+  auto timer = std::make_shared<Timer::ptr>();
+  *timer = m_iom->addTimer(
+      100,
+      [self, timer, deadline]() {
+        size_t conns = 0;
+        for (auto& server : self->m_servers) {
+          conns += server->getConnectionCount();
+        }
+        if (conns && GetCurrentMilliSecond() < deadline) {
+          return;
+        }
+        (*timer)->cancel();
+        timer->reset();
+        DDG_LOG_INFO(g_logger) << "hot restart drained, " << conns
+                               << " connections left";
+        if (self->m_drained) {
+          self->m_drained();
+        }
+      },
+      true);
+}
+
+Socket::ptr HotRestart::TakeInherited(Address::ptr addr) {
+  MutexType::Lock lock(s_inherited_mutex);
+  for (auto it = s_inherited.begin(); it != s_inherited.end(); ++it) {
+    if (*(*it)->getLocalAddress() == *addr) {
+      Socket::ptr sock = *it;
+      s_inherited.erase(it);
+      return sock;
+    }
+  }
+  return nullptr;
+}
+
+size_t HotRestart::CloseInherited() {
+  MutexType::Lock lock(s_inherited_mutex);
+  size_t n = s_inherited.size();
+  for (auto& sock : s_inherited) {
+    sock->close();
+  }
+  s_inherited.clear();
+  return n;
+}
+
+}  // namespace ddg
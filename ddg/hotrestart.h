@@ -0,0 +1,99 @@
+#ifndef DDG_HOTRESTART_H_
+#define DDG_HOTRESTART_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/address.h"
+#include "ddg/iomanager.h"
+#include "ddg/mutex.h"
+#include "ddg/noncopyable.h"
+#include "ddg/socket.h"
+#include "ddg/tcpserver.h"
+
+namespace ddg {
+
+/**
+ * @brief 热重启, 新进程通过unix socket(SCM_RIGHTS)接手旧进程的监听socket
+ *
+ * 旧进程: addServer之后listen, 等待新进程连上来
+ * 新进程: 先inherit拿到监听socket, TcpServer::bind遇到相同的地址直接使用;
+ *         服务都start之后调用ready, 旧进程收到后停止accept, 已有连接在
+ *         hot_restart.drain_timeout内处理完, 然后回调drained(一般是退出).
+ *         最后新进程自己listen, 等待下一次重启
+ *
+ * 交接期间两个进程共用同一个监听队列, 不会丢连接. 新进程在ready之前退出
+ * 的话旧进程继续服务
+ */
+class HotRestart : public std::enable_shared_from_this<HotRestart>,
+                   NonCopyable {
+ public:
+  using ptr = std::shared_ptr<HotRestart>;
+  using MutexType = Mutex;
+
+  explicit HotRestart(const std::string& path,
+                      IOManager* iom = IOManager::GetThis());
+
+  ~HotRestart();
+
+  // 要交给新进程的服务, 交接时交出它们全部的监听socket
+  void addServer(TcpServer::ptr server);
+
+  // 交接完成并且连接都结束(或者超时)之后在iom上调用
+  void setDrainedCallback(std::function<void()> cb) { m_drained = cb; }
+
+  /**
+   * @brief 新进程: 从旧进程接收监听socket
+   * @return 没有旧进程或者接收失败返回false
+   */
+  bool inherit(uint64_t timeout_ms = 3000);
+
+  /**
+   * @brief 新进程: 服务都start之后调用, 通知旧进程停止accept,
+   *        等旧进程关闭控制socket后返回
+   */
+  bool ready(uint64_t timeout_ms = 3000);
+
+  // 在path上等待下一个新进程
+  bool listen();
+
+  // 不再等待新进程
+  void close();
+
+  // 监听socket已经交出去了
+  bool isHandedOff() const { return m_handedOff; }
+
+  const std::string& getPath() const { return m_path; }
+
+  // 取出一个本地地址是addr的继承来的监听socket, 没有返回nullptr
+  static Socket::ptr TakeInherited(Address::ptr addr);
+
+  // 关闭没有用上的继承socket, 返回关闭的个数. TcpServer::start会接着
+  // accept所有同地址的继承socket, 剩下的只有本进程不再服务的地址
+  static size_t CloseInherited();
+
+ private:
+  void onAccept();
+
+  // 把监听socket发给conn, 等它ready
+  bool handoff(Socket::ptr conn);
+
+  // 停止服务并等连接结束
+  void drain();
+
+ private:
+  std::string m_path;
+  IOManager* m_iom;
+  Socket::ptr m_listener;
+  Socket::ptr m_conn;  // 新进程到旧进程的控制连接
+  std::vector<TcpServer::ptr> m_servers;
+  std::function<void()> m_drained;
+  std::atomic<bool> m_handedOff;
+};
+
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,259 @@
+#include "ddg/http/filecache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ddg/config.h"
+#include "ddg/log.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_file_cache_max_mmap_size =
+    Config::Lookup<uint64_t>("http.file_cache.max_mmap_size", 256 * 1024,
+                             "max size of file to mmap in file cache");
+
+static ConfigVar<uint32_t>::ptr g_file_cache_max_files =
+    Config::Lookup<uint32_t>("http.file_cache.max_files", 4096,
+                             "max number of files in file cache");
+
+static const uint32_t kWatchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                   IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+FileCache::File::~File() {
+  if (data) {
+    munmap(const_cast<char*>(data), size);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+FileCache::FileCache(const std::string& root, IOManager* iom)
+    : m_root(root),
+      m_iom(iom),
+      m_generation(0),
+      m_armed(false),
+      m_stopped(false) {
+  while (m_root.size() > 1 && m_root.back() == '/') {
+    m_root.pop_back();
+  }
+  m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  // 读事件在第一次监听目录时再挂, 构造函数里还不能用shared_from_this
+  if (m_inotifyFd < 0) {
+    DDG_LOG_ERROR(g_logger) << "inotify_init1 fail errno = " << errno
+                            << " errstr = " << strerror(errno);
+  }
+}
+
+FileCache::~FileCache() {
+  // 回调持有强引用, 走到这里时onNotify一定没有在执行
+  stop();
+  if (m_inotifyFd >= 0) {
+    ::close(m_inotifyFd);
+  }
+}
+
+void FileCache::stop() {
+  RWMutexType::WriteLock lock(m_mutex);
+  m_stopped = true;
+  if (m_armed) {
+    m_iom->delEvent(m_inotifyFd, IOManager::READ);
+    m_armed = false;
+  }
+}
+
+void FileCache::arm() {
+  if (!m_iom || m_stopped || m_armed) {
+    return;
+  }
+  std::weak_ptr<FileCache> weak(shared_from_this());
+  m_armed = !m_iom->addEvent(m_inotifyFd, IOManager::READ, [weak]() {
+    FileCache::ptr self = weak.lock();
+    if (self) {
+      self->onNotify();
+    }
+  });
+}
+
+size_t FileCache::size() {
+  RWMutexType::ReadLock lock(m_mutex);
+  return m_files.size();
+}
+
+FileCache::File::ptr FileCache::get(const std::string& path) {
+  if ((!m_iom || m_stopped) && m_inotifyFd >= 0) {
+    onNotify();
+  }
+  {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_files.find(path);
+    if (it != m_files.end()) {
+      return it->second;
+    }
+  }
+  return load(path);
+}
+
+bool FileCache::watch(const std::string& path) {
+  if (m_inotifyFd < 0) {
+    return false;
+  }
+  std::string dir = path.substr(0, path.rfind('/'));
+  {
+    RWMutexType::ReadLock lock(m_mutex);
+    if (m_dirs.count(dir)) {
+      return true;
+    }
+  }
+
+  std::string full = m_root + (dir.empty() ? "/" : dir);
+  int wd = inotify_add_watch(m_inotifyFd, full.c_str(), kWatchMask);
+  if (wd < 0) {
+    DDG_LOG_DEBUG(g_logger) << "inotify_add_watch(" << full
+                            << ") fail errno = " << errno;
+    return false;
+  }
+  RWMutexType::WriteLock lock(m_mutex);
+  m_dirs[dir] = wd;
+  m_watches[wd] = dir;
+  arm();
+  return true;
+}
+
+static std::string HttpDate(time_t t) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char buf[64];
+  strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return buf;
+}
+
+FileCache::File::ptr FileCache::load(const std::string& path) {
+  // 先监听目录再打开文件, 中间的修改不会漏掉
+  bool watched = watch(path);
+  uint64_t generation;
+  {
+    RWMutexType::ReadLock lock(m_mutex);
+    generation = m_generation;
+  }
+
+  std::string full = m_root + path;
+  int fd = ::open(full.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  File::ptr file(new File);
+  file->path = path;
+  file->size = st.st_size;
+  if (file->size > 0 &&
+      file->size <= g_file_cache_max_mmap_size->getValue()) {
+    void* data = mmap(nullptr, file->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      file->data = static_cast<const char*>(data);
+    }
+  }
+  if (file->data) {
+    ::close(fd);
+  } else {
+    file->fd = fd;
+  }
+
+  char etag[64];
+  snprintf(etag, sizeof(etag), "\"%lx.%lx-%lx\"",
+           static_cast<unsigned long>(st.st_mtim.tv_sec),
+           static_cast<unsigned long>(st.st_mtim.tv_nsec),
+           static_cast<unsigned long>(st.st_size));
+  file->etag = etag;
+  file->lastModified = HttpDate(st.st_mtim.tv_sec);
+
+  // 加载期间收到过inotify事件的话不放进缓存, 下次重新加载
+  if (watched) {
+    RWMutexType::WriteLock lock(m_mutex);
+    if (generation == m_generation &&
+        m_files.size() < g_file_cache_max_files->getValue()) {
+      m_files[path] = file;
+    }
+  }
+  return file;
+}
+
+void FileCache::eraseDir(const std::string& dir) {
+  std::string prefix = dir + "/";
+  for (auto it = m_files.begin(); it != m_files.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = m_files.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FileCache::onNotify() {
+  alignas(inotify_event) char buf[4096];
+  while (true) {
+    ssize_t n = ::read(m_inotifyFd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    ++m_generation;
+    for (char* p = buf; p < buf + n;) {
+      inotify_event* ev = reinterpret_cast<inotify_event*>(p);
+      p += sizeof(inotify_event) + ev->len;
+      if (ev->mask & IN_Q_OVERFLOW) {
+        m_files.clear();
+        continue;
+      }
+      auto it = m_watches.find(ev->wd);
+      if (it == m_watches.end()) {
+        continue;
+      }
+      std::string dir = it->second;
+      if (ev->len) {
+        std::string name = dir + "/" + ev->name;
+        m_files.erase(name);
+        if (ev->mask & IN_ISDIR) {
+          eraseDir(name);
+        }
+      }
+      if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        eraseDir(dir);
+        // 目录移走以后路径对不上了, 不再监听, 之后会收到IN_IGNORED
+        if (ev->mask & IN_MOVE_SELF) {
+          inotify_rm_watch(m_inotifyFd, ev->wd);
+        }
+      }
+      if (ev->mask & IN_IGNORED) {
+        eraseDir(dir);
+        m_dirs.erase(dir);
+        m_watches.erase(it);
+      }
+    }
+  }
+
+  // 触发后事件已经从IOManager上去掉了, 没有stop就再挂上
+  RWMutexType::WriteLock lock(m_mutex);
+  if (m_armed) {
+    m_armed = false;
+    arm();
+  }
+}
+
+}  // namespace http
+}  // namespace ddg
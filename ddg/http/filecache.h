@@ -0,0 +1,99 @@
+#ifndef DDG_HTTP_FILECACHE_H_
+#define DDG_HTTP_FILECACHE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "ddg/iomanager.h"
+#include "ddg/mutex.h"
+#include "ddg/noncopyable.h"
+
+namespace ddg {
+namespace http {
+
+/**
+ * @brief 静态文件缓存
+ *
+ * 打开过的文件连同元数据(大小, ETag, Last-Modified)一起缓存, 命中时不需要
+ * 任何系统调用. 小文件mmap到内存, 可以和响应头一起writev; 大文件只保留fd,
+ * 用sendfile发送. 文件所在目录用inotify监听, 文件被修改、删除或者移动时
+ * 立即从缓存中去掉.
+ * 必须由shared_ptr管理; 监听的读事件只持有weak_ptr. 事件挂着的时候
+ * IOManager::stop不会返回, 服务器停止时要调用stop
+ */
+class FileCache : NonCopyable,
+                  public std::enable_shared_from_this<FileCache> {
+ public:
+  using ptr = std::shared_ptr<FileCache>;
+  using RWMutexType = RWMutex;
+
+  struct File {
+    using ptr = std::shared_ptr<File>;
+
+    ~File();
+
+    std::string path;            // 相对root的路径
+    int fd = -1;                 // 没有mmap的大文件
+    const char* data = nullptr;  // mmap的小文件
+    size_t size = 0;
+    std::string etag;
+    std::string lastModified;
+  };
+
+  /**
+   * @param root 根目录
+   * @param iom 监听inotify事件的IOManager, 为空时每次get检查一次
+   */
+  FileCache(const std::string& root, IOManager* iom = IOManager::GetThis());
+
+  ~FileCache();
+
+  /**
+   * @brief 取文件
+   * @param path 相对root的路径, 以'/'开头, 调用者保证不含".."
+   * @return 不存在或者不是普通文件返回nullptr
+   */
+  File::ptr get(const std::string& path);
+
+  const std::string& getRoot() const { return m_root; }
+
+  size_t size();
+
+  // 不再在IOManager上监听, 之后每次get检查一次inotify事件
+  void stop();
+
+ private:
+  // 在IOManager上挂inotify的读事件, 需要持有m_mutex的写锁
+  void arm();
+
+  File::ptr load(const std::string& path);
+
+  // 监听path所在的目录
+  bool watch(const std::string& path);
+
+  // 读取并处理inotify事件
+  void onNotify();
+
+  // 删掉dir下面所有缓存的文件
+  void eraseDir(const std::string& dir);
+
+ private:
+  std::string m_root;
+  IOManager* m_iom;
+  int m_inotifyFd;
+  RWMutexType m_mutex;
+  std::unordered_map<std::string, File::ptr> m_files;
+  std::unordered_map<int, std::string> m_watches;  // wd -> 相对目录
+  std::unordered_map<std::string, int> m_dirs;     // 相对目录 -> wd
+  uint64_t m_generation;  // 每处理一批inotify事件加一
+  bool m_armed;           // 读事件挂在m_iom上
+  std::atomic<bool> m_stopped;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
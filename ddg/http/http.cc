@@ -0,0 +1,387 @@
+#include "ddg/http/http.h"
+
+#include <strings.h>
+#include <sstream>
+
+namespace ddg {
+namespace http {
+
+const size_t StringView::npos;
+
+StringView StringView::substr(size_t pos, size_t n) const {
+  if (pos > m_size) {
+    pos = m_size;
+  }
+  if (n > m_size - pos) {
+    n = m_size - pos;
+  }
+  return StringView(m_data + pos, n);
+}
+
+size_t StringView::find(char c, size_t pos) const {
+  if (pos >= m_size) {
+    return npos;
+  }
+  const void* p = memchr(m_data + pos, c, m_size - pos);
+  return p ? static_cast<const char*>(p) - m_data : npos;
+}
+
+bool StringView::equalsIgnoreCase(const StringView& rhs) const {
+  return m_size == rhs.m_size &&
+         (m_size == 0 || strncasecmp(m_data, rhs.m_data, m_size) == 0);
+}
+
+bool StringView::operator==(const StringView& rhs) const {
+  return m_size == rhs.m_size &&
+         (m_size == 0 || memcmp(m_data, rhs.m_data, m_size) == 0);
+}
+
+std::ostream& operator<<(std::ostream& os, const StringView& str) {
+  return os.write(str.data(), str.size());
+}
+
+HttpMethod StringToHttpMethod(const StringView& m) {
+#define XX(num, name, string)   \
+  if (m == StringView(#string)) { \
+    return HttpMethod::name;    \
+  }
+  HTTP_METHOD_MAP(XX);
+#undef XX
+  return HttpMethod::INVALID_METHOD;
+}
+
+static const char* s_method_string[] = {
+#define XX(num, name, string) #string,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+const char* HttpMethodToString(const HttpMethod& m) {
+  uint32_t idx = static_cast<uint32_t>(m);
+  if (idx >= (sizeof(s_method_string) / sizeof(s_method_string[0]))) {
+    return "<unknown>";
+  }
+  return s_method_string[idx];
+}
+
+const char* HttpStatusToString(const HttpStatus& s) {
+  switch (s) {
+#define XX(code, name, msg) \
+  case HttpStatus::name:    \
+    return #msg;
+    HTTP_STATUS_MAP(XX);
+#undef XX
+    default:
+      return "<unknown>";
+  }
+}
+
+bool CaseInsensitiveLess::operator()(const std::string& lhs,
+                                     const std::string& rhs) const {
+  return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
+}
+
+// 只追加数字, 比stringstream快
+static void AppendUint(std::string& out, uint64_t v) {
+  char buf[24];
+  char* p = buf + sizeof(buf);
+  do {
+    *--p = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  out.append(p, buf + sizeof(buf) - p);
+}
+
+static void AppendVersion(std::string& out, uint8_t version) {
+  out.append("HTTP/");
+  out.push_back('0' + (version >> 4));
+  out.push_back('.');
+  out.push_back('0' + (version & 0x0F));
+}
+
+// Connection由m_close决定, websocket时才输出头部里的Connection: Upgrade
+static void AppendHeaders(std::string& out, const HttpRequest::MapType& m,
+                          bool skip_length, bool skip_connection) {
+  for (auto& i : m) {
+    if (skip_length && strcasecmp(i.first.c_str(), "content-length") == 0) {
+      continue;
+    }
+    if (skip_connection && strcasecmp(i.first.c_str(), "connection") == 0) {
+      continue;
+    }
+    out.append(i.first);
+    out.append(": ", 2);
+    out.append(i.second);
+    out.append("\r\n", 2);
+  }
+}
+
+static int FromHex(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// application/x-www-form-urlencoded解码
+static std::string UrlDecode(const std::string& str) {
+  std::string out;
+  out.reserve(str.size());
+  for (size_t i = 0; i < str.size(); ++i) {
+    char c = str[i];
+    if (c == '+') {
+      out.push_back(' ');
+    } else if (c == '%' && i + 2 < str.size() && FromHex(str[i + 1]) >= 0 &&
+               FromHex(str[i + 2]) >= 0) {
+      out.push_back(FromHex(str[i + 1]) * 16 + FromHex(str[i + 2]));
+      i += 2;
+    } else {
+      out.push_back(c);
+    }
+  }
+  return out;
+}
+
+// HttpRequest
+HttpRequest::HttpRequest(uint8_t version, bool close)
+    : m_method(HttpMethod::GET),
+      m_version(version),
+      m_close(close),
+      m_websocket(false),
+      m_parsedParam(false),
+      m_path("/") {}
+
+void HttpRequest::setQuery(const std::string& v) {
+  m_query = v;
+  m_parsedParam = false;
+  m_params.clear();
+}
+
+std::string HttpRequest::getHeader(const std::string& key,
+                                   const std::string& def) const {
+  auto it = m_headers.find(key);
+  return it == m_headers.end() ? def : it->second;
+}
+
+void HttpRequest::setHeader(const std::string& key, const std::string& val) {
+  m_headers[key] = val;
+}
+
+void HttpRequest::delHeader(const std::string& key) {
+  m_headers.erase(key);
+}
+
+bool HttpRequest::hasHeader(const std::string& key, std::string* val) const {
+  auto it = m_headers.find(key);
+  if (it == m_headers.end()) {
+    return false;
+  }
+  if (val) {
+    *val = it->second;
+  }
+  return true;
+}
+
+void HttpRequest::initParam() {
+  if (m_parsedParam) {
+    return;
+  }
+  m_parsedParam = true;
+
+  size_t pos = 0;
+  while (pos < m_query.size()) {
+    size_t amp = m_query.find('&', pos);
+    if (amp == std::string::npos) {
+      amp = m_query.size();
+    }
+    size_t eq = m_query.find('=', pos);
+    if (eq != std::string::npos && eq < amp) {
+      m_params[UrlDecode(m_query.substr(pos, eq - pos))] =
+          UrlDecode(m_query.substr(eq + 1, amp - eq - 1));
+    } else if (amp > pos) {
+      m_params[UrlDecode(m_query.substr(pos, amp - pos))] = "";
+    }
+    pos = amp + 1;
+  }
+}
+
+std::string HttpRequest::getParam(const std::string& key,
+                                  const std::string& def) {
+  initParam();
+  auto it = m_params.find(key);
+  return it == m_params.end() ? def : it->second;
+}
+
+bool HttpRequest::hasParam(const std::string& key, std::string* val) {
+  initParam();
+  auto it = m_params.find(key);
+  if (it == m_params.end()) {
+    return false;
+  }
+  if (val) {
+    *val = it->second;
+  }
+  return true;
+}
+
+void HttpRequest::dumpHeader(std::string& out) const {
+  out.append(HttpMethodToString(m_method));
+  out.push_back(' ');
+  out.append(m_path);
+  if (!m_query.empty()) {
+    out.push_back('?');
+    out.append(m_query);
+  }
+  if (!m_fragment.empty()) {
+    out.push_back('#');
+    out.append(m_fragment);
+  }
+  out.push_back(' ');
+  AppendVersion(out, m_version);
+  out.append("\r\n", 2);
+
+  if (!m_websocket) {
+    out.append(m_close ? "Connection: close\r\n"
+                       : "Connection: keep-alive\r\n");
+  }
+  AppendHeaders(out, m_headers, true, !m_websocket);
+  if (!m_body.empty()) {
+    out.append("Content-Length: ");
+    AppendUint(out, m_body.size());
+    out.append("\r\n", 2);
+  }
+  out.append("\r\n", 2);
+}
+
+std::ostream& HttpRequest::dump(std::ostream& os) const {
+  std::string header;
+  dumpHeader(header);
+  return os << header << m_body;
+}
+
+std::string HttpRequest::toString() const {
+  std::stringstream ss;
+  dump(ss);
+  return ss.str();
+}
+
+// HttpResponse
+HttpResponse::HttpResponse(uint8_t version, bool close)
+    : m_status(HttpStatus::OK),
+      m_version(version),
+      m_close(close),
+      m_websocket(false) {}
+
+void HttpResponse::setBody(const std::string& v) {
+  m_body = v;
+  m_bodyRef = HttpBodyRef();
+}
+
+void HttpResponse::swapBody(std::string& v) {
+  m_body.swap(v);
+  m_bodyRef = HttpBodyRef();
+}
+
+void HttpResponse::setBodyRef(const void* data, size_t len,
+                              std::shared_ptr<void> holder) {
+  m_body.clear();
+  m_bodyRef = HttpBodyRef();
+  m_bodyRef.data = static_cast<const char*>(data);
+  m_bodyRef.length = len;
+  m_bodyRef.holder = holder;
+}
+
+void HttpResponse::setBodyFile(int fd, off_t offset, size_t len,
+                               std::shared_ptr<void> holder) {
+  m_body.clear();
+  m_bodyRef = HttpBodyRef();
+  m_bodyRef.fd = fd;
+  m_bodyRef.offset = offset;
+  m_bodyRef.length = len;
+  m_bodyRef.holder = holder;
+}
+
+std::string HttpResponse::getHeader(const std::string& key,
+                                    const std::string& def) const {
+  auto it = m_headers.find(key);
+  return it == m_headers.end() ? def : it->second;
+}
+
+void HttpResponse::setHeader(const std::string& key, const std::string& val) {
+  m_headers[key] = val;
+}
+
+void HttpResponse::delHeader(const std::string& key) {
+  m_headers.erase(key);
+}
+
+bool HttpResponse::hasHeader(const std::string& key, std::string* val) const {
+  auto it = m_headers.find(key);
+  if (it == m_headers.end()) {
+    return false;
+  }
+  if (val) {
+    *val = it->second;
+  }
+  return true;
+}
+
+void HttpResponse::dumpHeader(std::string& out) const {
+  AppendVersion(out, m_version);
+  out.push_back(' ');
+  AppendUint(out, static_cast<uint32_t>(m_status));
+  out.push_back(' ');
+  out.append(m_reason.empty() ? HttpStatusToString(m_status) : m_reason);
+  out.append("\r\n", 2);
+
+  if (!m_websocket) {
+    out.append(m_close ? "Connection: close\r\n"
+                       : "Connection: keep-alive\r\n");
+  }
+  // 有Content-Length时以调用者设置的为准(比如HEAD请求),
+  // 1xx/204/304没有body, 也不输出长度
+  uint32_t code = static_cast<uint32_t>(m_status);
+  bool has_length = m_websocket || code / 100 == 1 || code == 204 ||
+                    code == 304 || hasHeader("Content-Length");
+  AppendHeaders(out, m_headers, false, !m_websocket);
+  if (!has_length) {
+    out.append("Content-Length: ");
+    AppendUint(out, getBodySize());
+    out.append("\r\n", 2);
+  }
+  out.append("\r\n", 2);
+}
+
+std::ostream& HttpResponse::dump(std::ostream& os) const {
+  std::string header;
+  dumpHeader(header);
+  os << header;
+  if (m_bodyRef.data) {
+    return os.write(m_bodyRef.data, m_bodyRef.length);
+  } else if (m_bodyRef.fd >= 0) {
+    return os << "<file fd=" << m_bodyRef.fd << " offset=" << m_bodyRef.offset
+              << " length=" << m_bodyRef.length << ">";
+  }
+  return os << m_body;
+}
+
+std::string HttpResponse::toString() const {
+  std::stringstream ss;
+  dump(ss);
+  return ss.str();
+}
+
+std::ostream& operator<<(std::ostream& os, const HttpRequest& req) {
+  return req.dump(os);
+}
+
+std::ostream& operator<<(std::ostream& os, const HttpResponse& rsp) {
+  return rsp.dump(os);
+}
+
+}  // namespace http
+}  // namespace ddg
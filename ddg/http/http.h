@@ -0,0 +1,317 @@
+#ifndef DDG_HTTP_HTTP_H_
+#define DDG_HTTP_HTTP_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace ddg {
+namespace http {
+
+#define HTTP_METHOD_MAP(XX) \
+  XX(0, DELETE, DELETE)     \
+  XX(1, GET, GET)           \
+  XX(2, HEAD, HEAD)         \
+  XX(3, POST, POST)         \
+  XX(4, PUT, PUT)           \
+  XX(5, CONNECT, CONNECT)   \
+  XX(6, OPTIONS, OPTIONS)   \
+  XX(7, TRACE, TRACE)       \
+  XX(8, PATCH, PATCH)
+
+#define HTTP_STATUS_MAP(XX)                                                 \
+  XX(100, CONTINUE, Continue)                                               \
+  XX(101, SWITCHING_PROTOCOLS, Switching Protocols)                         \
+  XX(200, OK, OK)                                                           \
+  XX(201, CREATED, Created)                                                 \
+  XX(202, ACCEPTED, Accepted)                                               \
+  XX(204, NO_CONTENT, No Content)                                           \
+  XX(206, PARTIAL_CONTENT, Partial Content)                                 \
+  XX(301, MOVED_PERMANENTLY, Moved Permanently)                             \
+  XX(302, FOUND, Found)                                                     \
+  XX(304, NOT_MODIFIED, Not Modified)                                       \
+  XX(307, TEMPORARY_REDIRECT, Temporary Redirect)                           \
+  XX(400, BAD_REQUEST, Bad Request)                                         \
+  XX(401, UNAUTHORIZED, Unauthorized)                                       \
+  XX(403, FORBIDDEN, Forbidden)                                             \
+  XX(404, NOT_FOUND, Not Found)                                             \
+  XX(405, METHOD_NOT_ALLOWED, Method Not Allowed)                           \
+  XX(408, REQUEST_TIMEOUT, Request Timeout)                                 \
+  XX(411, LENGTH_REQUIRED, Length Required)                                 \
+  XX(412, PRECONDITION_FAILED, Precondition Failed)                         \
+  XX(413, PAYLOAD_TOO_LARGE, Payload Too Large)                             \
+  XX(414, URI_TOO_LONG, URI Too Long)                                       \
+  XX(416, RANGE_NOT_SATISFIABLE, Range Not Satisfiable)                     \
+  XX(426, UPGRADE_REQUIRED, Upgrade Required)                               \
+  XX(429, TOO_MANY_REQUESTS, Too Many Requests)                             \
+  XX(431, REQUEST_HEADER_FIELDS_TOO_LARGE, Request Header Fields Too Large) \
+  XX(500, INTERNAL_SERVER_ERROR, Internal Server Error)                     \
+  XX(501, NOT_IMPLEMENTED, Not Implemented)                                 \
+  XX(502, BAD_GATEWAY, Bad Gateway)                                         \
+  XX(503, SERVICE_UNAVAILABLE, Service Unavailable)                         \
+  XX(504, GATEWAY_TIMEOUT, Gateway Timeout)                                 \
+  XX(505, HTTP_VERSION_NOT_SUPPORTED, HTTP Version Not Supported)
+
+enum class HttpMethod {
+#define XX(num, name, string) name = num,
+  HTTP_METHOD_MAP(XX)
+#undef XX
+  INVALID_METHOD
+};
+
+enum class HttpStatus {
+#define XX(code, name, desc) name = code,
+  HTTP_STATUS_MAP(XX)
+#undef XX
+};
+
+/**
+ * @brief 指向外部缓冲区的字符串片段, 不持有内存
+ *
+ * C++11没有std::string_view, 解析器返回的方法、路径、头部都用它表示,
+ * 生命周期不能超过底层的缓冲区
+ */
+class StringView {
+ public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  StringView() : m_data(nullptr), m_size(0) {}
+
+  StringView(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+  StringView(const char* str) : m_data(str), m_size(str ? strlen(str) : 0) {}
+
+  StringView(const std::string& str)
+      : m_data(str.c_str()), m_size(str.size()) {}
+
+  const char* data() const { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  bool empty() const { return m_size == 0; }
+
+  const char* begin() const { return m_data; }
+
+  const char* end() const { return m_data + m_size; }
+
+  char operator[](size_t i) const { return m_data[i]; }
+
+  std::string toString() const { return std::string(m_data, m_size); }
+
+  StringView substr(size_t pos, size_t n = npos) const;
+
+  size_t find(char c, size_t pos = 0) const;
+
+  bool equalsIgnoreCase(const StringView& rhs) const;
+
+  bool operator==(const StringView& rhs) const;
+
+  bool operator!=(const StringView& rhs) const { return !(*this == rhs); }
+
+ private:
+  const char* m_data;
+  size_t m_size;
+};
+
+std::ostream& operator<<(std::ostream& os, const StringView& str);
+
+HttpMethod StringToHttpMethod(const StringView& m);
+
+const char* HttpMethodToString(const HttpMethod& m);
+
+const char* HttpStatusToString(const HttpStatus& s);
+
+// 头部名字不区分大小写
+struct CaseInsensitiveLess {
+  bool operator()(const std::string& lhs, const std::string& rhs) const;
+};
+
+class HttpRequest {
+ public:
+  using ptr = std::shared_ptr<HttpRequest>;
+  using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+
+  HttpRequest(uint8_t version = 0x11, bool close = true);
+
+  HttpMethod getMethod() const { return m_method; }
+
+  void setMethod(HttpMethod v) { m_method = v; }
+
+  uint8_t getVersion() const { return m_version; }
+
+  void setVersion(uint8_t v) { m_version = v; }
+
+  const std::string& getPath() const { return m_path; }
+
+  void setPath(const std::string& v) { m_path = v; }
+
+  const std::string& getQuery() const { return m_query; }
+
+  void setQuery(const std::string& v);
+
+  const std::string& getFragment() const { return m_fragment; }
+
+  void setFragment(const std::string& v) { m_fragment = v; }
+
+  const std::string& getBody() const { return m_body; }
+
+  void setBody(const std::string& v) { m_body = v; }
+
+  // 直接交换, 避免拷贝大的body
+  void swapBody(std::string& v) { m_body.swap(v); }
+
+  bool isClose() const { return m_close; }
+
+  void setClose(bool v) { m_close = v; }
+
+  bool isWebsocket() const { return m_websocket; }
+
+  void setWebsocket(bool v) { m_websocket = v; }
+
+  const MapType& getHeaders() const { return m_headers; }
+
+  void setHeaders(const MapType& v) { m_headers = v; }
+
+  std::string getHeader(const std::string& key,
+                        const std::string& def = "") const;
+
+  void setHeader(const std::string& key, const std::string& val);
+
+  void delHeader(const std::string& key);
+
+  bool hasHeader(const std::string& key, std::string* val = nullptr) const;
+
+  // query里的参数, 第一次访问时才解析
+  std::string getParam(const std::string& key, const std::string& def = "");
+
+  bool hasParam(const std::string& key, std::string* val = nullptr);
+
+  // 只输出请求行和头部, body由调用者另外发送
+  void dumpHeader(std::string& out) const;
+
+  std::ostream& dump(std::ostream& os) const;
+
+  std::string toString() const;
+
+ private:
+  void initParam();
+
+ private:
+  HttpMethod m_method;
+  uint8_t m_version;
+  bool m_close;
+  bool m_websocket;
+  bool m_parsedParam;
+  std::string m_path;
+  std::string m_query;
+  std::string m_fragment;
+  std::string m_body;
+  MapType m_headers;
+  MapType m_params;
+};
+
+/**
+ * @brief 不在std::string里的body
+ *
+ * 指向外部的内存(如mmap的文件)或者文件的一段(用sendfile发送),
+ * holder保证发送完成之前数据有效
+ */
+struct HttpBodyRef {
+  const char* data = nullptr;
+  int fd = -1;
+  off_t offset = 0;
+  size_t length = 0;
+  std::shared_ptr<void> holder;
+};
+
+class HttpResponse {
+ public:
+  using ptr = std::shared_ptr<HttpResponse>;
+  using MapType = HttpRequest::MapType;
+
+  HttpResponse(uint8_t version = 0x11, bool close = true);
+
+  HttpStatus getStatus() const { return m_status; }
+
+  void setStatus(HttpStatus v) { m_status = v; }
+
+  uint8_t getVersion() const { return m_version; }
+
+  void setVersion(uint8_t v) { m_version = v; }
+
+  const std::string& getBody() const { return m_body; }
+
+  void setBody(const std::string& v);
+
+  void swapBody(std::string& v);
+
+  // body指向外部内存, 发送时不拷贝
+  void setBodyRef(const void* data, size_t len, std::shared_ptr<void> holder);
+
+  // body是文件的一段, 发送时用sendfile
+  void setBodyFile(int fd, off_t offset, size_t len,
+                   std::shared_ptr<void> holder);
+
+  const HttpBodyRef& getBodyRef() const { return m_bodyRef; }
+
+  bool hasBodyRef() const { return m_bodyRef.data || m_bodyRef.fd >= 0; }
+
+  size_t getBodySize() const {
+    return hasBodyRef() ? m_bodyRef.length : m_body.size();
+  }
+
+  const std::string& getReason() const { return m_reason; }
+
+  void setReason(const std::string& v) { m_reason = v; }
+
+  bool isClose() const { return m_close; }
+
+  void setClose(bool v) { m_close = v; }
+
+  bool isWebsocket() const { return m_websocket; }
+
+  void setWebsocket(bool v) { m_websocket = v; }
+
+  const MapType& getHeaders() const { return m_headers; }
+
+  void setHeaders(const MapType& v) { m_headers = v; }
+
+  std::string getHeader(const std::string& key,
+                        const std::string& def = "") const;
+
+  void setHeader(const std::string& key, const std::string& val);
+
+  void delHeader(const std::string& key);
+
+  bool hasHeader(const std::string& key, std::string* val = nullptr) const;
+
+  // 只输出状态行和头部, body由调用者另外发送, 这样可以和body一起writev
+  void dumpHeader(std::string& out) const;
+
+  std::ostream& dump(std::ostream& os) const;
+
+  std::string toString() const;
+
+ private:
+  HttpStatus m_status;
+  uint8_t m_version;
+  bool m_close;
+  bool m_websocket;
+  std::string m_body;
+  HttpBodyRef m_bodyRef;
+  std::string m_reason;
+  MapType m_headers;
+};
+
+std::ostream& operator<<(std::ostream& os, const HttpRequest& req);
+
+std::ostream& operator<<(std::ostream& os, const HttpResponse& rsp);
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,515 @@
+#include "ddg/http/httpconnection.h"
+
+#include <strings.h>
+#include <sys/socket.h>
+#include <sstream>
+#include <vector>
+
+#include "ddg/hook.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+// body不超过这个大小时拷贝到写缓冲, 大的直接引用
+static const size_t kCopyBodySize = 4096;
+
+// 解析path[?query][#fragment]
+static void ParsePath(const std::string& str, size_t pos, HttpUrl& out) {
+  size_t hash = str.find('#', pos);
+  if (hash != std::string::npos) {
+    out.fragment = str.substr(hash + 1);
+  } else {
+    hash = str.size();
+  }
+  size_t question = str.find('?', pos);
+  if (question != std::string::npos && question < hash) {
+    out.query = str.substr(question + 1, hash - question - 1);
+  } else {
+    question = hash;
+  }
+  out.path = str.substr(pos, question - pos);
+  if (out.path.empty()) {
+    out.path = "/";
+  }
+}
+
+bool HttpUrl::Parse(const std::string& url, HttpUrl& out) {
+  static const char kScheme[] = "http://";
+  static const size_t kSchemeLen = sizeof(kScheme) - 1;
+  if (url.size() <= kSchemeLen ||
+      strncasecmp(url.c_str(), kScheme, kSchemeLen) != 0) {
+    return false;
+  }
+
+  size_t end = url.find_first_of("/?#", kSchemeLen);
+  if (end == std::string::npos) {
+    end = url.size();
+  }
+  std::string authority = url.substr(kSchemeLen, end - kSchemeLen);
+  size_t colon = std::string::npos;
+  if (!authority.empty() && authority[0] == '[') {
+    // [ipv6]:port
+    size_t bracket = authority.find(']');
+    if (bracket == std::string::npos) {
+      return false;
+    }
+    out.host = authority.substr(1, bracket - 1);
+    if (bracket + 1 < authority.size()) {
+      if (authority[bracket + 1] != ':') {
+        return false;
+      }
+      colon = bracket + 1;
+    }
+  } else {
+    colon = authority.rfind(':');
+    out.host = authority.substr(0, colon);
+  }
+  if (out.host.empty()) {
+    return false;
+  }
+
+  out.port = 80;
+  if (colon != std::string::npos) {
+    std::string port = authority.substr(colon + 1);
+    if (port.empty() || port.size() > 5 ||
+        port.find_first_not_of("0123456789") != std::string::npos) {
+      return false;
+    }
+    int v = atoi(port.c_str());
+    if (v <= 0 || v > 65535) {
+      return false;
+    }
+    out.port = v;
+  }
+
+  out.query.clear();
+  out.fragment.clear();
+  ParsePath(url, end, out);
+  return true;
+}
+
+std::string HttpResult::toString() const {
+  std::stringstream ss;
+  ss << "[HttpResult result=" << result << " error=" << error
+     << " response=" << (response ? response->toString() : "nullptr") << "]";
+  return ss.str();
+}
+
+static HttpRequest::ptr CreateRequest(HttpMethod method, const HttpUrl& url,
+                                      const HttpConnection::HeaderMap& headers,
+                                      const std::string& body, bool close) {
+  HttpRequest::ptr req(new HttpRequest(0x11, close));
+  req->setMethod(method);
+  req->setPath(url.path);
+  req->setQuery(url.query);
+  req->setFragment(url.fragment);
+  for (auto& i : headers) {
+    // Connection头由m_close决定, 不重复输出
+    if (strcasecmp(i.first.c_str(), "connection") == 0) {
+      req->setClose(strcasecmp(i.second.c_str(), "keep-alive") != 0);
+      continue;
+    }
+    req->setHeader(i.first, i.second);
+  }
+  req->setBody(body);
+  return req;
+}
+
+HttpResult::ptr HttpConnection::DoGet(const std::string& url,
+                                      uint64_t timeout_ms,
+                                      const HeaderMap& headers,
+                                      const std::string& body) {
+  return DoRequest(HttpMethod::GET, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnection::DoPost(const std::string& url,
+                                       uint64_t timeout_ms,
+                                       const HeaderMap& headers,
+                                       const std::string& body) {
+  return DoRequest(HttpMethod::POST, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnection::DoRequest(HttpMethod method,
+                                          const std::string& url,
+                                          uint64_t timeout_ms,
+                                          const HeaderMap& headers,
+                                          const std::string& body) {
+  HttpUrl u;
+  if (!HttpUrl::Parse(url, u)) {
+    return std::make_shared<HttpResult>(
+        static_cast<int>(HttpResult::Error::INVALID_URL), nullptr,
+        "invalid url: " + url);
+  }
+
+  IPAddress::ptr addr = Address::LookupAnyIPAddress(u.host);
+  if (!addr) {
+    return std::make_shared<HttpResult>(
+        static_cast<int>(HttpResult::Error::INVALID_HOST), nullptr,
+        "invalid host: " + u.host);
+  }
+  addr->setPort(u.port);
+
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  if (!sock) {
+    return std::make_shared<HttpResult>(
+        static_cast<int>(HttpResult::Error::CREATE_SOCKET_ERROR), nullptr,
+        "create socket fail: " + addr->toString() +
+            " errno=" + std::to_string(errno));
+  }
+  if (!sock->connect(addr, timeout_ms)) {
+    return std::make_shared<HttpResult>(
+        static_cast<int>(HttpResult::Error::CONNECT_FAIL), nullptr,
+        "connect fail: " + addr->toString());
+  }
+
+  HttpRequest::ptr req = CreateRequest(method, u, headers, body, true);
+  if (!req->hasHeader("Host")) {
+    req->setHeader("Host", u.host);
+  }
+  HttpConnection conn(sock);
+  return conn.request(req, timeout_ms);
+}
+
+HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
+    : HttpStream(sock, owner),
+      m_createTime(GetCurrentMilliSecond()),
+      m_lastUsedTime(m_createTime),
+      m_requestCount(0),
+      m_parser(HttpParser::RESPONSE) {}
+
+HttpConnection::~HttpConnection() {
+  DDG_LOG_DEBUG(g_logger) << "HttpConnection::~HttpConnection requests = "
+                          << m_requestCount;
+}
+
+HttpResponse::ptr HttpConnection::recvResponse(bool head) {
+  int ret = readHeader(m_parser, HttpParser::GetHttpResponseBufferSize());
+  if (ret <= 0) {
+    return nullptr;
+  }
+
+  HttpResponse::ptr rsp(
+      new HttpResponse(m_parser.getVersion(), !m_parser.isKeepAlive()));
+  rsp->setStatus(m_parser.getStatus());
+  rsp->setReason(m_parser.getReason().toString());
+  HttpResponse::MapType headers;
+  for (size_t i = 0; i < m_parser.getHeaderCount(); ++i) {
+    HttpHeaderView h = m_parser.getHeader(i);
+    headers[h.name.toString()] = h.value.toString();
+  }
+  rsp->setHeaders(headers);
+  consume(ret);
+
+  // 这些响应没有body
+  uint32_t code = static_cast<uint32_t>(m_parser.getStatus());
+  if (head || code / 100 == 1 || code == 204 || code == 304) {
+    return rsp;
+  }
+
+  // 既没有长度也不是chunked, body一直到连接关闭
+  bool until_close = !m_parser.isChunked() && !m_parser.hasContentLength();
+  std::string body;
+  if (readBody(m_parser, body, HttpParser::GetHttpResponseMaxBodySize(),
+               until_close) < 0) {
+    return nullptr;
+  }
+  if (until_close) {
+    rsp->setClose(true);
+  }
+  rsp->swapBody(body);
+  return rsp;
+}
+
+int HttpConnection::sendRequest(HttpRequest::ptr req) {
+  m_header.clear();
+  req->dumpHeader(m_header);
+  write(m_header.c_str(), m_header.size());
+
+  const std::string& body = req->getBody();
+  if (body.size() <= kCopyBodySize) {
+    write(body.c_str(), body.size());
+  } else {
+    writeRef(body.c_str(), body.size(), req);
+  }
+  return flush() ? 1 : -1;
+}
+
+// 超时回调和请求之间共享的状态. 请求结束后回调不能再shutdown, 否则fd
+// 可能已经关掉并被别的连接复用了
+namespace {
+struct RequestTimeout {
+  Mutex mutex;
+  bool finished = false;
+  bool timed_out = false;
+};
+}  // namespace
+
+HttpResult::ptr HttpConnection::request(HttpRequest::ptr req,
+                                        uint64_t timeout_ms) {
+  std::shared_ptr<RequestTimeout> state(new RequestTimeout);
+  Timer::ptr timer;
+  IOManager* iom = IOManager::GetThis();
+  if (iom && timeout_ms != ~0ull) {
+    Socket::ptr sock = m_socket;
+    timer = iom->addTimer(timeout_ms, [sock, state]() {
+      Mutex::Lock lock(state->mutex);
+      if (!state->finished) {
+        state->timed_out = true;
+        ::shutdown(sock->getSocket(), SHUT_RDWR);
+      }
+    });
+  }
+
+  int ret = sendRequest(req);
+  HttpResponse::ptr rsp;
+  if (ret > 0) {
+    rsp = recvResponse(req->getMethod() == HttpMethod::HEAD);
+  }
+  bool timed_out = false;
+  bool reusable = true;
+  if (timer) {
+    // cancel失败说明回调已经取出来了, 不确定有没有shutdown, 不能再复用
+    reusable = timer->cancel();
+    Mutex::Lock lock(state->mutex);
+    state->finished = true;
+    timed_out = state->timed_out;
+  }
+
+  if (timed_out) {
+    // 连接已经被shutdown了, 不能再复用
+    close();
+    if (!rsp) {
+      return std::make_shared<HttpResult>(
+          static_cast<int>(HttpResult::Error::TIMEOUT), nullptr,
+          "request timeout " + std::to_string(timeout_ms) + "ms");
+    }
+  } else if (ret <= 0) {
+    close();
+    return std::make_shared<HttpResult>(
+        static_cast<int>(HttpResult::Error::SEND_SOCKET_ERROR), nullptr,
+        "send request socket error errno=" + std::to_string(errno) +
+            " errstr=" + strerror(errno));
+  } else if (!rsp) {
+    close();
+    return std::make_shared<HttpResult>(
+        static_cast<int>(HttpResult::Error::RECV_ERROR), nullptr,
+        "recv response fail errno=" + std::to_string(errno));
+  }
+
+  if (rsp->isClose() || !reusable) {
+    close();
+  }
+  return std::make_shared<HttpResult>(
+      static_cast<int>(HttpResult::Error::OK), rsp, "ok");
+}
+
+HttpConnectionPool::ptr HttpConnectionPool::Create(const std::string& url,
+                                                   const std::string& vhost,
+                                                   uint32_t max_idle,
+                                                   uint32_t max_idle_time,
+                                                   uint32_t max_inflight) {
+  HttpUrl u;
+  if (!HttpUrl::Parse(url, u)) {
+    DDG_LOG_ERROR(g_logger) << "invalid url: " << url;
+    return nullptr;
+  }
+  return std::make_shared<HttpConnectionPool>(
+      u.host, vhost, u.port, max_idle, max_idle_time, max_inflight);
+}
+
+HttpConnectionPool::HttpConnectionPool(const std::string& host,
+                                       const std::string& vhost,
+                                       uint16_t port, uint32_t max_idle,
+                                       uint32_t max_idle_time,
+                                       uint32_t max_inflight)
+    : m_host(host),
+      m_vhost(vhost),
+      m_port(port),
+      m_maxIdle(max_idle),
+      m_maxIdleTime(max_idle_time),
+      m_maxInflight(max_inflight),
+      m_inflight(0),
+      m_connectCount(0) {}
+
+HttpConnectionPool::~HttpConnectionPool() {
+  for (auto i : m_conns) {
+    delete i;
+  }
+  m_conns.clear();
+}
+
+// 空闲连接对端关闭或者收到了多余的数据都不能再用,
+// 用原始的recv非阻塞地看一眼, 不走hook
+static bool IsIdleAlive(HttpConnection* conn) {
+  if (!conn->isConnected()) {
+    return false;
+  }
+  char c;
+  ssize_t n = recv_f(conn->getSocket()->getSocket(), &c, 1,
+                     MSG_PEEK | MSG_DONTWAIT);
+  return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(
+    uint64_t timeout_ms, HttpResult::Error* error) {
+  HttpResult::Error err = HttpResult::Error::OK;
+  if (++m_inflight > m_maxInflight) {
+    --m_inflight;
+    err = HttpResult::Error::TOO_MANY_INFLIGHT;
+    if (error) {
+      *error = err;
+    }
+    return nullptr;
+  }
+
+  uint64_t now = GetCurrentMilliSecond();
+  std::vector<HttpConnection*> invalid;
+  HttpConnection* ptr = nullptr;
+  Address::ptr addr;
+  {
+    MutexType::Lock lock(m_mutex);
+    // 最久没用的在前面, 先清掉超时的
+    while (!m_conns.empty() &&
+           m_conns.front()->m_lastUsedTime + m_maxIdleTime < now) {
+      invalid.push_back(m_conns.front());
+      m_conns.pop_front();
+    }
+    while (!m_conns.empty()) {
+      HttpConnection* conn = m_conns.back();
+      m_conns.pop_back();
+      if (IsIdleAlive(conn)) {
+        ptr = conn;
+        break;
+      }
+      invalid.push_back(conn);
+    }
+    addr = m_addr;
+  }
+  for (auto i : invalid) {
+    delete i;
+  }
+
+  if (!ptr) {
+    if (!addr) {
+      IPAddress::ptr ip = Address::LookupAnyIPAddress(m_host);
+      if (ip) {
+        ip->setPort(m_port);
+        addr = ip;
+        MutexType::Lock lock(m_mutex);
+        m_addr = addr;
+      }
+    }
+
+    Socket::ptr sock;
+    if (!addr) {
+      err = HttpResult::Error::INVALID_HOST;
+    } else if (!(sock = Socket::CreateTCP(addr))) {
+      err = HttpResult::Error::CREATE_SOCKET_ERROR;
+    } else if (!sock->connect(addr, timeout_ms)) {
+      err = HttpResult::Error::CONNECT_FAIL;
+    }
+    if (err != HttpResult::Error::OK) {
+      DDG_LOG_ERROR(g_logger) << "pool get connection fail host = " << m_host
+                              << ":" << m_port
+                              << " error = " << static_cast<int>(err)
+                              << " errno = " << errno;
+      --m_inflight;
+      if (error) {
+        *error = err;
+      }
+      return nullptr;
+    }
+    ++m_connectCount;
+    ptr = new HttpConnection(sock);
+  }
+
+  if (error) {
+    *error = err;
+  }
+  // 连接可能比池子活得久, 放回时池子已经没了就直接删掉
+  return HttpConnection::ptr(
+      ptr, std::bind(&HttpConnectionPool::ReleasePtr, std::placeholders::_1,
+                     std::weak_ptr<HttpConnectionPool>(shared_from_this())));
+}
+
+void HttpConnectionPool::ReleasePtr(HttpConnection* ptr,
+                                    std::weak_ptr<HttpConnectionPool> weak) {
+  HttpConnectionPool::ptr pool = weak.lock();
+  if (!pool) {
+    delete ptr;
+    return;
+  }
+  ++ptr->m_requestCount;
+  ptr->m_lastUsedTime = GetCurrentMilliSecond();
+  --pool->m_inflight;
+
+  // 关闭了或者还有没处理完的数据, 不能复用
+  if (!ptr->isConnected() || ptr->getBufferedSize() ||
+      ptr->getPendingSize()) {
+    delete ptr;
+    return;
+  }
+
+  {
+    MutexType::Lock lock(pool->m_mutex);
+    if (pool->m_conns.size() < pool->m_maxIdle) {
+      pool->m_conns.push_back(ptr);
+      return;
+    }
+  }
+  delete ptr;
+}
+
+HttpResult::ptr HttpConnectionPool::doGet(const std::string& url,
+                                          uint64_t timeout_ms,
+                                          const HeaderMap& headers,
+                                          const std::string& body) {
+  return doRequest(HttpMethod::GET, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doPost(const std::string& url,
+                                           uint64_t timeout_ms,
+                                           const HeaderMap& headers,
+                                           const std::string& body) {
+  return doRequest(HttpMethod::POST, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method,
+                                              const std::string& url,
+                                              uint64_t timeout_ms,
+                                              const HeaderMap& headers,
+                                              const std::string& body) {
+  HttpUrl u;
+  ParsePath(url, 0, u);
+  HttpRequest::ptr req = CreateRequest(method, u, headers, body, false);
+  return doRequest(req, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req,
+                                              uint64_t timeout_ms) {
+  HttpResult::Error err;
+  HttpConnection::ptr conn = getConnection(timeout_ms, &err);
+  if (!conn) {
+    return std::make_shared<HttpResult>(
+        static_cast<int>(err), nullptr,
+        "pool get connection fail host=" + m_host + ":" +
+            std::to_string(m_port));
+  }
+  if (!req->hasHeader("Host")) {
+    req->setHeader("Host", m_vhost.empty() ? m_host : m_vhost);
+  }
+  return conn->request(req, timeout_ms);
+}
+
+size_t HttpConnectionPool::getIdleCount() {
+  MutexType::Lock lock(m_mutex);
+  return m_conns.size();
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,194 @@
+#ifndef DDG_HTTP_HTTPCONNECTION_H_
+#define DDG_HTTP_HTTPCONNECTION_H_
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "ddg/address.h"
+#include "ddg/http/http.h"
+#include "ddg/http/httpparser.h"
+#include "ddg/http/httpstream.h"
+#include "ddg/mutex.h"
+
+namespace ddg {
+namespace http {
+
+// http://host[:port][/path][?query][#fragment]
+struct HttpUrl {
+  std::string host;
+  uint16_t port = 80;
+  std::string path = "/";
+  std::string query;
+  std::string fragment;
+
+  // 只支持http, 解析失败返回false
+  static bool Parse(const std::string& url, HttpUrl& out);
+};
+
+struct HttpResult {
+  using ptr = std::shared_ptr<HttpResult>;
+
+  enum class Error {
+    OK = 0,
+    INVALID_URL = 1,
+    INVALID_HOST = 2,
+    CONNECT_FAIL = 3,
+    SEND_CLOSE_BY_PEER = 4,
+    SEND_SOCKET_ERROR = 5,
+    TIMEOUT = 6,
+    CREATE_SOCKET_ERROR = 7,
+    POOL_GET_CONNECTION = 8,
+    TOO_MANY_INFLIGHT = 9,
+    RECV_ERROR = 10,
+  };
+
+  HttpResult(int _result, HttpResponse::ptr _response,
+             const std::string& _error)
+      : result(_result), response(_response), error(_error) {}
+
+  std::string toString() const;
+
+  int result;
+  HttpResponse::ptr response;
+  std::string error;
+};
+
+class HttpConnectionPool;
+
+// 客户端的一个HTTP连接
+class HttpConnection : public HttpStream {
+  friend class HttpConnectionPool;
+
+ public:
+  using ptr = std::shared_ptr<HttpConnection>;
+  using HeaderMap = std::map<std::string, std::string>;
+
+  static HttpResult::ptr DoGet(const std::string& url, uint64_t timeout_ms,
+                               const HeaderMap& headers = {},
+                               const std::string& body = "");
+
+  static HttpResult::ptr DoPost(const std::string& url, uint64_t timeout_ms,
+                                const HeaderMap& headers = {},
+                                const std::string& body = "");
+
+  static HttpResult::ptr DoRequest(HttpMethod method, const std::string& url,
+                                   uint64_t timeout_ms,
+                                   const HeaderMap& headers = {},
+                                   const std::string& body = "");
+
+  HttpConnection(Socket::ptr sock, bool owner = true);
+
+  ~HttpConnection();
+
+  /**
+   * @brief 接收一个响应
+   * @param head 对应的请求是HEAD, 响应没有body
+   */
+  HttpResponse::ptr recvResponse(bool head = false);
+
+  int sendRequest(HttpRequest::ptr req);
+
+  /**
+   * @brief 在这个连接上发送请求并等待响应
+   * @details 超时由IOManager的定时器控制: 到期后shutdown连接, 阻塞在收发上
+   *          的协程马上返回. 超时的连接不能再复用
+   */
+  HttpResult::ptr request(HttpRequest::ptr req, uint64_t timeout_ms);
+
+ private:
+  uint64_t m_createTime;
+  uint64_t m_lastUsedTime;
+  uint64_t m_requestCount;
+  HttpParser m_parser;
+  std::string m_header;
+};
+
+/**
+ * @brief 同一个host的长连接池
+ *
+ * 空闲连接按后进先出复用, 复用的连接不再connect. 空闲超过max_idle_time
+ * 的连接丢弃; 同时在用的连接数超过max_inflight时直接返回TOO_MANY_INFLIGHT.
+ * 必须由shared_ptr管理, 借出的连接只持有池子的weak_ptr
+ */
+class HttpConnectionPool
+    : public std::enable_shared_from_this<HttpConnectionPool> {
+ public:
+  using ptr = std::shared_ptr<HttpConnectionPool>;
+  using MutexType = Mutex;
+  using HeaderMap = HttpConnection::HeaderMap;
+
+  static HttpConnectionPool::ptr Create(const std::string& url,
+                                        const std::string& vhost,
+                                        uint32_t max_idle,
+                                        uint32_t max_idle_time,
+                                        uint32_t max_inflight);
+
+  /**
+   * @param vhost Host头, 为空时用host
+   * @param max_idle 最多保留的空闲连接数
+   * @param max_idle_time 空闲连接最长保留时间(毫秒)
+   * @param max_inflight 同时进行的请求数上限
+   */
+  HttpConnectionPool(const std::string& host, const std::string& vhost,
+                     uint16_t port, uint32_t max_idle, uint32_t max_idle_time,
+                     uint32_t max_inflight);
+
+  ~HttpConnectionPool();
+
+  /**
+   * @brief 取一个连接, 用完后析构时自动放回池子
+   * @param timeout_ms 需要新建连接时的connect超时
+   * @param error 失败原因
+   */
+  HttpConnection::ptr getConnection(uint64_t timeout_ms,
+                                    HttpResult::Error* error = nullptr);
+
+  HttpResult::ptr doGet(const std::string& url, uint64_t timeout_ms,
+                        const HeaderMap& headers = {},
+                        const std::string& body = "");
+
+  HttpResult::ptr doPost(const std::string& url, uint64_t timeout_ms,
+                         const HeaderMap& headers = {},
+                         const std::string& body = "");
+
+  // url是路径加参数, 如/path?a=1
+  HttpResult::ptr doRequest(HttpMethod method, const std::string& url,
+                            uint64_t timeout_ms,
+                            const HeaderMap& headers = {},
+                            const std::string& body = "");
+
+  HttpResult::ptr doRequest(HttpRequest::ptr req, uint64_t timeout_ms);
+
+  size_t getIdleCount();
+
+  uint32_t getInflight() const { return m_inflight; }
+
+  // 累计新建的连接数
+  uint64_t getConnectCount() const { return m_connectCount; }
+
+ private:
+  static void ReleasePtr(HttpConnection* ptr,
+                         std::weak_ptr<HttpConnectionPool> pool);
+
+ private:
+  std::string m_host;
+  std::string m_vhost;
+  uint16_t m_port;
+  uint32_t m_maxIdle;
+  uint32_t m_maxIdleTime;
+  uint32_t m_maxInflight;
+
+  MutexType m_mutex;
+  std::list<HttpConnection*> m_conns;  // 空闲连接, 最近用过的在后面
+  Address::ptr m_addr;
+  std::atomic<uint32_t> m_inflight;
+  std::atomic<uint64_t> m_connectCount;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,615 @@
+#include "ddg/http/httpparser.h"
+
+#include <string.h>
+#include <functional>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ddg/config.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+namespace http {
+
+static ConfigVar<uint64_t>::ptr g_http_request_buffer_size =
+    Config::Lookup<uint64_t>("http.request.buffer_size", 8 * 1024,
+                             "http request max header size");
+
+static ConfigVar<uint64_t>::ptr g_http_request_max_body_size =
+    Config::Lookup<uint64_t>("http.request.max_body_size", 64 * 1024 * 1024,
+                             "http request max body size");
+
+static ConfigVar<uint64_t>::ptr g_http_response_buffer_size =
+    Config::Lookup<uint64_t>("http.response.buffer_size", 8 * 1024,
+                             "http response max header size");
+
+static ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
+    Config::Lookup<uint64_t>("http.response.max_body_size", 64 * 1024 * 1024,
+                             "http response max body size");
+
+uint64_t HttpParser::GetHttpRequestBufferSize() {
+  return g_http_request_buffer_size->getValue();
+}
+
+uint64_t HttpParser::GetHttpRequestMaxBodySize() {
+  return g_http_request_max_body_size->getValue();
+}
+
+uint64_t HttpParser::GetHttpResponseBufferSize() {
+  return g_http_response_buffer_size->getValue();
+}
+
+uint64_t HttpParser::GetHttpResponseMaxBodySize() {
+  return g_http_response_max_body_size->getValue();
+}
+
+// RFC 7230 tchar
+struct TokenTable {
+  bool chars[256];
+
+  TokenTable() {
+    memset(chars, 0, sizeof(chars));
+    for (int c = '0'; c <= '9'; ++c) {
+      chars[c] = true;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+      chars[c] = true;
+      chars[c - 'a' + 'A'] = true;
+    }
+    for (const char* p = "!#$%&'*+-.^_`|~"; *p; ++p) {
+      chars[static_cast<unsigned char>(*p)] = true;
+    }
+  }
+};
+
+static const TokenTable s_token_table;
+
+static inline bool IsToken(const char* begin, const char* end) {
+  if (begin == end) {
+    return false;
+  }
+  for (; begin < end; ++begin) {
+    if (!s_token_table.chars[static_cast<unsigned char>(*begin)]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 找到第一个控制字符(除了HT), 包括'\r'和'\n', 没有则返回end
+static inline const char* FindControl(const char* p, const char* end) {
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // 有符号比较, 0x80以上的字节是负数, 不算控制字符
+    __m128i ctl =
+        _mm_andnot_si128(_mm_cmplt_epi8(v, zero), _mm_cmplt_epi8(v, space));
+    ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl);
+    ctl = _mm_or_si128(ctl, _mm_cmpeq_epi8(v, del));
+    int mask = _mm_movemask_epi8(ctl);
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  for (; p < end; ++p) {
+    unsigned char c = *p;
+    if ((c < 0x20 && c != '\t') || c == 0x7f) {
+      return p;
+    }
+  }
+  return end;
+}
+
+static inline const char* FindChar(const char* begin, const char* end,
+                                   char c) {
+  return static_cast<const char*>(memchr(begin, c, end - begin));
+}
+
+static inline bool IsOWS(char c) {
+  return c == ' ' || c == '\t';
+}
+
+HttpParser::HttpParser(Type type) : m_type(type) {
+  reset();
+}
+
+void HttpParser::reset() {
+  m_error = OK;
+  m_finished = false;
+  m_startLineDone = false;
+  m_data = nullptr;
+  m_lineBegin = 0;
+  m_scanned = 0;
+  m_method = HttpMethod::INVALID_METHOD;
+  m_methodField = m_uri = m_path = m_query = m_fragment = Field();
+  m_version = 0;
+  m_status = 0;
+  m_reason = Field();
+  m_headerCount = 0;
+  m_hasContentLength = false;
+  m_contentLength = 0;
+  m_chunked = false;
+  m_hasTransferEncoding = false;
+  m_connection = 0;
+  m_upgrade = false;
+}
+
+int HttpParser::execute(const char* data, size_t len) {
+  if (DDG_UNLIKELY(m_error != OK)) {
+    return -1;
+  }
+  m_data = data;
+  if (m_finished) {
+    return m_lineBegin;
+  }
+
+  uint64_t limit = m_type == REQUEST ? GetHttpRequestBufferSize()
+                                     : GetHttpResponseBufferSize();
+  const char* end = data + len;
+  while (true) {
+    const char* resume = nullptr;
+    const char* nl = findLineEnd(data + m_scanned, end, &resume);
+    if (!nl) {
+      if (m_error != OK) {
+        return -1;
+      }
+      m_scanned = resume - data;
+      if (len > limit) {
+        m_error = HEADER_TOO_LARGE;
+        return -1;
+      }
+      return 0;
+    }
+
+    const char* line_begin = data + m_lineBegin;
+    const char* line_end = nl;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+      --line_end;
+    }
+    size_t next = nl + 1 - data;
+
+    if (!m_startLineDone) {
+      // RFC 7230 3.5 请求行之前的空行忽略掉
+      if (line_end == line_begin && m_type == REQUEST) {
+        m_lineBegin = m_scanned = next;
+        continue;
+      }
+      bool ok = m_type == REQUEST ? parseRequestLine(line_begin, line_end)
+                                  : parseStatusLine(line_begin, line_end);
+      if (!ok) {
+        return -1;
+      }
+      m_startLineDone = true;
+    } else if (line_end == line_begin) {
+      m_lineBegin = m_scanned = next;
+      if (next > limit) {
+        m_error = HEADER_TOO_LARGE;
+        return -1;
+      }
+      // RFC 7230 3.3.3 请求有Transfer-Encoding但最后不是chunked时无法确定
+      // 长度, 只能拒绝, 否则前后两端理解不一致会被用来夹带请求
+      if (m_type == REQUEST && m_hasTransferEncoding && !m_chunked) {
+        m_error = INVALID_TRANSFER_ENCODING;
+        return -1;
+      }
+      // 同时带Content-Length和Transfer-Encoding的请求也拒绝, 不去猜
+      // 上游代理用的是哪一个
+      if (m_type == REQUEST && m_hasTransferEncoding && m_hasContentLength) {
+        m_error = INVALID_TRANSFER_ENCODING;
+        return -1;
+      }
+      m_finished = true;
+      return next;
+    } else if (!parseHeaderLine(line_begin, line_end)) {
+      return -1;
+    }
+    m_lineBegin = m_scanned = next;
+  }
+}
+
+const char* HttpParser::findLineEnd(const char* p, const char* end,
+                                    const char** resume) {
+  const char* q = FindControl(p, end);
+  if (q == end) {
+    *resume = end;
+    return nullptr;
+  }
+  if (*q == '\n') {
+    return q;
+  }
+  if (*q == '\r') {
+    if (q + 1 == end) {
+      *resume = q;  // '\r'后面的'\n'还没到
+      return nullptr;
+    }
+    if (q[1] == '\n') {
+      return q + 1;
+    }
+  }
+  m_error = !m_startLineDone
+                ? (m_type == REQUEST ? INVALID_URI : INVALID_STATUS)
+                : INVALID_HEADER;
+  return nullptr;
+}
+
+bool HttpParser::parseVersion(const char* begin, const char* end) {
+  if (end - begin != 8 || memcmp(begin, "HTTP/1.", 7) != 0 ||
+      (begin[7] != '0' && begin[7] != '1')) {
+    m_error = INVALID_VERSION;
+    return false;
+  }
+  m_version = begin[7] == '1' ? 0x11 : 0x10;
+  return true;
+}
+
+bool HttpParser::parseRequestLine(const char* begin, const char* end) {
+  const char* sp = FindChar(begin, end, ' ');
+  if (!sp || !IsToken(begin, sp)) {
+    m_error = INVALID_METHOD;
+    return false;
+  }
+  m_methodField = field(begin, sp);
+  m_method = StringToHttpMethod(view(m_methodField));
+  if (m_method == HttpMethod::INVALID_METHOD) {
+    m_error = INVALID_METHOD;
+    return false;
+  }
+
+  const char* uri = sp + 1;
+  sp = FindChar(uri, end, ' ');
+  if (!sp || sp == uri) {
+    m_error = INVALID_URI;
+    return false;
+  }
+  m_uri = field(uri, sp);
+  if (!parseVersion(sp + 1, end)) {
+    return false;
+  }
+
+  // absolute-form先跳过scheme和host
+  const char* path = uri;
+  if (*uri != '/' && *uri != '*') {
+    const char* scheme = FindChar(uri, sp, ':');
+    if (scheme && sp - scheme > 3 && scheme[1] == '/' && scheme[2] == '/') {
+      path = FindChar(scheme + 3, sp, '/');
+      if (!path) {
+        path = sp;
+      }
+    }
+  }
+
+  const char* fragment = FindChar(path, sp, '#');
+  const char* path_end = fragment ? fragment : sp;
+  const char* query = FindChar(path, path_end, '?');
+  m_path = field(path, query ? query : path_end);
+  if (query) {
+    m_query = field(query + 1, path_end);
+  }
+  if (fragment) {
+    m_fragment = field(fragment + 1, sp);
+  }
+  return true;
+}
+
+bool HttpParser::parseStatusLine(const char* begin, const char* end) {
+  const char* sp = FindChar(begin, end, ' ');
+  if (!sp || !parseVersion(begin, sp)) {
+    m_error = INVALID_VERSION;
+    return false;
+  }
+
+  const char* code = sp + 1;
+  if (end - code < 3) {
+    m_error = INVALID_STATUS;
+    return false;
+  }
+  m_status = 0;
+  for (int i = 0; i < 3; ++i) {
+    if (code[i] < '0' || code[i] > '9') {
+      m_error = INVALID_STATUS;
+      return false;
+    }
+    m_status = m_status * 10 + (code[i] - '0');
+  }
+
+  const char* reason = code + 3;
+  if (reason < end) {
+    if (*reason != ' ') {
+      m_error = INVALID_STATUS;
+      return false;
+    }
+    ++reason;
+  }
+  m_reason = field(reason, end);
+  return true;
+}
+
+bool HttpParser::parseHeaderLine(const char* begin, const char* end) {
+  // obs-fold已经废弃, 直接拒绝
+  const char* colon = FindChar(begin, end, ':');
+  if (!colon || !IsToken(begin, colon)) {
+    m_error = INVALID_HEADER;
+    return false;
+  }
+
+  if (DDG_UNLIKELY(m_headerCount == kMaxHeaders)) {
+    m_error = TOO_MANY_HEADERS;
+    return false;
+  }
+
+  const char* value = colon + 1;
+  while (value < end && IsOWS(*value)) {
+    ++value;
+  }
+  const char* value_end = end;
+  while (value_end > value && IsOWS(value_end[-1])) {
+    --value_end;
+  }
+
+  HeaderField& header = m_headers[m_headerCount++];
+  header.name = field(begin, colon);
+  header.value = field(value, value_end);
+  return onHeader(header);
+}
+
+// 按逗号分隔的列表里是否有token
+static void ForEachToken(const StringView& value,
+                         const std::function<void(const StringView&)>& cb) {
+  size_t pos = 0;
+  while (pos <= value.size()) {
+    size_t comma = value.find(',', pos);
+    if (comma == StringView::npos) {
+      comma = value.size();
+    }
+    size_t b = pos;
+    size_t e = comma;
+    while (b < e && IsOWS(value[b])) {
+      ++b;
+    }
+    while (e > b && IsOWS(value[e - 1])) {
+      --e;
+    }
+    if (e > b) {
+      cb(value.substr(b, e - b));
+    }
+    pos = comma + 1;
+  }
+}
+
+bool HttpParser::onHeader(const HeaderField& header) {
+  StringView name = view(header.name);
+  StringView value = view(header.value);
+
+  switch (name.size()) {
+    case 10:  // Connection
+      if (name.equalsIgnoreCase("Connection")) {
+        ForEachToken(value, [this](const StringView& token) {
+          if (token.equalsIgnoreCase("close")) {
+            m_connection = -1;
+          } else if (token.equalsIgnoreCase("keep-alive")) {
+            if (m_connection == 0) {
+              m_connection = 1;
+            }
+          } else if (token.equalsIgnoreCase("upgrade")) {
+            m_upgrade = true;
+          }
+        });
+      }
+      break;
+    case 14:  // Content-Length
+      if (name.equalsIgnoreCase("Content-Length")) {
+        if (value.empty()) {
+          m_error = INVALID_CONTENT_LENGTH;
+          return false;
+        }
+        uint64_t length = 0;
+        for (size_t i = 0; i < value.size(); ++i) {
+          char c = value[i];
+          if (c < '0' || c > '9' || length > (~0ull - 9) / 10) {
+            m_error = INVALID_CONTENT_LENGTH;
+            return false;
+          }
+          length = length * 10 + (c - '0');
+        }
+        if (m_hasContentLength && length != m_contentLength) {
+          m_error = INVALID_CONTENT_LENGTH;
+          return false;
+        }
+        m_hasContentLength = true;
+        m_contentLength = length;
+      }
+      break;
+    case 17:  // Transfer-Encoding
+      if (name.equalsIgnoreCase("Transfer-Encoding")) {
+        // 只看最后一个编码
+        bool chunked = false;
+        ForEachToken(value, [&chunked](const StringView& token) {
+          chunked = token.equalsIgnoreCase("chunked");
+        });
+        // 多个头部按一个列表处理, 以最后一个为准
+        m_chunked = chunked;
+        m_hasTransferEncoding = true;
+      }
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+HttpHeaderView HttpParser::getHeader(size_t idx) const {
+  HttpHeaderView header;
+  if (idx < m_headerCount) {
+    header.name = view(m_headers[idx].name);
+    header.value = view(m_headers[idx].value);
+  }
+  return header;
+}
+
+StringView HttpParser::getHeader(const StringView& name, bool* found) const {
+  for (size_t i = 0; i < m_headerCount; ++i) {
+    if (m_headers[i].name.length == name.size() &&
+        view(m_headers[i].name).equalsIgnoreCase(name)) {
+      if (found) {
+        *found = true;
+      }
+      return view(m_headers[i].value);
+    }
+  }
+  if (found) {
+    *found = false;
+  }
+  return StringView();
+}
+
+bool HttpParser::isKeepAlive() const {
+  if (m_connection != 0) {
+    return m_connection > 0;
+  }
+  return m_version == 0x11;
+}
+
+// HttpChunkedDecoder
+void HttpChunkedDecoder::reset() {
+  m_state = SIZE;
+  m_remaining = 0;
+  m_hexCount = 0;
+}
+
+static inline int DecodeHex(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+ssize_t HttpChunkedDecoder::decode(char* buf, size_t* len) {
+  size_t dst = 0;
+  size_t src = 0;
+  size_t bufsz = *len;
+
+  while (true) {
+    switch (m_state) {
+      case SIZE:
+        for (; src < bufsz; ++src) {
+          int v = DecodeHex(buf[src]);
+          if (v == -1) {
+            break;
+          }
+          if (m_hexCount == 16) {  // 超过64位
+            return -1;
+          }
+          m_remaining = m_remaining * 16 + v;
+          ++m_hexCount;
+        }
+        if (src == bufsz) {
+          goto incomplete;
+        }
+        // 数字后面只能是chunk-ext或者行尾, "1x"不能当成1
+        if (m_hexCount == 0 ||
+            (buf[src] != ';' && buf[src] != '\r' && buf[src] != '\n')) {
+          return -1;
+        }
+        m_hexCount = 0;
+        m_state = EXT;
+        // fall through
+      case EXT:
+        // chunk-ext直接跳过
+        for (; src < bufsz && buf[src] != '\n'; ++src) {
+        }
+        if (src == bufsz) {
+          goto incomplete;
+        }
+        ++src;
+        if (m_remaining == 0) {
+          m_state = TRAILER_HEAD;
+          break;
+        }
+        m_state = DATA;
+        // fall through
+      case DATA: {
+        size_t avail = bufsz - src;
+        if (avail < m_remaining) {
+          if (dst != src) {
+            memmove(buf + dst, buf + src, avail);
+          }
+          src += avail;
+          dst += avail;
+          m_remaining -= avail;
+          goto incomplete;
+        }
+        if (dst != src) {
+          memmove(buf + dst, buf + src, m_remaining);
+        }
+        src += m_remaining;
+        dst += m_remaining;
+        m_remaining = 0;
+        m_state = DATA_CRLF;
+      }
+        // fall through
+      case DATA_CRLF:
+        for (; src < bufsz && buf[src] == '\r'; ++src) {
+        }
+        if (src == bufsz) {
+          goto incomplete;
+        }
+        if (buf[src] != '\n') {
+          return -1;
+        }
+        ++src;
+        m_state = SIZE;
+        break;
+      case TRAILER_HEAD:
+        for (; src < bufsz && buf[src] == '\r'; ++src) {
+        }
+        if (src == bufsz) {
+          goto incomplete;
+        }
+        if (buf[src] == '\n') {
+          ++src;
+          m_state = DONE;
+          goto complete;
+        }
+        m_state = TRAILER_MIDDLE;
+        // fall through
+      case TRAILER_MIDDLE:
+        for (; src < bufsz && buf[src] != '\n'; ++src) {
+        }
+        if (src == bufsz) {
+          goto incomplete;
+        }
+        ++src;
+        m_state = TRAILER_HEAD;
+        break;
+      case DONE:
+        goto complete;
+    }
+  }
+
+complete : {
+  size_t left = bufsz - src;
+  if (left && dst != src) {
+    memmove(buf + dst, buf + src, left);
+  }
+  *len = dst;
+  return left;
+}
+
+incomplete:
+  *len = dst;
+  return -2;
+}
+
+}  // namespace http
+}  // namespace ddg
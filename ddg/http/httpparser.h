@@ -0,0 +1,224 @@
+#ifndef DDG_HTTP_HTTPPARSER_H_
+#define DDG_HTTP_HTTPPARSER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "ddg/http/http.h"
+
+namespace ddg {
+namespace http {
+
+struct HttpHeaderView {
+  StringView name;
+  StringView value;
+};
+
+/**
+ * @brief 增量式HTTP/1.x请求/响应头解析器
+ *
+ * 不做任何内存分配: 方法、路径、头部都记录为相对消息开头的偏移量,
+ * 通过StringView返回, 直接指向调用者的缓冲区. 调用者每收到一段数据就用
+ * 同一个消息开头和新的总长度再调用execute, 解析器从上次停下的位置继续扫描,
+ * 所以缓冲区扩容搬家也没有关系, 只要前面的内容不变.
+ * 找行尾和检查控制字符用SSE2一次比较16个字节
+ */
+class HttpParser {
+ public:
+  enum Type {
+    REQUEST = 0,
+    RESPONSE = 1,
+  };
+
+  enum Error {
+    OK = 0,
+    INVALID_METHOD,
+    INVALID_URI,
+    INVALID_VERSION,
+    INVALID_STATUS,
+    INVALID_HEADER,
+    INVALID_CONTENT_LENGTH,
+    INVALID_TRANSFER_ENCODING,  // 请求的最后一个编码不是chunked,
+                                // 或者同时带了Content-Length
+    TOO_MANY_HEADERS,
+    HEADER_TOO_LARGE,
+  };
+
+  static const size_t kMaxHeaders = 64;
+
+  explicit HttpParser(Type type = REQUEST);
+
+  // 开始解析下一个消息(keep-alive连接上复用)
+  void reset();
+
+  /**
+   * @brief 解析起始行和头部
+   * @param data 消息开头
+   * @param len 目前收到的总长度
+   * @return >0 头部解析完成, 值为头部长度(含空行); 0 数据不够; -1 出错
+   */
+  int execute(const char* data, size_t len);
+
+  bool isFinished() const { return m_finished; }
+
+  bool hasError() const { return m_error != OK; }
+
+  Error getError() const { return m_error; }
+
+  Type getType() const { return m_type; }
+
+  // 请求行
+  HttpMethod getMethod() const { return m_method; }
+
+  StringView getMethodString() const { return view(m_methodField); }
+
+  StringView getUri() const { return view(m_uri); }
+
+  StringView getPath() const { return view(m_path); }
+
+  StringView getQuery() const { return view(m_query); }
+
+  StringView getFragment() const { return view(m_fragment); }
+
+  // 0x10 or 0x11
+  uint8_t getVersion() const { return m_version; }
+
+  // 状态行
+  HttpStatus getStatus() const { return static_cast<HttpStatus>(m_status); }
+
+  StringView getReason() const { return view(m_reason); }
+
+  size_t getHeaderCount() const { return m_headerCount; }
+
+  HttpHeaderView getHeader(size_t idx) const;
+
+  // 头部名字不区分大小写, 不存在时返回空
+  StringView getHeader(const StringView& name, bool* found = nullptr) const;
+
+  bool hasContentLength() const { return m_hasContentLength; }
+
+  uint64_t getContentLength() const { return m_contentLength; }
+
+  bool isChunked() const { return m_chunked; }
+
+  bool isKeepAlive() const;
+
+  // Connection: Upgrade
+  bool isUpgrade() const { return m_upgrade; }
+
+  static uint64_t GetHttpRequestBufferSize();
+
+  static uint64_t GetHttpRequestMaxBodySize();
+
+  static uint64_t GetHttpResponseBufferSize();
+
+  static uint64_t GetHttpResponseMaxBodySize();
+
+ private:
+  struct Field {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  struct HeaderField {
+    Field name;
+    Field value;
+  };
+
+  StringView view(const Field& f) const {
+    return StringView(m_data + f.offset, f.length);
+  }
+
+  // 返回行尾'\n'的位置. 数据不够返回nullptr, 并通过resume给出下次继续扫描
+  // 的位置; 遇到非法的控制字符时设置错误
+  const char* findLineEnd(const char* p, const char* end,
+                          const char** resume);
+
+  bool parseRequestLine(const char* begin, const char* end);
+
+  bool parseStatusLine(const char* begin, const char* end);
+
+  bool parseVersion(const char* begin, const char* end);
+
+  bool parseHeaderLine(const char* begin, const char* end);
+
+  bool onHeader(const HeaderField& field);
+
+  Field field(const char* begin, const char* end) const {
+    Field f;
+    f.offset = begin - m_data;
+    f.length = end - begin;
+    return f;
+  }
+
+ private:
+  Type m_type;
+  Error m_error;
+  bool m_finished;
+  bool m_startLineDone;
+  const char* m_data;  // 最近一次execute传入的消息开头
+  size_t m_lineBegin;  // 当前行的开头
+  size_t m_scanned;    // 当前行已经检查过的位置, 下次从这里继续
+
+  HttpMethod m_method;
+  Field m_methodField;
+  Field m_uri;
+  Field m_path;
+  Field m_query;
+  Field m_fragment;
+  uint8_t m_version;
+  uint32_t m_status;
+  Field m_reason;
+
+  HeaderField m_headers[kMaxHeaders];
+  size_t m_headerCount;
+
+  bool m_hasContentLength;
+  uint64_t m_contentLength;
+  bool m_chunked;
+  bool m_hasTransferEncoding;
+  int8_t m_connection;  // -1 close, 0 未指定, 1 keep-alive
+  bool m_upgrade;
+};
+
+/**
+ * @brief 原地解码chunked编码的body
+ *
+ * 收到的数据可以分多次喂进来, 解码后的内容写回缓冲区开头
+ */
+class HttpChunkedDecoder {
+ public:
+  HttpChunkedDecoder() { reset(); }
+
+  void reset();
+
+  /**
+   * @param buf 新收到的数据, 解码后的body写回这里
+   * @param len 传入数据长度, 返回时为本次解码出的body长度
+   * @return >=0 全部解码完成, 值为最后一个chunk之后多出来的字节数,
+   *         这些字节紧跟在解码后的body后面; -1 出错; -2 需要更多数据
+   */
+  ssize_t decode(char* buf, size_t* len);
+
+  bool isFinished() const { return m_state == DONE; }
+
+ private:
+  enum State {
+    SIZE,
+    EXT,
+    DATA,
+    DATA_CRLF,
+    TRAILER_HEAD,
+    TRAILER_MIDDLE,
+    DONE,
+  };
+
+  State m_state;
+  uint64_t m_remaining;  // 当前chunk还没收到的字节数
+  int m_hexCount;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
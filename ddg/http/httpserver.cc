@@ -0,0 +1,67 @@
+#include "ddg/http/httpserver.h"
+
+#include "ddg/log.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+HttpServer::HttpServer(bool keepalive, IOManager* worker,
+                       IOManager* accept_worker)
+    : TcpServer(worker, accept_worker),
+      m_isKeepalive(keepalive),
+      m_dispatch(new ServletDispatch) {}
+
+void HttpServer::setName(const std::string& v) {
+  TcpServer::setName(v);
+  m_dispatch->setDefault(std::make_shared<NotFoundServlet>(v));
+}
+
+void HttpServer::stop(uint64_t timeout_ms) {
+  TcpServer::stop(timeout_ms);
+  m_dispatch->stop();
+}
+
+void HttpServer::handleClient(Socket::ptr client) {
+  DDG_LOG_DEBUG(g_logger) << "handleClient " << *client;
+  HttpSession::ptr session(new HttpSession(client));
+  while (true) {
+    HttpRequest::ptr req = session->recvRequest();
+    if (!req) {
+      if (session->hasParseError()) {
+        HttpResponse::ptr rsp(new HttpResponse(0x11, true));
+        rsp->setStatus(session->getErrorStatus());
+        rsp->setHeader("Server", getName());
+        session->sendResponse(rsp);
+      }
+      DDG_LOG_DEBUG(g_logger) << "recv http request fail, errno = " << errno
+                              << " errstr = " << strerror(errno)
+                              << " client: " << *client;
+      break;
+    }
+
+    if (req->isWebsocket()) {
+      // 握手之后这个连接不再是HTTP, 由WSServlet一直处理到断开
+      WSServlet::ptr ws = std::dynamic_pointer_cast<WSServlet>(
+          m_dispatch->getMatchedServlet(req->getPath()));
+      if (ws) {
+        ws->serve(req, session);
+        break;
+      }
+    }
+
+    HttpResponse::ptr rsp(
+        new HttpResponse(req->getVersion(), req->isClose() || !m_isKeepalive));
+    rsp->setHeader("Server", getName());
+    m_dispatch->handle(req, rsp, session);
+    if (session->sendResponse(rsp) <= 0 || rsp->isClose()) {
+      break;
+    }
+  }
+  session->flush();
+  session->close();
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,48 @@
+#ifndef DDG_HTTP_HTTPSERVER_H_
+#define DDG_HTTP_HTTPSERVER_H_
+
+#include <memory>
+
+#include "ddg/http/httpsession.h"
+#include "ddg/http/servlet.h"
+#include "ddg/http/wsservlet.h"
+#include "ddg/tcpserver.h"
+
+namespace ddg {
+namespace http {
+
+/**
+ * @brief HTTP/1.1服务器
+ *
+ * 支持长连接和pipelining: 一次收到的多个请求依次处理, 响应排队后合并成
+ * 一次writev发送
+ */
+class HttpServer : public TcpServer {
+ public:
+  using ptr = std::shared_ptr<HttpServer>;
+
+  HttpServer(bool keepalive = true,
+             IOManager* worker = IOManager::GetThis(),
+             IOManager* accept_worker = IOManager::GetThis());
+
+  ServletDispatch::ptr getServletDispatch() const { return m_dispatch; }
+
+  void setServletDispatch(ServletDispatch::ptr v) { m_dispatch = v; }
+
+  void setName(const std::string& v) override;
+
+  // 同时停止所有servlet, 让IOManager上不再留有它们的事件
+  void stop(uint64_t timeout_ms = 0) override;
+
+ protected:
+  void handleClient(Socket::ptr client) override;
+
+ private:
+  bool m_isKeepalive;
+  ServletDispatch::ptr m_dispatch;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,100 @@
+#include "ddg/http/httpsession.h"
+
+#include "ddg/log.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+// body不超过这个大小时拷贝到写缓冲, 大的直接引用
+static const size_t kCopyBodySize = 4096;
+
+// 排队的响应超过这个大小时不等pipelining直接发送
+static const size_t kMaxPendingSize = 64 * 1024;
+
+HttpSession::HttpSession(Socket::ptr sock, bool owner)
+    : HttpStream(sock, owner),
+      m_parser(HttpParser::REQUEST),
+      m_errorStatus(HttpStatus::OK) {}
+
+HttpRequest::ptr HttpSession::recvRequest() {
+  m_errorStatus = HttpStatus::OK;
+  uint64_t buff_size = HttpParser::GetHttpRequestBufferSize();
+  int ret = readHeader(m_parser, buff_size);
+  if (ret <= 0) {
+    if (ret == -2) {
+      m_errorStatus = m_parser.hasError()
+                          ? HttpStatus::BAD_REQUEST
+                          : HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE;
+    }
+    return nullptr;
+  }
+
+  // 解析结果指向读缓冲区, consume之前拷贝出来
+  HttpRequest::ptr req(
+      new HttpRequest(m_parser.getVersion(), !m_parser.isKeepAlive()));
+  req->setMethod(m_parser.getMethod());
+  StringView path = m_parser.getPath();
+  if (!path.empty()) {
+    req->setPath(path.toString());
+  }
+  req->setQuery(m_parser.getQuery().toString());
+  req->setFragment(m_parser.getFragment().toString());
+
+  HttpRequest::MapType headers;
+  for (size_t i = 0; i < m_parser.getHeaderCount(); ++i) {
+    HttpHeaderView h = m_parser.getHeader(i);
+    headers[h.name.toString()] = h.value.toString();
+  }
+  req->setHeaders(headers);
+  if (m_parser.isUpgrade() &&
+      m_parser.getHeader("Upgrade").equalsIgnoreCase("websocket")) {
+    req->setWebsocket(true);
+  }
+  consume(ret);
+
+  std::string body;
+  ret = readBody(m_parser, body, HttpParser::GetHttpRequestMaxBodySize());
+  if (ret < 0) {
+    if (ret == -2) {
+      m_errorStatus = m_parser.isChunked() ? HttpStatus::BAD_REQUEST
+                                           : HttpStatus::PAYLOAD_TOO_LARGE;
+    }
+    DDG_LOG_DEBUG(g_logger) << "recv http body fail ret = " << ret << " "
+                            << *m_socket;
+    return nullptr;
+  }
+  req->swapBody(body);
+  return req;
+}
+
+int HttpSession::sendResponse(HttpResponse::ptr rsp) {
+  m_header.clear();
+  rsp->dumpHeader(m_header);
+  write(m_header.c_str(), m_header.size());
+
+  const HttpBodyRef& ref = rsp->getBodyRef();
+  const std::string& body = rsp->getBody();
+  if (ref.fd >= 0) {
+    writeFile(ref.fd, ref.offset, ref.length, rsp);
+  } else if (ref.data) {
+    writeRef(ref.data, ref.length, rsp);
+  } else if (body.size() <= kCopyBodySize) {
+    write(body.c_str(), body.size());
+  } else {
+    writeRef(body.c_str(), body.size(), rsp);
+  }
+
+  // 缓冲区里还有下一个请求时先不发, 和后面的响应合并成一次writev
+  if (getBufferedSize() == 0 || getPendingSize() >= kMaxPendingSize ||
+      rsp->isClose()) {
+    if (!flush()) {
+      return -1;
+    }
+  }
+  return 1;
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,49 @@
+#ifndef DDG_HTTP_HTTPSESSION_H_
+#define DDG_HTTP_HTTPSESSION_H_
+
+#include <memory>
+#include <string>
+
+#include "ddg/http/http.h"
+#include "ddg/http/httpparser.h"
+#include "ddg/http/httpstream.h"
+
+namespace ddg {
+namespace http {
+
+// 服务端的一个HTTP连接
+class HttpSession : public HttpStream {
+ public:
+  using ptr = std::shared_ptr<HttpSession>;
+
+  HttpSession(Socket::ptr sock, bool owner = true);
+
+  /**
+   * @brief 接收一个请求
+   * @return 连接关闭或出错时返回nullptr, 出错原因见getErrorStatus
+   */
+  HttpRequest::ptr recvRequest();
+
+  bool hasParseError() const { return m_errorStatus != HttpStatus::OK; }
+
+  // 解析出错时应该回复的状态码, 没有出错时为OK
+  HttpStatus getErrorStatus() const { return m_errorStatus; }
+
+  /**
+   * @brief 发送响应
+   * @details 响应头和body先排队, 缓冲区里没有下一个请求(pipelining)时才
+   *          一次writev发出去
+   * @return >0 成功; <=0 失败
+   */
+  int sendResponse(HttpResponse::ptr rsp);
+
+ private:
+  HttpParser m_parser;
+  HttpStatus m_errorStatus;
+  std::string m_header;  // 复用, 避免每个响应都分配
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,333 @@
+#include "ddg/http/httpstream.h"
+
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static const size_t kInitBufferSize = 4096;
+
+// readTo每次最多准备这么多空间, 不按对方声明的长度一次分配
+static const size_t kReadToChunkSize = 64 * 1024;
+
+// readBody按收到的数据成倍扩大body, 最少扩到这么大
+static const size_t kBodyGrowSize = 64 * 1024;
+
+HttpStream::HttpStream(Socket::ptr sock, bool owner)
+    : m_socket(sock),
+      m_owner(owner),
+      m_buffer(kInitBufferSize, '\0'),
+      m_begin(0),
+      m_end(0),
+      m_pendingSize(0),
+      m_flushOnRead(true) {}
+
+HttpStream::~HttpStream() {
+  if (m_owner && m_socket) {
+    m_socket->close();
+  }
+}
+
+bool HttpStream::isConnected() const {
+  return m_socket && m_socket->isConnected();
+}
+
+void HttpStream::close() {
+  if (m_socket) {
+    m_socket->close();
+  }
+}
+
+bool HttpStream::flushBeforeRead() {
+  return !m_flushOnRead || !m_pendingSize || flush();
+}
+
+void HttpStream::consume(size_t n) {
+  DDG_ASSERT(n <= getBufferedSize());
+  m_begin += n;
+  if (m_begin == m_end) {
+    m_begin = m_end = 0;
+  }
+}
+
+int HttpStream::fill() {
+  if (!flushBeforeRead()) {
+    return -1;
+  }
+
+  if (m_end == m_buffer.size()) {
+    if (m_begin > 0) {
+      // 未处理的数据搬到开头, 解析器记录的是偏移量, 搬家不影响
+      memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+      m_end -= m_begin;
+      m_begin = 0;
+    } else {
+      m_buffer.resize(m_buffer.size() * 2);
+    }
+  }
+
+  int n = m_socket->recv(&m_buffer[m_end], m_buffer.size() - m_end);
+  if (n > 0) {
+    m_end += n;
+  }
+  return n;
+}
+
+int HttpStream::ensure(size_t n) {
+  while (getBufferedSize() < n) {
+    int ret = fill();
+    if (ret <= 0) {
+      return ret;
+    }
+  }
+  return 1;
+}
+
+int HttpStream::readTo(ByteArray& ba, size_t len) {
+  size_t copy = std::min(len, getBufferedSize());
+  ba.write(peek(), copy);
+  consume(copy);
+  len -= copy;
+
+  if (len && !flushBeforeRead()) {
+    return -1;
+  }
+  std::vector<iovec> iovs;
+  while (len) {
+    iovs.clear();
+    ba.getWriteBuffers(iovs, std::min(len, kReadToChunkSize));
+    int n = m_socket->recv(&iovs[0], iovs.size());
+    if (n <= 0) {
+      return n;
+    }
+    ba.commitWrite(n);
+    len -= n;
+  }
+  return 1;
+}
+
+int HttpStream::readHeader(HttpParser& parser, size_t max_size) {
+  parser.reset();
+  while (true) {
+    if (m_end > m_begin) {
+      int ret = parser.execute(peek(), getBufferedSize());
+      if (ret > 0) {
+        return ret;
+      } else if (ret < 0) {
+        DDG_LOG_DEBUG(g_logger) << "http parse error " << parser.getError()
+                                << " " << *m_socket;
+        return -2;
+      } else if (getBufferedSize() >= max_size) {
+        DDG_LOG_DEBUG(g_logger) << "http header too large "
+                                << getBufferedSize() << " " << *m_socket;
+        return -2;
+      }
+    }
+
+    int n = fill();
+    if (n <= 0) {
+      return n < 0 ? -1 : 0;
+    }
+  }
+}
+
+int HttpStream::readBody(const HttpParser& parser, std::string& body,
+                         uint64_t max_size, bool until_close) {
+  body.clear();
+  if (parser.isChunked()) {
+    HttpChunkedDecoder decoder;
+    while (true) {
+      if (m_end > m_begin) {
+        size_t len = getBufferedSize();
+        ssize_t left = decoder.decode(&m_buffer[m_begin], &len);
+        if (left == -1) {
+          return -2;
+        }
+        if (body.size() + len > max_size) {
+          return -2;
+        }
+        body.append(&m_buffer[m_begin], len);
+        if (left >= 0) {
+          // 多出来的数据紧跟在解码后的body后面, 是下一个消息
+          m_begin += len;
+          m_end = m_begin + left;
+          if (left == 0) {
+            m_begin = m_end = 0;
+          }
+          return 0;
+        }
+        m_begin = m_end = 0;
+      }
+
+      int n = fill();
+      if (n <= 0) {
+        return -1;
+      }
+    }
+  }
+
+  if (parser.hasContentLength()) {
+    uint64_t length = parser.getContentLength();
+    if (length > max_size) {
+      return -2;
+    }
+    size_t offset = std::min<uint64_t>(length, getBufferedSize());
+    body.assign(peek(), offset);
+    consume(offset);
+
+    // 剩下的直接收进body, 不经过缓冲区. Content-Length是对方声明的,
+    // 不能按它一次分配, 只声明不发送的连接也会占住max_size的内存
+    if (offset < length && !flushBeforeRead()) {
+      return -1;
+    }
+    while (offset < length) {
+      if (offset == body.size()) {
+        body.resize(std::min<uint64_t>(
+            length, std::max(offset * 2, kBodyGrowSize)));
+      }
+      int n = m_socket->recv(&body[offset], body.size() - offset);
+      if (n <= 0) {
+        return -1;
+      }
+      offset += n;
+    }
+    return 0;
+  }
+
+  if (until_close) {
+    while (true) {
+      if (body.size() + getBufferedSize() > max_size) {
+        return -2;
+      }
+      body.append(peek(), getBufferedSize());
+      consume(getBufferedSize());
+      int n = fill();
+      if (n < 0) {
+        return -1;
+      } else if (n == 0) {
+        return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+void HttpStream::write(const void* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  // 和上一段都在m_writeBuf里并且连续时直接合并
+  if (!m_pending.empty() && m_pending.back().data == nullptr &&
+      m_pending.back().fd < 0 &&
+      m_pending.back().offset + m_pending.back().len == m_writeBuf.size()) {
+    m_pending.back().len += len;
+  } else {
+    m_pending.push_back(Pending{nullptr, m_writeBuf.size(), len, -1});
+  }
+  m_writeBuf.append(static_cast<const char*>(data), len);
+  m_pendingSize += len;
+}
+
+void HttpStream::writeRef(const void* data, size_t len,
+                          std::shared_ptr<void> holder) {
+  if (len == 0) {
+    return;
+  }
+  m_pending.push_back(Pending{static_cast<const char*>(data), 0, len, -1});
+  if (holder) {
+    m_holders.push_back(holder);
+  }
+  m_pendingSize += len;
+}
+
+void HttpStream::writeFile(int fd, off_t offset, size_t len,
+                           std::shared_ptr<void> holder) {
+  if (len == 0) {
+    return;
+  }
+  m_pending.push_back(
+      Pending{nullptr, static_cast<size_t>(offset), len, fd});
+  if (holder) {
+    m_holders.push_back(holder);
+  }
+  m_pendingSize += len;
+}
+
+bool HttpStream::sendIovs(int flags) {
+  size_t idx = 0;
+  while (idx < m_iovs.size()) {
+    size_t count = std::min<size_t>(m_iovs.size() - idx, IOV_MAX);
+    int n = m_socket->send(&m_iovs[idx], count, flags);
+    if (n <= 0) {
+      DDG_LOG_DEBUG(g_logger) << "http flush fail n = " << n
+                              << " errno = " << errno << " " << *m_socket;
+      return false;
+    }
+    // 跳过已经写完的iovec, 写了一半的调整起点
+    size_t left = n;
+    while (idx < m_iovs.size() && left >= m_iovs[idx].iov_len) {
+      left -= m_iovs[idx].iov_len;
+      ++idx;
+    }
+    if (left) {
+      m_iovs[idx].iov_base = static_cast<char*>(m_iovs[idx].iov_base) + left;
+      m_iovs[idx].iov_len -= left;
+    }
+  }
+  return true;
+}
+
+bool HttpStream::sendFile(const Pending& p) {
+  off_t offset = p.offset;
+  size_t left = p.len;
+  while (left) {
+    int n = m_socket->sendFile(p.fd, &offset, left);
+    if (n <= 0) {
+      DDG_LOG_DEBUG(g_logger) << "http sendfile fail n = " << n
+                              << " errno = " << errno << " " << *m_socket;
+      return false;
+    }
+    left -= n;
+  }
+  return true;
+}
+
+bool HttpStream::flush() {
+  bool ok = true;
+  size_t i = 0;
+  while (ok && i < m_pending.size()) {
+    if (m_pending[i].fd >= 0) {
+      ok = sendFile(m_pending[i++]);
+      continue;
+    }
+
+    // 连续的内存段合并成一次writev, m_writeBuf可能扩容过,
+    // 到这里才把偏移量换成指针
+    m_iovs.clear();
+    for (; i < m_pending.size() && m_pending[i].fd < 0; ++i) {
+      const Pending& p = m_pending[i];
+      iovec iov;
+      iov.iov_base =
+          const_cast<char*>(p.data ? p.data : &m_writeBuf[p.offset]);
+      iov.iov_len = p.len;
+      m_iovs.push_back(iov);
+    }
+    ok = sendIovs(i < m_pending.size() ? MSG_MORE : 0);
+  }
+
+  m_pending.clear();
+  m_holders.clear();
+  m_writeBuf.clear();
+  m_pendingSize = 0;
+  return ok;
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,136 @@
+#ifndef DDG_HTTP_HTTPSTREAM_H_
+#define DDG_HTTP_HTTPSTREAM_H_
+
+#include <sys/uio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/bytearray.h"
+#include "ddg/http/httpparser.h"
+#include "ddg/noncopyable.h"
+#include "ddg/socket.h"
+
+namespace ddg {
+namespace http {
+
+/**
+ * @brief HTTP连接上的读写缓冲, 服务端和客户端共用
+ *
+ * 读: 数据收进一块连续的缓冲区, 直接交给HttpParser解析, 一次recv收到的
+ *     多个请求(pipelining)会留在缓冲区里给下一次用.
+ * 写: 待发送的数据先排队, flush时用一次writev全部发出去, 文件内容用
+ *     sendfile. 默认任何会阻塞的recv之前都会先flush, 所以pipelining的多个
+ *     响应可以合并成一次写.
+ * 读写缓冲都不加锁, 只能在一个协程里用; 有其他协程单独发送的连接
+ * (WebSocket)要关掉读之前的flush, 由发送方自己加锁flush
+ */
+class HttpStream : public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<HttpStream>;
+
+  HttpStream(Socket::ptr sock, bool owner = true);
+
+  virtual ~HttpStream();
+
+  /**
+   * @brief 读取并解析一个消息头, 解析结果指向内部缓冲区
+   * @param max_size 头部最大长度
+   * @return >0 头部长度; 0 对端关闭; -1 读出错或超时; -2 解析出错或头部太大
+   */
+  int readHeader(HttpParser& parser, size_t max_size);
+
+  /**
+   * @brief 读取readHeader之后的body, 调用前要先consume掉头部
+   * @param until_close 没有长度信息时是否一直读到连接关闭(用于响应)
+   * @return -1 读出错; -2 格式错误或超过max_size; 0 成功
+   */
+  int readBody(const HttpParser& parser, std::string& body, uint64_t max_size,
+               bool until_close = false);
+
+  // 缓冲区里还没处理的数据
+  const char* peek() const { return &m_buffer[m_begin]; }
+
+  size_t getBufferedSize() const { return m_end - m_begin; }
+
+  void consume(size_t n);
+
+  /**
+   * @brief 保证缓冲区里至少有n字节
+   * @return >0 成功; 0 对端关闭; -1 读出错
+   */
+  int ensure(size_t n);
+
+  /**
+   * @brief 读取len字节追加到ba
+   * @details 缓冲区里已有的先拷贝过去, 剩下的直接recv进ba的内存块,
+   *          内存随收到的数据分段增加, 不按len一次分配
+   * @return >0 成功; 0 对端关闭; -1 读出错
+   */
+  int readTo(ByteArray& ba, size_t len);
+
+  // 拷贝到内部的写缓冲
+  void write(const void* data, size_t len);
+
+  // 不拷贝, holder保证flush之前数据有效
+  void writeRef(const void* data, size_t len, std::shared_ptr<void> holder);
+
+  // 文件的一段, flush时用sendfile发送
+  void writeFile(int fd, off_t offset, size_t len,
+                 std::shared_ptr<void> holder);
+
+  size_t getPendingSize() const { return m_pendingSize; }
+
+  // recv之前是否先把排队的数据flush出去, 默认打开
+  void setFlushOnRead(bool v) { m_flushOnRead = v; }
+
+  // 把排队的数据一次writev发出去, 中间有文件时用sendfile
+  bool flush();
+
+  Socket::ptr getSocket() const { return m_socket; }
+
+  bool isConnected() const;
+
+  void close();
+
+ protected:
+  // 先flush, 再往缓冲区里收一次数据
+  int fill();
+
+  // 打开了setFlushOnRead并且有排队的数据时flush
+  bool flushBeforeRead();
+
+ private:
+  struct Pending {
+    const char* data;  // nullptr时数据在m_writeBuf的offset处
+    size_t offset;     // fd>=0时为文件偏移
+    size_t len;
+    int fd;
+  };
+
+  // 发送m_iovs, flags里带MSG_MORE时后面还有文件要发
+  bool sendIovs(int flags);
+
+  bool sendFile(const Pending& p);
+
+ protected:
+  Socket::ptr m_socket;
+  bool m_owner;
+
+ private:
+  std::string m_buffer;
+  size_t m_begin;
+  size_t m_end;
+
+  std::string m_writeBuf;
+  std::vector<Pending> m_pending;
+  std::vector<std::shared_ptr<void>> m_holders;
+  std::vector<iovec> m_iovs;
+  size_t m_pendingSize;
+  bool m_flushOnRead;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,280 @@
+#include "ddg/http/servlet.h"
+
+#include <fnmatch.h>
+#include <string.h>
+#include <algorithm>
+
+namespace ddg {
+namespace http {
+
+FunctionServlet::FunctionServlet(callback cb)
+    : Servlet("FunctionServlet"), m_cb(cb) {}
+
+int32_t FunctionServlet::handle(HttpRequest::ptr request,
+                                HttpResponse::ptr response,
+                                HttpSession::ptr session) {
+  return m_cb(request, response, session);
+}
+
+NotFoundServlet::NotFoundServlet(const std::string& name)
+    : Servlet("NotFoundServlet") {
+  m_content =
+      "<html><head><title>404 Not Found</title></head><body><center>"
+      "<h1>404 Not Found</h1></center><hr><center>" +
+      name + "</center></body></html>";
+}
+
+int32_t NotFoundServlet::handle(HttpRequest::ptr request,
+                                HttpResponse::ptr response,
+                                HttpSession::ptr session) {
+  response->setStatus(HttpStatus::NOT_FOUND);
+  response->setHeader("Content-Type", "text/html");
+  response->setBody(m_content);
+  return 0;
+}
+
+struct ServletDispatch::Node {
+  ~Node() {
+    for (auto i : children) {
+      delete i;
+    }
+    for (auto i : globs) {
+      delete i;
+    }
+  }
+
+  std::string segment;
+  Servlet::ptr exact;   // 路径正好结束在这个节点
+  Servlet::ptr prefix;  // 这个节点以及下面的所有路径
+  std::vector<Node*> children;  // 普通段, 按segment排序, 二分查找
+  std::vector<Node*> globs;     // 含通配符的段, 按注册顺序逐个匹配
+};
+
+// 跳过开头的'/', 取出下一段, path指向剩下的部分
+static StringView NextSegment(StringView& path) {
+  size_t begin = 0;
+  while (begin < path.size() && path[begin] == '/') {
+    ++begin;
+  }
+  size_t end = path.find('/', begin);
+  if (end == StringView::npos) {
+    end = path.size();
+  }
+  StringView seg = path.substr(begin, end - begin);
+  path = path.substr(end);
+  return seg;
+}
+
+static int CompareSegment(const std::string& lhs, const StringView& rhs) {
+  int ret = memcmp(lhs.c_str(), rhs.data(), std::min(lhs.size(), rhs.size()));
+  if (ret) {
+    return ret;
+  }
+  return lhs.size() < rhs.size() ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+static bool IsGlob(const StringView& seg) {
+  for (char c : seg) {
+    if (c == '*' || c == '?' || c == '[') {
+      return true;
+    }
+  }
+  return false;
+}
+
+ServletDispatch::ServletDispatch()
+    : Servlet("ServletDispatch"), m_root(new Node) {
+  m_default.reset(new NotFoundServlet("ddg/1.0"));
+}
+
+ServletDispatch::~ServletDispatch() {
+  delete m_root;
+}
+
+int32_t ServletDispatch::handle(HttpRequest::ptr request,
+                                HttpResponse::ptr response,
+                                HttpSession::ptr session) {
+  Servlet::ptr slt = getMatchedServlet(request->getPath());
+  if (slt) {
+    slt->handle(request, response, session);
+  }
+  return 0;
+}
+
+void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
+  add(uri, slt, EXACT);
+}
+
+void ServletDispatch::addServlet(const std::string& uri,
+                                 FunctionServlet::callback cb) {
+  add(uri, std::make_shared<FunctionServlet>(cb), EXACT);
+}
+
+void ServletDispatch::addPrefixServlet(const std::string& uri,
+                                       Servlet::ptr slt) {
+  add(uri, slt, PREFIX);
+}
+
+void ServletDispatch::addPrefixServlet(const std::string& uri,
+                                       FunctionServlet::callback cb) {
+  add(uri, std::make_shared<FunctionServlet>(cb), PREFIX);
+}
+
+void ServletDispatch::addGlobServlet(const std::string& uri,
+                                     Servlet::ptr slt) {
+  add(uri, slt, GLOB);
+}
+
+void ServletDispatch::addGlobServlet(const std::string& uri,
+                                     FunctionServlet::callback cb) {
+  add(uri, std::make_shared<FunctionServlet>(cb), GLOB);
+}
+
+void ServletDispatch::add(const std::string& uri, Servlet::ptr slt,
+                          Kind kind) {
+  RWMutexType::WriteLock lock(m_mutex);
+  Node* node = m_root;
+  StringView path(uri);
+  while (true) {
+    StringView seg = NextSegment(path);
+    if (seg.empty()) {
+      break;
+    }
+
+    Node* next = nullptr;
+    if (kind == GLOB && IsGlob(seg)) {
+      for (auto i : node->globs) {
+        if (CompareSegment(i->segment, seg) == 0) {
+          next = i;
+          break;
+        }
+      }
+      if (!next) {
+        next = new Node;
+        next->segment = seg.toString();
+        node->globs.push_back(next);
+      }
+    } else {
+      auto it = std::lower_bound(
+          node->children.begin(), node->children.end(), seg,
+          [](const Node* n, const StringView& s) {
+            return CompareSegment(n->segment, s) < 0;
+          });
+      if (it != node->children.end() &&
+          CompareSegment((*it)->segment, seg) == 0) {
+        next = *it;
+      } else {
+        next = new Node;
+        next->segment = seg.toString();
+        node->children.insert(it, next);
+      }
+    }
+    node = next;
+  }
+
+  if (kind == PREFIX) {
+    node->prefix = slt;
+  } else {
+    node->exact = slt;
+  }
+}
+
+const Servlet::ptr* ServletDispatch::Match(const Node* node, StringView path,
+                                           size_t depth,
+                                           PrefixMatch& prefix) {
+  // 深度相同时先走到的精确分支优先
+  if (node->prefix && (!prefix.servlet || depth > prefix.depth)) {
+    prefix.servlet = &node->prefix;
+    prefix.depth = depth;
+  }
+  StringView seg = NextSegment(path);
+  if (seg.empty()) {
+    return node->exact ? &node->exact : nullptr;
+  }
+
+  auto it = std::lower_bound(node->children.begin(), node->children.end(),
+                             seg, [](const Node* n, const StringView& s) {
+                               return CompareSegment(n->segment, s) < 0;
+                             });
+  if (it != node->children.end() && CompareSegment((*it)->segment, seg) == 0) {
+    const Servlet::ptr* ret = Match(*it, path, depth + 1, prefix);
+    if (ret) {
+      return ret;
+    }
+  }
+
+  if (!node->globs.empty()) {
+    // fnmatch要求'\0'结尾, 段比较短时不用分配内存
+    char buf[256];
+    std::string long_seg;
+    const char* str = buf;
+    if (seg.size() < sizeof(buf)) {
+      memcpy(buf, seg.data(), seg.size());
+      buf[seg.size()] = '\0';
+    } else {
+      long_seg = seg.toString();
+      str = long_seg.c_str();
+    }
+    for (auto i : node->globs) {
+      if (fnmatch(i->segment.c_str(), str, 0) == 0) {
+        const Servlet::ptr* ret = Match(i, path, depth + 1, prefix);
+        if (ret) {
+          return ret;
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+void ServletDispatch::Collect(const Node* node,
+                              std::vector<Servlet::ptr>& servlets) {
+  if (node->exact) {
+    servlets.push_back(node->exact);
+  }
+  if (node->prefix) {
+    servlets.push_back(node->prefix);
+  }
+  for (auto i : node->children) {
+    Collect(i, servlets);
+  }
+  for (auto i : node->globs) {
+    Collect(i, servlets);
+  }
+}
+
+void ServletDispatch::stop() {
+  std::vector<Servlet::ptr> servlets;
+  {
+    RWMutexType::ReadLock lock(m_mutex);
+    Collect(m_root, servlets);
+    servlets.push_back(m_default);
+  }
+  // 同一个servlet可能注册在多个路径上, stop要能重复调用
+  for (auto& i : servlets) {
+    i->stop();
+  }
+}
+
+Servlet::ptr ServletDispatch::getDefault() {
+  RWMutexType::ReadLock lock(m_mutex);
+  return m_default;
+}
+
+void ServletDispatch::setDefault(Servlet::ptr v) {
+  RWMutexType::WriteLock lock(m_mutex);
+  m_default = v;
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri) {
+  RWMutexType::ReadLock lock(m_mutex);
+  PrefixMatch prefix;
+  const Servlet::ptr* slt = Match(m_root, StringView(uri), 0, prefix);
+  if (!slt) {
+    slt = prefix.servlet;
+  }
+  return slt ? *slt : m_default;
+}
+
+}  // namespace http
+}  // namespace ddg
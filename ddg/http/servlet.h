@@ -0,0 +1,146 @@
+#ifndef DDG_HTTP_SERVLET_H_
+#define DDG_HTTP_SERVLET_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/http/http.h"
+#include "ddg/http/httpsession.h"
+#include "ddg/mutex.h"
+#include "ddg/noncopyable.h"
+
+namespace ddg {
+namespace http {
+
+class Servlet {
+ public:
+  using ptr = std::shared_ptr<Servlet>;
+
+  Servlet(const std::string& name) : m_name(name) {}
+
+  virtual ~Servlet() {}
+
+  virtual int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                         HttpSession::ptr session) = 0;
+
+  const std::string& getName() const { return m_name; }
+
+  // 服务器停止时调用, 去掉挂在IOManager上的事件和定时器
+  virtual void stop() {}
+
+ protected:
+  std::string m_name;
+};
+
+class FunctionServlet : public Servlet {
+ public:
+  using ptr = std::shared_ptr<FunctionServlet>;
+  using callback = std::function<int32_t(
+      HttpRequest::ptr request, HttpResponse::ptr response,
+      HttpSession::ptr session)>;
+
+  FunctionServlet(callback cb);
+
+  int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                 HttpSession::ptr session) override;
+
+ private:
+  callback m_cb;
+};
+
+class NotFoundServlet : public Servlet {
+ public:
+  using ptr = std::shared_ptr<NotFoundServlet>;
+
+  NotFoundServlet(const std::string& name);
+
+  int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                 HttpSession::ptr session) override;
+
+ private:
+  std::string m_content;
+};
+
+/**
+ * @brief 按路径分发请求
+ *
+ * 注册时把路径按'/'切成段, 编译进一棵前缀树, 匹配时逐段查找, 不用
+ * 遍历所有规则. 优先级: 精确匹配 > 通配(glob)匹配 > 最长前缀匹配 > 默认.
+ * 只要有规则完整匹配了整个路径, 就不会用前缀规则.
+ * 通配规则里含有*?[的段用fnmatch匹配, 每段只匹配一级目录
+ */
+class ServletDispatch : public Servlet, NonCopyable {
+ public:
+  using ptr = std::shared_ptr<ServletDispatch>;
+  using RWMutexType = RWMutex;
+
+  ServletDispatch();
+
+  ~ServletDispatch();
+
+  int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                 HttpSession::ptr session) override;
+
+  // 路径完全一致, 如/ping
+  void addServlet(const std::string& uri, Servlet::ptr slt);
+
+  void addServlet(const std::string& uri, FunctionServlet::callback cb);
+
+  // uri本身以及它下面的所有路径, 如/static匹配/static/js/a.js
+  void addPrefixServlet(const std::string& uri, Servlet::ptr slt);
+
+  void addPrefixServlet(const std::string& uri, FunctionServlet::callback cb);
+
+  // 段内通配, 如/user/*/info
+  void addGlobServlet(const std::string& uri, Servlet::ptr slt);
+
+  void addGlobServlet(const std::string& uri, FunctionServlet::callback cb);
+
+  Servlet::ptr getDefault();
+
+  void setDefault(Servlet::ptr v);
+
+  // 停止注册的所有servlet
+  void stop() override;
+
+  Servlet::ptr getMatchedServlet(const std::string& uri);
+
+ private:
+  struct Node;
+
+  enum Kind {
+    EXACT,
+    PREFIX,
+    GLOB,
+  };
+
+  void add(const std::string& uri, Servlet::ptr slt, Kind kind);
+
+  // 走过的节点上最深的前缀规则
+  struct PrefixMatch {
+    const Servlet::ptr* servlet = nullptr;
+    size_t depth = 0;
+  };
+
+  /**
+   * @brief 找完整匹配整个路径的精确或通配规则, 顺路记下最长的前缀规则
+   * @return 指向节点里servlet的指针, 没有完整匹配返回nullptr
+   */
+  static const Servlet::ptr* Match(const Node* node, StringView path,
+                                   size_t depth, PrefixMatch& prefix);
+
+  // node以及下面所有节点上的servlet
+  static void Collect(const Node* node, std::vector<Servlet::ptr>& servlets);
+
+ private:
+  RWMutexType m_mutex;
+  Node* m_root;
+  Servlet::ptr m_default;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,144 @@
+#include "ddg/http/staticservlet.h"
+
+#include <strings.h>
+
+namespace ddg {
+namespace http {
+
+static const char* GetContentType(const std::string& path) {
+  static const struct {
+    const char* ext;
+    const char* type;
+  } kTypes[] = {
+      {"html", "text/html"},
+      {"htm", "text/html"},
+      {"css", "text/css"},
+      {"js", "application/javascript"},
+      {"json", "application/json"},
+      {"txt", "text/plain"},
+      {"xml", "text/xml"},
+      {"png", "image/png"},
+      {"jpg", "image/jpeg"},
+      {"jpeg", "image/jpeg"},
+      {"gif", "image/gif"},
+      {"svg", "image/svg+xml"},
+      {"ico", "image/x-icon"},
+      {"wasm", "application/wasm"},
+      {"pdf", "application/pdf"},
+  };
+  size_t dot = path.rfind('.');
+  if (dot != std::string::npos && path.find('/', dot) == std::string::npos) {
+    const char* ext = path.c_str() + dot + 1;
+    for (auto& i : kTypes) {
+      if (strcasecmp(ext, i.ext) == 0) {
+        return i.type;
+      }
+    }
+  }
+  return "application/octet-stream";
+}
+
+// 路径里有".."段时不能访问根目录之外的文件
+static bool IsSafePath(const std::string& path) {
+  size_t pos = 0;
+  while ((pos = path.find("..", pos)) != std::string::npos) {
+    bool begin = pos == 0 || path[pos - 1] == '/';
+    bool end = pos + 2 == path.size() || path[pos + 2] == '/';
+    if (begin && end) {
+      return false;
+    }
+    pos += 2;
+  }
+  return true;
+}
+
+// If-None-Match可能是逗号分隔的多个ETag, 或者*
+static bool MatchEtag(const std::string& header, const std::string& etag) {
+  if (header == "*") {
+    return true;
+  }
+  size_t pos = 0;
+  while ((pos = header.find(etag, pos)) != std::string::npos) {
+    size_t end = pos + etag.size();
+    bool begin_ok = pos == 0 || header[pos - 1] == ' ' ||
+                    header[pos - 1] == ',' || header[pos - 1] == '/';
+    bool end_ok = end == header.size() || header[end] == ' ' ||
+                  header[end] == ',';
+    if (begin_ok && end_ok) {
+      return true;
+    }
+    pos = end;
+  }
+  return false;
+}
+
+StaticServlet::StaticServlet(const std::string& root,
+                             const std::string& prefix)
+    : Servlet("StaticServlet"),
+      m_cache(std::make_shared<FileCache>(root)),
+      m_prefix(prefix) {}
+
+StaticServlet::StaticServlet(FileCache::ptr cache, const std::string& prefix)
+    : Servlet("StaticServlet"), m_cache(cache), m_prefix(prefix) {}
+
+int32_t StaticServlet::handle(HttpRequest::ptr request,
+                              HttpResponse::ptr response,
+                              HttpSession::ptr session) {
+  HttpMethod method = request->getMethod();
+  if (method != HttpMethod::GET && method != HttpMethod::HEAD) {
+    response->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+    response->setHeader("Allow", "GET, HEAD");
+    return 0;
+  }
+
+  std::string path = request->getPath();
+  if (!m_prefix.empty() && path.compare(0, m_prefix.size(), m_prefix) == 0) {
+    path = path.substr(m_prefix.size());
+  }
+  if (path.empty() || path[0] != '/') {
+    path = "/" + path;
+  }
+  if (path.back() == '/') {
+    path += "index.html";
+  }
+  if (!IsSafePath(path)) {
+    response->setStatus(HttpStatus::FORBIDDEN);
+    return 0;
+  }
+
+  FileCache::File::ptr file = m_cache->get(path);
+  if (!file) {
+    response->setStatus(HttpStatus::NOT_FOUND);
+    return 0;
+  }
+
+  response->setHeader("ETag", file->etag);
+  response->setHeader("Last-Modified", file->lastModified);
+
+  // 条件请求只比较缓存的元数据
+  std::string inm;
+  std::string ims;
+  if (request->hasHeader("If-None-Match", &inm)) {
+    if (MatchEtag(inm, file->etag)) {
+      response->setStatus(HttpStatus::NOT_MODIFIED);
+      return 0;
+    }
+  } else if (request->hasHeader("If-Modified-Since", &ims) &&
+             ims == file->lastModified) {
+    response->setStatus(HttpStatus::NOT_MODIFIED);
+    return 0;
+  }
+
+  response->setHeader("Content-Type", GetContentType(path));
+  if (method == HttpMethod::HEAD) {
+    response->setHeader("Content-Length", std::to_string(file->size));
+  } else if (file->data) {
+    response->setBodyRef(file->data, file->size, file);
+  } else {
+    response->setBodyFile(file->fd, 0, file->size, file);
+  }
+  return 0;
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,47 @@
+#ifndef DDG_HTTP_STATICSERVLET_H_
+#define DDG_HTTP_STATICSERVLET_H_
+
+#include <memory>
+#include <string>
+
+#include "ddg/http/filecache.h"
+#include "ddg/http/servlet.h"
+
+namespace ddg {
+namespace http {
+
+/**
+ * @brief 静态文件
+ *
+ * 只支持GET和HEAD. 小文件直接从mmap的内存writev出去, 大文件用sendfile,
+ * body都不经过用户态的拷贝. If-None-Match/If-Modified-Since用缓存里的
+ * 元数据判断, 不需要stat
+ */
+class StaticServlet : public Servlet {
+ public:
+  using ptr = std::shared_ptr<StaticServlet>;
+
+  /**
+   * @param root 文件根目录
+   * @param prefix 注册的路径前缀, 查找文件前去掉, 如/static
+   */
+  StaticServlet(const std::string& root, const std::string& prefix = "");
+
+  StaticServlet(FileCache::ptr cache, const std::string& prefix = "");
+
+  int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                 HttpSession::ptr session) override;
+
+  FileCache::ptr getFileCache() const { return m_cache; }
+
+  void stop() override { m_cache->stop(); }
+
+ private:
+  FileCache::ptr m_cache;
+  std::string m_prefix;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,175 @@
+#include "ddg/http/wsservlet.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "ddg/config.h"
+#include "ddg/log.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_websocket_ping_interval =
+    Config::Lookup<uint32_t>("websocket.ping_interval", 30 * 1000,
+                             "websocket ping interval(ms)");
+
+static ConfigVar<uint32_t>::ptr g_websocket_ping_timeout =
+    Config::Lookup<uint32_t>("websocket.ping_timeout", 90 * 1000,
+                             "websocket idle timeout(ms)");
+
+static const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+WSServlet::WSServlet(callback cb, on_connect_cb connect_cb,
+                     on_close_cb close_cb)
+    : Servlet("WSServlet"),
+      m_callback(cb),
+      m_onConnect(connect_cb),
+      m_onClose(close_cb),
+      m_iom(nullptr) {}
+
+WSServlet::~WSServlet() {
+  MutexType::Lock lock(m_mutex);
+  cancelTimer();
+}
+
+void WSServlet::stop() {
+  MutexType::Lock lock(m_mutex);
+  cancelTimer();
+}
+
+void WSServlet::cancelTimer() {
+  if (m_timer) {
+    m_timer->cancel();
+    m_timer.reset();
+  }
+}
+
+int32_t WSServlet::handle(HttpRequest::ptr request,
+                          HttpResponse::ptr response,
+                          HttpSession::ptr session) {
+  response->setStatus(HttpStatus::UPGRADE_REQUIRED);
+  response->setHeader("Upgrade", "websocket");
+  return 0;
+}
+
+int32_t WSServlet::serve(HttpRequest::ptr request, HttpSession::ptr session) {
+  std::string key = request->getHeader("Sec-WebSocket-Key");
+  if (key.empty() || request->getHeader("Sec-WebSocket-Version") != "13") {
+    HttpResponse::ptr rsp(new HttpResponse(request->getVersion(), true));
+    rsp->setStatus(HttpStatus::BAD_REQUEST);
+    rsp->setHeader("Sec-WebSocket-Version", "13");
+    session->sendResponse(rsp);
+    return -1;
+  }
+
+  HttpResponse::ptr rsp(new HttpResponse(request->getVersion(), false));
+  rsp->setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+  rsp->setWebsocket(true);
+  rsp->setHeader("Upgrade", "websocket");
+  rsp->setHeader("Connection", "Upgrade");
+  key += kWebSocketGuid;
+  std::string digest = Sha1Sum(key.c_str(), key.size());
+  rsp->setHeader("Sec-WebSocket-Accept",
+                 Base64Encode(digest.c_str(), digest.size()));
+  if (session->sendResponse(rsp) <= 0 || !session->flush()) {
+    return -1;
+  }
+
+  WSSession::ptr ws(new WSSession(session));
+  {
+    MutexType::Lock lock(m_mutex);
+    m_sessions.insert(ws);
+    if (!m_timer && IOManager::GetThis()) {
+      m_iom = IOManager::GetThis();
+      uint64_t period = std::max(g_websocket_ping_interval->getValue() / 2,
+                                 static_cast<uint32_t>(10));
+      // 定时器会让IOManager::stop一直等着, 最后一个连接关闭时取消
+      std::weak_ptr<WSServlet> weak(shared_from_this());
+      m_timer = m_iom->addTimer(period,
+                                [weak]() {
+                                  WSServlet::ptr self = weak.lock();
+                                  if (self) {
+                                    self->onSweep();
+                                  }
+                                },
+                                true);
+    }
+  }
+
+  if (m_onConnect) {
+    m_onConnect(request, ws);
+  }
+  while (true) {
+    WSFrameMessage::ptr msg = ws->recvMessage();
+    if (!msg) {
+      break;
+    }
+    if (m_callback(request, msg, ws) != 0) {
+      ws->close();
+      break;
+    }
+  }
+  if (m_onClose) {
+    m_onClose(request, ws);
+  }
+
+  MutexType::Lock lock(m_mutex);
+  m_sessions.erase(ws);
+  if (m_sessions.empty()) {
+    cancelTimer();
+  }
+  return 0;
+}
+
+void WSServlet::broadcast(const std::string& data, int32_t opcode) {
+  std::shared_ptr<std::string> frame = WSSession::EncodeFrame(opcode, data);
+  std::vector<WSSession::ptr> sessions;
+  {
+    MutexType::Lock lock(m_mutex);
+    sessions.assign(m_sessions.begin(), m_sessions.end());
+  }
+
+  IOManager* iom = IOManager::GetThis();
+  for (auto& s : sessions) {
+    if (iom) {
+      iom->schedule([s, frame]() { s->sendFrame(frame); });
+    } else {
+      s->sendFrame(frame);
+    }
+  }
+}
+
+size_t WSServlet::getSessionCount() {
+  MutexType::Lock lock(m_mutex);
+  return m_sessions.size();
+}
+
+void WSServlet::onSweep() {
+  uint64_t now = GetCurrentMilliSecond();
+  uint64_t interval = g_websocket_ping_interval->getValue();
+  uint64_t timeout = g_websocket_ping_timeout->getValue();
+  std::vector<WSSession::ptr> sessions;
+  {
+    MutexType::Lock lock(m_mutex);
+    sessions.assign(m_sessions.begin(), m_sessions.end());
+  }
+
+  for (auto& s : sessions) {
+    uint64_t last = s->getLastActiveTime();
+    uint64_t idle = now > last ? now - last : 0;
+    if (idle >= timeout) {
+      DDG_LOG_DEBUG(g_logger) << "websocket idle timeout "
+                              << *s->getStream()->getSocket();
+      s->shutdown();
+    } else if (idle >= interval) {
+      // ping可能阻塞在发送上, 不占用定时器的协程
+      m_iom->schedule([s]() { s->ping(); });
+    }
+  }
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,86 @@
+#ifndef DDG_HTTP_WSSERVLET_H_
+#define DDG_HTTP_WSSERVLET_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include "ddg/http/servlet.h"
+#include "ddg/http/wssession.h"
+#include "ddg/iomanager.h"
+#include "ddg/mutex.h"
+
+namespace ddg {
+namespace http {
+
+/**
+ * @brief WebSocket服务
+ *
+ * 和普通Servlet一样注册到ServletDispatch, HttpServer收到Upgrade请求时
+ * 调用serve完成握手, 之后这个连接的协程一直在serve里收消息.
+ * 所有连接由一个周期定时器统一检查: 空闲超过ping_interval的发ping,
+ * 超过ping_timeout的直接断开. 定时器只在有连接时存在, 只持有weak_ptr,
+ * 所以WSServlet必须由shared_ptr管理
+ */
+class WSServlet : public Servlet,
+                  public std::enable_shared_from_this<WSServlet> {
+ public:
+  using ptr = std::shared_ptr<WSServlet>;
+  using MutexType = Mutex;
+  using callback = std::function<int32_t(
+      HttpRequest::ptr request, WSFrameMessage::ptr msg,
+      WSSession::ptr session)>;
+  using on_connect_cb =
+      std::function<int32_t(HttpRequest::ptr request, WSSession::ptr session)>;
+  using on_close_cb =
+      std::function<int32_t(HttpRequest::ptr request, WSSession::ptr session)>;
+
+  WSServlet(callback cb, on_connect_cb connect_cb = nullptr,
+            on_close_cb close_cb = nullptr);
+
+  ~WSServlet();
+
+  // 不是Upgrade请求, 返回426
+  int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                 HttpSession::ptr session) override;
+
+  /**
+   * @brief 握手并处理这个连接上的所有消息, 连接断开后返回
+   * @return 握手失败返回-1
+   */
+  int32_t serve(HttpRequest::ptr request, HttpSession::ptr session);
+
+  /**
+   * @brief 发给所有连接
+   * @details 帧只编码一次, 每个连接调度一个协程发送, 慢连接不会拖住其他连接
+   */
+  void broadcast(const std::string& data,
+                 int32_t opcode = WSFrameHead::TEXT_FRAME);
+
+  size_t getSessionCount();
+
+  // 取消检查连接的定时器, 之后有新连接时再启动
+  void stop() override;
+
+ private:
+  // 取消定时器, 需要持有m_mutex
+  void cancelTimer();
+
+  // 检查空闲连接
+  void onSweep();
+
+ private:
+  callback m_callback;
+  on_connect_cb m_onConnect;
+  on_close_cb m_onClose;
+  MutexType m_mutex;
+  std::unordered_set<WSSession::ptr> m_sessions;
+  IOManager* m_iom;
+  Timer::ptr m_timer;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
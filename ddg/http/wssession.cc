@@ -0,0 +1,353 @@
+#include "ddg/http/wssession.h"
+
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ddg/config.h"
+#include "ddg/fiber.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+namespace http {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_websocket_message_max_size =
+    Config::Lookup<uint32_t>("websocket.message.max_size",
+                             32 * 1024 * 1024, "websocket message max size");
+
+/**
+ * @brief 原地异或掩码
+ * @param offset data在整个payload里的偏移, 决定从掩码的第几个字节开始
+ */
+static void MaskPayload(char* data, size_t len, const uint8_t key[4],
+                        size_t offset) {
+  uint8_t k[4];
+  for (int i = 0; i < 4; ++i) {
+    k[i] = key[(offset + i) & 3];
+  }
+
+  size_t i = 0;
+#ifdef __SSE2__
+  // 16是4的倍数, 每次处理16字节掩码的相位不变
+  uint32_t k32;
+  memcpy(&k32, k, 4);
+  __m128i vk = _mm_set1_epi32(k32);
+  for (; i + 16 <= len; i += 16) {
+    __m128i* p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), vk));
+  }
+#endif
+  for (; i < len; ++i) {
+    data[i] ^= k[i & 3];
+  }
+}
+
+static void RandomMaskKey(uint8_t key[4]) {
+  static thread_local uint32_t t_seed = 0;
+  if (t_seed == 0) {
+    t_seed = static_cast<uint32_t>(GetCurrentMicroSecond()) | 1;
+  }
+  // xorshift32
+  t_seed ^= t_seed << 13;
+  t_seed ^= t_seed >> 17;
+  t_seed ^= t_seed << 5;
+  memcpy(key, &t_seed, 4);
+}
+
+// 帧头最长14字节: 2 + 8字节长度 + 4字节掩码
+static size_t EncodeHead(uint8_t* buf, int32_t opcode, bool fin, uint64_t len,
+                         const uint8_t* mask_key) {
+  size_t n = 2;
+  buf[0] = (fin ? 0x80 : 0) | (opcode & 0x0F);
+  buf[1] = mask_key ? 0x80 : 0;
+  if (len < 126) {
+    buf[1] |= len;
+  } else if (len <= 0xFFFF) {
+    buf[1] |= 126;
+    buf[2] = len >> 8;
+    buf[3] = len & 0xFF;
+    n = 4;
+  } else {
+    buf[1] |= 127;
+    for (int i = 0; i < 8; ++i) {
+      buf[2 + i] = static_cast<uint8_t>(len >> (56 - i * 8));
+    }
+    n = 10;
+  }
+  if (mask_key) {
+    memcpy(buf + n, mask_key, 4);
+    n += 4;
+  }
+  return n;
+}
+
+WSFrameMessage::WSFrameMessage(int opcode, ByteArray::ptr data)
+    : m_opcode(opcode), m_data(data) {}
+
+WSFrameMessage::WSFrameMessage(int opcode, const std::string& data)
+    : m_opcode(opcode), m_data(std::make_shared<ByteArray>()) {
+  m_data->write(data.c_str(), data.size());
+  m_data->setPosition(0);
+}
+
+std::string WSFrameMessage::toString() const {
+  return m_data ? m_data->toString() : "";
+}
+
+WSSession::WSSession(HttpStream::ptr stream, bool client)
+    : m_stream(stream),
+      m_client(client),
+      m_sending(false),
+      m_lastActiveTime(GetCurrentMilliSecond()) {
+  // 发送都在lock里flush, 收消息的协程不能碰写缓冲
+  m_stream->setFlushOnRead(false);
+}
+
+void WSSession::lock() {
+  // 持有者可能阻塞在send上让出了协程, 这里也只能让出等它
+  while (m_sending.exchange(true)) {
+    if (IOManager::GetThis()) {
+      Fiber::YieldToReady();
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+WSFrameMessage::ptr WSSession::recvMessage() {
+  ByteArray::ptr data;
+  int opcode = 0;
+  uint64_t max_size = g_websocket_message_max_size->getValue();
+  uint16_t error = 0;
+
+  while (true) {
+    if (m_stream->ensure(2) <= 0) {
+      return nullptr;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(m_stream->peek());
+    bool fin = p[0] & 0x80;
+    int op = p[0] & 0x0F;
+    bool mask = p[1] & 0x80;
+    uint64_t len = p[1] & 0x7F;
+    if ((p[0] & 0x70) || mask == m_client) {
+      // 没有协商扩展, RSV必须为0; 客户端发的帧必须有掩码
+      error = 1002;
+      break;
+    }
+
+    size_t head = 2 + (len == 126 ? 2 : (len == 127 ? 8 : 0)) + (mask ? 4 : 0);
+    if (m_stream->ensure(head) <= 0) {
+      return nullptr;
+    }
+    p = reinterpret_cast<const uint8_t*>(m_stream->peek());
+    if (len == 126) {
+      len = (p[2] << 8) | p[3];
+    } else if (len == 127) {
+      // 64位长度的最高位必须是0
+      if (p[2] & 0x80) {
+        error = 1002;
+        break;
+      }
+      len = 0;
+      for (int i = 0; i < 8; ++i) {
+        len = (len << 8) | p[2 + i];
+      }
+    }
+    uint8_t key[4] = {0};
+    if (mask) {
+      memcpy(key, p + head - 4, 4);
+    }
+    m_stream->consume(head);
+    m_lastActiveTime = GetCurrentMilliSecond();
+
+    if (op >= WSFrameHead::CLOSE) {
+      // 控制帧不能分片, 最长125字节, 可以夹在分片的数据帧中间
+      if (!fin || len > 125) {
+        error = 1002;
+        break;
+      }
+      char buf[125];
+      if (m_stream->ensure(len) <= 0) {
+        return nullptr;
+      }
+      memcpy(buf, m_stream->peek(), len);
+      m_stream->consume(len);
+      if (mask) {
+        MaskPayload(buf, len, key, 0);
+      }
+
+      if (op == WSFrameHead::PING) {
+        if (sendControl(WSFrameHead::PONG, buf, len) <= 0) {
+          return nullptr;
+        }
+      } else if (op == WSFrameHead::CLOSE) {
+        // 回一个close, 带上对方的状态码
+        sendControl(WSFrameHead::CLOSE, buf, len >= 2 ? 2 : 0);
+        return nullptr;
+      } else if (op != WSFrameHead::PONG) {
+        error = 1002;
+        break;
+      }
+      continue;
+    }
+
+    if (op == WSFrameHead::CONTINUE) {
+      if (!data) {
+        error = 1002;
+        break;
+      }
+    } else if (op == WSFrameHead::TEXT_FRAME || op == WSFrameHead::BIN_FRAME) {
+      if (data) {
+        error = 1002;
+        break;
+      }
+      data = std::make_shared<ByteArray>();
+      opcode = op;
+    } else {
+      error = 1002;
+      break;
+    }
+
+    // 不能写成getSize() + len, 对方给的len可能让加法溢出
+    if (data->getSize() > max_size || len > max_size - data->getSize()) {
+      error = 1009;
+      break;
+    }
+
+    // payload直接收进ByteArray, 再在它的内存块上原地去掉掩码
+    size_t start = data->getSize();
+    if (m_stream->readTo(*data, len) <= 0) {
+      return nullptr;
+    }
+    if (mask && len) {
+      std::vector<iovec> iovs;
+      data->getReadBuffers(iovs, len, start);
+      size_t offset = 0;
+      for (auto& iov : iovs) {
+        MaskPayload(static_cast<char*>(iov.iov_base), iov.iov_len, key,
+                    offset);
+        offset += iov.iov_len;
+      }
+    }
+
+    if (fin) {
+      data->setPosition(0);
+      return std::make_shared<WSFrameMessage>(opcode, data);
+    }
+  }
+
+  DDG_LOG_DEBUG(g_logger) << "websocket protocol error " << error << " "
+                          << *m_stream->getSocket();
+  close(error);
+  return nullptr;
+}
+
+void WSSession::writeHead(int32_t opcode, bool fin, uint64_t len,
+                          const uint8_t* mask_key) {
+  uint8_t buf[14];
+  size_t n = EncodeHead(buf, opcode, fin, len, mask_key);
+  m_stream->write(buf, n);
+}
+
+int32_t WSSession::sendMessage(WSFrameMessage::ptr msg, bool fin) {
+  ByteArray::ptr data = msg->getData();
+  size_t len = data ? data->getReadSize() : 0;
+  std::vector<iovec> iovs;
+  if (len) {
+    data->getReadBuffers(iovs, len);
+  }
+
+  lock();
+  if (m_client) {
+    // 不能改调用者的数据, 拷贝一份再加掩码
+    uint8_t key[4];
+    RandomMaskKey(key);
+    writeHead(msg->getOpcode(), fin, len, key);
+    std::string tmp;
+    tmp.reserve(len);
+    for (auto& iov : iovs) {
+      tmp.append(static_cast<const char*>(iov.iov_base), iov.iov_len);
+    }
+    MaskPayload(&tmp[0], tmp.size(), key, 0);
+    m_stream->write(tmp.c_str(), tmp.size());
+  } else {
+    writeHead(msg->getOpcode(), fin, len, nullptr);
+    for (auto& iov : iovs) {
+      m_stream->writeRef(iov.iov_base, iov.iov_len, data);
+    }
+  }
+  bool ok = m_stream->flush();
+  unlock();
+  return ok ? 1 : -1;
+}
+
+int32_t WSSession::sendMessage(const std::string& msg, int32_t opcode,
+                               bool fin) {
+  return sendMessage(std::make_shared<WSFrameMessage>(opcode, msg), fin);
+}
+
+int32_t WSSession::sendFrame(std::shared_ptr<std::string> frame) {
+  lock();
+  m_stream->writeRef(frame->c_str(), frame->size(), frame);
+  bool ok = m_stream->flush();
+  unlock();
+  return ok ? 1 : -1;
+}
+
+int32_t WSSession::sendControl(int32_t opcode, const void* data, size_t len) {
+  uint8_t key[4];
+  char buf[125];
+  memcpy(buf, data, len);
+  if (m_client) {
+    RandomMaskKey(key);
+    MaskPayload(buf, len, key, 0);
+  }
+
+  lock();
+  writeHead(opcode, true, len, m_client ? key : nullptr);
+  m_stream->write(buf, len);
+  bool ok = m_stream->flush();
+  unlock();
+  return ok ? 1 : -1;
+}
+
+int32_t WSSession::ping() {
+  return sendControl(WSFrameHead::PING, nullptr, 0);
+}
+
+int32_t WSSession::close(uint16_t code) {
+  uint8_t buf[2] = {static_cast<uint8_t>(code >> 8),
+                    static_cast<uint8_t>(code & 0xFF)};
+  return sendControl(WSFrameHead::CLOSE, buf, sizeof(buf));
+}
+
+void WSSession::shutdown() {
+  Socket::ptr sock = m_stream->getSocket();
+  if (sock) {
+    ::shutdown(sock->getSocket(), SHUT_RDWR);
+  }
+}
+
+std::shared_ptr<std::string> WSSession::EncodeFrame(int32_t opcode,
+                                                    const std::string& data,
+                                                    bool fin) {
+  uint8_t buf[14];
+  size_t n = EncodeHead(buf, opcode, fin, data.size(), nullptr);
+  std::shared_ptr<std::string> frame(new std::string);
+  frame->reserve(n + data.size());
+  frame->append(reinterpret_cast<const char*>(buf), n);
+  frame->append(data);
+  return frame;
+}
+
+}  // namespace http
+}  // namespace ddg
@@ -0,0 +1,121 @@
+#ifndef DDG_HTTP_WSSESSION_H_
+#define DDG_HTTP_WSSESSION_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "ddg/bytearray.h"
+#include "ddg/http/http.h"
+#include "ddg/http/httpstream.h"
+
+namespace ddg {
+namespace http {
+
+struct WSFrameHead {
+  enum Opcode {
+    CONTINUE = 0,
+    TEXT_FRAME = 1,
+    BIN_FRAME = 2,
+    CLOSE = 8,
+    PING = 9,
+    PONG = 0xA,
+  };
+};
+
+// 一个完整的消息, 分片的数据帧已经拼接到同一个ByteArray里
+class WSFrameMessage {
+ public:
+  using ptr = std::shared_ptr<WSFrameMessage>;
+
+  WSFrameMessage(int opcode = WSFrameHead::TEXT_FRAME,
+                 ByteArray::ptr data = nullptr);
+
+  WSFrameMessage(int opcode, const std::string& data);
+
+  int getOpcode() const { return m_opcode; }
+
+  ByteArray::ptr getData() const { return m_data; }
+
+  // 拷贝出消息内容
+  std::string toString() const;
+
+ private:
+  int m_opcode;
+  ByteArray::ptr m_data;
+};
+
+/**
+ * @brief WebSocket连接, 建立在握手之后的HttpStream上
+ *
+ * 收到的数据帧直接recv进ByteArray的内存块, 原地去掉掩码(SSE2),
+ * 分片的消息在同一个ByteArray里拼接. 发送时服务端的帧不加掩码, body直接
+ * 引用ByteArray的内存块. 多个协程可以同时发送(广播、ping), 发送路径用
+ * 协程级别的自旋锁串行化
+ */
+class WSSession : public std::enable_shared_from_this<WSSession> {
+ public:
+  using ptr = std::shared_ptr<WSSession>;
+
+  /**
+   * @param client 客户端发送的帧要加掩码, 收到的帧不能有掩码
+   */
+  WSSession(HttpStream::ptr stream, bool client = false);
+
+  /**
+   * @brief 接收一个完整的消息
+   * @details ping/pong/close控制帧在内部处理, 收到close或者出错时返回nullptr
+   */
+  WSFrameMessage::ptr recvMessage();
+
+  int32_t sendMessage(WSFrameMessage::ptr msg, bool fin = true);
+
+  int32_t sendMessage(const std::string& msg,
+                      int32_t opcode = WSFrameHead::TEXT_FRAME,
+                      bool fin = true);
+
+  // 发送已经编码好的服务端帧, 广播时同一份数据发给多个连接
+  int32_t sendFrame(std::shared_ptr<std::string> frame);
+
+  int32_t ping();
+
+  int32_t close(uint16_t code = 1000);
+
+  // 不等对方回应, 直接断开, 阻塞在recv上的协程会返回
+  void shutdown();
+
+  // 最后一次收到数据的时间(毫秒)
+  uint64_t getLastActiveTime() const { return m_lastActiveTime; }
+
+  HttpStream::ptr getStream() const { return m_stream; }
+
+  /**
+   * @brief 编码一个不加掩码的完整帧
+   */
+  static std::shared_ptr<std::string> EncodeFrame(int32_t opcode,
+                                                  const std::string& data,
+                                                  bool fin = true);
+
+ private:
+  int32_t sendControl(int32_t opcode, const void* data, size_t len);
+
+  // 写入帧头, mask_key非空时带上掩码
+  void writeHead(int32_t opcode, bool fin, uint64_t len,
+                 const uint8_t* mask_key);
+
+  void lock();
+
+  void unlock() { m_sending = false; }
+
+ private:
+  HttpStream::ptr m_stream;
+  bool m_client;
+  std::atomic<bool> m_sending;
+  std::atomic<uint64_t> m_lastActiveTime;
+};
+
+}  // namespace http
+}  // namespace ddg
+
+#endif
@@ -1,6 +1,7 @@
 #include "ddg/iomanager.h"
 
 #include <fcntl.h>
+#include <signal.h>
 #include <cmath>
 
 #include "ddg/macro.h"
@@ -9,6 +10,30 @@ namespace ddg {
 
 static Logger::ptr g_logger = DDG_LOG_ROOT();
 
+// 定向唤醒某个线程用的信号. 只在epoll_pwait里放开, 所以既不会丢,
+// 也不会打断别的系统调用. 协程切换会恢复创建时的信号掩码, 所以要在
+// 创建任何线程和协程之前就阻塞它
+static const int kWakeSignal = SIGURG;
+
+static void OnWakeSignal(int) {}
+
+struct WakeSignalIniter {
+  WakeSignalIniter() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnWakeSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(kWakeSignal, &sa, nullptr);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, kWakeSignal);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+  }
+};
+
+static WakeSignalIniter s_wake_signal_initer;
+
 IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
     : Scheduler(threads, use_caller, name) {
   m_epfd = epoll_create(5000);
@@ -54,18 +79,41 @@ void IOManager::contextResize(size_t size) {
   }
 }
 
-int IOManager::addEvent(int fd, Event event, Callback cb) {
-  FdContext* fd_ctx = nullptr;
+IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
   RWMutexType::ReadLock lock(m_mutex);
   if (m_fdContext.size() > static_cast<size_t>(fd)) {
-    fd_ctx = m_fdContext[fd];
-    lock.unlock();
-  } else {
-    lock.unlock();
-    RWMutexType::WriteLock lock2(m_mutex);
+    return m_fdContext[fd];
+  }
+  lock.unlock();
+
+  if (!auto_create) {
+    return nullptr;
+  }
+
+  RWMutexType::WriteLock lock2(m_mutex);
+  if (m_fdContext.size() <= static_cast<size_t>(fd)) {
     contextResize(1.5 * fd);
-    fd_ctx = m_fdContext[fd];
   }
+  return m_fdContext[fd];
+}
+
+int IOManager::addEvent(int fd, Event event, Callback cb,
+                        uint64_t timeout_ms) {
+  return addEvent(fd, event, cb, timeout_ms, nullptr);
+}
+
+int IOManager::waitEvent(int fd, Event event, uint64_t timeout_ms) {
+  int result = WAIT_READY;
+  if (addEvent(fd, event, nullptr, timeout_ms, &result)) {
+    return -1;
+  }
+  Fiber::YieldToHold();
+  return result;
+}
+
+int IOManager::addEvent(int fd, Event event, Callback cb, uint64_t timeout_ms,
+                        int* result) {
+  FdContext* fd_ctx = getFdContext(fd, true);
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
 
@@ -74,6 +122,7 @@ int IOManager::addEvent(int fd, Event event, Callback cb) {
         << "addEvent assert fd = " << fd
         << " event = " << static_cast<EPOLL_EVENTS>(event)
         << " fd_ctx.event = " << static_cast<EPOLL_EVENTS>(fd_ctx->events);
+    return -1;
   }
 
   int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
@@ -89,7 +138,7 @@ int IOManager::addEvent(int fd, Event event, Callback cb) {
     DDG_LOG_ERROR(g_logger)
         << "IOManager::addEvent epoll_ctl(" << m_epfd << ", " << op << ", "
         << fd << ", " << static_cast<EPOLL_EVENTS>(ev.events) << ");"
-        << "ret = " << ret << " msg = " << strerror(ret)
+        << "ret = " << ret << " msg = " << strerror(errno)
         << " fd_ctx->events = " << static_cast<EPOLL_EVENTS>(fd_ctx->events);
     return -1;
   }
@@ -97,9 +146,11 @@ int IOManager::addEvent(int fd, Event event, Callback cb) {
   m_pendingEventCount++;
   fd_ctx->events = static_cast<Event>(fd_ctx->events | event);
   FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
-  DDG_ASSERT(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
+  DDG_ASSERT(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb &&
+             !event_ctx.timer);
 
   event_ctx.scheduler = Scheduler::GetThis();
+  event_ctx.thread = event_ctx.scheduler ? ddg::GetThreadId() : 0;
   if (cb) {
     event_ctx.cb.swap(cb);
   } else {
@@ -107,17 +158,52 @@ int IOManager::addEvent(int fd, Event event, Callback cb) {
     DDG_ASSERT_MSG(event_ctx.fiber->getState() == Fiber::State::EXEC,
                    "state = " << event_ctx.fiber->getState());
   }
+  event_ctx.result = result;
+
+  uint64_t seq = ++event_ctx.seq;
+  if (timeout_ms != kNoTimeout) {
+    // 定时器只记录seq, 触发时在fd_ctx的锁内核对,
+    // 事件已经触发或者被重新注册就什么都不做
+    event_ctx.timer = addTimer(timeout_ms, [this, fd_ctx, event, seq]() {
+      onEventTimeout(fd_ctx, event, seq);
+    });
+  }
 
   return 0;
 }
 
+void IOManager::onEventTimeout(FdContext* fd_ctx, Event event, uint64_t seq) {
+  FdContext::MutexType::Lock lock(fd_ctx->mutex);
+  if (!(fd_ctx->events & event) || fd_ctx->getContext(event).seq != seq) {
+    return;
+  }
+
+  Event new_events = static_cast<Event>(fd_ctx->events & ~event);
+  int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+
+  epoll_event ev;
+  ev.events = EPOLLET | new_events;
+  ev.data.ptr = fd_ctx;
+
+  int ret = epoll_ctl(m_epfd, op, fd_ctx->fd, &ev);
+  if (ret) {
+    DDG_LOG_ERROR(g_logger)
+        << "IOManager::onEventTimeout epoll_ctl(" << m_epfd << ", " << op
+        << ", " << fd_ctx->fd << ", " << static_cast<EPOLL_EVENTS>(ev.events)
+        << ");" << ret << " = " << ret << " msg = " << strerror(errno);
+  }
+
+  fd_ctx->triggerEvent(event, WAIT_TIMEOUT);
+  m_pendingEventCount--;
+}
+
 bool IOManager::delEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if (static_cast<size_t>(fd) >= m_fdContext.size()) {
+  FdContext* fd_ctx = getFdContext(fd, false);
+  if (!fd_ctx) {
     return false;
   }
 
-  FdContext* fd_ctx = m_fdContext[fd];
+  FdContext::MutexType::Lock lock(fd_ctx->mutex);
   if (!(fd_ctx->events & event)) {
     return false;
   }
@@ -133,7 +219,7 @@ bool IOManager::delEvent(int fd, Event event) {
     DDG_LOG_ERROR(g_logger)
         << "IOManager::delEvent(" << m_epfd << ", " << op << ", " << fd << ", "
         << static_cast<EPOLL_EVENTS>(ev.events) << ");" << ret << " = " << ret
-        << " msg = " << strerror(ret);
+        << " msg = " << strerror(errno);
     return false;
   }
 
@@ -146,24 +232,21 @@ bool IOManager::delEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(m_mutex);
-
-  if (static_cast<size_t>(fd) >= m_fdContext.size()) {
+  FdContext* fd_ctx = getFdContext(fd, false);
+  if (!fd_ctx) {
     return false;
   }
 
-  FdContext* fd_ctx = m_fdContext[fd];
+  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if (DDG_UNLIKELY(!(fd_ctx->events & event))) {
     return false;
   }
-  lock.unlock();
 
-  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   Event new_events = static_cast<Event>(fd_ctx->events & ~event);
   int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
 
   epoll_event ev;
-  ev.events = op;
+  ev.events = EPOLLET | new_events;
   ev.data.ptr = fd_ctx;
 
   int ret = epoll_ctl(m_epfd, op, fd, &ev);
@@ -171,34 +254,30 @@ bool IOManager::cancelEvent(int fd, Event event) {
     DDG_LOG_ERROR(g_logger)
         << "IOManager::cancelEvent(" << m_epfd << ", " << op << ", " << fd
         << ", " << static_cast<EPOLL_EVENTS>(ev.events) << ");" << ret << " = "
-        << ret << " msg = " << strerror(ret);
+        << ret << " msg = " << strerror(errno);
     return false;
   }
 
-  fd_ctx->triggerEvent(event);
+  fd_ctx->triggerEvent(event, WAIT_CANCELLED);
   m_pendingEventCount--;
   return true;
 }
 
 bool IOManager::cancelAll(int fd) {
-  RWMutexType::ReadLock lock(m_mutex);
-
-  if (static_cast<size_t>(fd) >= m_fdContext.size()) {
+  FdContext* fd_ctx = getFdContext(fd, false);
+  if (!fd_ctx) {
     return false;
   }
 
-  FdContext* fd_ctx = m_fdContext[fd];
+  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if (!fd_ctx->events) {
     return false;
   }
 
-  lock.unlock();
-
-  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   int op = EPOLL_CTL_DEL;
 
   epoll_event ev;
-  ev.events = op;
+  ev.events = 0;
   ev.data.ptr = fd_ctx;
 
   int ret = epoll_ctl(m_epfd, op, fd, &ev);
@@ -207,22 +286,20 @@ bool IOManager::cancelAll(int fd) {
     DDG_LOG_ERROR(g_logger)
         << "IOManager::cancelEvent epoll_ctl(" << m_epfd << ", " << op << ", "
         << fd << ", " << static_cast<EPOLL_EVENTS>(ev.events) << ");" << ret
-        << " = " << ret << " msg = " << strerror(ret);
+        << " = " << ret << " msg = " << strerror(errno);
     return false;
   }
 
   if (fd_ctx->events & READ) {
-    fd_ctx->triggerEvent(READ);
+    fd_ctx->triggerEvent(READ, WAIT_CANCELLED);
     m_pendingEventCount--;
   }
 
   if (fd_ctx->events & WRITE) {
-    fd_ctx->triggerEvent(WRITE);
+    fd_ctx->triggerEvent(WRITE, WAIT_CANCELLED);
     m_pendingEventCount--;
   }
 
-  // fd_ctx = Event::NONE;
-
   DDG_ASSERT(fd_ctx->events == 0);
   return true;
 }
@@ -239,6 +316,22 @@ void IOManager::tickle() {
   DDG_ASSERT(ret == 1);
 }
 
+// 所有线程等在同一个epfd上, 写管道叫醒的不一定是目标线程
+void IOManager::tickleThread(uint64_t thread) {
+  if (thread == GetThreadId()) {
+    return;  // 自己会回到调度循环
+  }
+  RWMutexType::ReadLock lock(m_mutex);
+  auto it = m_idleThreads.find(thread);
+  if (it == m_idleThreads.end()) {
+    lock.unlock();
+    tickle();
+    return;
+  }
+  // 持有读锁, 目标线程退出idle前要拿写锁, 不会对已经退出的线程发信号
+  pthread_kill(it->second, kWakeSignal);
+}
+
 bool IOManager::isStoped() {
   return m_pendingEventCount == 0 && Scheduler::isStoped();
 }
@@ -256,43 +349,55 @@ void IOManager::idle() {
   std::shared_ptr<epoll_event> shared_events(
       evs, [](epoll_event* ptr) { delete[] ptr; });
 
+  sigset_t wait_mask;
+  pthread_sigmask(SIG_SETMASK, nullptr, &wait_mask);
+  sigdelset(&wait_mask, kWakeSignal);
+  {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_idleThreads[GetThreadId()] = pthread_self();
+  }
+
   while (true) {
     uint64_t next_timeout = 0;
     if (DDG_UNLIKELY(isStoped(next_timeout))) {
       DDG_LOG_DEBUG(g_logger) << "name = " << getName() << " idle stop exit";
+      {
+        RWMutexType::WriteLock lock(m_mutex);
+        m_idleThreads.erase(GetThreadId());
+      }
+      // 一次tickle只叫醒一个线程, 接力叫醒还睡在epoll_wait里的线程
+      tickle();
       break;
     }
 
-    int ret = 0;
-    do {
-      static const int MAX_TIMEOUT = 3000;
-      if (next_timeout != ~0ull) {
-        next_timeout = static_cast<int>(next_timeout) > MAX_TIMEOUT
-                           ? MAX_TIMEOUT
-                           : next_timeout;
-      } else {
-        next_timeout = MAX_TIMEOUT;
-      }
-
-      ret = epoll_wait(m_epfd, evs, MAX_EVENTS, static_cast<int>(next_timeout));
+    static const int MAX_TIMEOUT = 3000;
+    if (next_timeout != ~0ull) {
+      next_timeout = static_cast<int>(next_timeout) > MAX_TIMEOUT
+                         ? MAX_TIMEOUT
+                         : next_timeout;
+    } else {
+      next_timeout = MAX_TIMEOUT;
+    }
 
-      if (ret < 0 && errno == EINTR) {
-        if (errno == EINTR) {
-          DDG_LOG_DEBUG(g_logger)
-              << "IOManager::idle epoll_wait has been interrupted";
-        }
-        continue;
-      } else {
-        break;
-      }
-    } while (true);
+    int ret = epoll_pwait(m_epfd, evs, MAX_EVENTS,
+                          static_cast<int>(next_timeout), &wait_mask);
+    if (ret < 0 && errno == EINTR) {
+      // tickleThread的信号, 回到调度循环执行绑定到本线程的任务
+      DDG_LOG_DEBUG(g_logger)
+          << "IOManager::idle epoll_wait has been interrupted";
+      ret = 0;
+    }
 
+    // 取出定时器到回调进入队列之间isStoped会短暂为真, 这段时间算作活跃,
+    // 不然别的线程会退出, 绑定到它上面的协程就再也没人执行了
     std::vector<Callback> cbs;
+    m_activeThreadCount++;
     listExpiredCallback(cbs);
     if (!cbs.empty()) {
       schedule(cbs.begin(), cbs.end());
       cbs.clear();
     }
+    m_activeThreadCount--;
 
     for (int i = 0; i < ret; i++) {
       epoll_event& ev = evs[i];
@@ -306,12 +411,13 @@ void IOManager::idle() {
       FdContext* fd_ctx = static_cast<FdContext*>(ev.data.ptr);
       FdContext::MutexType::Lock lock(fd_ctx->mutex);
 
-      if (ev.events & (EPOLLIN | EPOLLHUP)) {  // EPOLLHUB用于半关闭提醒
-        ev.events |= (EPOLLIN | EPOLLHUP) & fd_ctx->events;
+      // 出错或者对端关闭时唤醒所有等待的事件, 由io调用自己拿到错误
+      if (ev.events & (EPOLLERR | EPOLLHUP)) {
+        ev.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
       }
 
       int real_events = NONE;
-      if (ev.events & (EPOLLIN | EPOLLHUP)) {
+      if (ev.events & EPOLLIN) {
         real_events |= READ;
       }
 
@@ -319,12 +425,15 @@ void IOManager::idle() {
         real_events |= WRITE;
       }
 
-      if ((fd_ctx->events & real_events) == NONE) {
+      // 只处理注册了的事件, 其他的可能已经超时或者被取消
+      real_events &= fd_ctx->events;
+      if (real_events == NONE) {
         continue;
       }
 
       int left_evs = fd_ctx->events & ~real_events;
       int op = left_evs ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+      ev.events = EPOLLET | left_evs;  // 只保留还没有触发的事件
       int ret2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &ev);
 
       if (ret2) {
@@ -357,24 +466,40 @@ void IOManager::onTimerInsertedAtFront() {
   tickle();
 }
 
-void IOManager::FdContext::triggerEvent(IOManager::Event event) {
+void IOManager::FdContext::triggerEvent(IOManager::Event event,
+                                        WaitResult result) {
   DDG_ASSERT(events & event);
 
   events = static_cast<Event>(events & ~event);  // 这里将事件消除
   EventContext& ctx = getContext(event);
+  if (ctx.timer) {
+    ctx.timer->cancel();  // 事件已经有结果了, deadline不再需要
+    ctx.timer.reset();
+  }
+  if (ctx.result) {
+    *ctx.result = result;  // 协程还挂起在等待中, 栈上的变量仍然有效
+    ctx.result = nullptr;
+  }
   if (ctx.cb) {
-    ctx.scheduler->schedule(&ctx.cb);
+    ctx.scheduler->schedule(&ctx.cb, ctx.thread);
   } else {
-    ctx.scheduler->schedule(&ctx.fiber);
+    ctx.scheduler->schedule(&ctx.fiber, ctx.thread);
   }
-  ctx.scheduler = nullptr;  // TODO: deal events
+  ctx.scheduler = nullptr;
+  ctx.thread = 0;
   return;
 }
 
 void IOManager::FdContext::resetContext(EventContext& ctx) {
+  if (ctx.timer) {
+    ctx.timer->cancel();
+    ctx.timer.reset();
+  }
   ctx.cb = nullptr;
   ctx.fiber.reset();
   ctx.scheduler = nullptr;
+  ctx.thread = 0;
+  ctx.result = nullptr;
 }
 
 IOManager::FdContext::EventContext& IOManager::FdContext::getContext(
@@ -2,7 +2,9 @@
 #define DDG_IOMANAGER_H
 
 #include <memory>
+#include <unordered_map>
 
+#include <pthread.h>
 #include <sys/epoll.h>
 #include <unistd.h>
 #include "ddg/fiber.h"
@@ -24,6 +26,15 @@ class IOManager : public Scheduler, public TimerManager {
     WRITE = EPOLLOUT,
   };
 
+  // 协程等待事件的结果
+  enum WaitResult {
+    WAIT_READY = 0,      // 事件就绪
+    WAIT_TIMEOUT = 1,    // 超过了deadline
+    WAIT_CANCELLED = 2,  // 被cancelEvent/cancelAll取消
+  };
+
+  static const uint64_t kNoTimeout = ~0ull;
+
  private:
   struct FdContext {
     using MutexType = Mutex;
@@ -32,14 +43,19 @@ class IOManager : public Scheduler, public TimerManager {
     struct EventContext {
       using Callback = std::function<void()>;
       Scheduler* scheduler = nullptr;
+      uint64_t thread = 0;  // 注册事件的线程, 唤醒时回到这个线程
       Fiber::ptr fiber;
       Callback cb;
+      Timer::ptr timer;       // deadline定时器
+      int* result = nullptr;  // 指向等待协程栈上的WaitResult
+      uint64_t seq = 0;       // 每次addEvent递增, 用来识别过期的定时器
     };
 
     EventContext& getContext(Event event);
 
     void resetContext(EventContext& ctx);  // 取消事件
-    void triggerEvent(Event event);        // 触发事件
+    void triggerEvent(Event event,
+                      WaitResult result = WAIT_READY);  // 触发事件
 
     EventContext read;
     EventContext write;
@@ -55,7 +71,12 @@ class IOManager : public Scheduler, public TimerManager {
             const std::string& name = "");
   ~IOManager();
 
-  int addEvent(int fd, Event event, Callback cb = nullptr);
+  // timeout_ms毫秒内事件没有就绪就当作超时触发, 回调同样会被调度
+  int addEvent(int fd, Event event, Callback cb = nullptr,
+               uint64_t timeout_ms = kNoTimeout);
+
+  // 在当前协程上等待事件, 返回WaitResult, 注册失败返回-1
+  int waitEvent(int fd, Event event, uint64_t timeout_ms = kNoTimeout);
 
   bool delEvent(int fd, Event event);
 
@@ -68,6 +89,8 @@ class IOManager : public Scheduler, public TimerManager {
  protected:
   void tickle() override;
 
+  void tickleThread(uint64_t thread) override;
+
   bool isStoped() override;
 
   bool isStoped(uint64_t& timeout);
@@ -78,6 +101,14 @@ class IOManager : public Scheduler, public TimerManager {
 
   void onTimerInsertedAtFront() override;
 
+ private:
+  int addEvent(int fd, Event event, Callback cb, uint64_t timeout_ms,
+               int* result);
+
+  FdContext* getFdContext(int fd, bool auto_create);
+
+  void onEventTimeout(FdContext* fd_ctx, Event event, uint64_t seq);
+
  private:
   int m_epfd = 0;
 
@@ -88,6 +119,9 @@ class IOManager : public Scheduler, public TimerManager {
   std::vector<FdContext*> m_fdContext;
 
   std::atomic<size_t> m_pendingEventCount{0};
+
+  // 在idle里等待过的线程, tickleThread用信号定向唤醒, 受m_mutex保护
+  std::unordered_map<uint64_t, pthread_t> m_idleThreads;
 };
 
 }  // namespace ddg
@@ -22,6 +22,19 @@ class LexicalCast {
   }  // 转化出错将报错
 };
 
+// boost::lexical_cast只认识0/1, yaml里面的布尔值是true/false
+template <>
+class LexicalCast<std::string, bool> {
+ public:
+  bool operator()(const std::string& v) { return YAML::Load(v).as<bool>(); }
+};
+
+template <>
+class LexicalCast<bool, std::string> {
+ public:
+  std::string operator()(const bool& v) { return v ? "true" : "false"; }
+};
+
 // for stl
 template <class T>
 class LexicalCast<std::string, std::vector<T>> {
@@ -158,8 +171,8 @@ class LexicalCast<std::string, std::map<std::string, T>> {
       ss.str("");
       ss.clear();
       ss << it->second;
-      mp.insert(
-          std::make_pair(it->first, LexicalCast<std::string, T>()(it->second)));
+      mp.insert(std::make_pair(it->first.Scalar(),
+                               LexicalCast<std::string, T>()(ss.str())));
     }
     return mp;
   }
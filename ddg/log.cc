@@ -1,6 +1,20 @@
 #include "log.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include "asynclog.h"
 #include "config.h"
 #include "lexicalcast.h"
+#include "mmaplog.h"
+#include "thread.h"
 
 namespace ddg {
 
@@ -44,7 +58,7 @@ LogLevel::Level LogLevel::FromString(const std::string& level) {
 Logger::Logger(const std::string& name)
     : m_name(name), m_level(LogLevel::DEBUG) {
   m_formatter.reset(
-      new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%F%T[%p]%T<%f:%l>%T%m%n"));
+      new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%F%T[%p]%T<%f:%l>%T%m%K%n"));
 }
 
 Logger::ptr Logger::getRoot() const {
@@ -99,18 +113,7 @@ void Logger::clearAppender() {
 }
 
 void Logger::setLevel(LogLevel::Level level) {
-  RWMutexType::WriteLock lock(m_rwmutex);
-  m_level = level;
-}
-
-LogLevel::Level Logger::getLevel() const {
-  RWMutexType::ReadLock lock(m_rwmutex);
-  return m_level;
-}
-
-std::string Logger::getName() const {
-  RWMutexType::ReadLock lock(m_rwmutex);
-  return m_name;
+  m_level.store(level, std::memory_order_relaxed);
 }
 
 LogFormatter::ptr Logger::getFormatter() const {
@@ -124,16 +127,17 @@ const std::list<LogAppender::ptr>& Logger::getAppenders() const {
 }
 
 void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
+  if (level < getLevel()) {
+    return;
+  }
+  auto self = shared_from_this();
   RWMutexType::ReadLock lock(m_rwmutex);
-  if (level >= m_level) {
-    auto self = shared_from_this();
-    if (!m_appenders.empty()) {
-      for (auto& i : m_appenders) {
-        i->log(self, level, event);
-      }
-    } else {
-      m_root->log(level, event);
+  if (!m_appenders.empty()) {
+    for (auto& i : m_appenders) {
+      i->log(self, level, event);
     }
+  } else {
+    m_root->log(level, event);
   }
 }
 
@@ -168,6 +172,15 @@ std::string Logger::toYamlString() const {
     if (m_formatter) {
       node["formatter"] = m_formatter->getPattern();
     }
+    if (m_limit.rate) {
+      node["rate_limit"] = m_limit.rate;
+    }
+    if (m_limit.burst) {
+      node["burst"] = m_limit.burst;
+    }
+    if (m_limit.sample < 1.0) {
+      node["sample"] = m_limit.sample;
+    }
 
     for (auto& i : m_appenders) {
       node["appenders"].push_back(YAML::Load(i->toYamlString()));
@@ -182,11 +195,70 @@ std::string Logger::toString() const {
   return toYamlString();
 }
 
+// LogStreamBuf
+LogStreamBuf::LogStreamBuf(size_t capacity)
+    : m_data(new char[capacity]), m_capacity(capacity) {
+  setp(m_data.get(), m_data.get() + m_capacity);
+}
+
+void LogStreamBuf::reset() {
+  setp(m_data.get(), m_data.get() + m_capacity);
+  m_truncated = false;
+}
+
+void LogStreamBuf::vprintf(const char* fmt, va_list al) {
+  size_t left = epptr() - pptr();
+  int n = vsnprintf(pptr(), left, fmt, al);
+  if (n < 0) {
+    return;
+  }
+  // vsnprintf最后要留一个'\0'
+  if (static_cast<size_t>(n) >= left) {
+    m_truncated = true;
+    n = left ? left - 1 : 0;
+  }
+  pbump(n);
+}
+
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c) {
+  // 满了, 丢掉, 流的状态保持正常
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    m_truncated = true;
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n) {
+  size_t left = epptr() - pptr();
+  size_t len = std::min(static_cast<size_t>(n), left);
+  memcpy(pptr(), s, len);
+  pbump(len);
+  if (len < static_cast<size_t>(n)) {
+    m_truncated = true;
+  }
+  return n;
+}
+
+// LogStream
+LogStream::LogStream(size_t capacity) : std::ostream(nullptr), m_buf(capacity) {
+  rdbuf(&m_buf);
+  m_flags = flags();
+}
+
+void LogStream::reset() {
+  m_buf.reset();
+  clear();
+  flags(m_flags);
+  precision(6);
+  width(0);
+  fill(' ');
+}
+
 // LogEvent
 LogEvent::LogEvent(Logger::ptr logger, LogLevel::Level level, const char* file,
                    const int32_t& line, const uint64_t& elapse,
                    const uint64_t& thread_id, const uint64_t& fiber_id,
-                   const uint64_t& time)
+                   const uint64_t& time, uint32_t nsec)
     : m_logger(logger),
       m_level(level),
       m_file(file),
@@ -194,7 +266,76 @@ LogEvent::LogEvent(Logger::ptr logger, LogLevel::Level level, const char* file,
       m_elapse(elapse),
       m_threadId(thread_id),
       m_fiberId(fiber_id),
-      m_time(time) {}
+      m_time(time),
+      m_nsec(nsec),
+      m_ss(kMaxContentSize) {}
+
+const size_t LogEvent::kMaxContentSize;
+
+void LogEvent::reset(const Logger::ptr& logger, LogLevel::Level level,
+                     const char* file, int32_t line, uint64_t elapse,
+                     uint64_t thread_id, uint64_t fiber_id, uint64_t time,
+                     uint32_t nsec) {
+  m_logger = logger;
+  m_level = level;
+  m_file = file;
+  m_line = line;
+  m_elapse = elapse;
+  m_threadId = thread_id;
+  m_fiberId = fiber_id;
+  m_time = time;
+  m_nsec = nsec;
+  m_ss.reset();
+  m_fields.clear();
+  m_fieldData.clear();
+}
+
+// 键和字符串值都追加到m_fieldData里, Field里只记偏移
+static LogEvent::Field NewField(std::string& data, LogEvent::Field::Type type,
+                                const char* key, size_t key_len) {
+  LogEvent::Field field;
+  field.type = type;
+  field.key = data.size();
+  field.key_len = key_len;
+  field.str = 0;
+  field.str_len = 0;
+  field.u = 0;
+  data.append(key, key_len);
+  return field;
+}
+
+void LogEvent::addIntField(const char* key, size_t key_len, int64_t v) {
+  Field field = NewField(m_fieldData, Field::INT, key, key_len);
+  field.i = v;
+  m_fields.push_back(field);
+}
+
+void LogEvent::addUIntField(const char* key, size_t key_len, uint64_t v) {
+  Field field = NewField(m_fieldData, Field::UINT, key, key_len);
+  field.u = v;
+  m_fields.push_back(field);
+}
+
+void LogEvent::addDoubleField(const char* key, size_t key_len, double v) {
+  Field field = NewField(m_fieldData, Field::DOUBLE, key, key_len);
+  field.d = v;
+  m_fields.push_back(field);
+}
+
+void LogEvent::addBoolField(const char* key, size_t key_len, bool v) {
+  Field field = NewField(m_fieldData, Field::BOOL, key, key_len);
+  field.b = v;
+  m_fields.push_back(field);
+}
+
+void LogEvent::addStringField(const char* key, size_t key_len,
+                              const char* str, size_t len) {
+  Field field = NewField(m_fieldData, Field::STRING, key, key_len);
+  field.str = m_fieldData.size();
+  field.str_len = std::min(len, kMaxContentSize);
+  m_fieldData.append(str, field.str_len);
+  m_fields.push_back(field);
+}
 
 void LogEvent::format(const char* fmt, ...) {
   va_list al;
@@ -204,25 +345,224 @@ void LogEvent::format(const char* fmt, ...) {
 }
 
 void LogEvent::format(const char* fmt, va_list al) {
-  char* buf = nullptr;
-  int len = vasprintf(&buf, fmt, al);
-  if (len != -1) {
-    m_ss << std::string(buf, len);
-    free(buf);
-  }
+  m_ss.vprintf(fmt, al);
 }
 
 // LogEventWrap
+// 每个线程缓存的LogEvent, 用LogEvent::m_inUse标记是否空闲
+static thread_local std::vector<LogEvent::ptr> t_events;
+
+static uint64_t MonotonicMicroSecond() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+// %r输出的elapse从这里开始算
+static const uint64_t s_start_us = MonotonicMicroSecond();
+
 LogEventWrap::LogEventWrap(LogEvent::ptr event) : m_event(event) {}
 
+LogEventWrap::LogEventWrap(const Logger::ptr& logger, LogLevel::Level level,
+                           const char* file, int32_t line, uint64_t thread_id,
+                           uint64_t fiber_id)
+    : m_pooled(true) {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t elapse = MonotonicMicroSecond() - s_start_us;
+  // 只有本线程会把event标记为在用, 其他线程只会清除标记
+  for (auto& i : t_events) {
+    if (!i->m_inUse.load(std::memory_order_acquire)) {
+      m_event = i;
+      break;
+    }
+  }
+  if (m_event) {
+    m_event->reset(logger, level, file, line, elapse, thread_id, fiber_id,
+                   ts.tv_sec, ts.tv_nsec);
+  } else {
+    m_event = std::make_shared<LogEvent>(logger, level, file, line, elapse,
+                                         thread_id, fiber_id, ts.tv_sec,
+                                         ts.tv_nsec);
+    t_events.push_back(m_event);
+  }
+  m_event->m_inUse.store(true, std::memory_order_relaxed);
+}
+
 LogEventWrap::~LogEventWrap() {
   m_event->getLogger()->log(m_event->getLevel(), m_event);
+  if (m_pooled) {
+    // 不让缓存的event拖住logger
+    m_event->m_logger.reset();
+    m_event->m_inUse.store(false, std::memory_order_release);
+  }
 }
 
-std::stringstream& LogEventWrap::getSS() {
+std::ostream& LogEventWrap::getSS() {
   return m_event->getSS();
 }
 
+// LogSite
+static ConfigVar<uint32_t>::ptr g_log_limit_report_interval =
+    Config::Lookup<uint32_t>("log.limit_report_interval", 10000,
+                             "log suppressed count report interval ms");
+
+// 所有构造过的调用点, 只增不减
+static std::atomic<LogSite*> s_log_sites{nullptr};
+
+// 抽样用的xorshift64*, 每个线程一个, 返回32位
+static uint32_t NextRandom() {
+  static thread_local uint64_t t_state =
+      (GetThreadId() << 32) ^ MonotonicMicroSecond() ^ 0x9e3779b97f4a7c15ull;
+  t_state ^= t_state >> 12;
+  t_state ^= t_state << 25;
+  t_state ^= t_state >> 27;
+  return (t_state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+// 汇总线程不释放. 它用到的配置和日志器是静态变量, 进程退出时
+// 在它们析构之前(atexit)让线程停下, 停下之后不再碰任何东西
+static void StartLimitReporter() {
+  static Mutex* s_mutex = new Mutex;
+  static bool s_stopped = false;
+  static Thread* s_thread = []() {
+    atexit([]() {
+      Mutex::Lock lock(*s_mutex);
+      s_stopped = true;
+    });
+    return new Thread("log_limit", []() {
+      while (true) {
+        uint32_t interval = 0;
+        {
+          Mutex::Lock lock(*s_mutex);
+          if (s_stopped) {
+            return;
+          }
+          interval = g_log_limit_report_interval->getValue();
+        }
+        if (!interval) {
+          usleep(1000 * 1000);
+          continue;
+        }
+        usleep(interval * 1000ull);
+        Mutex::Lock lock(*s_mutex);
+        if (s_stopped) {
+          return;
+        }
+        LogSite::ReportSuppressed();
+      }
+    });
+  }();
+  (void)s_thread;
+}
+
+LogSite::LogSite(const char* file, int32_t line)
+    : m_file(file), m_line(line), m_lastReportUs(MonotonicMicroSecond()) {
+  m_next = s_log_sites.load(std::memory_order_relaxed);
+  while (!s_log_sites.compare_exchange_weak(m_next, this,
+                                            std::memory_order_release)) {
+  }
+}
+
+bool LogSite::allow(Logger& logger, LogLevel::Level level) {
+  if (level >= LogLevel::FATAL) {
+    return true;
+  }
+  if (NextRandom() >= logger.m_sample.load(std::memory_order_relaxed)) {
+    suppress(logger, level);
+    return false;
+  }
+  uint32_t rate = logger.m_rate.load(std::memory_order_relaxed);
+  if (!rate) {
+    return true;
+  }
+  uint32_t burst = logger.m_burst.load(std::memory_order_relaxed);
+  double capacity = burst ? burst : rate;
+  uint64_t now = MonotonicMicroSecond();
+  {
+    SpinLock::Lock lock(m_mutex);
+    if (!m_lastUs) {
+      m_tokens = capacity;
+      m_lastUs = now;
+    } else if (now > m_lastUs) {
+      m_tokens = std::min(capacity, m_tokens + (now - m_lastUs) * rate / 1e6);
+      m_lastUs = now;
+    }
+    if (m_tokens >= 1) {
+      m_tokens -= 1;
+      return true;
+    }
+  }
+  suppress(logger, level);
+  return false;
+}
+
+// 只在汇总之后第一次丢的时候记下logger, 之后只加计数
+void LogSite::suppress(Logger& logger, LogLevel::Level level) {
+  if (m_suppressed.fetch_add(1, std::memory_order_relaxed) == 0) {
+    SpinLock::Lock lock(m_mutex);
+    m_logger = logger.shared_from_this();
+    m_level = level;
+  }
+}
+
+void LogSite::ReportSuppressed() {
+  uint64_t now = MonotonicMicroSecond();
+  for (LogSite* site = s_log_sites.load(std::memory_order_acquire); site;
+       site = site->m_next) {
+    if (!site->m_suppressed.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    Logger::ptr logger;
+    LogLevel::Level level;
+    uint64_t since = 0;
+    uint64_t n = 0;
+    {
+      SpinLock::Lock lock(site->m_mutex);
+      if (site->m_level == LogLevel::UNKNOW) {
+        // 第一次丢的线程还没记下logger, 下次再报
+        continue;
+      }
+      n = site->m_suppressed.exchange(0, std::memory_order_relaxed);
+      logger = site->m_logger.lock();
+      level = site->m_level;
+      since = site->m_lastReportUs;
+      site->m_lastReportUs = now;
+    }
+    // logger已经删掉了就不报了
+    if (!n || !logger) {
+      continue;
+    }
+    LogEventWrap(logger, level, site->m_file, site->m_line, GetThreadId(),
+                 GetFiberId())
+            .kv("suppressed", n)
+        << "suppressed " << n << " log lines in last "
+        << (now - since) / 1000 << "ms";
+  }
+}
+
+void Logger::setLimit(const LogLimit& limit) {
+  {
+    RWMutexType::WriteLock lock(m_rwmutex);
+    m_limit = limit;
+  }
+  m_rate.store(limit.rate, std::memory_order_relaxed);
+  m_burst.store(limit.burst, std::memory_order_relaxed);
+  m_sample.store(limit.sample >= 1.0
+                     ? 1ull << 32
+                     : static_cast<uint64_t>(limit.sample * 4294967296.0),
+                 std::memory_order_relaxed);
+  if (limit.isLimited()) {
+    StartLimitReporter();
+  }
+  m_limited.store(limit.isLimited(), std::memory_order_release);
+}
+
+LogLimit Logger::getLimit() const {
+  RWMutexType::ReadLock lock(m_rwmutex);
+  return m_limit;
+}
+
 // Appender
 void LogAppender::setFormatter(LogFormatter::ptr val) {
   RWMutexType::WriteLock lock(m_rwmutex);
@@ -235,8 +575,7 @@ LogFormatter::ptr LogAppender::getFormatter() const {
 }
 
 void LogAppender::setLevel(LogLevel::Level level) {
-  RWMutexType::WriteLock lock(m_rwmutex);
-  m_level = level;
+  m_level.store(level, std::memory_order_relaxed);
 }
 
 std::string StdoutLogAppender::toYamlString() const {
@@ -245,7 +584,9 @@ std::string StdoutLogAppender::toYamlString() const {
     RWMutexType::ReadLock lock(m_rwmutex);
     node["level"] = LogLevel::ToString(m_level);
     node["type"] = LogAppender::ToString(LogAppender::STDOUT_LOG_APPENDER);
-    node["formatter"] = m_formatter->getPattern();
+    if (m_formatter) {
+      node["formatter"] = m_formatter->getPattern();
+    }
   }
   std::stringstream ss;
   ss << node;
@@ -261,10 +602,24 @@ std::string FileLogAppender::toYamlString() const {
   {
     RWMutexType::ReadLock lock(m_rwmutex);
     node["level"] = LogLevel::ToString(m_level);
-    node["type"] = LogAppender::ToString(LogAppender::STDOUT_LOG_APPENDER);
-    node["formatter"] = m_formatter->getPattern();
+    node["type"] = LogAppender::ToString(LogAppender::FILE_LOG_APPENDER);
+    if (m_formatter) {
+      node["formatter"] = m_formatter->getPattern();
+    }
     node["file"] = m_filename;
   }
+  if (m_options.max_size) {
+    node["max_size"] = m_options.max_size;
+  }
+  if (m_options.rollover != NONE) {
+    node["rollover"] = RolloverToString(m_options.rollover);
+  }
+  if (m_options.max_files) {
+    node["max_files"] = m_options.max_files;
+  }
+  if (m_options.compress) {
+    node["compress"] = true;
+  }
   std::stringstream ss;
   ss << node;
   return ss.str();
@@ -276,6 +631,7 @@ std::string FileLogAppender::toString() const {
 
 #define FILE_LOG_APPENDER_STR "FileLogAppender"
 #define STDOUT_LOG_APPENDER_STR "StdoutLogAppender"
+#define MMAP_FILE_LOG_APPENDER_STR "MmapFileLogAppender"
 
 LogAppender::Type LogAppender::FromString(const std::string& type) {
 #define XX(name)              \
@@ -284,6 +640,7 @@ LogAppender::Type LogAppender::FromString(const std::string& type) {
   }
   XX(FILE_LOG_APPENDER);
   XX(STDOUT_LOG_APPENDER);
+  XX(MMAP_FILE_LOG_APPENDER);
   return LogAppender::UNKNOW_APPENDER;
 
 #undef XX
@@ -297,6 +654,7 @@ std::string LogAppender::ToString(LogAppender::Type type) {
     break
     XX(FILE_LOG_APPENDER);
     XX(STDOUT_LOG_APPENDER);
+    XX(MMAP_FILE_LOG_APPENDER);
     default:
       return "UnknowAppender";
 #undef XX
@@ -305,34 +663,615 @@ std::string LogAppender::ToString(LogAppender::Type type) {
 
 #undef FILE_LOG_APPENDER_STR
 #undef STDOUT_LOG_APPENDER_STR
+#undef MMAP_FILE_LOG_APPENDER_STR
 
 void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level,
                             LogEvent::ptr event) {
+  if (level < m_level.load(std::memory_order_relaxed)) {
+    return;
+  }
+  MutexType::Lock lock(m_mutex);
+  m_formatter->format(std::cout, logger, level, event);
+}
+
+void StdoutLogAppender::write(const char* data, size_t len) {
+  MutexType::Lock lock(m_mutex);
+  std::cout.write(data, len);
+}
+
+void StdoutLogAppender::flush() {
   MutexType::Lock lock(m_mutex);
-  if (level >= m_level) {
-    std::cout << m_formatter->format(logger, level, event);
+  std::cout.flush();
+}
+
+// 切分出来的旧文件在这个线程里压缩和删除, 不占用打日志的线程.
+// 每秒还会调用一遍watchers, 返回false的去掉
+namespace {
+
+struct LogFileWorker {
+  LogFileWorker() {
+    thread.reset(new Thread("log_file", [this]() { run(); }));
+  }
+
+  void schedule(std::function<void()> task) {
+    {
+      Mutex::Lock lock(mutex);
+      tasks.push_back(task);
+    }
+    sem.post();
+  }
+
+  void watch(std::function<bool()> watcher) {
+    Mutex::Lock lock(mutex);
+    watchers.push_back(watcher);
+  }
+
+  void run() {
+    time_t next_watch = 0;
+    while (true) {
+      std::function<void()> task;
+      if (sem.waitFor(1000)) {
+        Mutex::Lock lock(mutex);
+        task.swap(tasks.front());
+        tasks.pop_front();
+      }
+      if (task) {
+        task();
+      }
+      time_t now = time(nullptr);
+      if (now >= next_watch) {
+        next_watch = now + 1;
+        runWatchers();
+      }
+    }
+  }
+
+  void runWatchers() {
+    std::list<std::function<bool()>> list;
+    {
+      Mutex::Lock lock(mutex);
+      list.swap(watchers);
+    }
+    for (auto it = list.begin(); it != list.end();) {
+      if ((*it)()) {
+        ++it;
+      } else {
+        it = list.erase(it);
+      }
+    }
+    Mutex::Lock lock(mutex);
+    watchers.splice(watchers.end(), list);
   }
+
+  Mutex mutex;
+  std::list<std::function<void()>> tasks;
+  std::list<std::function<bool()>> watchers;
+  Semphore sem;
+  std::unique_ptr<Thread> thread;
+};
+
+LogFileWorker* GetLogFileWorker() {
+  // 不释放, 进程退出时没压缩完的旧文件保持原样
+  static LogFileWorker* s_worker = new LogFileWorker;
+  return s_worker;
 }
 
-FileLogAppender::FileLogAppender(const std::string& file) : m_filename(file) {
-  m_filestream.open(m_filename);
+}  // namespace
+
+static void ScheduleLogFileTask(std::function<void()> task) {
+  GetLogFileWorker()->schedule(task);
+}
+
+// 先压缩到临时文件, 完成后再换掉原文件
+static bool CompressLogFile(const std::string& file) {
+  std::string tmp = file + ".gz.tmp";
+  FILE* in = fopen(file.c_str(), "rb");
+  if (!in) {
+    return false;
+  }
+  gzFile out = gzopen(tmp.c_str(), "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+  char buf[64 * 1024];
+  size_t n = 0;
+  bool ok = true;
+  while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    ok = gzwrite(out, buf, n) == static_cast<int>(n);
+  }
+  ok = gzclose(out) == Z_OK && ok && !ferror(in);
+  fclose(in);
+  if (!ok || rename(tmp.c_str(), (file + ".gz").c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  unlink(file.c_str());
+  return true;
+}
+
+// 删除file切分出来的旧文件, 只保留最新的max_files个.
+// 旧文件名是"文件名.时间[.序号][.gz]", 按时间和序号排序
+static void RemoveOldLogFiles(const std::string& file, uint32_t max_files) {
+  size_t pos = file.rfind('/');
+  std::string dir = pos == std::string::npos ? "." : file.substr(0, pos + 1);
+  std::string prefix =
+      (pos == std::string::npos ? file : file.substr(pos + 1)) + ".";
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    return;
+  }
+  std::vector<std::tuple<std::string, int, std::string>> files;
+  while (dirent* e = readdir(d)) {
+    std::string name = e->d_name;
+    // 跳过压缩中的临时文件
+    if (name.compare(0, prefix.size(), prefix) ||
+        name.size() < prefix.size() + 15 || !isdigit(name[prefix.size()]) ||
+        name.compare(name.size() - 4, 4, ".tmp") == 0) {
+      continue;
+    }
+    std::string time = name.substr(prefix.size(), 15);
+    const char* rest = name.c_str() + prefix.size() + 15;
+    int seq = *rest == '.' && isdigit(rest[1]) ? atoi(rest + 1) : 0;
+    std::string path = pos == std::string::npos ? name : dir + name;
+    files.push_back(std::make_tuple(time, seq, path));
+  }
+  closedir(d);
+  if (files.size() <= max_files) {
+    return;
+  }
+  std::sort(files.begin(), files.end());
+  for (size_t i = 0; i < files.size() - max_files; ++i) {
+    unlink(std::get<2>(files[i]).c_str());
+  }
+}
+
+static time_t NextRollTime(time_t t, FileLogAppender::Rollover rollover) {
+  if (rollover == FileLogAppender::NONE) {
+    return 0;
+  }
+  struct tm tm;
+  localtime_r(&t, &tm);
+  tm.tm_sec = 0;
+  tm.tm_min = 0;
+  if (rollover == FileLogAppender::HOURLY) {
+    ++tm.tm_hour;
+  } else {
+    tm.tm_hour = 0;
+    ++tm.tm_mday;
+  }
+  tm.tm_isdst = -1;
+  return mktime(&tm);
+}
+
+FileLogAppender::Rollover FileLogAppender::RolloverFromString(
+    const std::string& str) {
+  if (str == "hourly") {
+    return HOURLY;
+  }
+  if (str == "daily") {
+    return DAILY;
+  }
+  return NONE;
+}
+
+std::string FileLogAppender::RolloverToString(Rollover rollover) {
+  switch (rollover) {
+    case HOURLY:
+      return "hourly";
+    case DAILY:
+      return "daily";
+    default:
+      return "none";
+  }
+}
+
+// 备用文件是同一目录下的隐藏文件, 带上进程号和序号, 不会和切分出来的
+// 旧文件或者同一个文件的其他FileLogAppender冲突
+static std::string SpareFileName(const std::string& file) {
+  static std::atomic<uint32_t> s_seq(0);
+  size_t pos = file.rfind('/');
+  std::string dir = pos == std::string::npos ? "" : file.substr(0, pos + 1);
+  std::string base = pos == std::string::npos ? file : file.substr(pos + 1);
+  return dir + "." + base + ".next." + std::to_string(getpid()) + "." +
+         std::to_string(s_seq.fetch_add(1, std::memory_order_relaxed));
+}
+
+FileLogAppender::FileLogAppender(const std::string& file)
+    : FileLogAppender(file, RollOptions()) {}
+
+FileLogAppender::FileLogAppender(const std::string& file,
+                                 const RollOptions& options)
+    : m_filename(file), m_spareName(SpareFileName(file)), m_options(options) {
+  time_t now = time(nullptr);
+  Mutex::Lock lock(m_fileMutex);
+  openFile(now);
+  prepare(now, rollEnabled());
+}
+
+FileLogAppender::~FileLogAppender() {
+  // 后台任务只持有weak_ptr, 没做完的改名在这里做完, 再删掉备用文件
+  Mutex::Lock lock(m_fileMutex);
+  prepare(time(nullptr), false);
+  if (m_spare.is_open()) {
+    m_spare.close();
+    unlink(m_spareName.c_str());
+  }
 }
 
 void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level,
                           LogEvent::ptr event) {
-  MutexType::Lock lock(m_mutex);
-  if (level >= m_level) {
-    m_filestream << m_formatter->format(logger, level, event);
+  if (level < m_level.load(std::memory_order_relaxed)) {
+    return;
   }
+  // 先在锁外格式化, 知道长度才能判断是否要切分
+  static thread_local LogStream t_buffer(LogEvent::kMaxContentSize + 4096);
+  t_buffer.reset();
+  m_formatter->format(t_buffer, logger, level, event);
+  append(event->getTime(), t_buffer.data(), t_buffer.size());
+}
+
+void FileLogAppender::write(const char* data, size_t len) {
+  append(time(nullptr), data, len);
+}
+
+void FileLogAppender::append(time_t now, const char* data, size_t len) {
+  if (!m_watched.load(std::memory_order_relaxed) && !m_watched.exchange(true)) {
+    // 第一次写的时候交给后台线程每秒检查一次文件是否还在
+    std::weak_ptr<FileLogAppender> weak = shared_from_this();
+    GetLogFileWorker()->watch([weak]() {
+      FileLogAppender::ptr self = weak.lock();
+      if (!self) {
+        return false;
+      }
+      Mutex::Lock lock(self->m_fileMutex);
+      self->checkFile(time(nullptr));
+      return true;
+    });
+  }
+  int action = NOTHING;
+  {
+    MutexType::Lock lock(m_mutex);
+    action = checkRoll(now, len);
+    if (!(action & NEED_SPARE)) {
+      m_filestream.write(data, len);
+      m_size += len;
+    }
+  }
+  if (action & NEED_SPARE) {
+    // 连续切分时后台线程还没准备好备用文件, 在锁外自己准备
+    {
+      Mutex::Lock lock(m_fileMutex);
+      prepare(now, true);
+    }
+    MutexType::Lock lock(m_mutex);
+    action = (action | checkRoll(now, len)) & ~NEED_SPARE;
+    m_filestream.write(data, len);
+    m_size += len;
+  }
+  background(action, now);
+}
+
+void FileLogAppender::flush() {
+  MutexType::Lock lock(m_mutex);
+  m_filestream.flush();
 }
 
 bool FileLogAppender::reopen() {
-  RWMutexType::WriteLock lock(m_rwmutex);
-  if (m_filestream) {
-    m_filestream.close();
+  time_t now = time(nullptr);
+  Mutex::Lock lock(m_fileMutex);
+  prepare(now, false);
+  return openFile(now);
+}
+
+bool FileLogAppender::roll() {
+  time_t now = time(nullptr);
+  Mutex::Lock lock(m_fileMutex);
+  prepare(now, true);
+  bool rolled = false;
+  {
+    MutexType::Lock lock2(m_mutex);
+    if (!m_size) {
+      // 空文件不切分, 只推迟下一次切分的时间
+      m_openTime = now;
+      m_nextRoll = NextRollTime(now, m_options.rollover);
+    } else if (m_spare.is_open()) {
+      swapSpare(now);
+      rolled = true;
+    }
+  }
+  if (rolled) {
+    prepare(now, rollEnabled());
+  }
+  return rolled;
+}
+
+int FileLogAppender::checkRoll(time_t now, size_t len) {
+  int action = NOTHING;
+  if ((!m_nextRoll || now < m_nextRoll) &&
+      (!m_options.max_size || !m_size || m_size + len <= m_options.max_size)) {
+    return action;
+  }
+  if (!m_size) {
+    m_openTime = now;
+    m_nextRoll = NextRollTime(now, m_options.rollover);
+  } else if (m_spare.is_open()) {
+    swapSpare(now);
+    action |= ROLLED;
+  } else if (now >= m_spareRetry) {
+    action |= NEED_SPARE;
+  }
+  return action;
+}
+
+void FileLogAppender::swapSpare(time_t now) {
+  // 换下来的文件还叫m_filename, 备用文件改名成m_filename之前先写着
+  m_filestream.swap(m_spare);
+  m_spare.swap(m_retired);
+  m_rolledTime = m_openTime;
+  m_size = m_spareSize;
+  m_dev = m_spareDev;
+  m_inode = m_spareInode;
+  m_openTime = now;
+  m_nextRoll = NextRollTime(now, m_options.rollover);
+}
+
+bool FileLogAppender::openFile(time_t now) {
+  std::ofstream stream(m_filename, std::ios::app);
+  struct stat st;
+  bool ok = stream && stat(m_filename.c_str(), &st) == 0;
+  MutexType::Lock lock(m_mutex);
+  m_filestream.swap(stream);
+  if (ok) {
+    m_size = st.st_size;
+    m_dev = st.st_dev;
+    m_inode = st.st_ino;
+    // 重启后接着写已有的文件, 按它的修改时间判断是否已经该切分了
+    m_openTime = m_size ? st.st_mtime : now;
+  } else {
+    m_size = 0;
+    m_dev = 0;
+    m_inode = 0;
+    m_openTime = now;
+  }
+  m_nextRoll = NextRollTime(m_openTime, m_options.rollover);
+  lock.unlock();
+  // 旧文件在锁外关闭
+  stream.close();
+  return ok;
+}
+
+void FileLogAppender::prepare(time_t now, bool spare) {
+  std::ofstream retired;
+  time_t rolled_time = 0;
+  {
+    MutexType::Lock lock(m_mutex);
+    retired.swap(m_retired);
+    rolled_time = m_rolledTime;
+    spare = spare && !m_spare.is_open();
+  }
+  retired.close();
+  std::string segment;
+  if (rolled_time) {
+    char buf[32];
+    struct tm tm;
+    localtime_r(&rolled_time, &tm);
+    strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+    std::string base = m_filename + "." + buf;
+    // 同一秒切出来的旧文件序号只增不减, 后台删掉了前面的也不复用
+    int seq = base == m_lastBase ? m_lastSeq + 1 : 0;
+    segment = seq ? base + "." + std::to_string(seq) : base;
+    while (access(segment.c_str(), F_OK) == 0 ||
+           access((segment + ".gz").c_str(), F_OK) == 0) {
+      segment = base + "." + std::to_string(++seq);
+    }
+    m_lastBase = base;
+    m_lastSeq = seq;
+    if (rename(m_filename.c_str(), segment.c_str()) != 0) {
+      segment.clear();
+    }
+    rename(m_spareName.c_str(), m_filename.c_str());
+    MutexType::Lock lock(m_mutex);
+    m_rolledTime = 0;
+  }
+  if (spare) {
+    std::ofstream stream(m_spareName, std::ios::app);
+    struct stat st;
+    bool ok = stream && stat(m_spareName.c_str(), &st) == 0;
+    MutexType::Lock lock(m_mutex);
+    if (ok) {
+      m_spare.swap(stream);
+      m_spareSize = st.st_size;
+      m_spareDev = st.st_dev;
+      m_spareInode = st.st_ino;
+    } else {
+      m_spareRetry = now + 1;
+    }
+  }
+  retire(segment);
+}
+
+void FileLogAppender::checkFile(time_t now) {
+  prepare(now, false);
+  dev_t dev = 0;
+  ino_t inode = 0;
+  bool good = false;
+  {
+    MutexType::Lock lock(m_mutex);
+    dev = m_dev;
+    inode = m_inode;
+    good = !!m_filestream;
+  }
+  struct stat st;
+  if (!good || stat(m_filename.c_str(), &st) != 0 || st.st_dev != dev ||
+      st.st_ino != inode) {
+    openFile(now);
+  }
+}
+
+void FileLogAppender::background(int action, time_t now) {
+  if (!(action & ROLLED)) {
+    return;
+  }
+  // 改名, 再准备好下一个备用文件
+  std::weak_ptr<FileLogAppender> weak = shared_from_this();
+  ScheduleLogFileTask([weak, now]() {
+    FileLogAppender::ptr self = weak.lock();
+    if (self) {
+      Mutex::Lock lock(self->m_fileMutex);
+      self->prepare(now, true);
+    }
+  });
+}
+
+void FileLogAppender::retire(const std::string& segment) {
+  if (segment.empty() || (!m_options.compress && !m_options.max_files)) {
+    return;
+  }
+  std::string file = m_filename;
+  RollOptions options = m_options;
+  ScheduleLogFileTask([segment, file, options]() {
+    if (options.compress) {
+      CompressLogFile(segment);
+    }
+    if (options.max_files) {
+      RemoveOldLogFiles(file, options.max_files);
+    }
+  });
+}
+
+// 从后往前写十进制, 返回开始的位置
+static char* FormatUInt(char* end, uint64_t v) {
+  do {
+    *--end = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  return end;
+}
+
+static void WriteUInt(std::streambuf* sb, uint64_t v) {
+  char buf[24];
+  char* end = buf + sizeof(buf);
+  char* begin = FormatUInt(end, v);
+  sb->sputn(begin, end - begin);
+}
+
+static void WriteInt(std::streambuf* sb, int64_t v) {
+  if (v < 0) {
+    sb->sputc('-');
+    WriteUInt(sb, -static_cast<uint64_t>(v));
+  } else {
+    WriteUInt(sb, v);
+  }
+}
+
+// 整数值直接按整数输出, 其他的用能还原出原值的最短的%g; JSON没有inf/nan
+static void WriteDouble(std::streambuf* sb, double v) {
+  if (!std::isfinite(v)) {
+    sb->sputn("null", 4);
+    return;
+  }
+  // 先判断范围, 超出int64_t的double转整数是未定义行为
+  if (std::fabs(v) < 1e15 && v == static_cast<int64_t>(v)) {
+    WriteInt(sb, static_cast<int64_t>(v));
+    return;
+  }
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%.15g", v);
+  if (strtod(buf, nullptr) != v) {
+    len = snprintf(buf, sizeof(buf), "%.17g", v);
+  }
+  sb->sputn(buf, len);
+}
+
+// 需要转义的字符: 0不用转义, 'u'输出\u00XX, 其他输出反斜杠加这个字符
+struct JsonEscapeTable {
+  JsonEscapeTable() {
+    memset(table, 0, sizeof(table));
+    for (int i = 0; i < 0x20; ++i) {
+      table[i] = 'u';
+    }
+    table[static_cast<uint8_t>('"')] = '"';
+    table[static_cast<uint8_t>('\\')] = '\\';
+    table[static_cast<uint8_t>('\b')] = 'b';
+    table[static_cast<uint8_t>('\f')] = 'f';
+    table[static_cast<uint8_t>('\n')] = 'n';
+    table[static_cast<uint8_t>('\r')] = 'r';
+    table[static_cast<uint8_t>('\t')] = 't';
+    table[0x7f] = 'u';
+  }
+
+  char table[256];
+};
+
+static const JsonEscapeTable s_json_escape;
+
+// 不需要转义的连续字符一次写出去
+static void WriteJsonString(std::streambuf* sb, const char* str, size_t len) {
+  static const char kHex[] = "0123456789abcdef";
+  sb->sputc('"');
+  size_t begin = 0;
+  for (size_t i = 0; i < len; ++i) {
+    uint8_t c = str[i];
+    char e = s_json_escape.table[c];
+    if (!e) {
+      continue;
+    }
+    sb->sputn(str + begin, i - begin);
+    if (e == 'u') {
+      char buf[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+      sb->sputn(buf, 6);
+    } else {
+      char buf[2] = {'\\', e};
+      sb->sputn(buf, 2);
+    }
+    begin = i + 1;
+  }
+  sb->sputn(str + begin, len - begin);
+  sb->sputc('"');
+}
+
+static void WriteFieldValue(std::streambuf* sb, const LogEvent& event,
+                            const LogEvent::Field& field, bool json) {
+  switch (field.type) {
+    case LogEvent::Field::INT:
+      WriteInt(sb, field.i);
+      break;
+    case LogEvent::Field::UINT:
+      WriteUInt(sb, field.u);
+      break;
+    case LogEvent::Field::DOUBLE:
+      WriteDouble(sb, field.d);
+      break;
+    case LogEvent::Field::BOOL:
+      field.b ? sb->sputn("true", 4) : sb->sputn("false", 5);
+      break;
+    case LogEvent::Field::STRING: {
+      const char* str = event.getFieldData() + field.str;
+      // 文本格式里只有带空格, 引号, =或控制字符的字符串才加引号
+      bool quote = json || !field.str_len;
+      for (size_t i = 0; !quote && i < field.str_len; ++i) {
+        uint8_t c = str[i];
+        quote = c == ' ' || c == '=' || s_json_escape.table[c];
+      }
+      if (quote) {
+        WriteJsonString(sb, str, field.str_len);
+      } else {
+        sb->sputn(str, field.str_len);
+      }
+      break;
+    }
+  }
+}
+
+// %K: 每个键值对输出为" key=value"
+static void WriteTextFields(std::streambuf* sb, const LogEvent& event) {
+  for (auto& field : event.getFields()) {
+    sb->sputc(' ');
+    sb->sputn(event.getFieldData() + field.key, field.key_len);
+    sb->sputc('=');
+    WriteFieldValue(sb, event, field, false);
   }
-  m_filestream.open(m_filename);
-  return !m_filestream;
 }
 
 // Formatter
@@ -356,7 +1295,10 @@ class MessageFormatItem : public LogFormatter::FormatItem {
  public:
   void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level,
               LogEvent::ptr event) override {
-    os << event->getContent();
+    os.write(event->getContentData(), event->getContentSize());
+    if (event->isTruncated()) {
+      os << "...";
+    }
   }
 };
 
@@ -368,12 +1310,18 @@ class LevelFormatItem : public LogFormatter::FormatItem {
   }
 };
 
+// %r进程启动以来的毫秒数, %r{us}微秒数; 用的是单调时钟, 不受改系统时间影响
 class ElapseFormatItem : public LogFormatter::FormatItem {
  public:
+  ElapseFormatItem(const std::string& fmt = "") : m_us(fmt == "us") {}
+
   void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level,
               LogEvent::ptr event) override {
-    os << event->getElapse();  // TODO:
+    os << (m_us ? event->getElapse() : event->getElapse() / 1000);
   }
+
+ private:
+  bool m_us;
 };
 
 class ThreadIdFormatItem : public LogFormatter::FormatItem {
@@ -392,29 +1340,112 @@ class FiberIdFormatItem : public LogFormatter::FormatItem {
   }
 };
 
+// strftime的格式, 另外支持%3N(毫秒) %6N(微秒) %9N/%N(纳秒).
+// 秒以上的部分每个线程缓存一份, 同一秒内的日志只需要拷贝再补上秒以下的数字
 class DateTimeFormatItem : public LogFormatter::FormatItem {
  public:
   DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
-      : m_format(format) {
-    if (m_format.empty()) {
-      m_format = "%Y-%m-%d %H:%M:%S";
+      : m_id(++s_id) {
+    std::string fmt = format.empty() ? "%Y-%m-%d %H:%M:%S" : format;
+    std::string str;
+    for (size_t i = 0; i < fmt.size(); ++i) {
+      if (fmt[i] != '%' || i + 1 == fmt.size()) {
+        str.push_back(fmt[i]);
+        continue;
+      }
+      int digits = 0;
+      size_t len = 0;
+      if (fmt[i + 1] == 'N') {
+        digits = 9;
+        len = 2;
+      } else if (i + 2 < fmt.size() && fmt[i + 2] == 'N' &&
+                 (fmt[i + 1] == '3' || fmt[i + 1] == '6' ||
+                  fmt[i + 1] == '9')) {
+        digits = fmt[i + 1] - '0';
+        len = 3;
+      }
+      if (!digits || m_segments.size() + 1 >= kMaxSegments) {
+        // 其他的交给strftime, %%也要原样保留
+        str.append(fmt, i, 2);
+        ++i;
+        continue;
+      }
+      m_segments.push_back(Segment{str, digits});
+      str.clear();
+      i += len - 1;
     }
+    m_segments.push_back(Segment{str, 0});
   }
 
   void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level,
               LogEvent::ptr event) override {
-    struct tm tm;
-    time_t time = event->getTime();
-    localtime_r(&time, &tm);
-    char buf[64]{0};
-    strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-    os << buf;
+    write(os.rdbuf(), *event);
+  }
+
+  void write(std::streambuf* sb, const LogEvent& event) {
+    // 每个线程缓存几个item的结果, 用m_id区分, item析构后地址重用也不会错
+    static thread_local Cache t_caches[kCaches];
+    Cache& cache = t_caches[m_id % kCaches];
+    time_t time = event.getTime();
+    if (cache.id != m_id || cache.time != time) {
+      struct tm tm;
+      localtime_r(&time, &tm);
+      size_t len = 0;
+      for (size_t i = 0; i < m_segments.size(); ++i) {
+        if (!m_segments[i].format.empty()) {
+          len += strftime(cache.buf + len, sizeof(cache.buf) - len,
+                          m_segments[i].format.c_str(), &tm);
+        }
+        cache.ends[i] = len;
+      }
+      cache.id = m_id;
+      cache.time = time;
+    }
+
+    size_t begin = 0;
+    for (size_t i = 0; i < m_segments.size(); ++i) {
+      sb->sputn(cache.buf + begin, cache.ends[i] - begin);
+      begin = cache.ends[i];
+      int digits = m_segments[i].digits;
+      if (digits) {
+        char buf[9];
+        uint32_t v = event.getNanoSecond();
+        for (int j = 9; j > digits; --j) {
+          v /= 10;
+        }
+        for (int j = digits - 1; j >= 0; --j) {
+          buf[j] = '0' + v % 10;
+          v /= 10;
+        }
+        sb->sputn(buf, digits);
+      }
+    }
   }
 
  private:
-  std::string m_format;
+  static const size_t kMaxSegments = 8;
+  static const size_t kCaches = 4;
+
+  // strftime的格式, 后面跟digits位秒以下的数字
+  struct Segment {
+    std::string format;
+    int digits;
+  };
+
+  struct Cache {
+    uint64_t id = 0;
+    time_t time = 0;
+    size_t ends[kMaxSegments];
+    char buf[128];
+  };
+
+  static std::atomic<uint64_t> s_id;
+  uint64_t m_id;
+  std::vector<Segment> m_segments;
 };
 
+std::atomic<uint64_t> DateTimeFormatItem::s_id{0};
+
 class LineFormatItem : public LogFormatter::FormatItem {
  public:
   void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level,
@@ -447,6 +1478,14 @@ class NewLineFormatItem : public LogFormatter::FormatItem {
   }
 };
 
+class FieldsFormatItem : public LogFormatter::FormatItem {
+ public:
+  void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level,
+              LogEvent::ptr event) override {
+    WriteTextFields(os.rdbuf(), *event);
+  }
+};
+
 class TabFormatItem : public LogFormatter::FormatItem {
  public:
   void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level,
@@ -455,19 +1494,11 @@ class TabFormatItem : public LogFormatter::FormatItem {
   }
 };
 
-LogFormatter::LogFormatter(const std::string& pattern) : m_pattern(pattern) {
-  m_error = !initPattern(m_pattern, m_items);
-}
-
-bool LogFormatter::checkValid(const std::string& pattern) {
-  std::vector<FormatItem::ptr> items;
-  return LogFormatter::initPattern(pattern, items);
-}
+// str, format, type(0是普通字符串, 1是%后面的item)
+using PatternTokens = std::vector<std::tuple<std::string, std::string, int>>;
 
-bool LogFormatter::initPattern(const std::string& pattern,
-                               std::vector<FormatItem::ptr>& items) {
-  //str, format, type
-  std::vector<std::tuple<std::string, std::string, int>> vec;
+// 把pattern拆成字符串和item, 格式错误返回false
+static bool ParsePattern(const std::string& pattern, PatternTokens& vec) {
   std::string nstr;
   bool error = false;
   for (size_t i = 0; i < pattern.size(); i++) {
@@ -479,6 +1510,7 @@ bool LogFormatter::initPattern(const std::string& pattern,
     if (i + 1 < pattern.size()) {
       if (pattern[i + 1] == '%') {
         nstr.push_back('%');
+        ++i;
         continue;
       }
     }
@@ -537,7 +1569,13 @@ bool LogFormatter::initPattern(const std::string& pattern,
   if (!nstr.empty()) {
     vec.push_back(std::make_tuple(nstr, "", 0));
   }
+  return !error;
+}
 
+bool LogFormatter::initPattern(const std::string& pattern,
+                               std::vector<FormatItem::ptr>& items) {
+  PatternTokens vec;
+  bool error = !ParsePattern(pattern, vec);
   static std::unordered_map<
       std::string, std::function<FormatItem::ptr(const std::string& str)>>
       s_format_items = {
@@ -546,19 +1584,28 @@ bool LogFormatter::initPattern(const std::string& pattern,
 #str, [](const std::string& fmt) { \
       return std::make_shared<C>();    \
     }                                  \
+  }
+// 带{}参数的item
+#define XF(str, C)                      \
+  {                                     \
+#str, [](const std::string& fmt) {  \
+      return std::make_shared<C>(fmt);  \
+    }                                   \
   }
           XX(m, MessageFormatItem),
           XX(p, LevelFormatItem),
-          XX(r, ElapseFormatItem),
+          XF(r, ElapseFormatItem),
           XX(c, NameFormatItem),
           XX(t, ThreadIdFormatItem),
           XX(n, NewLineFormatItem),
-          XX(d, DateTimeFormatItem),
+          XF(d, DateTimeFormatItem),
           XX(f, FilenameFormatItem),
           XX(l, LineFormatItem),
           XX(T, TabFormatItem),
           XX(F, FiberIdFormatItem),
-          XX(N, ThreadIdFormatItem)
+          XX(N, ThreadIdFormatItem),
+          XX(K, FieldsFormatItem)
+#undef XF
 #undef XX
       };
   for (auto& i : vec) {
@@ -581,38 +1628,409 @@ bool LogFormatter::initPattern(const std::string& pattern,
   return !error;
 }
 
+// 编译后的pattern: 连续的字符串合并到literals里, 其他item变成一条指令,
+// format时在一个switch循环里执行, 没有虚函数调用
+// 正在读LogFormatter::m_program的线程. seq是奇数表示在读, 每进出一次加1.
+// setPattern换下来的Program记下当时在读的线程, 等它们的seq都变了, 也就是
+// 都离开过一次, 才释放(简化的epoch回收). 读的过程中不会切换协程
+struct FormatReader {
+  std::atomic<uint64_t> seq{0};
+};
+
+namespace {
+
+struct FormatReaders {
+  FormatReaders() { pthread_key_create(&key, &Unregister); }
+
+  // 线程退出时调用, 比thread_local的析构晚, 那些析构函数里还可以打日志
+  static void Unregister(void* arg);
+
+  Mutex mutex;
+  std::list<std::shared_ptr<FormatReader>> list;
+  pthread_key_t key;
+};
+
+FormatReaders* GetFormatReaders() {
+  // 不释放, 进程退出时还有线程在退出
+  static FormatReaders* s_readers = new FormatReaders;
+  return s_readers;
+}
+
+thread_local FormatReader* t_format_reader = nullptr;
+
+void FormatReaders::Unregister(void* arg) {
+  t_format_reader = nullptr;
+  FormatReaders* readers = GetFormatReaders();
+  Mutex::Lock lock(readers->mutex);
+  for (auto it = readers->list.begin(); it != readers->list.end(); ++it) {
+    if (it->get() == arg) {
+      readers->list.erase(it);
+      break;
+    }
+  }
+}
+
+// 每个线程第一次读的时候登记
+FormatReader* GetFormatReader() {
+  if (!t_format_reader) {
+    std::shared_ptr<FormatReader> reader = std::make_shared<FormatReader>();
+    FormatReaders* readers = GetFormatReaders();
+    {
+      Mutex::Lock lock(readers->mutex);
+      readers->list.push_back(reader);
+    }
+    t_format_reader = reader.get();
+    pthread_setspecific(readers->key, t_format_reader);
+  }
+  return t_format_reader;
+}
+
+}  // namespace
+
+struct LogFormatter::Program {
+  enum Code : uint8_t {
+    LITERAL,  // literals[a, a + b)
+    MESSAGE,
+    LEVEL,
+    ELAPSE_MS,
+    ELAPSE_US,
+    THREAD_ID,
+    FIBER_ID,
+    DATETIME,  // datetimes[a]
+    FILENAME,
+    LINE,
+    NAME,
+    FIELDS,
+  };
+
+  struct Op {
+    Code code;
+    uint32_t a;
+    uint32_t b;
+  };
+
+  std::string pattern;
+  bool error = false;
+  // pattern是json或json{时间格式}时, 整行输出为一个JSON对象
+  bool json = false;
+  std::vector<Op> ops;
+  std::string literals;
+  std::vector<std::unique_ptr<DateTimeFormatItem>> datetimes;
+  // 换下来时正在format的线程和它们当时的seq
+  std::vector<std::pair<std::shared_ptr<FormatReader>, uint64_t>> busy;
+
+  void addLiteral(const std::string& str) {
+    if (!ops.empty() && ops.back().code == LITERAL) {
+      ops.back().b += str.size();
+    } else {
+      ops.push_back(Op{LITERAL, static_cast<uint32_t>(literals.size()),
+                       static_cast<uint32_t>(str.size())});
+    }
+    literals += str;
+  }
+};
+
+LogFormatter::Program* LogFormatter::Compile(const std::string& pattern) {
+  std::unique_ptr<Program> prog(new Program);
+  prog->pattern = pattern;
+  PatternTokens vec;
+  bool error = !ParsePattern(pattern, vec);
+  static const std::unordered_map<std::string, Program::Code> s_codes = {
+#define XX(str, code) \
+  { #str, Program::code }
+      XX(m, MESSAGE),  XX(p, LEVEL),    XX(r, ELAPSE_MS), XX(c, NAME),
+      XX(t, THREAD_ID), XX(d, DATETIME), XX(f, FILENAME), XX(l, LINE),
+      XX(F, FIBER_ID),  XX(N, THREAD_ID), XX(K, FIELDS)
+#undef XX
+  };
+  if (pattern == "json" ||
+      (pattern.compare(0, 5, "json{") == 0 && pattern.back() == '}')) {
+    std::string fmt = pattern.size() > 4
+                          ? pattern.substr(5, pattern.size() - 6)
+                          : "%Y-%m-%d %H:%M:%S.%3N";
+    // 时间直接写在JSON的字符串里, 不做转义
+    if (fmt.find_first_of("\"\\") != std::string::npos) {
+      throw std::invalid_argument(pattern);
+    }
+    prog->json = true;
+    prog->datetimes.emplace_back(new DateTimeFormatItem(fmt));
+    return prog.release();
+  }
+  for (auto& i : vec) {
+    const std::string& str = std::get<0>(i);
+    const std::string& fmt = std::get<1>(i);
+    if (std::get<2>(i) == 0) {
+      prog->addLiteral(str);
+      continue;
+    }
+    if (str == "n") {
+      prog->addLiteral("\n");
+      continue;
+    }
+    if (str == "T") {
+      prog->addLiteral("\t");
+      continue;
+    }
+    auto it = s_codes.find(str);
+    if (it == s_codes.end()) {
+      prog->addLiteral("<<error_format %" + str + ">>");
+      error = true;
+      continue;
+    }
+    Program::Code code = it->second;
+    uint32_t a = 0;
+    if (code == Program::ELAPSE_MS && fmt == "us") {
+      code = Program::ELAPSE_US;
+    } else if (code == Program::DATETIME) {
+      a = prog->datetimes.size();
+      prog->datetimes.emplace_back(new DateTimeFormatItem(fmt));
+    }
+    prog->ops.push_back(Program::Op{code, a, 0});
+  }
+  if (error) {
+    throw std::invalid_argument(pattern);
+  }
+  prog->error = error;
+  return prog.release();
+}
+
+bool LogFormatter::checkValid(const std::string& pattern) {
+  // json模式没有对应的item, 按编译的结果判断
+  try {
+    delete Compile(pattern);
+  } catch (std::invalid_argument&) {
+    return false;
+  }
+  return true;
+}
+
+// 读m_program期间持有, seq先变成奇数再读, 离开时变回偶数
+class LogFormatter::ReadGuard {
+ public:
+  explicit ReadGuard(const std::atomic<Program*>& program)
+      : m_reader(GetFormatReader()) {
+    m_seq = m_reader->seq.load(std::memory_order_relaxed);
+    m_reader->seq.store(m_seq + 1);
+    prog = program.load();
+  }
+
+  ~ReadGuard() { m_reader->seq.store(m_seq + 2, std::memory_order_release); }
+
+  const Program* prog;
+
+ private:
+  FormatReader* m_reader;
+  uint64_t m_seq;
+};
+
+LogFormatter::LogFormatter(const std::string& pattern)
+    : m_program(Compile(pattern)) {}
+
+LogFormatter::~LogFormatter() {
+  delete m_program.load();
+  for (auto prog : m_retired) {
+    delete prog;
+  }
+}
+
 bool LogFormatter::setPattern(const std::string& pattern) {
+  Program* prog = Compile(pattern);
+  bool error = prog->error;
   RWMutexType::WriteLock lock(m_rwmutex);
-  m_error = !initPattern(pattern, m_items);
-  return !m_error;
+  Program* old = m_program.exchange(prog);
+  {
+    // 这之后才开始读的线程拿到的都是新的
+    FormatReaders* readers = GetFormatReaders();
+    Mutex::Lock lock2(readers->mutex);
+    for (auto& reader : readers->list) {
+      uint64_t seq = reader->seq.load();
+      if (seq & 1) {
+        old->busy.push_back(std::make_pair(reader, seq));
+      }
+    }
+  }
+  m_retired.push_back(old);
+  // 释放所有读者都已经离开的, 留下的只有还在读的
+  auto end = std::remove_if(m_retired.begin(), m_retired.end(),
+                            [](Program* p) {
+                              for (auto& i : p->busy) {
+                                if (i.first->seq.load() == i.second) {
+                                  return false;
+                                }
+                              }
+                              delete p;
+                              return true;
+                            });
+  m_retired.erase(end, m_retired.end());
+  return !error;
 }
 
 bool LogFormatter::getError() const {
-  RWMutexType::ReadLock lock(m_rwmutex);
-  return m_error;
+  ReadGuard guard(m_program);
+  return guard.prog->error;
 }
 
 std::string LogFormatter::getPattern() const {
-  RWMutexType::ReadLock lock(m_rwmutex);
-  return m_pattern;
+  ReadGuard guard(m_program);
+  return guard.prog->pattern;
 }
 
-std::string LogFormatter::format(Logger::ptr logger, LogLevel::Level level,
-                                 LogEvent::ptr event) {
+std::string LogFormatter::format(const Logger::ptr& logger,
+                                 LogLevel::Level level,
+                                 const LogEvent::ptr& event) {
   std::stringstream ss;
-  {
-    RWMutexType::ReadLock lock(m_rwmutex);
-    for (auto& i : m_items) {
-      i->format(ss, logger, level, event);
+  format(ss, logger, level, event);
+  return ss.str();
+}
+
+// 线程号和协程号在一段时间内不变, 每个线程缓存最近一次格式化的结果
+struct IdCache {
+  uint64_t id = UINT64_MAX;
+  char buf[24];
+  char* begin = buf + sizeof(buf);
+
+  void write(std::streambuf* sb, uint64_t v) {
+    if (v != id) {
+      id = v;
+      begin = FormatUInt(buf + sizeof(buf), v);
+    }
+    sb->sputn(begin, buf + sizeof(buf) - begin);
+  }
+};
+
+struct LevelName {
+  const char* str;
+  size_t len;
+};
+
+static const LevelName& GetLevelName(LogLevel::Level level) {
+  static const LevelName s_names[] = {
+#define XX(name) \
+  { #name, sizeof(#name) - 1 }
+      XX(UNKNOW), XX(DEBUG), XX(INFO),  XX(WARN),
+      XX(ERROR),  XX(FATAL), XX(UNKNOW)
+#undef XX
+  };
+  // 和LogLevel::ToString一致, 不认识的都是UNKNOW
+  size_t i = static_cast<size_t>(level);
+  return s_names[i < sizeof(s_names) / sizeof(s_names[0]) ? i : 0];
+}
+
+// {"time":..,"level":..,"logger":..,"thread":..,"fiber":..,"file":..,
+//  "line":..,"msg":..,键值对...}
+static void FormatJson(std::streambuf* sb, DateTimeFormatItem& datetime,
+                       LogLevel::Level level, const LogEvent& ev) {
+  sb->sputn("{\"time\":\"", 9);
+  datetime.write(sb, ev);
+  sb->sputn("\",\"level\":\"", 11);
+  const LevelName& name = GetLevelName(level);
+  sb->sputn(name.str, name.len);
+  sb->sputn("\",\"logger\":", 11);
+  const std::string& logger = ev.getLogger()->getName();
+  WriteJsonString(sb, logger.data(), logger.size());
+  sb->sputn(",\"thread\":", 10);
+  WriteUInt(sb, ev.getThreadId());
+  sb->sputn(",\"fiber\":", 9);
+  WriteUInt(sb, ev.getFiberId());
+  sb->sputn(",\"file\":", 8);
+  const char* file = ev.getFile() ? ev.getFile() : "";
+  WriteJsonString(sb, file, strlen(file));
+  sb->sputn(",\"line\":", 8);
+  WriteInt(sb, ev.getLine());
+  sb->sputn(",\"msg\":", 7);
+  if (ev.isTruncated()) {
+    // 截断的消息后面加上..., 和文本格式一样
+    std::string tmp(ev.getContentData(), ev.getContentSize());
+    tmp += "...";
+    WriteJsonString(sb, tmp.data(), tmp.size());
+  } else {
+    WriteJsonString(sb, ev.getContentData(), ev.getContentSize());
+  }
+  for (auto& field : ev.getFields()) {
+    sb->sputc(',');
+    WriteJsonString(sb, ev.getFieldData() + field.key, field.key_len);
+    sb->sputc(':');
+    WriteFieldValue(sb, ev, field, true);
+  }
+  sb->sputn("}\n", 2);
+}
+
+void LogFormatter::format(std::ostream& os, const Logger::ptr& logger,
+                          LogLevel::Level level, const LogEvent::ptr& event) {
+  static thread_local IdCache t_thread_id;
+  static thread_local IdCache t_fiber_id;
+  ReadGuard guard(m_program);
+  const Program* prog = guard.prog;
+  const LogEvent& ev = *event;
+  // 直接写streambuf, 省掉每次ostream::write的sentry
+  std::streambuf* sb = os.rdbuf();
+  if (prog->json) {
+    FormatJson(sb, *prog->datetimes[0], level, ev);
+    return;
+  }
+  for (const Program::Op& op : prog->ops) {
+    switch (op.code) {
+      case Program::LITERAL:
+        sb->sputn(prog->literals.data() + op.a, op.b);
+        break;
+      case Program::MESSAGE:
+        sb->sputn(ev.getContentData(), ev.getContentSize());
+        if (ev.isTruncated()) {
+          sb->sputn("...", 3);
+        }
+        break;
+      case Program::LEVEL: {
+        const LevelName& name = GetLevelName(level);
+        sb->sputn(name.str, name.len);
+        break;
+      }
+      case Program::ELAPSE_MS:
+        WriteUInt(sb, ev.getElapse() / 1000);
+        break;
+      case Program::ELAPSE_US:
+        WriteUInt(sb, ev.getElapse());
+        break;
+      case Program::THREAD_ID:
+        t_thread_id.write(sb, ev.getThreadId());
+        break;
+      case Program::FIBER_ID:
+        t_fiber_id.write(sb, ev.getFiberId());
+        break;
+      case Program::DATETIME:
+        prog->datetimes[op.a]->write(sb, ev);
+        break;
+      case Program::FILENAME:
+        if (ev.getFile()) {
+          sb->sputn(ev.getFile(), strlen(ev.getFile()));
+        }
+        break;
+      case Program::LINE:
+        if (ev.getLine() < 0) {
+          sb->sputc('-');
+          WriteUInt(sb, -static_cast<int64_t>(ev.getLine()));
+        } else {
+          WriteUInt(sb, ev.getLine());
+        }
+        break;
+      case Program::NAME: {
+        const std::string& name = ev.getLogger()->getName();
+        sb->sputn(name.data(), name.size());
+        break;
+      }
+      case Program::FIELDS:
+        WriteTextFields(sb, ev);
+        break;
     }
   }
-  return ss.str();
 }
 
 // Log dataset structure
 bool LogAppenderDefine::operator==(const LogAppenderDefine& oth) const {
   return type == oth.type && level == oth.level && formatter == oth.formatter &&
-         oth.file == oth.file;
+         file == oth.file && async == oth.async &&
+         queue_size == oth.queue_size && overflow == oth.overflow &&
+         max_size == oth.max_size && rollover == oth.rollover &&
+         max_files == oth.max_files && compress == oth.compress;
 }
 
 bool LogDefine::operator==(const LogDefine& oth) const {
@@ -626,7 +2044,8 @@ bool LogDefine::operator==(const LogDefine& oth) const {
     }
   }
 
-  return name == oth.name && level == oth.level && formatter == oth.formatter;
+  return name == oth.name && level == oth.level &&
+         formatter == oth.formatter && limit == oth.limit;
 }
 
 bool LogDefine::operator<(const LogDefine& oth) const {
@@ -682,6 +2101,7 @@ void LoggerManager::init() {
         }
       }
       logger->setLevel(i.level);
+      logger->setLimit(i.limit);
       if (!i.formatter.empty()) {
         logger->setFormatter(i.formatter);
       }
@@ -693,8 +2113,18 @@ void LoggerManager::init() {
           case LogAppender::STDOUT_LOG_APPENDER:
             ap.reset(new StdoutLogAppender);
             break;
-          case LogAppender::FILE_LOG_APPENDER:
-            ap.reset(new FileLogAppender(appender.file));
+          case LogAppender::FILE_LOG_APPENDER: {
+            FileLogAppender::RollOptions options;
+            options.max_size = appender.max_size;
+            options.rollover =
+                FileLogAppender::RolloverFromString(appender.rollover);
+            options.max_files = appender.max_files;
+            options.compress = appender.compress;
+            ap.reset(new FileLogAppender(appender.file, options));
+            break;
+          }
+          case LogAppender::MMAP_FILE_LOG_APPENDER:
+            ap.reset(new MmapFileLogAppender(appender.file));
             break;
           default:
             DDG_LOG_INFO(DDG_LOG_ROOT())
@@ -706,6 +2136,14 @@ void LoggerManager::init() {
         if (!appender.formatter.empty()) {
           ap->setFormatter(std::make_shared<LogFormatter>(appender.formatter));
         }
+        if (appender.async) {
+          auto async = std::make_shared<AsyncLogAppender>(
+              ap, appender.queue_size ? appender.queue_size
+                                      : AsyncLogAppender::kDefaultQueueSize,
+              AsyncLogAppender::OverflowFromString(appender.overflow));
+          async->setLevel(appender.level);
+          ap = async;
+        }
         logger->addAppender(ap);
       }
     }
@@ -717,6 +2155,7 @@ void LoggerManager::init() {
         logger->setLevel(static_cast<LogLevel::Level>(
             100));  // 设置后会立即生效，但是在使用的线程或者协程，正在使用不会报错
         logger->clearAppender();  // 当其他进程和携程使用完后，就可以释放了
+        logger->setLimit(LogLimit());
         DDG_LOG_REMOVE(i.name);
       }
     }
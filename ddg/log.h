@@ -1,8 +1,13 @@
 #ifndef DDG_LOG_H_
 #define DDG_LOG_H_
 
+#include <ctype.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
 #include <time.h>
+#include <atomic>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -10,6 +15,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -23,12 +29,33 @@
 // Logger(DEBUG) -> LogAppender(DEBUG) -> LogEvent(DEBUG)
 // if you want to output level, must clear the each level
 
-#define DDG_LOG_LEVEL(logger, level)                                     \
-  if (logger->getLevel() <= level)                                       \
-  ddg::LogEventWrap(std::make_shared<ddg::LogEvent>(                     \
-                        logger, level, __FILE__, __LINE__, 0,            \
-                        ddg::GetThreadId(), ddg::GetFiberId(), time(0))) \
-      .getSS()
+// 编译期的最低日志级别(LogLevel::Level的值), 低于它的日志语句条件恒为假,
+// 整条语句被编译器去掉. 例如-DDDG_LOG_MIN_LEVEL=2去掉所有DEBUG日志
+#ifndef DDG_LOG_MIN_LEVEL
+#define DDG_LOG_MIN_LEVEL 1
+#endif
+
+#define DDG_LOG_ENABLED(level) ((level) >= DDG_LOG_MIN_LEVEL)
+
+// 当前调用点的LogSite, 只在logger配置了限速或抽样时才构造
+// 调用点不析构, 进程退出时别的线程还可能在打日志
+#define DDG_LOG_SITE()                                                  \
+  ([]() -> ddg::LogSite& {                                              \
+    static ddg::LogSite* ddg_log_site =                                 \
+        new ddg::LogSite(__FILE__, __LINE__);                           \
+    return *ddg_log_site;                                               \
+  }())
+
+// 级别满足, 并且没有被这个调用点的限速或抽样丢掉
+#define DDG_LOG_PASS(logger, level)                            \
+  (DDG_LOG_ENABLED(level) && logger->getLevel() <= level &&    \
+   (!logger->isLimited() || DDG_LOG_SITE().allow(*logger, level)))
+
+// 可以先附加键值对, 再输出消息: DDG_LOG_INFO(g_logger).kv("fd", fd) << "..."
+#define DDG_LOG_LEVEL(logger, level)                                    \
+  if (DDG_LOG_PASS(logger, level))                                      \
+  ddg::LogEventWrap(logger, level, __FILE__, __LINE__,                  \
+                    ddg::GetThreadId(), ddg::GetFiberId())
 
 #define DDG_LOG_DEBUG(logger) DDG_LOG_LEVEL(logger, ddg::LogLevel::DEBUG)
 
@@ -40,12 +67,11 @@
 
 #define DDG_LOG_FATAL(logger) DDG_LOG_LEVEL(logger, ddg::LogLevel::FATAL)
 
-#define DDG_LOG_FMT_LEVEL(logger, level, fmt, ...)                       \
-  if (logger->getLevel() <= level)                                       \
-  ddg::LogEventWrap(std::make_shared<ddg::LogEvent>(                     \
-                        logger, level, __FILE__, __LINE__, 0,            \
-                        ddg::GetThreadId(), ddg::GetFiberId(), time(0))) \
-      .getEvent()                                                        \
+#define DDG_LOG_FMT_LEVEL(logger, level, fmt, ...)                      \
+  if (DDG_LOG_PASS(logger, level))                                      \
+  ddg::LogEventWrap(logger, level, __FILE__, __LINE__,                  \
+                    ddg::GetThreadId(), ddg::GetFiberId())              \
+      .getEvent()                                                       \
       ->format(fmt, __VA_ARGS__)
 
 #define DDG_LOG_FMT_DEBUG(logger, fmt, ...) \
@@ -90,18 +116,80 @@ class LogLevel {
   static LogLevel::Level FromString(const std::string& level_str);
 };
 
+// 固定容量的缓冲区, 写满之后多出来的内容直接丢掉, 不会再分配内存
+class LogStreamBuf : public std::streambuf {
+ public:
+  explicit LogStreamBuf(size_t capacity);
+
+  const char* data() const { return pbase(); }
+
+  size_t size() const { return pptr() - pbase(); }
+
+  bool isTruncated() const { return m_truncated; }
+
+  void reset();
+
+  // 直接格式化到缓冲区里
+  void vprintf(const char* fmt, va_list al);
+
+ protected:
+  int_type overflow(int_type c) override;
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+ private:
+  std::unique_ptr<char[]> m_data;
+  size_t m_capacity;
+  bool m_truncated = false;
+};
+
+// 写到LogStreamBuf的输出流, reset之后可以重复使用
+class LogStream : public std::ostream {
+ public:
+  explicit LogStream(size_t capacity);
+
+  const char* data() const { return m_buf.data(); }
+
+  size_t size() const { return m_buf.size(); }
+
+  bool isTruncated() const { return m_buf.isTruncated(); }
+
+  // 清空内容, 恢复std::hex之类的格式设置
+  void reset();
+
+  void vprintf(const char* fmt, va_list al) { m_buf.vprintf(fmt, al); }
+
+ private:
+  LogStreamBuf m_buf;
+  std::ios_base::fmtflags m_flags;
+};
+
 // LogEvent
 class LogEvent {
  public:
+  // 日志内容的最大长度, 超出的部分截断
+  static const size_t kMaxContentSize = 16 * 1024;
+
+  /**
+   * @param elapse 进程启动到现在的单调时间, 微秒
+   * @param time 时间戳, 秒
+   * @param nsec 时间戳秒以下的纳秒部分
+   */
   LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
            const char* file, const int32_t& line, const uint64_t& elapse,
            const uint64_t& thread_id, const uint64_t& fiber_id,
-           const uint64_t& time);
+           const uint64_t& time, uint32_t nsec = 0);
 
   // typedef std::shared_ptr<LogEvent> ptr;
   using ptr = std::shared_ptr<LogEvent>;
 
-  std::shared_ptr<Logger> getLogger() const { return m_logger; }
+  // 复用这个LogEvent记录新的一条日志
+  void reset(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+             const char* file, int32_t line, uint64_t elapse,
+             uint64_t thread_id, uint64_t fiber_id, uint64_t time,
+             uint32_t nsec);
+
+  const std::shared_ptr<Logger>& getLogger() const { return m_logger; }
 
   LogLevel::Level getLevel() const { return m_level; }
 
@@ -117,14 +205,55 @@ class LogEvent {
 
   uint64_t getTime() const { return m_time; }
 
-  std::string getContent() const { return m_ss.str(); }
+  uint32_t getNanoSecond() const { return m_nsec; }
+
+  std::string getContent() const {
+    return std::string(m_ss.data(), m_ss.size());
+  }
+
+  const char* getContentData() const { return m_ss.data(); }
+
+  size_t getContentSize() const { return m_ss.size(); }
+
+  bool isTruncated() const { return m_ss.isTruncated(); }
 
   void format(const char* fmt, ...);
   void format(const char* fmt, va_list al);
 
-  std::stringstream& getSS() { return m_ss; }
+  std::ostream& getSS() { return m_ss; }
+
+  // 附加的键值对, 文本格式用%K输出, JSON格式输出为单独的字段
+  struct Field {
+    enum Type : uint8_t { INT, UINT, DOUBLE, BOOL, STRING };
+
+    Type type;
+    uint32_t key;  // 在getFieldData()里的偏移
+    uint32_t key_len;
+    uint32_t str;  // STRING的值在getFieldData()里的偏移
+    uint32_t str_len;
+    union {
+      int64_t i;
+      uint64_t u;
+      double d;
+      bool b;
+    };
+  };
+
+  void addIntField(const char* key, size_t key_len, int64_t v);
+  void addUIntField(const char* key, size_t key_len, uint64_t v);
+  void addDoubleField(const char* key, size_t key_len, double v);
+  void addBoolField(const char* key, size_t key_len, bool v);
+  // 超过kMaxContentSize的部分截断
+  void addStringField(const char* key, size_t key_len, const char* str,
+                      size_t len);
+
+  const std::vector<Field>& getFields() const { return m_fields; }
+
+  const char* getFieldData() const { return m_fieldData.data(); }
 
  private:
+  friend class LogEventWrap;
+
   std::shared_ptr<Logger> m_logger;
   LogLevel::Level m_level = LogLevel::DEBUG;
   const char* m_file = nullptr;
@@ -134,23 +263,141 @@ class LogEvent {
   uint64_t m_fiberId = 0;   // 协程号
 
   uint64_t m_time = 0;
-  std::stringstream m_ss;
+  uint32_t m_nsec = 0;
+  LogStream m_ss;
+  // 复用event时只清空, 保留容量, 稳定之后不再分配内存
+  std::vector<Field> m_fields;
+  std::string m_fieldData;
+  // 缓存的event正被某条日志语句使用. 协程可能在语句中间让出,
+  // 换到别的线程继续, 所以在结束的线程上清除
+  std::atomic<bool> m_inUse{false};
 };
 
-// LogEventWrap
+// LogEventWrap::kv按值的类型选择LogEvent::add*Field, 其他类型用<<转成字符串
+template <class T, class Enable = void>
+struct LogFieldTraits {
+  static void Add(LogEvent& event, const char* key, size_t len, const T& v) {
+    static thread_local LogStream t_ss(LogEvent::kMaxContentSize);
+    t_ss.reset();
+    t_ss << v;
+    event.addStringField(key, len, t_ss.data(), t_ss.size());
+  }
+};
+
+template <>
+struct LogFieldTraits<bool> {
+  static void Add(LogEvent& event, const char* key, size_t len, bool v) {
+    event.addBoolField(key, len, v);
+  }
+};
+
+template <class T>
+struct LogFieldTraits<
+    T, typename std::enable_if<std::is_integral<T>::value &&
+                               std::is_signed<T>::value>::type> {
+  static void Add(LogEvent& event, const char* key, size_t len, T v) {
+    event.addIntField(key, len, v);
+  }
+};
+
+template <class T>
+struct LogFieldTraits<
+    T, typename std::enable_if<std::is_integral<T>::value &&
+                               !std::is_signed<T>::value &&
+                               !std::is_same<T, bool>::value>::type> {
+  static void Add(LogEvent& event, const char* key, size_t len, T v) {
+    event.addUIntField(key, len, v);
+  }
+};
+
+template <class T>
+struct LogFieldTraits<T,
+                      typename std::enable_if<std::is_enum<T>::value>::type> {
+  static void Add(LogEvent& event, const char* key, size_t len, T v) {
+    event.addIntField(key, len, static_cast<int64_t>(v));
+  }
+};
+
+template <class T>
+struct LogFieldTraits<
+    T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static void Add(LogEvent& event, const char* key, size_t len, T v) {
+    event.addDoubleField(key, len, v);
+  }
+};
 
+template <class T>
+struct LogFieldTraits<
+    T, typename std::enable_if<std::is_same<T, const char*>::value ||
+                               std::is_same<T, char*>::value>::type> {
+  static void Add(LogEvent& event, const char* key, size_t len,
+                  const char* v) {
+    event.addStringField(key, len, v ? v : "", v ? strlen(v) : 0);
+  }
+};
+
+template <>
+struct LogFieldTraits<std::string> {
+  static void Add(LogEvent& event, const char* key, size_t len,
+                  const std::string& v) {
+    event.addStringField(key, len, v.data(), v.size());
+  }
+};
+
+// LogEventWrap
+// 日志宏用的LogEvent来自线程局部的缓存, 取第一个没在用的(输出参数时又打了
+// 日志, 或者协程在语句中间让出, 就用下一个), 稳定之后打日志不需要分配内存.
+// event在log返回之后会被下一条日志复用, appender不能保存LogEvent::ptr,
+// 以后还要用的内容必须在log里拷贝出来
 class LogEventWrap {
  public:
   LogEventWrap(LogEvent::ptr event);
 
+  // 时间在这里取: CLOCK_REALTIME的时间戳和CLOCK_MONOTONIC的elapse
+  LogEventWrap(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+               const char* file, int32_t line, uint64_t thread_id,
+               uint64_t fiber_id);
+
   ~LogEventWrap();
 
-  std::stringstream& getSS();
+  std::ostream& getSS();
 
   LogEvent::ptr getEvent() const { return m_event; }
 
+  template <class T>
+  LogEventWrap& operator<<(const T& v) {
+    m_event->m_ss << v;
+    return *this;
+  }
+
+  // std::endl, std::hex之类的
+  LogEventWrap& operator<<(std::ostream& (*f)(std::ostream&)) {
+    f(m_event->m_ss);
+    return *this;
+  }
+
+  LogEventWrap& operator<<(std::ios_base& (*f)(std::ios_base&)) {
+    f(m_event->m_ss);
+    return *this;
+  }
+
+  template <class T>
+  LogEventWrap& kv(const char* key, const T& v) {
+    LogFieldTraits<typename std::decay<T>::type>::Add(*m_event, key,
+                                                     strlen(key), v);
+    return *this;
+  }
+
+  template <class T>
+  LogEventWrap& kv(const std::string& key, const T& v) {
+    LogFieldTraits<typename std::decay<T>::type>::Add(*m_event, key.data(),
+                                                     key.size(), v);
+    return *this;
+  }
+
  private:
   LogEvent::ptr m_event;
+  bool m_pooled = false;
 };
 
 // LogFormatter
@@ -174,11 +421,17 @@ class LogFormatter {
  public:
   LogFormatter(const std::string& pattern);
 
+  ~LogFormatter();
+
   // typedef std::shared_ptr<LogFormatter> ptr;
   using ptr = std::shared_ptr<LogFormatter>;
 
-  std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level,
-                     LogEvent::ptr event);
+  std::string format(const std::shared_ptr<Logger>& logger,
+                     LogLevel::Level level, const LogEvent::ptr& event);
+
+  // 直接写到os里, 不产生中间的字符串, 不加锁
+  void format(std::ostream& os, const std::shared_ptr<Logger>& logger,
+              LogLevel::Level level, const LogEvent::ptr& event);
   bool setPattern(const std::string& pattern);
 
   bool getError() const;
@@ -191,11 +444,19 @@ class LogFormatter {
 
   RWMutexType& getMutex() { return m_rwmutex; }
 
+ private:
+  struct Program;
+  class ReadGuard;
+
+  // pattern编译成的指令, 失败时抛出std::invalid_argument
+  static Program* Compile(const std::string& pattern);
+
  private:
   mutable RWMutexType m_rwmutex;
-  std::string m_pattern;
-  std::vector<FormatItem::ptr> m_items;
-  bool m_error = false;
+  // format只读当前的Program, 不加锁; setPattern换下来的等正在用它的线程
+  // 都离开之后, 在下一次setPattern时释放, 剩下的析构时一起释放
+  std::atomic<Program*> m_program;
+  std::vector<Program*> m_retired;
 };
 
 // LogAppender
@@ -207,7 +468,8 @@ class LogAppender {
   enum Type {
     FILE_LOG_APPENDER = 0,
     STDOUT_LOG_APPENDER = 1,
-    UNKNOW_APPENDER = 2,
+    MMAP_FILE_LOG_APPENDER = 2,
+    UNKNOW_APPENDER = 3,
   };
 
   static LogAppender::Type FromString(const std::string& type);
@@ -217,9 +479,15 @@ class LogAppender {
 
   virtual ~LogAppender() {}
 
+  // event会被复用, 不能在返回后继续持有(见LogEventWrap)
   virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
                    LogEvent::ptr event) = 0;
 
+  // 直接输出已经格式化好的日志, AsyncLogAppender在后台线程里批量调用
+  virtual void write(const char* data, size_t len) = 0;
+
+  virtual void flush() {}
+
   LogFormatter::ptr getFormatter() const;
 
   void setFormatter(LogFormatter::ptr val);
@@ -237,7 +505,7 @@ class LogAppender {
  protected:
   mutable RWMutexType m_rwmutex;
   mutable MutexType m_mutex;
-  LogLevel::Level m_level = LogLevel::DEBUG;
+  std::atomic<LogLevel::Level> m_level{LogLevel::DEBUG};
   LogFormatter::ptr m_formatter;
 };
 
@@ -249,30 +517,141 @@ class StdoutLogAppender : public LogAppender {
   void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
            LogEvent::ptr event) override;
 
+  void write(const char* data, size_t len) override;
+
+  void flush() override;
+
   std::string toYamlString() const override;
   std::string toString() const override;
 };
 
-class FileLogAppender : public LogAppender {
+// 追加写文件, 可以按大小和时间切分.
+// 切分时当前文件改名为"文件名.打开时间"(重名时再加序号), 再打开新文件;
+// 压缩和删除旧文件在后台线程里做. 每秒检查一次文件是否被外部移走或删除
+// (logrotate), 是的话重新打开.
+// 开启了切分时会预先打开一个备用文件, 到了切分的时候在锁里直接换上;
+// 改名, 重新打开和每秒的检查都在后台线程里做, 打日志的线程不等文件操作
+class FileLogAppender : public LogAppender,
+                        public std::enable_shared_from_this<FileLogAppender> {
  public:
-  FileLogAppender(const std::string& file = "/tmp/ddg_server.txt");
   // typedef std::shared_ptr<FileLogAppender> ptr;
   using ptr = std::shared_ptr<FileLogAppender>;
 
+  enum Rollover {
+    NONE = 0,
+    HOURLY = 1,
+    DAILY = 2,
+  };
+
+  static Rollover RolloverFromString(const std::string& str);
+  static std::string RolloverToString(Rollover rollover);
+
+  struct RollOptions {
+    uint64_t max_size = 0;   // 超过这个大小切分, 0不按大小切分
+    Rollover rollover = NONE;
+    uint32_t max_files = 0;  // 保留的旧文件个数, 0全部保留
+    bool compress = false;   // 旧文件gzip压缩
+  };
+
+  FileLogAppender(const std::string& file = "/tmp/ddg_server.txt");
+
+  FileLogAppender(const std::string& file, const RollOptions& options);
+
+  ~FileLogAppender();
+
   void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
            LogEvent::ptr event) override;
+
+  void write(const char* data, size_t len) override;
+
+  void flush() override;
+
   bool reopen();
 
+  // 立即切分
+  bool roll();
+
+  const RollOptions& getRollOptions() const { return m_options; }
+
   std::string toYamlString() const override;
 
   std::string toString() const override;
 
+ private:
+  enum Action {
+    NOTHING = 0,
+    ROLLED = 1,      // 换上了备用文件, 等着改名
+    NEED_SPARE = 2,  // 该切分了, 但是备用文件还没准备好
+  };
+
+  bool rollEnabled() const {
+    return m_options.max_size || m_options.rollover != NONE;
+  }
+
+  void append(time_t now, const char* data, size_t len);
+
+  // 下面两个需要持有m_mutex, 只改内存里的状态
+  int checkRoll(time_t now, size_t len);
+
+  void swapSpare(time_t now);
+
+  // 下面的需要持有m_fileMutex, 不能持有m_mutex
+  bool openFile(time_t now);
+
+  // 完成上一次切分的改名, spare为true时没有备用文件就打开一个
+  void prepare(time_t now, bool spare);
+
+  // 文件被外部移走或删除时重新打开
+  void checkFile(time_t now);
+
+  // 不持有锁时调用, 换上了备用文件的话让后台线程改名
+  void background(int action, time_t now);
+
+  // 不持有锁时调用, 把旧文件交给后台线程
+  void retire(const std::string& segment);
+
  private:
   std::string m_filename;
+  std::string m_spareName;   // 备用文件, 和m_filename在同一个目录
   std::ofstream m_filestream;
+  std::ofstream m_spare;
+  std::ofstream m_retired;   // 换下来的文件, 在锁外关闭
+  Mutex m_fileMutex;         // 串行化改名和打开文件
+  std::string m_lastBase;    // 上一个旧文件不带序号的名字和序号
+  int m_lastSeq = 0;
+  RollOptions m_options;
+  uint64_t m_size = 0;
+  time_t m_openTime = 0;     // 当前文件开始写的时间, 用于旧文件命名
+  time_t m_nextRoll = 0;     // 按时间切分的下一个时刻
+  time_t m_rolledTime = 0;   // 换下来的文件的开始时间, 0表示没有要改名的
+  time_t m_spareRetry = 0;   // 备用文件打开失败后, 下一次重试的时刻
+  dev_t m_dev = 0;
+  ino_t m_inode = 0;
+  uint64_t m_spareSize = 0;
+  dev_t m_spareDev = 0;
+  ino_t m_spareInode = 0;
+  std::atomic<bool> m_watched{false};  // 已经交给后台线程检查文件
 };
 
 // Logger
+/**
+ * @brief 按调用点的限速和抽样
+ *
+ * 先按sample的概率抽样, 抽中的再经过每个调用点一个的令牌桶: 每秒补充
+ * rate个, 最多攒burst个. FATAL不受限制. 丢掉的条数定期汇总输出一次
+ */
+struct LogLimit {
+  uint32_t rate = 0;    // 每个调用点每秒最多输出的条数, 0不限速
+  uint32_t burst = 0;   // 令牌桶容量, 0表示等于rate
+  double sample = 1.0;  // 输出的概率, 1不抽样
+
+  bool isLimited() const { return rate || sample < 1.0; }
+
+  bool operator==(const LogLimit& oth) const {
+    return rate == oth.rate && burst == oth.burst && sample == oth.sample;
+  }
+};
+
 class Logger : public std::enable_shared_from_this<
                    Logger> {  // 启动这个后，会自动共享这个
  public:
@@ -298,9 +677,13 @@ class Logger : public std::enable_shared_from_this<
 
   void setLevel(LogLevel::Level level);
 
-  LogLevel::Level getLevel() const;
+  // 日志宏每次都要判断, 不加锁
+  LogLevel::Level getLevel() const {
+    return m_level.load(std::memory_order_relaxed);
+  }
 
-  std::string getName() const;
+  // 名字创建之后不会变, 不加锁
+  const std::string& getName() const { return m_name; }
 
   void setFormatter(LogFormatter::ptr formatter);
   void setFormatter(const std::string& pattern);
@@ -315,15 +698,69 @@ class Logger : public std::enable_shared_from_this<
 
   RWMutexType& getMutex() { return m_rwmutex; }
 
+  // 设置限速和抽样, 第一次设置时启动汇总丢弃条数的线程
+  void setLimit(const LogLimit& limit);
+
+  LogLimit getLimit() const;
+
+  // 日志宏每次都要判断, 没有限制时不用找调用点
+  bool isLimited() const { return m_limited.load(std::memory_order_relaxed); }
+
  private:
+  friend class LogSite;
+
   mutable RWMutexType m_rwmutex;
   std::string m_name;
-  LogLevel::Level m_level;
+  std::atomic<LogLevel::Level> m_level;
+  LogLimit m_limit;
+  // 下面几个是m_limit给日志宏用的拷贝
+  std::atomic<bool> m_limited{false};
+  std::atomic<uint32_t> m_rate{0};
+  std::atomic<uint32_t> m_burst{0};
+  std::atomic<uint64_t> m_sample{1ull << 32};  // 32位随机数小于它的才输出
   std::list<LogAppender::ptr> m_appenders;
   LogFormatter::ptr m_formatter;
   Logger::ptr m_root = nullptr;
 };
 
+/**
+ * @brief 一个日志调用点的限速状态
+ *
+ * 由DDG_LOG_SITE在调用点创建, 从不释放, 构造时挂到全局链表上,
+ * 汇总线程遍历链表输出被丢掉的条数
+ */
+class LogSite : public NonCopyable {
+ public:
+  LogSite(const char* file, int32_t line);
+
+  // 是否输出这一条, 不输出的计入丢弃条数
+  bool allow(Logger& logger, LogLevel::Level level);
+
+  const char* getFile() const { return m_file; }
+
+  int32_t getLine() const { return m_line; }
+
+  uint64_t getSuppressed() const { return m_suppressed; }
+
+  // 把每个调用点丢掉的条数通过最近丢日志的logger输出, 并清零
+  static void ReportSuppressed();
+
+ private:
+  void suppress(Logger& logger, LogLevel::Level level);
+
+ private:
+  const char* m_file;
+  int32_t m_line;
+  SpinLock m_mutex;
+  double m_tokens = 0;
+  uint64_t m_lastUs = 0;  // 上次补充令牌的时间, 0表示还没用过
+  std::atomic<uint64_t> m_suppressed{0};
+  std::weak_ptr<Logger> m_logger;
+  LogLevel::Level m_level = LogLevel::UNKNOW;
+  uint64_t m_lastReportUs = 0;
+  LogSite* m_next = nullptr;
+};
+
 class LoggerManager {
  public:
   using ptr = std::shared_ptr<LoggerManager>;
@@ -362,6 +799,15 @@ struct LogAppenderDefine {
   LogLevel::Level level = LogLevel::UNKNOW;
   std::string formatter;
   std::string file;
+  // 异步输出, 见AsyncLogAppender
+  bool async = false;
+  uint32_t queue_size = 0;  // 0使用默认大小
+  std::string overflow;     // block/drop/drop_report, 默认block
+  // 文件切分, 见FileLogAppender::RollOptions
+  uint64_t max_size = 0;  // 可以带K/M/G后缀
+  std::string rollover;   // hourly/daily
+  uint32_t max_files = 0;
+  bool compress = false;
 
   bool operator==(const LogAppenderDefine& oth) const;
 
@@ -373,6 +819,7 @@ struct LogDefine {
   LogLevel::Level level = LogLevel::UNKNOW;
   std::string formatter;
   std::vector<LogAppenderDefine> appenders;
+  LogLimit limit;
 
   bool operator==(const LogDefine& oth) const;
   bool operator<(const LogDefine& oth) const;
@@ -400,6 +847,28 @@ class LexicalCast<LogAppenderDefine, std::string> {
     if (in.type != LogAppender::UNKNOW_APPENDER) {
       node["type"] = LogAppender::ToString(in.type);
     }
+
+    if (in.async) {
+      node["async"] = true;
+      if (in.queue_size) {
+        node["queue_size"] = in.queue_size;
+      }
+      if (!in.overflow.empty()) {
+        node["overflow"] = in.overflow;
+      }
+    }
+    if (in.max_size) {
+      node["max_size"] = in.max_size;
+    }
+    if (!in.rollover.empty()) {
+      node["rollover"] = in.rollover;
+    }
+    if (in.max_files) {
+      node["max_files"] = in.max_files;
+    }
+    if (in.compress) {
+      node["compress"] = true;
+    }
     std::stringstream ss;
     ss << node;
     return ss.str();
@@ -409,6 +878,25 @@ class LexicalCast<LogAppenderDefine, std::string> {
 template <>
 class LexicalCast<std::string, LogAppenderDefine> {
  public:
+  // 100, 64K, 100M, 1G
+  static uint64_t ParseSize(const std::string& str) {
+    char* end = nullptr;
+    uint64_t size = strtoull(str.c_str(), &end, 10);
+    switch (toupper(*end)) {
+      case 'G':
+        size <<= 10;
+        // fall through
+      case 'M':
+        size <<= 10;
+        // fall through
+      case 'K':
+        size <<= 10;
+      default:
+        break;
+    }
+    return size;
+  }
+
   LogAppenderDefine operator()(const std::string& in) {
     YAML::Node node = YAML::Load(in);
     LogAppenderDefine define;
@@ -422,6 +910,20 @@ class LexicalCast<std::string, LogAppenderDefine> {
         define.file = it->second.Scalar();
       } else if (key == "formatter") {
         define.formatter = it->second.Scalar();
+      } else if (key == "async") {
+        define.async = it->second.as<bool>();
+      } else if (key == "queue_size") {
+        define.queue_size = it->second.as<uint32_t>();
+      } else if (key == "overflow") {
+        define.overflow = it->second.Scalar();
+      } else if (key == "max_size") {
+        define.max_size = ParseSize(it->second.Scalar());
+      } else if (key == "rollover") {
+        define.rollover = it->second.Scalar();
+      } else if (key == "max_files") {
+        define.max_files = it->second.as<uint32_t>();
+      } else if (key == "compress") {
+        define.compress = it->second.as<bool>();
       } else {
         DDG_LOG_WARN(DDG_LOG_ROOT()) << "LexicalCast(from std::string to "
                                         "LogAppenerDefine) gets unexpected key "
@@ -453,6 +955,16 @@ class LexicalCast<LogDefine, std::string> {
       }
     }
 
+    if (in.limit.rate) {
+      node["rate_limit"] = in.limit.rate;
+    }
+    if (in.limit.burst) {
+      node["burst"] = in.limit.burst;
+    }
+    if (in.limit.sample < 1.0) {
+      node["sample"] = in.limit.sample;
+    }
+
     for (auto& appender : in.appenders) {
       node["appenders"].push_back(
           YAML::Load(LexicalCast<LogAppenderDefine, std::string>()(appender)));
@@ -490,6 +1002,15 @@ class LexicalCast<std::string, LogDefine> {
         } else {
           define.formatter = formatter;
         }
+      } else if (key == "rate_limit") {
+        define.limit.rate = it->second.as<uint32_t>();
+      } else if (key == "burst") {
+        define.limit.burst = it->second.as<uint32_t>();
+      } else if (key == "sample") {
+        define.limit.sample = it->second.as<double>();
+        if (define.limit.sample < 0 || define.limit.sample > 1) {
+          throw std::invalid_argument(key);
+        }
       } else if (key == "appenders") {
         std::stringstream ss;
         for (auto it = node[key].begin(); it != node[key].end(); it++) {
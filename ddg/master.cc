@@ -0,0 +1,332 @@
+#include "ddg/master.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <iostream>
+
+#include "ddg/config.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_worker_processes = Config::Lookup<uint32_t>(
+    "master.worker_processes", 0, "worker process count, 0 means cpu count");
+
+static ConfigVar<uint64_t>::ptr g_restart_delay =
+    Config::Lookup<uint64_t>("master.restart_delay", 1000,
+                             "delay(ms) before restarting a crash-looping "
+                             "worker");
+
+static ConfigVar<uint64_t>::ptr g_stop_timeout =
+    Config::Lookup<uint64_t>("master.stop_timeout", 10 * 1000,
+                             "wait(ms) for workers to exit before SIGKILL");
+
+static int s_worker_index = -1;
+static std::string s_config_file;
+static int s_signal_fd = -1;
+
+// master处理的信号, 平时阻塞住, 用sigtimedwait同步处理
+static void MasterSignals(sigset_t* set) {
+  sigemptyset(set);
+  sigaddset(set, SIGCHLD);
+  sigaddset(set, SIGHUP);
+  sigaddset(set, SIGTERM);
+  sigaddset(set, SIGINT);
+  sigaddset(set, SIGQUIT);
+}
+
+// worker处理的信号, 在IOManager上通过signalfd处理
+static void WorkerSignals(sigset_t* set) {
+  sigemptyset(set);
+  sigaddset(set, SIGHUP);
+  sigaddset(set, SIGTERM);
+  sigaddset(set, SIGINT);
+  sigaddset(set, SIGQUIT);
+}
+
+/**
+ * @param with_logs 是否应用logs配置. 异步appender等会创建后台线程,
+ *        fork出来的worker不继承线程, 所以master不加载, 由worker自己加载
+ */
+static bool LoadConfigFile(const std::string& file, bool with_logs) {
+  if (file.empty()) {
+    return true;
+  }
+  try {
+    YAML::Node root = YAML::LoadFile(file);
+    if (!with_logs && root.IsMap()) {
+      root.remove("logs");
+    }
+    Config::LoadFromYaml(root);
+  } catch (std::exception& e) {
+    DDG_LOG_ERROR(g_logger) << "load config " << file
+                            << " fail: " << e.what();
+    return false;
+  }
+  return true;
+}
+
+Master::Master(const std::string& config_file, WorkerMain main)
+    : m_configFile(config_file),
+      m_main(main),
+      m_count(0),
+      m_stopping(false) {
+  DDG_ASSERT(m_main);
+}
+
+bool Master::IsWorker() {
+  return s_worker_index >= 0;
+}
+
+int Master::GetWorkerIndex() {
+  return s_worker_index;
+}
+
+bool Master::loadConfig() {
+  if (!LoadConfigFile(m_configFile, false)) {
+    return false;
+  }
+  m_count = g_worker_processes->getValue();
+  if (m_count == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    m_count = cpus > 0 ? cpus : 1;
+  }
+  return true;
+}
+
+int Master::run() {
+  if (!loadConfig()) {
+    return 1;
+  }
+  s_config_file = m_configFile;
+
+  sigset_t set;
+  MasterSignals(&set);
+  sigprocmask(SIG_BLOCK, &set, nullptr);
+
+  DDG_LOG_INFO(g_logger) << "master " << getpid() << " start " << m_count
+                         << " workers";
+  adjust();
+  while (!m_stopping) {
+    // 有等待重启的worker时按它的时间醒来
+    uint64_t now = GetCurrentMilliSecond();
+    uint64_t wait = 1000;
+    for (auto& w : m_workers) {
+      if (w.pid == 0 && w.restart_time) {
+        uint64_t left = w.restart_time > now ? w.restart_time - now : 0;
+        wait = std::min(wait, left);
+      }
+    }
+    timespec ts;
+    ts.tv_sec = wait / 1000;
+    ts.tv_nsec = wait % 1000 * 1000000;
+    siginfo_t info;
+    int sig = sigtimedwait(&set, &info, &ts);
+    switch (sig) {
+      case SIGCHLD:
+        reap();
+        break;
+      case SIGHUP:
+        DDG_LOG_INFO(g_logger) << "master reload " << m_configFile;
+        if (loadConfig()) {
+          signalAll(SIGHUP);
+        }
+        break;
+      case SIGTERM:
+      case SIGINT:
+      case SIGQUIT:
+        DDG_LOG_INFO(g_logger) << "master receive signal " << sig
+                               << ", stop workers";
+        m_stopping = true;
+        break;
+      default:
+        break;
+    }
+    if (!m_stopping) {
+      adjust();
+    }
+  }
+
+  signalAll(SIGTERM);
+  uint64_t deadline = GetCurrentMilliSecond() + g_stop_timeout->getValue();
+  sigset_t chld;
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  while (getAliveCount() && GetCurrentMilliSecond() < deadline) {
+    timespec ts = {0, 100 * 1000000};
+    sigtimedwait(&chld, nullptr, &ts);
+    reap();
+  }
+  if (getAliveCount()) {
+    DDG_LOG_WARN(g_logger) << "master kill " << getAliveCount()
+                           << " workers after stop timeout";
+    signalAll(SIGKILL);
+    while (getAliveCount()) {
+      int status = 0;
+      pid_t pid = waitpid(-1, &status, 0);
+      if (pid < 0 && errno == ECHILD) {
+        break;
+      }
+      for (auto& w : m_workers) {
+        if (w.pid == pid) {
+          w.pid = 0;
+        }
+      }
+    }
+  }
+  DDG_LOG_INFO(g_logger) << "master " << getpid() << " exit";
+  return 0;
+}
+
+void Master::spawn(int index) {
+  Worker& w = m_workers[index];
+  pid_t master = getpid();
+  // 还没输出的日志不能带到子进程里再输出一遍
+  std::cout.flush();
+  fflush(nullptr);
+  pid_t pid = fork();
+  if (pid < 0) {
+    DDG_LOG_ERROR(g_logger) << "fork worker " << index
+                            << " fail errno = " << errno
+                            << " errstr = " << strerror(errno);
+    w.restart_time = GetCurrentMilliSecond() + g_restart_delay->getValue();
+    return;
+  }
+  if (pid > 0) {
+    w.pid = pid;
+    w.start_time = GetCurrentMilliSecond();
+    w.restart_time = 0;
+    DDG_LOG_INFO(g_logger) << "master start worker " << index
+                           << " pid = " << pid;
+    return;
+  }
+
+  // worker: master退出时跟着退出
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (getppid() != master) {
+    _exit(1);
+  }
+  s_worker_index = index;
+  // 控制信号保持阻塞, IOManager的线程都继承这个掩码, 只能从signalfd读到
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGCHLD);
+  sigprocmask(SIG_UNBLOCK, &set, nullptr);
+  WorkerSignals(&set);
+  s_signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+  // 日志配置在fork之后加载, 它的后台线程属于worker自己
+  LoadConfigFile(m_configFile, true);
+  exit(m_main(index));
+}
+
+void Master::reap() {
+  int status = 0;
+  pid_t pid = 0;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+      Worker& w = m_workers[i];
+      if (w.pid != pid) {
+        continue;
+      }
+      uint64_t now = GetCurrentMilliSecond();
+      if (WIFSIGNALED(status)) {
+        DDG_LOG_ERROR(g_logger) << "worker " << i << " pid = " << pid
+                                << " killed by signal " << WTERMSIG(status);
+      } else {
+        DDG_LOG_INFO(g_logger) << "worker " << i << " pid = " << pid
+                               << " exit code " << WEXITSTATUS(status);
+      }
+      w.pid = 0;
+      // 启动后很快就退出的, 等一会儿再拉起, 避免不停地fork
+      uint64_t delay = g_restart_delay->getValue();
+      w.restart_time = now - w.start_time < delay ? now + delay : now;
+    }
+  }
+}
+
+void Master::adjust() {
+  if (m_workers.size() < m_count) {
+    m_workers.resize(m_count);
+  }
+  uint64_t now = GetCurrentMilliSecond();
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    Worker& w = m_workers[i];
+    if (i >= m_count) {
+      // 配置减少了worker数, 多出来的停掉
+      if (w.pid && !w.restart_time) {
+        kill(w.pid, SIGTERM);
+        w.restart_time = ~0ull;
+      }
+      continue;
+    }
+    if (w.pid == 0 && w.restart_time <= now) {
+      spawn(i);
+    }
+  }
+  while (m_workers.size() > m_count && m_workers.back().pid == 0) {
+    m_workers.pop_back();
+  }
+}
+
+void Master::signalAll(int sig) {
+  for (auto& w : m_workers) {
+    if (w.pid) {
+      kill(w.pid, sig);
+    }
+  }
+}
+
+size_t Master::getAliveCount() const {
+  size_t n = 0;
+  for (auto& w : m_workers) {
+    n += w.pid != 0;
+  }
+  return n;
+}
+
+bool Master::WatchSignals(IOManager* iom, std::function<void()> on_stop,
+                          std::function<void()> on_reload) {
+  if (s_signal_fd < 0) {
+    return false;
+  }
+  auto handler = std::make_shared<std::function<void()>>();
+  *handler = [iom, on_stop, on_reload, handler]() {
+    signalfd_siginfo info;
+    bool stop = false;
+    while (read(s_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+      if (info.ssi_signo == SIGHUP) {
+        DDG_LOG_INFO(g_logger) << "worker " << s_worker_index << " reload "
+                               << s_config_file;
+        if (LoadConfigFile(s_config_file, true) && on_reload) {
+          on_reload();
+        }
+      } else {
+        stop = true;
+      }
+    }
+    if (stop) {
+      DDG_LOG_INFO(g_logger) << "worker " << s_worker_index << " stop";
+      // 正在执行的是addEvent里的拷贝, 清掉自引用, 不再监听
+      *handler = nullptr;
+      if (on_stop) {
+        on_stop();
+      }
+      return;
+    }
+    iom->addEvent(s_signal_fd, IOManager::READ, *handler);
+  };
+  return iom->addEvent(s_signal_fd, IOManager::READ, *handler) == 0;
+}
+
+}  // namespace ddg
@@ -0,0 +1,93 @@
+#ifndef DDG_MASTER_H_
+#define DDG_MASTER_H_
+
+#include <sys/types.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ddg/iomanager.h"
+#include "ddg/noncopyable.h"
+
+namespace ddg {
+
+/**
+ * @brief 多进程master/worker模式
+ *
+ * master读取YAML配置后fork出master.worker_processes个worker, 每个worker
+ * 在自己的IOManager上运行, 用SO_REUSEPORT各自监听同样的地址, 由内核分配
+ * 连接. 进程之间不共享任何锁, 一个worker崩溃不影响其他worker
+ *
+ * master:
+ *   SIGCHLD          worker异常退出时重新拉起, 启动后很快又退出的延迟重启
+ *   SIGHUP           重新加载配置, 调整worker数量并转发给worker
+ *   SIGTERM/SIGINT   转发SIGTERM, 等待worker退出, 超时后SIGKILL
+ *
+ * master自己不创建线程, run之前也不能创建线程或IOManager. 配置里的logs
+ * 只在worker里加载(异步appender等有后台线程), master的日志用默认配置
+ */
+class Master : NonCopyable {
+ public:
+  // worker的入口, 参数是worker编号, 返回值是进程退出码
+  using WorkerMain = std::function<int(int index)>;
+
+  /**
+   * @param config_file YAML配置文件, 为空时不加载
+   */
+  Master(const std::string& config_file, WorkerMain main);
+
+  /**
+   * @brief 启动worker并处理信号, 直到收到退出信号并且worker都已退出
+   * @return master的退出码, worker进程不会从这里返回
+   */
+  int run();
+
+  // 当前进程是否是worker
+  static bool IsWorker();
+
+  // worker编号, master里返回-1
+  static int GetWorkerIndex();
+
+  /**
+   * @brief worker里调用, 在iom上处理master转发过来的信号
+   * @param on_stop 收到SIGTERM/SIGINT/SIGQUIT时调用, 应该停止服务让iom退出,
+   *        之后不再监听信号
+   * @param on_reload 收到SIGHUP并重新加载配置之后调用
+   * @return 不是worker返回false
+   */
+  static bool WatchSignals(IOManager* iom, std::function<void()> on_stop,
+                           std::function<void()> on_reload = nullptr);
+
+ private:
+  struct Worker {
+    pid_t pid = 0;
+    uint64_t start_time = 0;
+    uint64_t restart_time = 0;  // pid为0时, 到这个时间再拉起
+  };
+
+  bool loadConfig();
+
+  void spawn(int index);
+
+  // 回收退出的worker, 安排重启
+  void reap();
+
+  // 拉起到时间的worker, 停掉多余的
+  void adjust();
+
+  void signalAll(int sig);
+
+  // 还没退出的worker数
+  size_t getAliveCount() const;
+
+ private:
+  std::string m_configFile;
+  WorkerMain m_main;
+  std::vector<Worker> m_workers;
+  size_t m_count;  // 期望的worker数
+  bool m_stopping;
+};
+
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,228 @@
+#include "ddg/mmaplog.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "ddg/macro.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+const uint32_t MmapFileLogAppender::kDefaultChunkSize;
+const uint32_t MmapFileLogAppender::kSlots;
+
+// 文件末尾可能是预分配的'\0', 找到最后一个非'\0'字节之后的位置
+static uint64_t FindDataEnd(int fd, uint64_t size) {
+  char buf[64 * 1024];
+  while (size) {
+    size_t n = std::min<uint64_t>(size, sizeof(buf));
+    if (pread(fd, buf, n, size - n) != static_cast<ssize_t>(n)) {
+      return size;
+    }
+    for (size_t i = n; i > 0; --i) {
+      if (buf[i - 1]) {
+        return size - n + i;
+      }
+    }
+    size -= n;
+  }
+  return 0;
+}
+
+MmapFileLogAppender::MmapFileLogAppender(const std::string& file,
+                                         uint32_t chunk_size)
+    : m_filename(file) {
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  m_chunkSize = std::max<uint64_t>((chunk_size + page - 1) / page * page,
+                                   page);
+  m_fd = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat st;
+  if (m_fd < 0 || fstat(m_fd, &st) != 0) {
+    DDG_LOG_ERROR(g_logger) << "MmapFileLogAppender open " << file
+                            << " failed, errno=" << errno << " "
+                            << strerror(errno);
+    if (m_fd >= 0) {
+      close(m_fd);
+      m_fd = -1;
+    }
+    return;
+  }
+  m_start = FindDataEnd(m_fd, st.st_size);
+  m_offset = m_start;
+  {
+    MutexType::Lock lock(m_mapMutex);
+    uint64_t n = m_start / m_chunkSize;
+    if (mapChunk(n) < 0 || mapChunk(n + 1) < 0) {
+      DDG_LOG_ERROR(g_logger) << "MmapFileLogAppender map " << file
+                              << " failed, errno=" << errno << " "
+                              << strerror(errno);
+    }
+  }
+  m_thread.reset(new Thread("mmap_log", [this]() { run(); }));
+}
+
+MmapFileLogAppender::~MmapFileLogAppender() {
+  if (m_fd < 0) {
+    return;
+  }
+  m_stopping = true;
+  m_sem.post();
+  m_thread->join();
+  for (auto& slot : m_slots) {
+    if (slot.index) {
+      munmap(slot.addr, m_chunkSize);
+    }
+  }
+  // 去掉预分配的部分
+  if (ftruncate(m_fd, m_offset) != 0) {
+    DDG_LOG_ERROR(g_logger) << "MmapFileLogAppender truncate " << m_filename
+                            << " failed, errno=" << errno;
+  }
+  close(m_fd);
+}
+
+void MmapFileLogAppender::log(Logger::ptr logger, LogLevel::Level level,
+                              LogEvent::ptr event) {
+  if (level < m_level.load(std::memory_order_relaxed)) {
+    return;
+  }
+  static thread_local LogStream t_buffer(LogEvent::kMaxContentSize + 4096);
+  t_buffer.reset();
+  m_formatter->format(t_buffer, logger, level, event);
+  write(t_buffer.data(), t_buffer.size());
+}
+
+void MmapFileLogAppender::write(const char* data, size_t len) {
+  if (m_fd < 0 || !len || m_error.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint64_t pos = m_offset.fetch_add(len, std::memory_order_relaxed);
+  // 一条记录可能跨过chunk的边界
+  while (len) {
+    uint64_t n = pos / m_chunkSize;
+    uint64_t off = pos % m_chunkSize;
+    size_t part = std::min<uint64_t>(len, m_chunkSize - off);
+    char* addr = getChunk(n);
+    if (!addr) {
+      return;
+    }
+    memcpy(addr + off, data, part);
+    Slot& slot = m_slots[n % kSlots];
+    // 写满了让后台线程解除映射, 并提前映射再下一个
+    if (slot.written.fetch_add(part, std::memory_order_acq_rel) + part ==
+        m_chunkSize) {
+      m_sem.post();
+    }
+    pos += part;
+    data += part;
+    len -= part;
+  }
+}
+
+char* MmapFileLogAppender::getChunk(uint64_t n) {
+  Slot& slot = m_slots[n % kSlots];
+  if (slot.index.load(std::memory_order_acquire) == n + 1) {
+    return slot.addr;
+  }
+  // 后台线程没来得及映射
+  while (true) {
+    {
+      MutexType::Lock lock(m_mapMutex);
+      int rt = mapChunk(n);
+      if (rt > 0) {
+        return slot.addr;
+      }
+      if (rt < 0) {
+        m_error = true;
+        return nullptr;
+      }
+    }
+    sched_yield();
+  }
+}
+
+int MmapFileLogAppender::mapChunk(uint64_t n) {
+  Slot& slot = m_slots[n % kSlots];
+  uint64_t index = slot.index.load(std::memory_order_acquire);
+  if (index == n + 1) {
+    return 1;
+  }
+  if (index) {
+    unmapFinished();
+    if (slot.index.load(std::memory_order_acquire)) {
+      return 0;
+    }
+  }
+  // 真正分配磁盘空间, 磁盘满时在这里报错, 而不是写内存时SIGBUS
+  off_t begin = n * m_chunkSize;
+  int rt = posix_fallocate(m_fd, begin, m_chunkSize);
+  if (rt) {
+    errno = rt;
+    return -1;
+  }
+  void* addr = mmap(nullptr, m_chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    m_fd, begin);
+  if (addr == MAP_FAILED) {
+    return -1;
+  }
+  slot.addr = static_cast<char*>(addr);
+  // 打开时已有数据的那个chunk, 前面的部分算已经写过
+  slot.written.store(n == m_start / m_chunkSize ? m_start % m_chunkSize : 0,
+                     std::memory_order_relaxed);
+  slot.index.store(n + 1, std::memory_order_release);
+  return 1;
+}
+
+void MmapFileLogAppender::unmapFinished() {
+  for (auto& slot : m_slots) {
+    if (slot.index.load(std::memory_order_acquire) &&
+        slot.written.load(std::memory_order_acquire) == m_chunkSize) {
+      munmap(slot.addr, m_chunkSize);
+      slot.index.store(0, std::memory_order_release);
+    }
+  }
+}
+
+void MmapFileLogAppender::run() {
+  while (true) {
+    m_sem.wait();
+    if (m_stopping) {
+      break;
+    }
+    MutexType::Lock lock(m_mapMutex);
+    unmapFinished();
+    uint64_t n = m_offset.load(std::memory_order_relaxed) / m_chunkSize;
+    if (mapChunk(n) >= 0) {
+      mapChunk(n + 1);
+    }
+  }
+}
+
+std::string MmapFileLogAppender::toYamlString() const {
+  YAML::Node node;
+  {
+    RWMutexType::ReadLock lock(m_rwmutex);
+    node["level"] = LogLevel::ToString(m_level);
+    node["type"] =
+        LogAppender::ToString(LogAppender::MMAP_FILE_LOG_APPENDER);
+    if (m_formatter) {
+      node["formatter"] = m_formatter->getPattern();
+    }
+    node["file"] = m_filename;
+  }
+  std::stringstream ss;
+  ss << node;
+  return ss.str();
+}
+
+std::string MmapFileLogAppender::toString() const {
+  return toYamlString();
+}
+
+}  // namespace ddg
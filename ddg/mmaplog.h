@@ -0,0 +1,94 @@
+#ifndef DDG_MMAPLOG_H_
+#define DDG_MMAPLOG_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "ddg/log.h"
+#include "ddg/mutex.h"
+#include "ddg/thread.h"
+
+namespace ddg {
+
+/**
+ * @brief 用mmap写文件的appender
+ *
+ * 文件按chunk预先分配空间并映射, 写日志时用原子的偏移量占位后直接拷贝到
+ * 映射的内存里, 不需要write系统调用, 多个线程可以同时拷贝.
+ * 后台线程在写到一个新chunk时提前映射下一个, 并解除已经写满的chunk.
+ * 数据直接在page cache里, 进程崩溃也不会丢.
+ *
+ * 运行中文件末尾是预分配的'\0', 析构时截掉; 崩溃后重新打开会从最后一个
+ * 非'\0'字节之后接着写
+ */
+class MmapFileLogAppender : public LogAppender {
+ public:
+  using ptr = std::shared_ptr<MmapFileLogAppender>;
+  using MutexType = Mutex;
+
+  static const uint32_t kDefaultChunkSize = 4 * 1024 * 1024;
+
+  /**
+   * @param chunk_size 每次映射的大小, 向上取整到页大小
+   */
+  MmapFileLogAppender(const std::string& file,
+                      uint32_t chunk_size = kDefaultChunkSize);
+
+  ~MmapFileLogAppender();
+
+  void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
+           LogEvent::ptr event) override;
+
+  void write(const char* data, size_t len) override;
+
+  std::string toYamlString() const override;
+
+  std::string toString() const override;
+
+  bool isOpen() const { return m_fd >= 0; }
+
+  // 已经写入的长度
+  uint64_t getOffset() const { return m_offset; }
+
+ private:
+  // 同时映射的chunk数, 第n个chunk用第n % kSlots个
+  static const uint32_t kSlots = 4;
+
+  struct Slot {
+    std::atomic<uint64_t> index{0};  // chunk号 + 1, 0表示空闲
+    std::atomic<uint64_t> written{0};  // 已经写完的字节数
+    char* addr = nullptr;
+  };
+
+  // 返回第n个chunk映射的地址, 还没映射的话在调用线程里映射
+  char* getChunk(uint64_t n);
+
+  /**
+   * @brief 映射第n个chunk, 需要持有m_mapMutex
+   * @return 1成功, 0对应的slot还在被前面的chunk使用, -1出错
+   */
+  int mapChunk(uint64_t n);
+
+  // 解除已经写满的chunk, 需要持有m_mapMutex
+  void unmapFinished();
+
+  void run();
+
+ private:
+  std::string m_filename;
+  uint64_t m_chunkSize;
+  int m_fd = -1;
+  uint64_t m_start = 0;  // 打开时已有的数据长度
+  std::atomic<uint64_t> m_offset{0};
+  std::atomic<bool> m_error{false};  // 映射失败(比如磁盘满了)之后不再写
+  Slot m_slots[kSlots];
+  MutexType m_mapMutex;
+  std::atomic<bool> m_stopping{false};
+  Semphore m_sem;
+  std::unique_ptr<Thread> m_thread;
+};
+
+}  // namespace ddg
+
+#endif
@@ -1,4 +1,8 @@
 #include "ddg/mutex.h"
+
+#include <errno.h>
+#include <time.h>
+
 #include "log.h"
 
 namespace ddg {
@@ -22,6 +26,23 @@ void Semphore::wait() {
   }
 }
 
+bool Semphore::waitFor(uint64_t ms) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += ms % 1000 * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ++ts.tv_sec;
+    ts.tv_nsec -= 1000000000;
+  }
+  while (sem_timedwait(&m_sem, &ts)) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void Semphore::post() {
   if (sem_post(&m_sem)) {
     std::logic_error("sem_post error");
@@ -25,6 +25,9 @@ class Semphore : virtual public NonCopyable {
 
   void wait();
 
+  // 最多等ms毫秒, 超时返回false
+  bool waitFor(uint64_t ms);
+
   void post();
 
  private:
@@ -125,7 +128,7 @@ class WriteScopedLockImpl {
  public:
   WriteScopedLockImpl(T& mutex) : m_mutex(mutex) {
     m_mutex.wrlock();
-    m_islocked = false;
+    m_islocked = true;
   }
 
   ~WriteScopedLockImpl() { unlock(); }
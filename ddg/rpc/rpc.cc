@@ -0,0 +1,62 @@
+#include "ddg/rpc/rpc.h"
+
+#include <string.h>
+#include <sstream>
+
+#include "ddg/endian.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+namespace rpc {
+
+const char* RpcStatusToString(RpcStatus s) {
+  switch (s) {
+#define XX(name)        \
+  case RpcStatus::name: \
+    return #name;
+    XX(OK);
+    XX(METHOD_NOT_FOUND);
+    XX(HANDLER_ERROR);
+    XX(DEADLINE_EXCEEDED);
+    XX(TIMEOUT);
+    XX(CONNECTION_CLOSED);
+    XX(SEND_ERROR);
+    XX(DECODE_ERROR);
+    XX(INVALID_ARGUMENT);
+#undef XX
+    default:
+      return "UNKNOWN";
+  }
+}
+
+void RpcMessage::Encode(std::string& out, uint8_t type, uint32_t seq,
+                        uint32_t arg, const std::string& method,
+                        const std::string& body) {
+  DDG_ASSERT(method.size() <= kRpcMaxMethodSize);
+  DDG_ASSERT(body.size() <= kRpcMaxBodySize);
+  size_t pos = out.size();
+  out.resize(pos + kRpcHeaderSize);
+  char* p = &out[pos];
+  p[0] = static_cast<char>(kRpcMagic);
+  p[1] = static_cast<char>(kRpcVersion);
+  p[2] = static_cast<char>(type);
+  p[3] = static_cast<char>(method.size());
+  uint32_t v = ByteSwapOnLittleEndian(seq);
+  memcpy(p + 4, &v, 4);
+  v = ByteSwapOnLittleEndian(arg);
+  memcpy(p + 8, &v, 4);
+  v = ByteSwapOnLittleEndian(static_cast<uint32_t>(body.size()));
+  memcpy(p + 12, &v, 4);
+  out.append(method);
+  out.append(body);
+}
+
+std::string RpcResult::toString() const {
+  std::stringstream ss;
+  ss << "[RpcResult status=" << RpcStatusToString(status)
+     << " body_size=" << body.size() << "]";
+  return ss.str();
+}
+
+}  // namespace rpc
+}  // namespace ddg
@@ -0,0 +1,78 @@
+#ifndef DDG_RPC_RPC_H_
+#define DDG_RPC_RPC_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+namespace ddg {
+namespace rpc {
+
+/**
+ * 帧格式(大端), 头部固定16字节:
+ *
+ *   magic(1) version(1) type(1) method_len(1) seq(4) arg(4) body_len(4)
+ *   method(method_len) body(body_len)
+ *
+ * 请求的arg是调用方的超时(毫秒, 0表示不限), 响应的arg是RpcStatus.
+ * 同一个连接上的多个调用用seq区分, 响应可以乱序返回
+ */
+static const uint8_t kRpcMagic = 0xDD;
+static const uint8_t kRpcVersion = 1;
+static const size_t kRpcHeaderSize = 16;
+static const size_t kRpcMaxMethodSize = 0xFF;
+static const uint64_t kRpcMaxBodySize = UINT32_MAX;
+
+enum class RpcStatus : int32_t {
+  OK = 0,
+  METHOD_NOT_FOUND = 1,
+  HANDLER_ERROR = 2,      // 处理函数返回非0
+  DEADLINE_EXCEEDED = 3,  // 服务端排队时已经超过调用方的超时, 没有执行
+  // 下面的只在客户端产生
+  TIMEOUT = 4,
+  CONNECTION_CLOSED = 5,
+  SEND_ERROR = 6,
+  DECODE_ERROR = 7,      // 响应不能解码成要求的结构体
+  INVALID_ARGUMENT = 8,  // 方法名或者请求超过帧格式的长度限制, 没有发送
+};
+
+const char* RpcStatusToString(RpcStatus s);
+
+struct RpcMessage {
+  using ptr = std::shared_ptr<RpcMessage>;
+
+  enum Type {
+    REQUEST = 1,
+    RESPONSE = 2,
+  };
+
+  uint8_t type = REQUEST;
+  uint32_t seq = 0;
+  uint32_t arg = 0;
+  std::string method;
+  std::string body;
+
+  // 编码后追加到out, 调用方保证method和body没有超过长度限制
+  static void Encode(std::string& out, uint8_t type, uint32_t seq,
+                     uint32_t arg, const std::string& method,
+                     const std::string& body);
+};
+
+struct RpcResult {
+  using ptr = std::shared_ptr<RpcResult>;
+
+  RpcResult(RpcStatus _status, const std::string& _body = "")
+      : status(_status), body(_body) {}
+
+  bool isOk() const { return status == RpcStatus::OK; }
+
+  std::string toString() const;
+
+  RpcStatus status;
+  std::string body;
+};
+
+}  // namespace rpc
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,164 @@
+#include "ddg/rpc/rpcconnection.h"
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+namespace rpc {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+RpcConnection::ptr RpcConnection::Connect(Address::ptr addr,
+                                          uint64_t timeout_ms,
+                                          IOManager* iom) {
+  DDG_ASSERT(iom);
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  if (!sock->connect(addr, timeout_ms)) {
+    DDG_LOG_DEBUG(g_logger) << "rpc connect fail " << *addr;
+    return nullptr;
+  }
+  RpcConnection::ptr conn(new RpcConnection(sock, iom));
+  iom->schedule(std::bind(&RpcConnection::onRecv, conn));
+  return conn;
+}
+
+RpcConnection::RpcConnection(Socket::ptr sock, IOManager* iom)
+    : RpcStream(sock), m_iom(iom), m_seq(0), m_closed(false) {}
+
+RpcResult::ptr RpcConnection::call(const std::string& method,
+                                   const std::string& request,
+                                   uint64_t timeout_ms) {
+  DDG_ASSERT(Scheduler::GetThis());
+  if (method.size() > kRpcMaxMethodSize ||
+      request.size() > kRpcMaxBodySize) {
+    return std::make_shared<RpcResult>(RpcStatus::INVALID_ARGUMENT);
+  }
+  Call::ptr c(new Call);
+  c->fiber = Fiber::GetThis();
+  c->scheduler = Scheduler::GetThis();
+  c->thread = GetThreadId();
+  uint32_t seq = ++m_seq;
+  {
+    MutexType::Lock lock(m_mutex);
+    if (m_closed) {
+      return std::make_shared<RpcResult>(RpcStatus::CONNECTION_CLOSED);
+    }
+    m_calls[seq] = c;
+  }
+
+  Timer::ptr timer;
+  if (timeout_ms) {
+    std::weak_ptr<RpcConnection> weak(shared_from_this());
+    timer = m_iom->addTimer(timeout_ms, [weak, seq]() {
+      RpcConnection::ptr self = weak.lock();
+      if (self) {
+        self->onTimeout(seq);
+      }
+    });
+  }
+
+  uint32_t arg = static_cast<uint32_t>(
+      std::min<uint64_t>(timeout_ms, UINT32_MAX));
+  if (!sendMessage(RpcMessage::REQUEST, seq, arg, method, request)) {
+    take(seq);
+    Finish(c, std::make_shared<RpcResult>(RpcStatus::SEND_ERROR));
+  }
+
+  // 发送时当前协程可能挂在写事件上, 那时候完成的调用不会唤醒它
+  bool parked = false;
+  {
+    MutexType::Lock lock(c->mutex);
+    if (!c->done) {
+      c->parked = parked = true;
+    }
+  }
+  if (parked) {
+    Fiber::YieldToHold();
+  }
+  if (timer) {
+    timer->cancel();
+  }
+  return c->result;
+}
+
+size_t RpcConnection::getInflight() {
+  MutexType::Lock lock(m_mutex);
+  return m_calls.size();
+}
+
+void RpcConnection::shutdown() {
+  ::shutdown(m_socket->getSocket(), SHUT_RDWR);
+}
+
+void RpcConnection::onRecv() {
+  while (true) {
+    RpcMessage::ptr msg = recvMessage();
+    if (!msg) {
+      break;
+    }
+    if (msg->type != RpcMessage::RESPONSE) {
+      DDG_LOG_DEBUG(g_logger) << "unexpected rpc message type "
+                              << static_cast<int>(msg->type) << " "
+                              << *m_socket;
+      break;
+    }
+    Call::ptr c = take(msg->seq);
+    if (!c) {
+      // 已经超时
+      continue;
+    }
+    RpcResult::ptr result(new RpcResult(static_cast<RpcStatus>(msg->arg)));
+    result->body.swap(msg->body);
+    Finish(c, result);
+  }
+
+  std::unordered_map<uint32_t, Call::ptr> calls;
+  {
+    MutexType::Lock lock(m_mutex);
+    m_closed = true;
+    calls.swap(m_calls);
+  }
+  for (auto& i : calls) {
+    Finish(i.second,
+           std::make_shared<RpcResult>(RpcStatus::CONNECTION_CLOSED));
+  }
+  close();
+}
+
+void RpcConnection::onTimeout(uint32_t seq) {
+  Call::ptr c = take(seq);
+  if (c) {
+    Finish(c, std::make_shared<RpcResult>(RpcStatus::TIMEOUT));
+  }
+}
+
+RpcConnection::Call::ptr RpcConnection::take(uint32_t seq) {
+  MutexType::Lock lock(m_mutex);
+  auto it = m_calls.find(seq);
+  if (it == m_calls.end()) {
+    return nullptr;
+  }
+  Call::ptr c = it->second;
+  m_calls.erase(it);
+  return c;
+}
+
+bool RpcConnection::Finish(Call::ptr call, RpcResult::ptr result) {
+  MutexType::Lock lock(call->mutex);
+  if (call->done) {
+    return false;
+  }
+  call->done = true;
+  call->result = result;
+  if (call->parked) {
+    call->scheduler->schedule(call->fiber, call->thread);
+  }
+  return true;
+}
+
+}  // namespace rpc
+}  // namespace ddg
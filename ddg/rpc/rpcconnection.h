@@ -0,0 +1,111 @@
+#ifndef DDG_RPC_RPCCONNECTION_H_
+#define DDG_RPC_RPCCONNECTION_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "ddg/address.h"
+#include "ddg/fiber.h"
+#include "ddg/iomanager.h"
+#include "ddg/mutex.h"
+#include "ddg/rpc/rpcstream.h"
+#include "ddg/serialize.h"
+
+namespace ddg {
+namespace rpc {
+
+/**
+ * @brief RPC客户端连接
+ *
+ * 一个连接上可以有任意多个协程同时调用. 每个调用分配一个seq, 发出请求后
+ * 调用的协程挂起, 连接的读协程收到对应seq的响应、超时定时器触发或者连接
+ * 断开时, 三者中最先发生的一个把它唤醒. 调用的协程可能在发送时挂在
+ * 写事件上, 这时只记下结果, 等它自己挂起之前看到
+ *
+ * 读协程持有连接, 不再使用时要调用shutdown
+ */
+class RpcConnection : public RpcStream,
+                      public std::enable_shared_from_this<RpcConnection> {
+ public:
+  using ptr = std::shared_ptr<RpcConnection>;
+  using MutexType = Mutex;
+
+  /**
+   * @brief 建立连接并在iom上启动读协程
+   * @return 连接失败返回nullptr
+   */
+  static RpcConnection::ptr Connect(Address::ptr addr,
+                                    uint64_t timeout_ms = -1,
+                                    IOManager* iom = IOManager::GetThis());
+
+  /**
+   * @brief 调用method, 必须在协程里调用
+   * @param timeout_ms 0表示不限, 同时发给服务端, 排队超时的请求不会执行
+   */
+  RpcResult::ptr call(const std::string& method, const std::string& request,
+                      uint64_t timeout_ms);
+
+  /**
+   * @brief 请求和响应是用DDG_SERIALIZE声明的结构体
+   * @details 服务端返回HANDLER_ERROR时也会尝试解码响应
+   */
+  template <class Req, class Rsp>
+  RpcStatus call(const std::string& method, const Req& request, Rsp& response,
+                 uint64_t timeout_ms) {
+    RpcResult::ptr r = call(method, SerializeToString(request), timeout_ms);
+    if (r->status == RpcStatus::OK || r->status == RpcStatus::HANDLER_ERROR) {
+      if (!DeserializeFromString(r->body, response)) {
+        return RpcStatus::DECODE_ERROR;
+      }
+    }
+    return r->status;
+  }
+
+  // 正在等待响应的调用数
+  size_t getInflight();
+
+  bool isClosed() const { return m_closed; }
+
+  // 断开连接, 所有等待中的调用返回CONNECTION_CLOSED
+  void shutdown();
+
+ private:
+  struct Call {
+    using ptr = std::shared_ptr<Call>;
+
+    Fiber::ptr fiber;
+    Scheduler* scheduler;
+    uint64_t thread = 0;  // 在发起调用的线程上唤醒
+    MutexType mutex;
+    bool done = false;
+    bool parked = false;  // 已经准备在call里挂起等结果
+    RpcResult::ptr result;
+  };
+
+  RpcConnection(Socket::ptr sock, IOManager* iom);
+
+  // 读协程, 按seq把响应交给等待的调用
+  void onRecv();
+
+  void onTimeout(uint32_t seq);
+
+  // 从m_calls里取出seq对应的调用
+  Call::ptr take(uint32_t seq);
+
+  // 设置结果, 只有第一次生效; 调用的协程已经挂起等结果时唤醒它
+  static bool Finish(Call::ptr call, RpcResult::ptr result);
+
+ private:
+  IOManager* m_iom;
+  std::atomic<uint32_t> m_seq;
+  std::atomic<bool> m_closed;
+  MutexType m_mutex;
+  std::unordered_map<uint32_t, Call::ptr> m_calls;
+};
+
+}  // namespace rpc
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,84 @@
+#include "ddg/rpc/rpcserver.h"
+
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+namespace rpc {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+RpcServer::RpcServer(IOManager* worker, IOManager* accept_worker)
+    : TcpServer(worker, accept_worker) {}
+
+void RpcServer::registerMethod(const std::string& name, Handler handler) {
+  DDG_ASSERT(name.size() <= kRpcMaxMethodSize);
+  RWMutexType::WriteLock lock(m_mutex);
+  m_handlers[name] = std::make_shared<Handler>(handler);
+}
+
+void RpcServer::unregisterMethod(const std::string& name) {
+  RWMutexType::WriteLock lock(m_mutex);
+  m_handlers.erase(name);
+}
+
+void RpcServer::handleClient(Socket::ptr client) {
+  DDG_LOG_DEBUG(g_logger) << "handleClient " << *client;
+  RpcStream::ptr stream(new RpcStream(client));
+  TcpServer::ptr self = shared_from_this();
+  while (true) {
+    RpcMessage::ptr msg = stream->recvMessage();
+    if (!msg) {
+      break;
+    }
+    if (msg->type != RpcMessage::REQUEST) {
+      DDG_LOG_DEBUG(g_logger) << "unexpected rpc message type "
+                              << static_cast<int>(msg->type) << " "
+                              << *client;
+      break;
+    }
+    uint64_t now = GetCurrentMilliSecond();
+    m_worker->schedule([self, this, stream, msg, now]() {
+      dispatch(stream, msg, now);
+    });
+  }
+  // 还在执行的请求持有stream, 全部结束后才关闭
+}
+
+void RpcServer::dispatch(RpcStream::ptr stream, RpcMessage::ptr request,
+                         uint64_t recv_time) {
+  RpcStatus status = RpcStatus::OK;
+  std::string response;
+  uint32_t timeout = request->arg;
+  if (timeout && GetCurrentMilliSecond() - recv_time >= timeout) {
+    // 调用方已经超时了, 不用再执行
+    status = RpcStatus::DEADLINE_EXCEEDED;
+  } else {
+    std::shared_ptr<Handler> handler;
+    {
+      RWMutexType::ReadLock lock(m_mutex);
+      auto it = m_handlers.find(request->method);
+      if (it != m_handlers.end()) {
+        handler = it->second;
+      }
+    }
+    if (!handler) {
+      status = RpcStatus::METHOD_NOT_FOUND;
+    } else if ((*handler)(request->body, response) != 0) {
+      status = RpcStatus::HANDLER_ERROR;
+    }
+  }
+  if (response.size() > kRpcMaxBodySize) {
+    DDG_LOG_ERROR(g_logger) << "rpc response too large, method="
+                            << request->method
+                            << " size=" << response.size();
+    status = RpcStatus::HANDLER_ERROR;
+    response.clear();
+  }
+  stream->sendMessage(RpcMessage::RESPONSE, request->seq,
+                      static_cast<uint32_t>(status), "", response);
+}
+
+}  // namespace rpc
+}  // namespace ddg
@@ -0,0 +1,76 @@
+#ifndef DDG_RPC_RPCSERVER_H_
+#define DDG_RPC_RPCSERVER_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "ddg/mutex.h"
+#include "ddg/rpc/rpcstream.h"
+#include "ddg/serialize.h"
+#include "ddg/tcpserver.h"
+
+namespace ddg {
+namespace rpc {
+
+/**
+ * @brief RPC服务器
+ *
+ * 每个连接一个协程读请求, 每个请求调度到worker上单独的协程执行,
+ * 同一个连接上的请求并发处理, 响应按完成顺序写回
+ */
+class RpcServer : public TcpServer {
+ public:
+  using ptr = std::shared_ptr<RpcServer>;
+  using RWMutexType = RWMutex;
+  // 返回0表示成功, 非0时客户端收到HANDLER_ERROR, response一样会返回
+  using Handler = std::function<int32_t(const std::string& request,
+                                        std::string& response)>;
+
+  RpcServer(IOManager* worker = IOManager::GetThis(),
+            IOManager* accept_worker = IOManager::GetThis());
+
+  // 方法名不超过255字节
+  void registerMethod(const std::string& name, Handler handler);
+
+  /**
+   * @brief 请求和响应是用DDG_SERIALIZE声明的结构体, 需要显式指定模板参数
+   * @details 请求解码失败时不调用handler, 客户端收到HANDLER_ERROR
+   */
+  template <class Req, class Rsp>
+  void registerMethod(const std::string& name,
+                      std::function<int32_t(const Req&, Rsp&)> handler) {
+    registerMethod(name, [handler](const std::string& request,
+                                   std::string& response) {
+      Req req;
+      if (!DeserializeFromString(request, req)) {
+        return -1;
+      }
+      Rsp rsp;
+      int32_t ret = handler(req, rsp);
+      StringWriter w(response);
+      Serialize(w, rsp);
+      return ret;
+    });
+  }
+
+  void unregisterMethod(const std::string& name);
+
+ protected:
+  void handleClient(Socket::ptr client) override;
+
+ private:
+  void dispatch(RpcStream::ptr stream, RpcMessage::ptr request,
+                uint64_t recv_time);
+
+ private:
+  RWMutexType m_mutex;
+  // 取出来之后不持有锁执行, 用shared_ptr避免每次拷贝std::function
+  std::unordered_map<std::string, std::shared_ptr<Handler>> m_handlers;
+};
+
+}  // namespace rpc
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,138 @@
+#include "ddg/rpc/rpcstream.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "ddg/config.h"
+#include "ddg/endian.h"
+#include "ddg/log.h"
+
+namespace ddg {
+namespace rpc {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_rpc_max_body_size = Config::Lookup<uint32_t>(
+    "rpc.max_body_size", 64 * 1024 * 1024, "rpc message max body size");
+
+// 不超过这个大小的body先收进读缓冲再拷贝, 大的直接recv进目标字符串
+static const size_t kBufferedBodySize = 64 * 1024;
+
+static uint32_t ReadUint32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return ByteSwapOnLittleEndian(v);
+}
+
+RpcStream::RpcStream(Socket::ptr sock, bool owner)
+    : HttpStream(sock, owner), m_sending(false), m_sendError(false) {}
+
+RpcMessage::ptr RpcStream::recvMessage() {
+  if (ensure(kRpcHeaderSize) <= 0) {
+    return nullptr;
+  }
+  const char* p = peek();
+  if (static_cast<uint8_t>(p[0]) != kRpcMagic ||
+      static_cast<uint8_t>(p[1]) != kRpcVersion) {
+    DDG_LOG_DEBUG(g_logger) << "invalid rpc header " << *m_socket;
+    return nullptr;
+  }
+  RpcMessage::ptr msg(new RpcMessage);
+  msg->type = static_cast<uint8_t>(p[2]);
+  size_t method_len = static_cast<uint8_t>(p[3]);
+  msg->seq = ReadUint32(p + 4);
+  msg->arg = ReadUint32(p + 8);
+  uint32_t body_len = ReadUint32(p + 12);
+  if (body_len > g_rpc_max_body_size->getValue()) {
+    DDG_LOG_DEBUG(g_logger) << "rpc body too large " << body_len << " "
+                            << *m_socket;
+    return nullptr;
+  }
+  consume(kRpcHeaderSize);
+
+  if (!readString(msg->method, method_len) ||
+      !readString(msg->body, body_len)) {
+    return nullptr;
+  }
+  return msg;
+}
+
+bool RpcStream::readString(std::string& out, size_t len) {
+  if (len <= kBufferedBodySize) {
+    if (ensure(len) <= 0) {
+      return false;
+    }
+    out.assign(peek(), len);
+    consume(len);
+    return true;
+  }
+
+  size_t copy = std::min(len, getBufferedSize());
+  out.resize(len);
+  memcpy(&out[0], peek(), copy);
+  consume(copy);
+  while (copy < len) {
+    int n = m_socket->recv(&out[copy], len - copy);
+    if (n <= 0) {
+      return false;
+    }
+    copy += n;
+  }
+  return true;
+}
+
+bool RpcStream::sendMessage(uint8_t type, uint32_t seq, uint32_t arg,
+                            const std::string& method,
+                            const std::string& body) {
+  {
+    MutexType::Lock lock(m_sendMutex);
+    if (m_sendError) {
+      return false;
+    }
+    RpcMessage::Encode(m_sendBuf, type, seq, arg, method, body);
+    if (m_sending) {
+      // 正在发送的协程会把它一起发出去
+      return true;
+    }
+    m_sending = true;
+  }
+
+  std::string buf;
+  while (true) {
+    {
+      MutexType::Lock lock(m_sendMutex);
+      if (m_sendBuf.empty()) {
+        m_sending = false;
+        return true;
+      }
+      buf.swap(m_sendBuf);
+    }
+    // 发送时不持有锁, send会让出协程
+    bool ok = sendAll(buf);
+    buf.clear();
+    if (!ok) {
+      MutexType::Lock lock(m_sendMutex);
+      m_sendError = true;
+      m_sending = false;
+      m_sendBuf.clear();
+      return false;
+    }
+  }
+}
+
+bool RpcStream::sendAll(const std::string& data) {
+  size_t offset = 0;
+  while (offset < data.size()) {
+    int n = m_socket->send(data.c_str() + offset, data.size() - offset);
+    if (n <= 0) {
+      DDG_LOG_DEBUG(g_logger) << "rpc send fail errno = " << errno << " "
+                              << *m_socket;
+      return false;
+    }
+    offset += n;
+  }
+  return true;
+}
+
+}  // namespace rpc
+}  // namespace ddg
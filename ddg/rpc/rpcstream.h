@@ -0,0 +1,63 @@
+#ifndef DDG_RPC_RPCSTREAM_H_
+#define DDG_RPC_RPCSTREAM_H_
+
+#include <memory>
+#include <string>
+
+#include "ddg/http/httpstream.h"
+#include "ddg/mutex.h"
+#include "ddg/rpc/rpc.h"
+
+namespace ddg {
+namespace rpc {
+
+/**
+ * @brief RPC连接的读写, 服务端和客户端共用
+ *
+ * 读缓冲复用HttpStream, 同一时间只能有一个协程读.
+ * 写可以多个协程同时调用: 消息先编码进共享的发送缓冲, 没有人在发送时
+ * 当前协程负责发送, 发送期间别的协程追加的消息在下一轮一次send出去,
+ * 并发的小调用因此会合并成少量的系统调用
+ */
+class RpcStream : public http::HttpStream {
+ public:
+  using ptr = std::shared_ptr<RpcStream>;
+  using MutexType = Mutex;
+
+  RpcStream(Socket::ptr sock, bool owner = true);
+
+  /**
+   * @brief 读取一个消息
+   * @return 连接关闭、出错或者格式错误时返回nullptr
+   */
+  RpcMessage::ptr recvMessage();
+
+  /**
+   * @brief 发送一个消息
+   * @return 连接已经出错返回false. 返回true时消息可能还在别的协程的
+   *         发送队列里
+   */
+  bool sendMessage(uint8_t type, uint32_t seq, uint32_t arg,
+                   const std::string& method, const std::string& body);
+
+  bool sendMessage(const RpcMessage& msg) {
+    return sendMessage(msg.type, msg.seq, msg.arg, msg.method, msg.body);
+  }
+
+ private:
+  // 读取len字节到out
+  bool readString(std::string& out, size_t len);
+
+  bool sendAll(const std::string& data);
+
+ private:
+  MutexType m_sendMutex;
+  std::string m_sendBuf;
+  bool m_sending;
+  bool m_sendError;
+};
+
+}  // namespace rpc
+}  // namespace ddg
+
+#endif
@@ -36,16 +36,29 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
   m_threadCount = threads;
 }
 
-Scheduler::~Scheduler() {}
+Scheduler::~Scheduler() {
+  if (GetThis() == this) {
+    t_scheduler = nullptr;
+  }
+}
 
 std::string Scheduler::getName() const {
   return m_name;
 }
 
+std::vector<uint64_t> Scheduler::getThreadIds() {
+  MutexType::Lock lock(m_mutex);
+  return m_threadIds;
+}
+
 void Scheduler::tickle() {
   DDG_LOG_DEBUG(g_logger) << "in tickle ...";
 }
 
+void Scheduler::tickleThread(uint64_t thread) {
+  tickle();
+}
+
 void Scheduler::idle() {
   DDG_LOG_DEBUG(g_logger) << "in idle ...";
 }
@@ -132,6 +145,7 @@ Fiber* Scheduler::GetMainFiber() {
 
 void Scheduler::run() {
   DDG_LOG_DEBUG(g_logger) << "into run ...";
+  ddg::SetHookEnable(true);
   SetThis();
   if (ddg::GetThreadId() != m_rootThread) {
     t_scheduler_fiber = Fiber::GetThis().get();
@@ -146,10 +160,12 @@ void Scheduler::run() {
     bool tickle_me = false;
     {
       MutexType::Lock lock(m_mutex);
-      for (auto it = m_fibers.begin(); it != m_fibers.end(); it++) {
+      for (auto it = m_fibers.begin(); it != m_fibers.end();) {
 #define itt (*it)
-        if (itt->thread != 0 && itt->thread == GetThreadId()) {
-          tickle_me = true;
+        // 指定了线程的任务只能在对应线程上执行
+        // 调度时已经定向唤醒过对应线程, 这里再tickle只会把自己叫醒
+        if (itt->thread != 0 && itt->thread != GetThreadId()) {
+          ++it;
           continue;
         }
 
@@ -158,29 +174,27 @@ void Scheduler::run() {
           auto state = fiber->getState();
           bool is_skip = false;
           switch (state) {
-            case Fiber::State::INIT:
-            case Fiber::State::HOLD:  // 预备
-              fiber->setState(Fiber::State::READY);
-              is_skip = true;
-              break;
-            case Fiber::State::EXEC:  // 挂起
+            case Fiber::State::EXEC:  // 还没有切出去, 等下一轮
               is_skip = true;
               break;
+            case Fiber::State::INIT:
+            case Fiber::State::HOLD:  // 被显式调度(如io事件、定时器唤醒)
             case Fiber::State::READY:
               is_skip = false;
               break;
             default:
-              m_fibers.erase(it++);
-              is_skip = true;
+              it = m_fibers.erase(it);
+              continue;
           }
 
           if (is_skip) {
+            ++it;
             continue;
           }
         }
 
         ft = itt;
-        m_fibers.erase(it++);
+        m_fibers.erase(it);
         m_activeThreadCount++;
         is_active = true;
         tickle_me = is_active;
@@ -204,17 +218,13 @@ void Scheduler::run() {
       }
 
       fiber->setState(Fiber::State::Type::READY);
-      fiber->swapIn();
-      m_activeThreadCount--;
-      auto state = fiber->getState();  // 如果是调用当前携程的话没法释放
-      // DDG_LOG_DEBUG(g_logger)
-      // << "come here "
-      // << "Fiber State: " << Fiber::State::ToString(fiber->getState());
+      // HOLD的协程swapIn返回时已经可能被别的线程唤醒, 不能再改它的状态
+      auto state = fiber->swapIn();
+      // 先放回队列再减活跃数, 否则中间isStoped会短暂为真, 别的线程会退出
       if (state == Fiber::State::READY) {
         schedule(ft);
-      } else if (state != Fiber::State::TERM && state != Fiber::State::EXCEPT) {
-        ft->fiber->setState(Fiber::State::HOLD);
       }
+      m_activeThreadCount--;
 
       ft.reset();  // 重新设置智能指针
     } else {
@@ -226,17 +236,15 @@ void Scheduler::run() {
         if (idle_ft->fiber) {
           auto fiber = idle_ft->fiber;
           m_idleThreadCount++;
-          fiber->swapIn();
+          auto state = fiber->swapIn();
           m_idleThreadCount--;
-          if (fiber->getState() == Fiber::State::EXEC) {
-            fiber->setState(Fiber::State::HOLD);
-          } else if (fiber->getState() == Fiber::State::TERM ||
-                     fiber->getState() == Fiber::State::EXCEPT) {
+          if (state == Fiber::State::TERM || state == Fiber::State::EXCEPT) {
             idle_ft.reset();
           }
         }
       } else {
         DDG_LOG_DEBUG(g_logger) << "idle_ft count: " << idle_ft.use_count();
+        ddg::SetHookEnable(false);
         break;
       }
     }
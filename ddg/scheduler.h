@@ -26,6 +26,12 @@ class Scheduler : public NonCopyable {
 
   std::string getName() const;
 
+  // 参与调度的线程id, start之后才完整
+  std::vector<uint64_t> getThreadIds();
+
+  // use_caller时的调用线程, 只在stop里参与调度; 否则为0
+  uint64_t getRootThread() const { return m_rootThread; }
+
   void SetThis();
 
   void start();
@@ -42,6 +48,9 @@ class Scheduler : public NonCopyable {
 
   virtual void tickle();
 
+  // 唤醒指定的线程, 去执行绑定在它上面的任务
+  virtual void tickleThread(uint64_t thread);
+
   virtual void idle();
 
   bool hasIdleThreads() { return m_idleThreadCount > 0; }
@@ -88,7 +97,11 @@ class Scheduler : public NonCopyable {
       need_tickle = scheduleNoLock(fc, thread);
     }
     if (need_tickle) {
-      tickle();
+      if (thread) {
+        tickleThread(thread);
+      } else {
+        tickle();
+      }
     }
   }
 
@@ -109,7 +122,7 @@ class Scheduler : public NonCopyable {
 
  private:
   template <class FiberOrCb>
-  bool scheduleNoLock(FiberOrCb fc, int thread = 0) {
+  bool scheduleNoLock(FiberOrCb fc, uint64_t thread = 0) {
     FiberAndThread::ptr ft = std::make_shared<FiberAndThread>(fc, thread);
     if (ft->fiber || ft->cb) {
       m_fibers.push_back(ft);
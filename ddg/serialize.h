@@ -0,0 +1,707 @@
+#ifndef DDG_SERIALIZE_H_
+#define DDG_SERIALIZE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "ddg/bytearray.h"
+#include "ddg/endian.h"
+
+/**
+ * 结构体的二进制序列化, 字段布局参考protobuf, 但是不和protobuf兼容:
+ *
+ *   每个字段 = key(varint, tag << 3 | wire_type) + 值
+ *   整数是varint, 有符号整数和enum都用zigzag(相当于protobuf的sint),
+ *   float/double定长, 大端(protobuf是小端),
+ *   string和嵌套结构体是长度(varint) + 内容,
+ *   数值的vector打包成一个长度前缀的字段, 其他vector每个元素一个字段,
+ *   map每个元素是一个嵌套的{1: key, 2: value}
+ *
+ * 值为0或空的字段不写, 不认识的tag跳过, 所以两端可以各自增删字段.
+ * 解码时嵌套的结构体最多kMaxMessageDepth层, 防止恶意数据让递归的结构体
+ * 把栈用完.
+ *
+ * 在结构体里用DDG_SERIALIZE列出字段:
+ *
+ *   struct User {
+ *     int32_t id = 0;
+ *     std::string name;
+ *     std::vector<int32_t> scores;
+ *     DDG_SERIALIZE(DDG_FIELD(1, id) DDG_FIELD(2, name) DDG_FIELD(3, scores))
+ *   };
+ *
+ * 写入端可以是ByteArray或者StringWriter, 读取端可以是ByteArray或者
+ * MemoryReader. 解码时string字段直接从ByteArray的内存块拷贝到结构体里,
+ * 中间没有临时的std::string
+ */
+// 访问者参数的名字不能和字段重名
+#define DDG_FIELD(tag, name) ddg_visitor.field(tag, #name, name);
+
+#define DDG_SERIALIZE(fields)                 \
+  using DdgMessage = void;                    \
+  template <class Visitor>                    \
+  void ddgVisit(Visitor& ddg_visitor) {       \
+    fields                                    \
+  }                                           \
+  template <class Visitor>                    \
+  void ddgVisit(Visitor& ddg_visitor) const { \
+    fields                                    \
+  }
+
+namespace ddg {
+
+enum WireType {
+  WIRE_VARINT = 0,
+  WIRE_FIXED64 = 1,
+  WIRE_LENGTH = 2,
+  WIRE_FIXED32 = 5,
+};
+
+// 写到连续的std::string, 接口和ByteArray的写入函数一致
+class StringWriter {
+ public:
+  explicit StringWriter(std::string& out) : m_out(out) {}
+
+  void writeUint32(uint32_t v) { writeUint64(v); }
+
+  void writeUint64(uint64_t v) {
+    char buf[10];
+    size_t n = 0;
+    while (v >= 0x80) {
+      buf[n++] = static_cast<char>(v | 0x80);
+      v >>= 7;
+    }
+    buf[n++] = static_cast<char>(v);
+    m_out.append(buf, n);
+  }
+
+  void writeInt32(int32_t v) {
+    writeUint32((static_cast<uint32_t>(v) << 1) ^
+                static_cast<uint32_t>(v >> 31));
+  }
+
+  void writeInt64(int64_t v) {
+    writeUint64((static_cast<uint64_t>(v) << 1) ^
+                static_cast<uint64_t>(v >> 63));
+  }
+
+  void writeFuint32(uint32_t v) {
+    v = ByteSwapOnLittleEndian(v);
+    m_out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  void writeFuint64(uint64_t v) {
+    v = ByteSwapOnLittleEndian(v);
+    m_out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  void writeFloat(float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    writeFuint32(u);
+  }
+
+  void writeDouble(double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    writeFuint64(u);
+  }
+
+  void write(const void* buf, size_t size) {
+    m_out.append(static_cast<const char*>(buf), size);
+  }
+
+ private:
+  std::string& m_out;
+};
+
+// 从一段连续内存读, 接口和ByteArray的读取函数一致, 数据不够时抛出
+// std::out_of_range
+class MemoryReader {
+ public:
+  MemoryReader(const void* data, size_t size)
+      : m_data(static_cast<const uint8_t*>(data)), m_size(size), m_pos(0) {}
+
+  uint32_t readUint32() { return static_cast<uint32_t>(readUint64()); }
+
+  uint64_t readUint64() {
+    uint64_t result = 0;
+    for (int i = 0; i < 64; i += 7) {
+      check(1);
+      uint8_t b = m_data[m_pos++];
+      result |= static_cast<uint64_t>(b & 0x7F) << i;
+      if (b < 0x80) {
+        break;
+      }
+    }
+    return result;
+  }
+
+  int32_t readInt32() {
+    uint32_t v = readUint32();
+    return static_cast<int32_t>((v >> 1) ^ -(v & 1));
+  }
+
+  int64_t readInt64() {
+    uint64_t v = readUint64();
+    return static_cast<int64_t>((v >> 1) ^ -(v & 1));
+  }
+
+  uint32_t readFuint32() {
+    uint32_t v;
+    read(&v, sizeof(v));
+    return ByteSwapOnLittleEndian(v);
+  }
+
+  uint64_t readFuint64() {
+    uint64_t v;
+    read(&v, sizeof(v));
+    return ByteSwapOnLittleEndian(v);
+  }
+
+  float readFloat() {
+    uint32_t u = readFuint32();
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+  }
+
+  double readDouble() {
+    uint64_t u = readFuint64();
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+  }
+
+  void read(void* buf, size_t size) {
+    check(size);
+    memcpy(buf, m_data + m_pos, size);
+    m_pos += size;
+  }
+
+  void skip(size_t size) {
+    check(size);
+    m_pos += size;
+  }
+
+  size_t getPosition() const { return m_pos; }
+
+  size_t getReadSize() const { return m_size - m_pos; }
+
+ private:
+  void check(size_t size) const {
+    if (size > m_size - m_pos) {
+      throw std::out_of_range("not enough len");
+    }
+  }
+
+ private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+};
+
+namespace serialize_detail {
+
+template <class T>
+struct VoidType {
+  using type = void;
+};
+
+// 用DDG_SERIALIZE声明过的结构体
+template <class T, class = void>
+struct IsMessage : std::false_type {};
+
+template <class T>
+struct IsMessage<T, typename VoidType<typename T::DdgMessage>::type>
+    : std::true_type {};
+
+inline size_t VarintSize(uint64_t v) {
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+inline uint32_t MakeKey(uint32_t tag, WireType wire) {
+  return (tag << 3) | wire;
+}
+
+inline size_t ZigzagSize(int64_t v) {
+  return VarintSize((static_cast<uint64_t>(v) << 1) ^
+                    static_cast<uint64_t>(v >> 63));
+}
+
+[[noreturn]] inline void ThrowFormatError(const char* what) {
+  throw std::runtime_error(what);
+}
+
+static const int kMaxMessageDepth = 100;
+
+// 当前线程正在解码的嵌套层数. 解码过程中不会切换协程
+inline int& MessageDepth() {
+  static thread_local int t_depth = 0;
+  return t_depth;
+}
+
+struct MessageDepthGuard {
+  MessageDepthGuard() {
+    if (++MessageDepth() > kMaxMessageDepth) {
+      --MessageDepth();
+      ThrowFormatError("message nested too deep");
+    }
+  }
+  ~MessageDepthGuard() { --MessageDepth(); }
+};
+
+// 长度前缀, 顺便检查数据够不够, 避免按错误的长度分配内存
+template <class R>
+size_t ReadLength(R& r) {
+  uint64_t len = r.readUint64();
+  if (len > r.getReadSize()) {
+    throw std::out_of_range("not enough len");
+  }
+  return static_cast<size_t>(len);
+}
+
+template <class R>
+void SkipField(R& r, uint32_t wire) {
+  switch (wire) {
+    case WIRE_VARINT:
+      r.readUint64();
+      break;
+    case WIRE_FIXED64:
+      r.skip(8);
+      break;
+    case WIRE_LENGTH:
+      r.skip(ReadLength(r));
+      break;
+    case WIRE_FIXED32:
+      r.skip(4);
+      break;
+    default:
+      ThrowFormatError("unknown wire type");
+  }
+}
+
+template <class T>
+size_t MessageSize(const T& msg);
+
+template <class W, class T>
+void WriteMessage(W& w, const T& msg);
+
+template <class R, class T>
+void ReadMessage(R& r, T& msg, size_t end);
+
+/**
+ * 单个值的编码: kWire, Size(长度前缀也算在内), Write, Read, IsDefault
+ */
+template <class T, class Enable = void>
+struct ValueCodec;
+
+template <>
+struct ValueCodec<bool> {
+  static const WireType kWire = WIRE_VARINT;
+  static size_t Size(bool v) { return 1; }
+  template <class W>
+  static void Write(W& w, bool v) { w.writeUint32(v ? 1 : 0); }
+  template <class R>
+  static void Read(R& r, bool& v) { v = r.readUint64() != 0; }
+  static bool IsDefault(bool v) { return !v; }
+};
+
+template <class T>
+struct ValueCodec<T, typename std::enable_if<
+                        std::is_integral<T>::value &&
+                        std::is_unsigned<T>::value>::type> {
+  static const WireType kWire = WIRE_VARINT;
+  static size_t Size(T v) { return VarintSize(v); }
+  template <class W>
+  static void Write(W& w, T v) { w.writeUint64(v); }
+  template <class R>
+  static void Read(R& r, T& v) { v = static_cast<T>(r.readUint64()); }
+  static bool IsDefault(T v) { return v == 0; }
+};
+
+template <class T>
+struct ValueCodec<T, typename std::enable_if<
+                        std::is_integral<T>::value &&
+                        std::is_signed<T>::value>::type> {
+  static const WireType kWire = WIRE_VARINT;
+  static size_t Size(T v) { return ZigzagSize(v); }
+  template <class W>
+  static void Write(W& w, T v) { w.writeInt64(v); }
+  template <class R>
+  static void Read(R& r, T& v) { v = static_cast<T>(r.readInt64()); }
+  static bool IsDefault(T v) { return v == 0; }
+};
+
+template <class T>
+struct ValueCodec<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+  static const WireType kWire = WIRE_VARINT;
+  static size_t Size(T v) { return ZigzagSize(static_cast<int64_t>(v)); }
+  template <class W>
+  static void Write(W& w, T v) { w.writeInt64(static_cast<int64_t>(v)); }
+  template <class R>
+  static void Read(R& r, T& v) { v = static_cast<T>(r.readInt64()); }
+  static bool IsDefault(T v) { return static_cast<int64_t>(v) == 0; }
+};
+
+template <>
+struct ValueCodec<float> {
+  static const WireType kWire = WIRE_FIXED32;
+  static size_t Size(float v) { return 4; }
+  template <class W>
+  static void Write(W& w, float v) { w.writeFloat(v); }
+  template <class R>
+  static void Read(R& r, float& v) { v = r.readFloat(); }
+  static bool IsDefault(float v) { return v == 0; }
+};
+
+template <>
+struct ValueCodec<double> {
+  static const WireType kWire = WIRE_FIXED64;
+  static size_t Size(double v) { return 8; }
+  template <class W>
+  static void Write(W& w, double v) { w.writeDouble(v); }
+  template <class R>
+  static void Read(R& r, double& v) { v = r.readDouble(); }
+  static bool IsDefault(double v) { return v == 0; }
+};
+
+template <>
+struct ValueCodec<std::string> {
+  static const WireType kWire = WIRE_LENGTH;
+  static size_t Size(const std::string& v) {
+    return VarintSize(v.size()) + v.size();
+  }
+  template <class W>
+  static void Write(W& w, const std::string& v) {
+    w.writeUint64(v.size());
+    w.write(v.c_str(), v.size());
+  }
+  template <class R>
+  static void Read(R& r, std::string& v) {
+    size_t len = ReadLength(r);
+    v.resize(len);
+    if (len) {
+      r.read(&v[0], len);
+    }
+  }
+  static bool IsDefault(const std::string& v) { return v.empty(); }
+};
+
+template <class T>
+struct ValueCodec<T, typename std::enable_if<IsMessage<T>::value>::type> {
+  static const WireType kWire = WIRE_LENGTH;
+  static size_t Size(const T& v) {
+    size_t n = MessageSize(v);
+    return VarintSize(n) + n;
+  }
+  template <class W>
+  static void Write(W& w, const T& v) {
+    w.writeUint64(MessageSize(v));
+    WriteMessage(w, v);
+  }
+  template <class R>
+  static void Read(R& r, T& v) {
+    size_t len = ReadLength(r);
+    ReadMessage(r, v, r.getPosition() + len);
+  }
+  // 嵌套的结构体总是写出来, 空结构体只占两个字节
+  static bool IsDefault(const T& v) { return false; }
+};
+
+/**
+ * 字段的编码, 在ValueCodec上加key, 处理vector和map
+ */
+template <class T>
+struct FieldCodec {
+  using Codec = ValueCodec<T>;
+
+  static size_t Size(uint32_t tag, const T& v) {
+    if (Codec::IsDefault(v)) {
+      return 0;
+    }
+    return VarintSize(MakeKey(tag, Codec::kWire)) + Codec::Size(v);
+  }
+
+  template <class W>
+  static void Write(W& w, uint32_t tag, const T& v) {
+    if (Codec::IsDefault(v)) {
+      return;
+    }
+    w.writeUint32(MakeKey(tag, Codec::kWire));
+    Codec::Write(w, v);
+  }
+
+  template <class R>
+  static void Read(R& r, uint32_t wire, T& v) {
+    if (wire != Codec::kWire) {
+      ThrowFormatError("wire type mismatch");
+    }
+    Codec::Read(r, v);
+  }
+};
+
+template <class T>
+struct FieldCodec<std::vector<T>> {
+  using Codec = ValueCodec<T>;
+  // 数值类型打包成一个字段
+  static const bool kPacked = Codec::kWire != WIRE_LENGTH;
+
+  static size_t PayloadSize(const std::vector<T>& v) {
+    size_t n = 0;
+    for (auto& i : v) {
+      n += Codec::Size(i);
+    }
+    return n;
+  }
+
+  static size_t Size(uint32_t tag, const std::vector<T>& v) {
+    if (v.empty()) {
+      return 0;
+    }
+    if (kPacked) {
+      size_t n = PayloadSize(v);
+      return VarintSize(MakeKey(tag, WIRE_LENGTH)) + VarintSize(n) + n;
+    }
+    return VarintSize(MakeKey(tag, WIRE_LENGTH)) * v.size() + PayloadSize(v);
+  }
+
+  template <class W>
+  static void Write(W& w, uint32_t tag, const std::vector<T>& v) {
+    if (v.empty()) {
+      return;
+    }
+    uint32_t key = MakeKey(tag, WIRE_LENGTH);
+    if (kPacked) {
+      w.writeUint32(key);
+      w.writeUint64(PayloadSize(v));
+      for (auto& i : v) {
+        Codec::Write(w, i);
+      }
+      return;
+    }
+    for (auto& i : v) {
+      w.writeUint32(key);
+      Codec::Write(w, i);
+    }
+  }
+
+  template <class R>
+  static void Read(R& r, uint32_t wire, std::vector<T>& v) {
+    if (kPacked && wire == WIRE_LENGTH) {
+      size_t len = ReadLength(r);
+      size_t end = r.getPosition() + len;
+      while (r.getPosition() < end) {
+        v.emplace_back();
+        Codec::Read(r, v.back());
+      }
+      if (r.getPosition() != end) {
+        ThrowFormatError("packed field overrun");
+      }
+      return;
+    }
+    if (wire != Codec::kWire) {
+      ThrowFormatError("wire type mismatch");
+    }
+    v.emplace_back();
+    Codec::Read(r, v.back());
+  }
+};
+
+// map的每个元素当作嵌套的{1: key, 2: value}
+template <class M>
+struct MapFieldCodec {
+  using K = typename M::key_type;
+  using V = typename M::mapped_type;
+
+  static size_t EntrySize(const K& k, const V& v) {
+    return FieldCodec<K>::Size(1, k) + FieldCodec<V>::Size(2, v);
+  }
+
+  static size_t Size(uint32_t tag, const M& m) {
+    size_t key_size = VarintSize(MakeKey(tag, WIRE_LENGTH));
+    size_t n = 0;
+    for (auto& i : m) {
+      size_t entry = EntrySize(i.first, i.second);
+      n += key_size + VarintSize(entry) + entry;
+    }
+    return n;
+  }
+
+  template <class W>
+  static void Write(W& w, uint32_t tag, const M& m) {
+    uint32_t key = MakeKey(tag, WIRE_LENGTH);
+    for (auto& i : m) {
+      w.writeUint32(key);
+      w.writeUint64(EntrySize(i.first, i.second));
+      FieldCodec<K>::Write(w, 1, i.first);
+      FieldCodec<V>::Write(w, 2, i.second);
+    }
+  }
+
+  template <class R>
+  static void Read(R& r, uint32_t wire, M& m) {
+    if (wire != WIRE_LENGTH) {
+      ThrowFormatError("wire type mismatch");
+    }
+    size_t len = ReadLength(r);
+    size_t end = r.getPosition() + len;
+    K k = K();
+    V v = V();
+    while (r.getPosition() < end) {
+      uint32_t key = r.readUint32();
+      if ((key >> 3) == 1) {
+        FieldCodec<K>::Read(r, key & 7, k);
+      } else if ((key >> 3) == 2) {
+        FieldCodec<V>::Read(r, key & 7, v);
+      } else {
+        SkipField(r, key & 7);
+      }
+    }
+    if (r.getPosition() != end) {
+      ThrowFormatError("map entry overrun");
+    }
+    m[std::move(k)] = std::move(v);
+  }
+};
+
+template <class K, class V>
+struct FieldCodec<std::map<K, V>> : MapFieldCodec<std::map<K, V>> {};
+
+template <class K, class V>
+struct FieldCodec<std::unordered_map<K, V>>
+    : MapFieldCodec<std::unordered_map<K, V>> {};
+
+struct SizeVisitor {
+  size_t size = 0;
+
+  template <class T>
+  void field(uint32_t tag, const char* name, const T& v) {
+    size += FieldCodec<T>::Size(tag, v);
+  }
+};
+
+template <class W>
+struct WriteVisitor {
+  W& w;
+
+  template <class T>
+  void field(uint32_t tag, const char* name, const T& v) {
+    FieldCodec<T>::Write(w, tag, v);
+  }
+};
+
+// 找到tag对应的字段并解码
+template <class R>
+struct ReadVisitor {
+  R& r;
+  uint32_t tag;
+  uint32_t wire;
+  bool matched;
+
+  template <class T>
+  void field(uint32_t t, const char* name, T& v) {
+    if (t == tag && !matched) {
+      matched = true;
+      FieldCodec<T>::Read(r, wire, v);
+    }
+  }
+};
+
+template <class T>
+size_t MessageSize(const T& msg) {
+  SizeVisitor v;
+  msg.ddgVisit(v);
+  return v.size;
+}
+
+template <class W, class T>
+void WriteMessage(W& w, const T& msg) {
+  WriteVisitor<W> v{w};
+  msg.ddgVisit(v);
+}
+
+template <class R, class T>
+void ReadMessage(R& r, T& msg, size_t end) {
+  MessageDepthGuard guard;
+  while (r.getPosition() < end) {
+    uint32_t key = r.readUint32();
+    ReadVisitor<R> v{r, key >> 3, key & 7, false};
+    msg.ddgVisit(v);
+    if (!v.matched) {
+      SkipField(r, key & 7);
+    }
+  }
+  if (r.getPosition() != end) {
+    ThrowFormatError("message overrun");
+  }
+}
+
+}  // namespace serialize_detail
+
+template <class T>
+size_t SerializedSize(const T& msg) {
+  return serialize_detail::MessageSize(msg);
+}
+
+/**
+ * @brief 编码msg追加到out(ByteArray或者StringWriter)
+ */
+template <class W, class T>
+void Serialize(W& out, const T& msg) {
+  serialize_detail::WriteMessage(out, msg);
+}
+
+template <class T>
+std::string SerializeToString(const T& msg) {
+  std::string out;
+  out.reserve(SerializedSize(msg));
+  StringWriter w(out);
+  Serialize(w, msg);
+  return out;
+}
+
+/**
+ * @brief 从in的读位置开始解码len字节到msg, msg先被重置
+ * @return 数据不完整或者格式错误返回false, 此时读位置不确定
+ */
+template <class R, class T>
+bool Deserialize(R& in, T& msg, size_t len) {
+  msg = T();
+  try {
+    if (len > in.getReadSize()) {
+      return false;
+    }
+    serialize_detail::ReadMessage(in, msg, in.getPosition() + len);
+  } catch (std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+// 解码所有可读的数据
+template <class R, class T>
+bool Deserialize(R& in, T& msg) {
+  return Deserialize(in, msg, in.getReadSize());
+}
+
+template <class T>
+bool DeserializeFromString(const std::string& data, T& msg) {
+  MemoryReader r(data.c_str(), data.size());
+  return Deserialize(r, msg);
+}
+
+}  // namespace ddg
+
+#endif
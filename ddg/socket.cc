@@ -0,0 +1,606 @@
+#include "ddg/socket.h"
+
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "ddg/config.h"
+#include "ddg/fdmanager.h"
+#include "ddg/hook.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<bool>::ptr g_tcp_nodelay =
+    Config::Lookup<bool>("tcp.nodelay", true, "tcp socket TCP_NODELAY");
+
+static ConfigVar<bool>::ptr g_tcp_reuseport =
+    Config::Lookup<bool>("tcp.reuseport", false, "tcp socket SO_REUSEPORT");
+
+static ConfigVar<bool>::ptr g_tcp_keepalive_enable = Config::Lookup<bool>(
+    "tcp.keepalive.enable", false, "tcp socket SO_KEEPALIVE");
+
+static ConfigVar<int>::ptr g_tcp_keepalive_idle = Config::Lookup<int>(
+    "tcp.keepalive.idle", 60, "tcp keepalive idle time(second)");
+
+static ConfigVar<int>::ptr g_tcp_keepalive_interval = Config::Lookup<int>(
+    "tcp.keepalive.interval", 10, "tcp keepalive probe interval(second)");
+
+static ConfigVar<int>::ptr g_tcp_keepalive_count =
+    Config::Lookup<int>("tcp.keepalive.count", 3, "tcp keepalive probe count");
+
+Socket::ptr Socket::CreateTCP(Address::ptr address) {
+  return std::make_shared<Socket>(address->getFamily(), TCP, 0);
+}
+
+Socket::ptr Socket::CreateUDP(Address::ptr address) {
+  Socket::ptr sock = std::make_shared<Socket>(address->getFamily(), UDP, 0);
+  sock->newSock();
+  sock->m_isConnected = true;
+  return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket() {
+  return std::make_shared<Socket>(IPv4, TCP, 0);
+}
+
+Socket::ptr Socket::CreateUDPSocket() {
+  Socket::ptr sock = std::make_shared<Socket>(IPv4, UDP, 0);
+  sock->newSock();
+  sock->m_isConnected = true;
+  return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket6() {
+  return std::make_shared<Socket>(IPv6, TCP, 0);
+}
+
+Socket::ptr Socket::CreateUDPSocket6() {
+  Socket::ptr sock = std::make_shared<Socket>(IPv6, UDP, 0);
+  sock->newSock();
+  sock->m_isConnected = true;
+  return sock;
+}
+
+Socket::ptr Socket::CreateUnixTCPSocket() {
+  return std::make_shared<Socket>(UNIX, TCP, 0);
+}
+
+Socket::ptr Socket::CreateUnixUDPSocket() {
+  Socket::ptr sock = std::make_shared<Socket>(UNIX, UDP, 0);
+  sock->newSock();
+  sock->m_isConnected = true;
+  return sock;
+}
+
+Socket::ptr Socket::CreateFromFd(int fd) {
+  int family = 0;
+  int type = 0;
+  int protocol = 0;
+  socklen_t len = sizeof(int);
+  if (::getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &family, &len) ||
+      ::getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) ||
+      ::getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &len)) {
+    DDG_LOG_ERROR(g_logger) << "CreateFromFd(" << fd << ") errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return nullptr;
+  }
+  FdMgr::GetInstance()->get(fd, true);
+  Socket::ptr sock = std::make_shared<Socket>(family, type, protocol);
+  if (!sock->init(fd)) {
+    return nullptr;
+  }
+  return sock;
+}
+
+Socket::Socket(int family, int type, int protocol)
+    : m_sock(-1),
+      m_family(family),
+      m_type(type),
+      m_protocol(protocol),
+      m_isConnected(false) {}
+
+Socket::~Socket() {
+  close();
+}
+
+// 负数(包括~0)表示不超时, 对应内核的{0, 0}
+static timeval ToTimeval(int64_t ms) {
+  if (ms < 0) {
+    return timeval{0, 0};
+  }
+  return timeval{static_cast<time_t>(ms / 1000),
+                 static_cast<suseconds_t>(ms % 1000 * 1000)};
+}
+
+int64_t Socket::getSendTimeout() {
+  FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
+  if (ctx) {
+    return ctx->getTimeout(SO_SNDTIMEO);
+  }
+  return -1;
+}
+
+void Socket::setSendTimeout(int64_t v) {
+  setOption(SOL_SOCKET, SO_SNDTIMEO, ToTimeval(v));
+}
+
+int64_t Socket::getRecvTimeout() {
+  FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
+  if (ctx) {
+    return ctx->getTimeout(SO_RCVTIMEO);
+  }
+  return -1;
+}
+
+void Socket::setRecvTimeout(int64_t v) {
+  setOption(SOL_SOCKET, SO_RCVTIMEO, ToTimeval(v));
+}
+
+bool Socket::getOption(int level, int option, void* result, socklen_t* len) {
+  int ret = getsockopt(m_sock, level, option, result, len);
+  if (ret) {
+    DDG_LOG_DEBUG(g_logger) << "getOption sock = " << m_sock
+                            << " level = " << level << " option = " << option
+                            << " errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool Socket::setOption(int level, int option, const void* result,
+                       socklen_t len) {
+  if (setsockopt(m_sock, level, option, result, len)) {
+    DDG_LOG_DEBUG(g_logger) << "setOption sock = " << m_sock
+                            << " level = " << level << " option = " << option
+                            << " errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool Socket::setNoDelay(bool on) {
+  int val = on ? 1 : 0;
+  return setOption(IPPROTO_TCP, TCP_NODELAY, val);
+}
+
+bool Socket::setReusePort(bool on) {
+  if (!isValid()) {
+    newSock();  // CreateTCP不会立即创建fd, 这个选项又必须在bind之前设置
+  }
+  int val = on ? 1 : 0;
+  return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
+bool Socket::setKeepAlive(bool on, int idle, int interval, int count) {
+  int val = on ? 1 : 0;
+  if (!setOption(SOL_SOCKET, SO_KEEPALIVE, val)) {
+    return false;
+  }
+  if (!on) {
+    return true;
+  }
+
+  bool ok = true;
+  if (idle > 0) {
+    ok = setOption(IPPROTO_TCP, TCP_KEEPIDLE, idle) && ok;
+  }
+  if (interval > 0) {
+    ok = setOption(IPPROTO_TCP, TCP_KEEPINTVL, interval) && ok;
+  }
+  if (count > 0) {
+    ok = setOption(IPPROTO_TCP, TCP_KEEPCNT, count) && ok;
+  }
+  return ok;
+}
+
+Socket::ptr Socket::accept() {
+  Socket::ptr sock = std::make_shared<Socket>(m_family, m_type, m_protocol);
+  // 新连接直接带上O_NONBLOCK, FdCtx初始化时省掉一次fcntl
+  int newsock =
+      ::accept4(m_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (newsock == -1) {
+    if (isValid()) {  // 被其他协程close唤醒的不算错误
+      DDG_LOG_ERROR(g_logger) << "accept(" << m_sock << ") errno = " << errno
+                              << " errstr = " << strerror(errno);
+    }
+    return nullptr;
+  }
+
+  if (sock->init(newsock)) {
+    return sock;
+  }
+  return nullptr;
+}
+
+size_t Socket::acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count) {
+  // 第一个连接走hook, 没有连接时让出协程
+  Socket::ptr sock = accept();
+  if (!sock) {
+    return 0;
+  }
+  socks.push_back(sock);
+
+  // 被唤醒后把积压的连接一次取完, 直到EAGAIN, 不再回到epoll
+  size_t count = 1;
+  while (count < max_count) {
+    int newsock =
+        accept4_f(m_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (newsock == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        DDG_LOG_ERROR(g_logger) << "accept4(" << m_sock << ") errno = "
+                                << errno << " errstr = " << strerror(errno);
+      }
+      break;
+    }
+
+    if (IsHookEnable()) {
+      FdMgr::GetInstance()->get(newsock, true);
+    }
+    sock = std::make_shared<Socket>(m_family, m_type, m_protocol);
+    if (sock->init(newsock)) {
+      socks.push_back(sock);
+      ++count;
+    } else {
+      ::close(newsock);
+    }
+  }
+  return count;
+}
+
+bool Socket::init(int sock) {
+  FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock);
+  if (ctx && (!ctx->isSocket() || ctx->isClosed())) {
+    return false;
+  }
+
+  m_sock = sock;
+  m_isConnected = true;
+  initSock();
+  getLocalAddress();
+  getRemoteAddress();
+  return true;
+}
+
+bool Socket::bind(const Address::ptr addr) {
+  if (!isValid()) {
+    newSock();
+    if (DDG_UNLIKELY(!isValid())) {
+      return false;
+    }
+  }
+
+  if (DDG_UNLIKELY(addr->getFamily() != m_family)) {
+    DDG_LOG_ERROR(g_logger) << "bind sock.family(" << m_family
+                            << ") addr.family(" << addr->getFamily()
+                            << ") not equal, addr = " << addr->toString();
+    return false;
+  }
+
+  UnixAddress::ptr uaddr = std::dynamic_pointer_cast<UnixAddress>(addr);
+  if (uaddr) {
+    // 上一个进程遗留下来的socket文件, 连接不上就删除掉
+    std::string path = uaddr->getPath();
+    struct stat st;
+    if (!path.empty() && path[0] != '\\' && stat(path.c_str(), &st) == 0 &&
+        S_ISSOCK(st.st_mode)) {
+      Socket::ptr sock = Socket::CreateUnixTCPSocket();
+      if (sock->connect(uaddr)) {
+        return false;
+      }
+      unlink(path.c_str());
+    }
+  }
+
+  if (::bind(m_sock, addr->getAddr(), addr->getAddrLen())) {
+    DDG_LOG_ERROR(g_logger) << "bind error errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+  getLocalAddress();
+  return true;
+}
+
+bool Socket::reconnect(uint64_t timeout_ms) {
+  if (!m_remoteAddress) {
+    DDG_LOG_ERROR(g_logger) << "reconnect m_remoteAddress is null";
+    return false;
+  }
+  m_localAddress.reset();
+  return connect(m_remoteAddress, timeout_ms);
+}
+
+bool Socket::connect(const Address::ptr addr, uint64_t timeout_ms) {
+  m_remoteAddress = addr;
+  if (!isValid()) {
+    newSock();
+    if (DDG_UNLIKELY(!isValid())) {
+      return false;
+    }
+  }
+
+  if (DDG_UNLIKELY(addr->getFamily() != m_family)) {
+    DDG_LOG_ERROR(g_logger) << "connect sock.family(" << m_family
+                            << ") addr.family(" << addr->getFamily()
+                            << ") not equal, addr = " << addr->toString();
+    return false;
+  }
+
+  // -1不超时; 不能走::connect, hook过的connect会用tcp.connect.timeout
+  if (::connect_with_timeout(m_sock, addr->getAddr(), addr->getAddrLen(),
+                             timeout_ms)) {
+    DDG_LOG_ERROR(g_logger)
+        << "sock = " << m_sock << " connect(" << addr->toString()
+        << ") timeout = " << timeout_ms << " error errno = " << errno
+        << " errstr = " << strerror(errno);
+    close();
+    return false;
+  }
+
+  m_isConnected = true;
+  getRemoteAddress();
+  getLocalAddress();
+  return true;
+}
+
+bool Socket::listen(int backlog) {
+  if (!isValid()) {
+    DDG_LOG_ERROR(g_logger) << "listen error sock = -1";
+    return false;
+  }
+  if (::listen(m_sock, backlog)) {
+    DDG_LOG_ERROR(g_logger) << "listen error errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool Socket::close() {
+  if (!m_isConnected && m_sock == -1) {
+    return true;
+  }
+  m_isConnected = false;
+  if (m_sock != -1) {
+    ::close(m_sock);
+    m_sock = -1;
+  }
+  return true;
+}
+
+int Socket::send(const void* buffer, size_t length, int flags) {
+  if (isConnected()) {
+    return ::send(m_sock, buffer, length, flags);
+  }
+  return -1;
+}
+
+int Socket::send(const iovec* buffers, size_t length, int flags) {
+  if (isConnected()) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<iovec*>(buffers);
+    msg.msg_iovlen = length;
+    return ::sendmsg(m_sock, &msg, flags);
+  }
+  return -1;
+}
+
+int Socket::sendFile(int fd, off_t* offset, size_t count) {
+  if (isConnected()) {
+    // 一次最多0x7ffff000字节, 不会超过int
+    return ::sendfile(m_sock, fd, offset, count);
+  }
+  return -1;
+}
+
+int Socket::sendTo(const void* buffer, size_t length, const Address::ptr to,
+                   int flags) {
+  if (isConnected()) {
+    return ::sendto(m_sock, buffer, length, flags, to->getAddr(),
+                    to->getAddrLen());
+  }
+  return -1;
+}
+
+int Socket::sendTo(const iovec* buffers, size_t length, const Address::ptr to,
+                   int flags) {
+  if (isConnected()) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<iovec*>(buffers);
+    msg.msg_iovlen = length;
+    msg.msg_name = to->getAddr();
+    msg.msg_namelen = to->getAddrLen();
+    return ::sendmsg(m_sock, &msg, flags);
+  }
+  return -1;
+}
+
+int Socket::recv(void* buffer, size_t length, int flags) {
+  if (isConnected()) {
+    return ::recv(m_sock, buffer, length, flags);
+  }
+  return -1;
+}
+
+int Socket::recv(iovec* buffers, size_t length, int flags) {
+  if (isConnected()) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = length;
+    return ::recvmsg(m_sock, &msg, flags);
+  }
+  return -1;
+}
+
+int Socket::recvFrom(void* buffer, size_t length, Address::ptr from,
+                     int flags) {
+  if (isConnected()) {
+    socklen_t len = from->getAddrLen();
+    return ::recvfrom(m_sock, buffer, length, flags, from->getAddr(), &len);
+  }
+  return -1;
+}
+
+int Socket::recvFrom(iovec* buffers, size_t length, Address::ptr from,
+                     int flags) {
+  if (isConnected()) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = length;
+    msg.msg_name = from->getAddr();
+    msg.msg_namelen = from->getAddrLen();
+    return ::recvmsg(m_sock, &msg, flags);
+  }
+  return -1;
+}
+
+// 根据family创建一个空的地址用于getpeername/getsockname
+static Address::ptr NewAddressByFamily(int family) {
+  switch (family) {
+    case AF_INET:
+      return std::make_shared<IPv4Address>();
+    case AF_INET6:
+      return std::make_shared<IPv6Address>();
+    case AF_UNIX:
+      return std::make_shared<UnixAddress>();
+    default:
+      return std::make_shared<UnknownAddress>(family);
+  }
+}
+
+Address::ptr Socket::getRemoteAddress() {
+  if (m_remoteAddress) {
+    return m_remoteAddress;
+  }
+
+  Address::ptr result = NewAddressByFamily(m_family);
+  socklen_t addrlen = result->getAddrLen();
+  if (getpeername(m_sock, result->getAddr(), &addrlen)) {
+    return std::make_shared<UnknownAddress>(m_family);
+  }
+  if (m_family == AF_UNIX) {
+    std::static_pointer_cast<UnixAddress>(result)->setAddrLen(addrlen);
+  }
+  m_remoteAddress = result;
+  return m_remoteAddress;
+}
+
+Address::ptr Socket::getLocalAddress() {
+  if (m_localAddress) {
+    return m_localAddress;
+  }
+
+  Address::ptr result = NewAddressByFamily(m_family);
+  socklen_t addrlen = result->getAddrLen();
+  if (getsockname(m_sock, result->getAddr(), &addrlen)) {
+    DDG_LOG_ERROR(g_logger) << "getsockname error sock = " << m_sock
+                            << " errno = " << errno
+                            << " errstr = " << strerror(errno);
+    return std::make_shared<UnknownAddress>(m_family);
+  }
+  if (m_family == AF_UNIX) {
+    std::static_pointer_cast<UnixAddress>(result)->setAddrLen(addrlen);
+  }
+  m_localAddress = result;
+  return m_localAddress;
+}
+
+bool Socket::isValid() const {
+  return m_sock != -1;
+}
+
+int Socket::getError() {
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (!getOption(SOL_SOCKET, SO_ERROR, &error, &len)) {
+    error = errno;
+  }
+  return error;
+}
+
+std::ostream& Socket::dump(std::ostream& os) const {
+  os << "[Socket sock = " << m_sock << " is_connected = " << m_isConnected
+     << " family = " << m_family << " type = " << m_type
+     << " protocol = " << m_protocol;
+  if (m_localAddress) {
+    os << " local_address = " << m_localAddress->toString();
+  }
+  if (m_remoteAddress) {
+    os << " remote_address = " << m_remoteAddress->toString();
+  }
+  os << "]";
+  return os;
+}
+
+std::string Socket::toString() const {
+  std::stringstream ss;
+  dump(ss);
+  return ss.str();
+}
+
+bool Socket::cancelRead() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && iom->cancelEvent(m_sock, IOManager::READ);
+}
+
+bool Socket::cancelWrite() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && iom->cancelEvent(m_sock, IOManager::WRITE);
+}
+
+bool Socket::cancelAccept() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && iom->cancelEvent(m_sock, IOManager::READ);
+}
+
+bool Socket::cancelAll() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && iom->cancelAll(m_sock);
+}
+
+void Socket::initSock() {
+  int val = 1;
+  setOption(SOL_SOCKET, SO_REUSEADDR, val);
+  if (m_type != SOCK_STREAM || m_family == AF_UNIX) {
+    return;
+  }
+
+  if (g_tcp_nodelay->getValue()) {
+    setNoDelay(true);
+  }
+  if (g_tcp_reuseport->getValue()) {
+    setReusePort(true);
+  }
+  if (g_tcp_keepalive_enable->getValue()) {
+    setKeepAlive(true, g_tcp_keepalive_idle->getValue(),
+                 g_tcp_keepalive_interval->getValue(),
+                 g_tcp_keepalive_count->getValue());
+  }
+}
+
+void Socket::newSock() {
+  m_sock = socket(m_family, m_type, m_protocol);
+  if (DDG_LIKELY(m_sock != -1)) {
+    initSock();
+  } else {
+    DDG_LOG_ERROR(g_logger) << "socket(" << m_family << ", " << m_type << ", "
+                            << m_protocol << ") errno = " << errno
+                            << " errstr = " << strerror(errno);
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, const Socket& sock) {
+  return sock.dump(os);
+}
+
+}  // namespace ddg
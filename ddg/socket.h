@@ -0,0 +1,187 @@
+#ifndef DDG_SOCKET_H_
+#define DDG_SOCKET_H_
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/address.h"
+#include "ddg/noncopyable.h"
+
+namespace ddg {
+
+/**
+ * @brief socket封装, 在IOManager的协程中调用时io会自动让出协程
+ */
+class Socket : public std::enable_shared_from_this<Socket>, NonCopyable {
+ public:
+  using ptr = std::shared_ptr<Socket>;
+  using weak_ptr = std::weak_ptr<Socket>;
+
+  enum Type {
+    TCP = SOCK_STREAM,
+    UDP = SOCK_DGRAM,
+  };
+
+  enum Family {
+    IPv4 = AF_INET,
+    IPv6 = AF_INET6,
+    UNIX = AF_UNIX,
+  };
+
+  static Socket::ptr CreateTCP(Address::ptr address);
+
+  static Socket::ptr CreateUDP(Address::ptr address);
+
+  static Socket::ptr CreateTCPSocket();
+
+  static Socket::ptr CreateUDPSocket();
+
+  static Socket::ptr CreateTCPSocket6();
+
+  static Socket::ptr CreateUDPSocket6();
+
+  static Socket::ptr CreateUnixTCPSocket();
+
+  static Socket::ptr CreateUnixUDPSocket();
+
+  // 接管一个已有的fd, 比如从其他进程传过来的监听socket
+  static Socket::ptr CreateFromFd(int fd);
+
+  Socket(int family, int type, int protocol = 0);
+
+  virtual ~Socket();
+
+  // 超时时间, 单位毫秒, 负数表示不超时
+  int64_t getSendTimeout();
+
+  void setSendTimeout(int64_t v);
+
+  int64_t getRecvTimeout();
+
+  void setRecvTimeout(int64_t v);
+
+  bool getOption(int level, int option, void* result, socklen_t* len);
+
+  template <class T>
+  bool getOption(int level, int option, T& result) {
+    socklen_t length = sizeof(T);
+    return getOption(level, option, &result, &length);
+  }
+
+  bool setOption(int level, int option, const void* result, socklen_t len);
+
+  template <class T>
+  bool setOption(int level, int option, const T& value) {
+    return setOption(level, option, &value, sizeof(T));
+  }
+
+  // TCP_NODELAY
+  bool setNoDelay(bool on);
+
+  // SO_REUSEPORT, 需要在bind之前设置
+  bool setReusePort(bool on);
+
+  // SO_KEEPALIVE, idle/interval单位秒, 为0时使用系统默认值
+  bool setKeepAlive(bool on, int idle = 0, int interval = 0, int count = 0);
+
+  virtual Socket::ptr accept();
+
+  // 等到第一个连接后继续非阻塞地accept, 最多取max_count个, 返回取到的数量
+  size_t acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count = 64);
+
+  virtual bool bind(const Address::ptr addr);
+
+  // timeout_ms为-1时一直等到连接完成
+  virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
+
+  virtual bool reconnect(uint64_t timeout_ms = -1);
+
+  virtual bool listen(int backlog = SOMAXCONN);
+
+  virtual bool close();
+
+  virtual int send(const void* buffer, size_t length, int flags = 0);
+
+  // 聚集写, 一次系统调用写出多个缓冲区
+  virtual int send(const iovec* buffers, size_t length, int flags = 0);
+
+  // 文件内容由内核直接发出去, 不经过用户态, offset返回时指向下一次的位置
+  int sendFile(int fd, off_t* offset, size_t count);
+
+  virtual int sendTo(const void* buffer, size_t length, const Address::ptr to,
+                     int flags = 0);
+
+  virtual int sendTo(const iovec* buffers, size_t length,
+                     const Address::ptr to, int flags = 0);
+
+  virtual int recv(void* buffer, size_t length, int flags = 0);
+
+  // 分散读, 一次系统调用读入多个缓冲区
+  virtual int recv(iovec* buffers, size_t length, int flags = 0);
+
+  virtual int recvFrom(void* buffer, size_t length, Address::ptr from,
+                       int flags = 0);
+
+  virtual int recvFrom(iovec* buffers, size_t length, Address::ptr from,
+                       int flags = 0);
+
+  Address::ptr getRemoteAddress();
+
+  Address::ptr getLocalAddress();
+
+  int getFamily() const { return m_family; }
+
+  int getType() const { return m_type; }
+
+  int getProtocol() const { return m_protocol; }
+
+  bool isConnected() const { return m_isConnected; }
+
+  bool isValid() const;
+
+  int getError();
+
+  virtual std::ostream& dump(std::ostream& os) const;
+
+  virtual std::string toString() const;
+
+  int getSocket() const { return m_sock; }
+
+  // 唤醒阻塞在该socket上的协程
+  bool cancelRead();
+
+  bool cancelWrite();
+
+  bool cancelAccept();
+
+  bool cancelAll();
+
+ protected:
+  void initSock();
+
+  void newSock();
+
+  virtual bool init(int sock);
+
+ protected:
+  int m_sock;
+  int m_family;
+  int m_type;
+  int m_protocol;
+  bool m_isConnected;
+
+  Address::ptr m_localAddress;
+  Address::ptr m_remoteAddress;
+};
+
+std::ostream& operator<<(std::ostream& os, const Socket& sock);
+
+}  // namespace ddg
+
+#endif
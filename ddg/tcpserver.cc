@@ -0,0 +1,290 @@
+#include "ddg/tcpserver.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+
+#include "ddg/config.h"
+#include "ddg/hotrestart.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/master.h"
+#include "ddg/utils.h"
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
+    Config::Lookup<uint64_t>("tcp_server.read_timeout", 60 * 1000 * 2,
+                             "tcp server read timeout");
+
+static ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+    Config::Lookup<uint32_t>("tcp_server.accept_batch", 64,
+                             "tcp server max accept count per wakeup");
+
+TcpServer::TcpServer(IOManager* worker, IOManager* accept_worker)
+    : m_worker(worker),
+      m_acceptWorker(accept_worker),
+      m_recvTimeout(g_tcp_server_read_timeout->getValue()),
+      m_name("ddg/1.0.0"),
+      m_isStop(true) {
+  DDG_ASSERT(m_worker && m_acceptWorker);
+}
+
+TcpServer::~TcpServer() {
+  for (auto& sock : m_socks) {
+    sock->close();
+  }
+  m_socks.clear();
+}
+
+bool TcpServer::bind(Address::ptr addr) {
+  std::vector<Address::ptr> addrs;
+  std::vector<Address::ptr> fails;
+  addrs.push_back(addr);
+  return bind(addrs, fails);
+}
+
+bool TcpServer::bind(const std::vector<Address::ptr>& addrs,
+                     std::vector<Address::ptr>& fails) {
+  for (auto& addr : addrs) {
+    // 热重启时直接用旧进程交过来的监听socket
+    Socket::ptr sock = HotRestart::TakeInherited(addr);
+    if (sock) {
+      m_socks.push_back(sock);
+      continue;
+    }
+
+    sock = Socket::CreateTCP(addr);
+    // thread-per-core模式下每个线程还要再绑定一次同样的地址,
+    // 多进程模式下每个worker各自绑定
+    if ((isThreadPerCore() || Master::IsWorker()) &&
+        addr->getFamily() != AF_UNIX) {
+      sock->setReusePort(true);
+    }
+
+    if (!sock->bind(addr)) {
+      DDG_LOG_ERROR(g_logger) << "bind fail errno = " << errno
+                              << " errstr = " << strerror(errno)
+                              << " addr = [" << addr->toString() << "]";
+      fails.push_back(addr);
+      continue;
+    }
+
+    if (!sock->listen()) {
+      DDG_LOG_ERROR(g_logger) << "listen fail errno = " << errno
+                              << " errstr = " << strerror(errno)
+                              << " addr = [" << addr->toString() << "]";
+      fails.push_back(addr);
+      continue;
+    }
+    m_socks.push_back(sock);
+  }
+
+  if (!fails.empty()) {
+    m_socks.clear();
+    return false;
+  }
+
+  for (auto& sock : m_socks) {
+    DDG_LOG_INFO(g_logger) << "server bind success: " << *sock;
+  }
+  return true;
+}
+
+bool TcpServer::start() {
+  if (!m_isStop) {
+    return true;
+  }
+  m_isStop = false;
+
+  if (!isThreadPerCore()) {
+    std::vector<Socket::ptr> socks = m_socks;
+    for (auto& sock : socks) {
+      m_acceptWorker->schedule(
+          std::bind(&TcpServer::startAccept, shared_from_this(), sock));
+      acceptInherited(sock->getLocalAddress(), std::vector<uint64_t>());
+    }
+    return true;
+  }
+
+  // 每个线程一个监听socket, 由内核按连接做负载均衡
+  // use_caller的调用线程只在stop里跑调度, 不能放监听socket
+  std::vector<uint64_t> thread_ids = m_worker->getThreadIds();
+  uint64_t root = m_worker->getRootThread();
+  thread_ids.erase(std::remove(thread_ids.begin(), thread_ids.end(), root),
+                   thread_ids.end());
+  std::vector<Socket::ptr> socks = m_socks;
+  for (auto& sock : socks) {
+    Address::ptr addr = sock->getLocalAddress();
+    m_acceptWorker->schedule(
+        std::bind(&TcpServer::startAccept, shared_from_this(), sock),
+        thread_ids.empty() ? 0 : thread_ids[0]);
+    if (addr->getFamily() == AF_UNIX) {
+      acceptInherited(addr, thread_ids);
+      continue;
+    }
+
+    for (size_t i = 1; i < thread_ids.size(); ++i) {
+      Socket::ptr other = HotRestart::TakeInherited(addr);
+      if (other) {
+        m_socks.push_back(other);
+        m_acceptWorker->schedule(
+            std::bind(&TcpServer::startAccept, shared_from_this(), other),
+            thread_ids[i]);
+        continue;
+      }
+
+      other = Socket::CreateTCP(addr);
+      other->setReusePort(true);
+      if (!other->bind(addr) || !other->listen()) {
+        DDG_LOG_ERROR(g_logger) << "thread-per-core listen fail errno = "
+                                << errno << " errstr = " << strerror(errno)
+                                << " addr = [" << addr->toString() << "]";
+        continue;
+      }
+      m_socks.push_back(other);
+      m_acceptWorker->schedule(
+          std::bind(&TcpServer::startAccept, shared_from_this(), other),
+          thread_ids[i]);
+    }
+    acceptInherited(addr, thread_ids);
+  }
+  return true;
+}
+
+void TcpServer::acceptInherited(Address::ptr addr,
+                                const std::vector<uint64_t>& thread_ids) {
+  size_t i = 0;
+  while (Socket::ptr sock = HotRestart::TakeInherited(addr)) {
+    DDG_LOG_INFO(g_logger) << "accept on extra inherited socket " << *sock;
+    m_socks.push_back(sock);
+    uint64_t thread =
+        thread_ids.empty() ? 0 : thread_ids[i++ % thread_ids.size()];
+    m_acceptWorker->schedule(
+        std::bind(&TcpServer::startAccept, shared_from_this(), sock),
+        thread);
+  }
+}
+
+void TcpServer::stop(uint64_t timeout_ms) {
+  if (m_isStop) {
+    return;
+  }
+  m_isStop = true;
+
+  auto self = shared_from_this();
+  // 在accept_worker上关闭, close的hook会唤醒阻塞在accept上的协程
+  m_acceptWorker->schedule([this, self]() {
+    for (auto& sock : m_socks) {
+      sock->close();
+    }
+    m_socks.clear();
+  });
+
+  if (timeout_ms == 0) {
+    m_worker->schedule(std::bind(&TcpServer::shutdownClients, self));
+    return;
+  }
+  MutexType::Lock lock(m_mutex);
+  if (m_clients.empty()) {
+    return;
+  }
+  // 定时器会让worker一直不能退出, 连接都结束了就取消
+  m_stopTimer = m_worker->addTimer(
+      timeout_ms, std::bind(&TcpServer::shutdownClients, self));
+}
+
+size_t TcpServer::getConnectionCount() {
+  MutexType::Lock lock(m_mutex);
+  return m_clients.size();
+}
+
+void TcpServer::shutdownClients() {
+  MutexType::Lock lock(m_mutex);
+  m_stopTimer.reset();
+  if (!m_clients.empty()) {
+    DDG_LOG_INFO(g_logger) << "server " << m_name << " shutdown "
+                           << m_clients.size() << " connections";
+  }
+  // 只做shutdown, 阻塞的读写会返回, 连接由各自的协程关闭
+  for (auto& client : m_clients) {
+    ::shutdown(client->getSocket(), SHUT_RDWR);
+  }
+}
+
+void TcpServer::handleClient(Socket::ptr client) {
+  DDG_LOG_INFO(g_logger) << "handleClient: " << *client;
+}
+
+void TcpServer::onClient(Socket::ptr client) {
+  {
+    MutexType::Lock lock(m_mutex);
+    m_clients.insert(client);
+  }
+
+  try {
+    handleClient(client);
+  } catch (std::exception& e) {
+    DDG_LOG_ERROR(g_logger) << "handleClient " << *client
+                            << " exception: " << e.what();
+  } catch (...) {
+    DDG_LOG_ERROR(g_logger) << "handleClient " << *client
+                            << " unknown exception";
+  }
+
+  client->close();
+  MutexType::Lock lock(m_mutex);
+  m_clients.erase(client);
+  if (m_clients.empty() && m_stopTimer) {
+    m_stopTimer->cancel();
+    m_stopTimer.reset();
+  }
+}
+
+void TcpServer::startAccept(Socket::ptr sock) {
+  std::vector<Socket::ptr> clients;
+  while (!m_isStop) {
+    clients.clear();
+    if (sock->acceptBatch(clients, g_tcp_server_accept_batch->getValue()) ==
+        0) {
+      if (!m_isStop) {
+        // 比如fd用完了, 稍等一下再accept, 避免空转
+        usleep(10 * 1000);
+      }
+      continue;
+    }
+
+    for (auto& client : clients) {
+      client->setRecvTimeout(m_recvTimeout);
+      if (isThreadPerCore()) {
+        m_worker->schedule(
+            std::bind(&TcpServer::onClient, shared_from_this(), client),
+            GetThreadId());
+      } else {
+        m_worker->schedule(
+            std::bind(&TcpServer::onClient, shared_from_this(), client));
+      }
+    }
+  }
+}
+
+std::string TcpServer::toString(const std::string& prefix) {
+  std::stringstream ss;
+  ss << prefix << "[type = tcp"
+     << " name = " << m_name
+     << " worker = " << m_worker->getName()
+     << " accept = " << m_acceptWorker->getName()
+     << " recv_timeout = " << m_recvTimeout
+     << " thread_per_core = " << isThreadPerCore()
+     << " connections = " << getConnectionCount() << "]" << std::endl;
+  std::string pfx = prefix.empty() ? "    " : prefix;
+  for (auto& sock : m_socks) {
+    ss << pfx << pfx << *sock << std::endl;
+  }
+  return ss.str();
+}
+
+}  // namespace ddg
@@ -0,0 +1,100 @@
+#ifndef DDG_TCPSERVER_H_
+#define DDG_TCPSERVER_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ddg/address.h"
+#include "ddg/iomanager.h"
+#include "ddg/mutex.h"
+#include "ddg/noncopyable.h"
+#include "ddg/socket.h"
+
+namespace ddg {
+
+/**
+ * @brief TCP服务器
+ *
+ * accept循环跑在accept_worker上, 每个连接在worker上开一个协程执行
+ * handleClient. worker和accept_worker是同一个IOManager时为thread-per-core
+ * 模式: 每个线程用SO_REUSEPORT单独监听一份, 连接就在accept它的线程上处理,
+ * 不跨线程
+ */
+class TcpServer : public std::enable_shared_from_this<TcpServer>,
+                  NonCopyable {
+ public:
+  using ptr = std::shared_ptr<TcpServer>;
+  using MutexType = Mutex;
+
+  TcpServer(IOManager* worker = IOManager::GetThis(),
+            IOManager* accept_worker = IOManager::GetThis());
+
+  virtual ~TcpServer();
+
+  virtual bool bind(Address::ptr addr);
+
+  // 失败的地址放到fails里, 有一个失败就返回false
+  virtual bool bind(const std::vector<Address::ptr>& addrs,
+                    std::vector<Address::ptr>& fails);
+
+  virtual bool start();
+
+  // 停止accept, 已有连接在timeout_ms内自行结束, 超时后强制shutdown
+  virtual void stop(uint64_t timeout_ms = 0);
+
+  // 连接的读超时, 也就是空闲超时, 单位毫秒
+  uint64_t getRecvTimeout() const { return m_recvTimeout; }
+
+  void setRecvTimeout(uint64_t v) { m_recvTimeout = v; }
+
+  std::string getName() const { return m_name; }
+
+  virtual void setName(const std::string& v) { m_name = v; }
+
+  bool isStop() const { return m_isStop; }
+
+  bool isThreadPerCore() const { return m_worker == m_acceptWorker; }
+
+  size_t getConnectionCount();
+
+  std::vector<Socket::ptr> getSocks() const { return m_socks; }
+
+  virtual std::string toString(const std::string& prefix = "");
+
+ protected:
+  // 每个连接一个协程, 子类重写来处理业务
+  virtual void handleClient(Socket::ptr client);
+
+  virtual void startAccept(Socket::ptr sock);
+
+ private:
+  void onClient(Socket::ptr client);
+
+  void shutdownClients();
+
+  // 旧进程交过来的同地址监听socket里剩下的也要accept, 按thread_ids轮流
+  // 分给各线程. 关掉它们会RST掉已经在队列里的连接
+  void acceptInherited(Address::ptr addr,
+                       const std::vector<uint64_t>& thread_ids);
+
+ protected:
+  std::vector<Socket::ptr> m_socks;  // 监听socket
+  IOManager* m_worker;
+  IOManager* m_acceptWorker;
+  uint64_t m_recvTimeout;
+  std::string m_name;
+  std::atomic<bool> m_isStop;
+
+ private:
+  MutexType m_mutex;
+  std::set<Socket::ptr> m_clients;  // 正在处理的连接
+  Timer::ptr m_stopTimer;           // stop的超时, 连接都结束时提前取消
+};
+
+}  // namespace ddg
+
+#endif
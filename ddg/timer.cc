@@ -0,0 +1,196 @@
+#include "ddg/timer.h"
+
+#include "ddg/utils.h"
+
+namespace ddg {
+
+bool Timer::Comparator::operator()(const Timer::ptr& lhs,
+                                   const Timer::ptr& rhs) const {
+  if (!lhs && !rhs) {
+    return false;
+  }
+  if (!lhs) {
+    return true;
+  }
+  if (!rhs) {
+    return false;
+  }
+  if (lhs->m_next != rhs->m_next) {
+    return lhs->m_next < rhs->m_next;
+  }
+  return lhs.get() < rhs.get();
+}
+
+Timer::Timer(uint64_t ms, Callback cb, bool recurring, TimerManager* manager)
+    : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager) {
+  m_next = ddg::GetCurrentMilliSecond() + m_ms;
+}
+
+Timer::Timer(uint64_t next) : m_next(next) {}
+
+bool Timer::cancel() {
+  TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+  if (m_cb) {
+    m_cb = nullptr;
+    auto it = m_manager->m_timers.find(shared_from_this());
+    if (it != m_manager->m_timers.end()) {
+      m_manager->m_timers.erase(it);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool Timer::refresh() {
+  TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+  if (!m_cb) {
+    return false;
+  }
+
+  auto it = m_manager->m_timers.find(shared_from_this());
+  if (it == m_manager->m_timers.end()) {
+    return false;
+  }
+
+  // 先删除再插入，否则会破坏set的有序性
+  m_manager->m_timers.erase(it);
+  m_next = ddg::GetCurrentMilliSecond() + m_ms;
+  m_manager->m_timers.insert(shared_from_this());
+  return true;
+}
+
+bool Timer::reset(uint64_t ms, bool from_now) {
+  if (ms == m_ms && !from_now) {
+    return true;
+  }
+
+  TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+  if (!m_cb) {
+    return false;
+  }
+
+  auto it = m_manager->m_timers.find(shared_from_this());
+  if (it == m_manager->m_timers.end()) {
+    return false;
+  }
+
+  m_manager->m_timers.erase(it);
+  uint64_t start = from_now ? ddg::GetCurrentMilliSecond() : m_next - m_ms;
+  m_ms = ms;
+  m_next = start + m_ms;
+  m_manager->addTimer(shared_from_this(), lock);
+  return true;
+}
+
+TimerManager::TimerManager() {
+  m_previousTime = ddg::GetCurrentMilliSecond();
+}
+
+TimerManager::~TimerManager() {}
+
+Timer::ptr TimerManager::addTimer(uint64_t ms, Callback cb, bool recurring) {
+  Timer::ptr timer(new Timer(ms, cb, recurring, this));
+  RWMutexType::WriteLock lock(m_mutex);
+  addTimer(timer, lock);
+  return timer;
+}
+
+static void OnTimer(std::weak_ptr<void> weak_cond, TimerManager::Callback cb) {
+  std::shared_ptr<void> tmp = weak_cond.lock();
+  if (tmp) {
+    cb();
+  }
+}
+
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, Callback cb,
+                                           std::weak_ptr<void> weak_cond,
+                                           bool recurring) {
+  return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+}
+
+uint64_t TimerManager::getNextTimer() {
+  RWMutexType::ReadLock lock(m_mutex);
+  m_tickled = false;
+  if (m_timers.empty()) {
+    return ~0ull;
+  }
+
+  const Timer::ptr& next = *m_timers.begin();
+  uint64_t now_ms = ddg::GetCurrentMilliSecond();
+  if (now_ms >= next->m_next) {
+    return 0;
+  }
+  return next->m_next - now_ms;
+}
+
+void TimerManager::listExpiredCallback(std::vector<Callback>& cbs) {
+  uint64_t now_ms = ddg::GetCurrentMilliSecond();
+  {
+    RWMutexType::ReadLock lock(m_mutex);
+    if (m_timers.empty()) {
+      return;
+    }
+  }
+
+  RWMutexType::WriteLock lock(m_mutex);
+  if (m_timers.empty()) {
+    return;
+  }
+
+  bool rollover = detectClockRollover(now_ms);
+  if (!rollover && (*m_timers.begin())->m_next > now_ms) {
+    return;
+  }
+
+  auto it = m_timers.begin();
+  if (rollover) {
+    it = m_timers.end();
+  } else {
+    while (it != m_timers.end() && (*it)->m_next <= now_ms) {
+      ++it;
+    }
+  }
+
+  std::vector<Timer::ptr> expired(m_timers.begin(), it);
+  m_timers.erase(m_timers.begin(), it);
+
+  cbs.reserve(cbs.size() + expired.size());
+  for (auto& timer : expired) {
+    cbs.push_back(timer->m_cb);
+    if (timer->m_recurring) {
+      timer->m_next = now_ms + timer->m_ms;
+      m_timers.insert(timer);
+    } else {
+      timer->m_cb = nullptr;
+    }
+  }
+}
+
+bool TimerManager::hasTimer() {
+  RWMutexType::ReadLock lock(m_mutex);
+  return !m_timers.empty();
+}
+
+void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
+  auto it = m_timers.insert(val).first;
+  bool at_front = (it == m_timers.begin()) && !m_tickled;
+  if (at_front) {
+    m_tickled = true;
+  }
+  lock.unlock();
+
+  if (at_front) {
+    onTimerInsertedAtFront();
+  }
+}
+
+bool TimerManager::detectClockRollover(uint64_t now_ms) {
+  bool rollover = false;
+  if (now_ms < m_previousTime && now_ms < (m_previousTime - 60 * 60 * 1000)) {
+    rollover = true;
+  }
+  m_previousTime = now_ms;
+  return rollover;
+}
+
+}  // namespace ddg
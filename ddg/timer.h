@@ -0,0 +1,99 @@
+#ifndef DDG_TIMER_H_
+#define DDG_TIMER_H_
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "ddg/mutex.h"
+
+namespace ddg {
+
+class TimerManager;
+
+/**
+ * @brief 定时器
+ */
+class Timer : public std::enable_shared_from_this<Timer> {
+ public:
+  friend class TimerManager;
+
+  using ptr = std::shared_ptr<Timer>;
+  using Callback = std::function<void()>;
+
+  // 取消定时器
+  bool cancel();
+
+  // 以当前时间为起点重新计时
+  bool refresh();
+
+  // 重新设置定时器的周期, from_now表示是否从当前时间开始计时
+  bool reset(uint64_t ms, bool from_now);
+
+ private:
+  Timer(uint64_t ms, Callback cb, bool recurring, TimerManager* manager);
+
+  // 只用于在有序集合中查找
+  explicit Timer(uint64_t next);
+
+ private:
+  struct Comparator {
+    bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
+  };
+
+  bool m_recurring = false;  // 是否循环
+  uint64_t m_ms = 0;         // 执行周期
+  uint64_t m_next = 0;       // 精确的执行时间
+  Callback m_cb;
+  TimerManager* m_manager = nullptr;
+};
+
+/**
+ * @brief 定时器管理器
+ */
+class TimerManager {
+ public:
+  friend class Timer;
+
+  using RWMutexType = RWMutex;
+  using Callback = std::function<void()>;
+
+  TimerManager();
+
+  virtual ~TimerManager();
+
+  Timer::ptr addTimer(uint64_t ms, Callback cb, bool recurring = false);
+
+  // 条件定时器，weak_cond失效时不执行回调
+  Timer::ptr addConditionTimer(uint64_t ms, Callback cb,
+                               std::weak_ptr<void> weak_cond,
+                               bool recurring = false);
+
+  // 距离下一个定时器执行的毫秒数，没有定时器返回~0ull
+  uint64_t getNextTimer();
+
+  void listExpiredCallback(std::vector<Callback>& cbs);
+
+  bool hasTimer();
+
+ protected:
+  // 有新的定时器插入到最前面时调用
+  virtual void onTimerInsertedAtFront() = 0;
+
+  void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+
+ private:
+  // 检测系统时间是否被往回调了
+  bool detectClockRollover(uint64_t now_ms);
+
+ private:
+  RWMutexType m_mutex;
+  std::set<Timer::ptr, Timer::Comparator> m_timers;
+  bool m_tickled = false;  // 避免频繁调用onTimerInsertedAtFront
+  uint64_t m_previousTime = 0;
+};
+
+}  // namespace ddg
+
+#endif
@@ -0,0 +1,253 @@
+#include "ddg/udpsocket.h"
+
+#include <errno.h>
+#include <netinet/udp.h>
+#include <string.h>
+
+#include "ddg/hook.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace ddg {
+
+static Logger::ptr g_logger = DDG_LOG_NAME("system");
+
+// 内核对一条GSO消息的限制
+static const size_t kMaxGsoSegments = 64;
+static const size_t kMaxGsoBytes = 65000;
+
+static const size_t kRecvControlSize = CMSG_SPACE(sizeof(int));
+static const size_t kSendControlSize = CMSG_SPACE(sizeof(uint16_t));
+
+UdpRecvBatch::UdpRecvBatch(size_t count, size_t slot_size)
+    : m_slotSize(slot_size),
+      m_size(0),
+      m_buffer(count * slot_size),
+      m_msgs(count),
+      m_iovs(count),
+      m_addrs(count),
+      m_controls(count * kRecvControlSize),
+      m_segments(count) {
+  DDG_ASSERT(count > 0 && slot_size > 0);
+  memset(&m_msgs[0], 0, sizeof(mmsghdr) * count);
+  for (size_t i = 0; i < count; ++i) {
+    m_iovs[i].iov_base = &m_buffer[i * slot_size];
+    m_iovs[i].iov_len = slot_size;
+    msghdr& hdr = m_msgs[i].msg_hdr;
+    hdr.msg_iov = &m_iovs[i];
+    hdr.msg_iovlen = 1;
+    hdr.msg_name = &m_addrs[i];
+  }
+}
+
+Address::ptr UdpRecvBatch::getAddress(size_t i) const {
+  return Address::Create(getAddr(i), getAddrLen(i));
+}
+
+void UdpRecvBatch::prepare() {
+  for (size_t i = 0; i < m_msgs.size(); ++i) {
+    msghdr& hdr = m_msgs[i].msg_hdr;
+    hdr.msg_namelen = sizeof(sockaddr_storage);
+    hdr.msg_control = &m_controls[i * kRecvControlSize];
+    hdr.msg_controllen = kRecvControlSize;
+    hdr.msg_flags = 0;
+    m_msgs[i].msg_len = 0;
+  }
+  m_size = 0;
+}
+
+void UdpRecvBatch::finish(size_t n) {
+  m_size = n;
+  for (size_t i = 0; i < n; ++i) {
+    m_segments[i] = 0;
+    msghdr* hdr = &m_msgs[i].msg_hdr;
+    for (cmsghdr* c = CMSG_FIRSTHDR(hdr); c; c = CMSG_NXTHDR(hdr, c)) {
+      if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+        int seg = 0;
+        memcpy(&seg, CMSG_DATA(c), sizeof(seg));
+        // 只有一个报文时内核也可能带上, 统一成0
+        if (seg > 0 && static_cast<size_t>(seg) < m_msgs[i].msg_len) {
+          m_segments[i] = seg;
+        }
+      }
+    }
+  }
+}
+
+UdpSendBatch::UdpSendBatch(size_t max_datagrams, bool gso)
+    : m_maxDatagrams(max_datagrams), m_gso(gso), m_datagrams(0) {
+  m_messages.reserve(max_datagrams);
+}
+
+bool UdpSendBatch::add(const void* data, size_t len, const sockaddr* to,
+                       socklen_t to_len) {
+  if (isFull()) {
+    return false;
+  }
+  DDG_ASSERT(to_len <= sizeof(sockaddr_storage));
+  ++m_datagrams;
+  // 和上一条消息合并: 同一个地址, 不超过上一条的报文大小,
+  // 上一条最后一个报文没有变短过
+  if (m_gso && !m_messages.empty() && len > 0) {
+    Message& last = m_messages.back();
+    if (len <= last.segment && last.length % last.segment == 0 &&
+        last.length / last.segment < kMaxGsoSegments &&
+        last.length + len <= kMaxGsoBytes && last.addr_len == to_len &&
+        (to_len == 0 || memcmp(&last.addr, to, to_len) == 0)) {
+      m_buffer.append(static_cast<const char*>(data), len);
+      last.length += len;
+      return true;
+    }
+  }
+  Message msg;
+  msg.offset = m_buffer.size();
+  msg.length = len;
+  msg.segment = len;
+  msg.addr_len = to_len;
+  if (to_len) {
+    memcpy(&msg.addr, to, to_len);
+  }
+  m_buffer.append(static_cast<const char*>(data), len);
+  m_messages.push_back(msg);
+  return true;
+}
+
+void UdpSendBatch::clear() {
+  m_datagrams = 0;
+  m_buffer.clear();
+  m_messages.clear();
+}
+
+void UdpSendBatch::build(bool gso) {
+  size_t count = gso ? m_messages.size() : m_datagrams;
+  m_msgs.resize(count);
+  m_iovs.resize(count);
+  m_counts.resize(count);
+  m_controls.resize(count * kSendControlSize);
+  memset(&m_msgs[0], 0, sizeof(mmsghdr) * count);
+
+  char* base = &m_buffer[0];
+  size_t idx = 0;
+  auto fill = [&](Message& msg, size_t offset, size_t len, size_t segs) {
+    m_iovs[idx].iov_base = base + offset;
+    m_iovs[idx].iov_len = len;
+    m_counts[idx] = segs;
+    msghdr& hdr = m_msgs[idx].msg_hdr;
+    hdr.msg_iov = &m_iovs[idx];
+    hdr.msg_iovlen = 1;
+    if (msg.addr_len) {
+      hdr.msg_name = &msg.addr;
+      hdr.msg_namelen = msg.addr_len;
+    }
+    if (segs > 1) {
+      hdr.msg_control = &m_controls[idx * kSendControlSize];
+      hdr.msg_controllen = kSendControlSize;
+      cmsghdr* c = CMSG_FIRSTHDR(&hdr);
+      c->cmsg_level = SOL_UDP;
+      c->cmsg_type = UDP_SEGMENT;
+      c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t seg = msg.segment;
+      memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+    }
+    ++idx;
+  };
+  for (auto& msg : m_messages) {
+    if (gso) {
+      size_t segs =
+          msg.segment ? (msg.length + msg.segment - 1) / msg.segment : 1;
+      fill(msg, msg.offset, msg.length, segs);
+      continue;
+    }
+    size_t off = 0;
+    do {
+      size_t len = std::min(msg.segment, msg.length - off);
+      fill(msg, msg.offset + off, len, 1);
+      off += len;
+    } while (off < msg.length);
+  }
+  DDG_ASSERT(idx == count);
+}
+
+UdpSocket::ptr UdpSocket::Create(int family) {
+  UdpSocket::ptr sock = std::make_shared<UdpSocket>(family);
+  sock->newSock();
+  sock->m_isConnected = true;
+  sock->probeGso();
+  return sock;
+}
+
+UdpSocket::UdpSocket(int family)
+    : Socket(family, UDP, 0), m_gro(false), m_gsoSupported(false) {}
+
+void UdpSocket::probeGso() {
+  int v = 0;
+  socklen_t len = sizeof(v);
+  m_gsoSupported =
+      ::getsockopt(m_sock, SOL_UDP, UDP_SEGMENT, &v, &len) == 0;
+}
+
+bool UdpSocket::setGro(bool v) {
+  int val = v;
+  if (::setsockopt(m_sock, SOL_UDP, UDP_GRO, &val, sizeof(val))) {
+    DDG_LOG_WARN(g_logger) << "setsockopt UDP_GRO fail sock=" << m_sock
+                           << " errno=" << errno
+                           << " errstr=" << strerror(errno);
+    return false;
+  }
+  m_gro = v;
+  return true;
+}
+
+int UdpSocket::recvBatch(UdpRecvBatch& batch, int flags) {
+  batch.prepare();
+  int n = ::recvmmsg(m_sock, &batch.m_msgs[0], batch.m_msgs.size(),
+                     flags | MSG_WAITFORONE, nullptr);
+  if (n < 0) {
+    return -1;
+  }
+  batch.finish(n);
+  return n;
+}
+
+int UdpSocket::sendBatch(UdpSendBatch& batch, int flags) {
+  if (batch.empty()) {
+    return 0;
+  }
+  bool gso = m_gsoSupported;
+  batch.build(gso);
+  size_t total = batch.m_msgs.size();
+  size_t sent = 0;
+  size_t datagrams = 0;
+  while (sent < total) {
+    int n = ::sendmmsg(m_sock, &batch.m_msgs[sent], total - sent, flags);
+    if (n < 0) {
+      // 网卡或路径MTU不支持这么大的分段, 拆开重发剩下的
+      if (gso && (errno == EIO || errno == EINVAL)) {
+        DDG_LOG_WARN(g_logger) << "sendmmsg with UDP_SEGMENT fail sock="
+                               << m_sock << " errno=" << errno
+                               << ", disable gso";
+        gso = m_gsoSupported = false;
+        batch.build(false);
+        total = batch.m_msgs.size();
+        sent = datagrams;
+        continue;
+      }
+      return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+      datagrams += batch.m_counts[sent + i];
+    }
+    sent += n;
+  }
+  return datagrams;
+}
+
+}  // namespace ddg
@@ -0,0 +1,206 @@
+#ifndef DDG_UDPSOCKET_H_
+#define DDG_UDPSOCKET_H_
+
+#include <sys/socket.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddg/address.h"
+#include "ddg/noncopyable.h"
+#include "ddg/socket.h"
+
+namespace ddg {
+
+/**
+ * @brief 一批接收缓冲, 构造时一次分配好, 反复使用
+ * @details 开启GRO时一个槽里可能是多个同样大小的报文拼在一起,
+ *          用getSegmentSize或者forEach拆开
+ */
+class UdpRecvBatch : NonCopyable {
+ public:
+  /**
+   * @param count 一次最多收的报文数
+   * @param slot_size 每个槽的大小, 开启GRO时要够放下合并后的报文
+   */
+  explicit UdpRecvBatch(size_t count = 64, size_t slot_size = 2048);
+
+  // 上次收到的槽数
+  size_t size() const { return m_size; }
+
+  size_t getCapacity() const { return m_msgs.size(); }
+
+  size_t getSlotSize() const { return m_slotSize; }
+
+  const char* getData(size_t i) const { return &m_buffer[i * m_slotSize]; }
+
+  size_t getLength(size_t i) const { return m_msgs[i].msg_len; }
+
+  // GRO合并后每个报文的大小, 0表示槽里只有一个报文
+  size_t getSegmentSize(size_t i) const { return m_segments[i]; }
+
+  // 报文被截断(槽不够大)
+  bool isTruncated(size_t i) const {
+    return m_msgs[i].msg_hdr.msg_flags & MSG_TRUNC;
+  }
+
+  const sockaddr* getAddr(size_t i) const {
+    return reinterpret_cast<const sockaddr*>(&m_addrs[i]);
+  }
+
+  socklen_t getAddrLen(size_t i) const {
+    return m_msgs[i].msg_hdr.msg_namelen;
+  }
+
+  // 会分配内存, 热路径上用getAddr
+  Address::ptr getAddress(size_t i) const;
+
+  /**
+   * @brief 依次访问收到的每个报文, GRO合并的报文会拆开
+   * @param cb void(const char* data, size_t len, size_t slot)
+   */
+  template <class CallBack>
+  void forEach(CallBack cb) const {
+    for (size_t i = 0; i < m_size; ++i) {
+      const char* data = getData(i);
+      size_t len = getLength(i);
+      size_t seg = m_segments[i] ? m_segments[i] : len;
+      for (size_t off = 0; off < len; off += seg) {
+        cb(data + off, std::min(seg, len - off), i);
+      }
+    }
+  }
+
+ private:
+  friend class UdpSocket;
+
+  // 收之前恢复每个槽的长度字段
+  void prepare();
+
+  // 收完之后解析GRO控制消息
+  void finish(size_t n);
+
+ private:
+  size_t m_slotSize;
+  size_t m_size;
+  std::vector<char> m_buffer;
+  std::vector<mmsghdr> m_msgs;
+  std::vector<iovec> m_iovs;
+  std::vector<sockaddr_storage> m_addrs;
+  std::vector<char> m_controls;
+  std::vector<size_t> m_segments;
+};
+
+/**
+ * @brief 一批待发送的报文, 数据拷到内部缓冲里, clear之后复用
+ * @details 开启gso时, 连续加入的发往同一地址且大小相同的报文合并成一条
+ *          带UDP_SEGMENT的消息, 由内核(或网卡)切分. socket不支持GSO时
+ *          发送前会重新拆开
+ */
+class UdpSendBatch : NonCopyable {
+ public:
+  explicit UdpSendBatch(size_t max_datagrams = 64, bool gso = true);
+
+  /**
+   * @brief 加入一个报文
+   * @return 满了返回false, 需要先发送
+   */
+  bool add(const void* data, size_t len, const sockaddr* to,
+           socklen_t to_len);
+
+  bool add(const void* data, size_t len, Address::ptr to) {
+    return add(data, len, to->getAddr(), to->getAddrLen());
+  }
+
+  // 已连接的socket不需要地址
+  bool add(const void* data, size_t len) {
+    return add(data, len, nullptr, 0);
+  }
+
+  // 报文数(不是消息数)
+  size_t size() const { return m_datagrams; }
+
+  bool empty() const { return m_datagrams == 0; }
+
+  bool isFull() const { return m_datagrams >= m_maxDatagrams; }
+
+  void clear();
+
+ private:
+  friend class UdpSocket;
+
+  struct Message {
+    size_t offset;
+    size_t length;
+    size_t segment;  // 合并的报文大小, 只有一个报文时等于length
+    sockaddr_storage addr;
+    socklen_t addr_len;
+  };
+
+  /**
+   * @brief 生成mmsghdr
+   * @param gso false时把合并的消息拆开
+   */
+  void build(bool gso);
+
+ private:
+  size_t m_maxDatagrams;
+  bool m_gso;
+  size_t m_datagrams;
+  std::string m_buffer;
+  std::vector<Message> m_messages;
+  std::vector<mmsghdr> m_msgs;
+  std::vector<iovec> m_iovs;
+  std::vector<char> m_controls;
+  std::vector<size_t> m_counts;  // 每条mmsghdr包含的报文数
+};
+
+/**
+ * @brief 批量收发的UDP socket
+ * @details recvmmsg/sendmmsg都经过hook, 在IOManager的协程里没有数据时
+ *          让出协程, 唤醒一次收走一整批
+ */
+class UdpSocket : public Socket {
+ public:
+  using ptr = std::shared_ptr<UdpSocket>;
+
+  static UdpSocket::ptr Create(int family = IPv4);
+
+  explicit UdpSocket(int family);
+
+  /**
+   * @brief 开关GRO
+   * @return 内核不支持返回false
+   */
+  bool setGro(bool v);
+
+  bool isGro() const { return m_gro; }
+
+  // 内核是否支持UDP_SEGMENT
+  bool isGsoSupported() const { return m_gsoSupported; }
+
+  /**
+   * @brief 收一批报文, 至少收到一个才返回
+   * @return 收到的槽数, 出错返回-1, 结果同时记在batch.size()
+   */
+  int recvBatch(UdpRecvBatch& batch, int flags = 0);
+
+  /**
+   * @brief 发送batch里的全部报文, 不会清空batch
+   * @return 发出的报文数, 出错返回-1
+   */
+  int sendBatch(UdpSendBatch& batch, int flags = 0);
+
+ private:
+  // 探测内核是否支持GSO
+  void probeGso();
+
+ private:
+  bool m_gro;
+  bool m_gsoSupported;
+};
+
+}  // namespace ddg
+
+#endif
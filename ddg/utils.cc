@@ -1,6 +1,7 @@
 #include "utils.h"
 
 #include <execinfo.h>
+#include <string.h>
 #include <pthread.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
@@ -61,7 +62,7 @@ ScopedMalloc::~ScopedMalloc() {
 uint64_t GetCurrentMicroSecond() {
   struct timeval tv;
   int ret = gettimeofday(&tv, nullptr);
-  if (!ret) {
+  if (ret) {
     throw std::system_error();
   }
 
@@ -77,4 +78,108 @@ uint64_t GetCurrentMilliSecond() {
   return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+static inline uint32_t Rol32(uint32_t v, int n) {
+  return (v << n) | (v >> (32 - n));
+}
+
+static void Sha1Block(uint32_t state[5], const uint8_t* block) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) |
+           (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 80; ++i) {
+    w[i] = Rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+           e = state[4];
+  for (int i = 0; i < 80; ++i) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t t = Rol32(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = Rol32(b, 30);
+    b = a;
+    a = t;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+std::string Sha1Sum(const void* data, size_t len) {
+  uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                       0xC3D2E1F0};
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  size_t left = len;
+  for (; left >= 64; left -= 64, p += 64) {
+    Sha1Block(state, p);
+  }
+
+  // 补位: 0x80, 若干0, 最后8字节是比特长度
+  uint8_t tail[128] = {0};
+  memcpy(tail, p, left);
+  tail[left] = 0x80;
+  size_t tail_len = left < 56 ? 64 : 128;
+  uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 0; i < 8; ++i) {
+    tail[tail_len - 1 - i] = static_cast<uint8_t>(bits >> (i * 8));
+  }
+  for (size_t i = 0; i < tail_len; i += 64) {
+    Sha1Block(state, tail + i);
+  }
+
+  std::string out(20, '\0');
+  for (int i = 0; i < 5; ++i) {
+    out[i * 4] = static_cast<char>(state[i] >> 24);
+    out[i * 4 + 1] = static_cast<char>(state[i] >> 16);
+    out[i * 4 + 2] = static_cast<char>(state[i] >> 8);
+    out[i * 4 + 3] = static_cast<char>(state[i]);
+  }
+  return out;
+}
+
+std::string Base64Encode(const void* data, size_t len) {
+  static const char kTable[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = (p[i] << 16) | (p[i + 1] << 8) | p[i + 2];
+    out.push_back(kTable[v >> 18]);
+    out.push_back(kTable[(v >> 12) & 0x3F]);
+    out.push_back(kTable[(v >> 6) & 0x3F]);
+    out.push_back(kTable[v & 0x3F]);
+  }
+  if (i < len) {
+    uint32_t v = p[i] << 16;
+    if (i + 1 < len) {
+      v |= p[i + 1] << 8;
+    }
+    out.push_back(kTable[v >> 18]);
+    out.push_back(kTable[(v >> 12) & 0x3F]);
+    out.push_back(i + 1 < len ? kTable[(v >> 6) & 0x3F] : '=');
+    out.push_back('=');
+  }
+  return out;
+}
+
 }  // namespace ddg
@@ -28,6 +28,11 @@ uint64_t GetCurrentMicroSecond();
 
 uint64_t GetCurrentMilliSecond();
 
+// 返回20字节的二进制摘要
+std::string Sha1Sum(const void* data, size_t len);
+
+std::string Base64Encode(const void* data, size_t len);
+
 class ScopedMalloc : public NonCopyable {
  public:
   explicit ScopedMalloc(size_t size) noexcept;
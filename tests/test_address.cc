@@ -0,0 +1,36 @@
+#include "ddg/address.h"
+#include "ddg/log.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+void test_lookup() {
+  std::vector<ddg::Address::ptr> addrs;
+  bool v = ddg::Address::Lookup(addrs, "localhost:8080", AF_UNSPEC);
+  if (!v) {
+    DDG_LOG_ERROR(g_logger) << "lookup fail";
+    return;
+  }
+
+  for (size_t i = 0; i < addrs.size(); i++) {
+    DDG_LOG_INFO(g_logger) << i << " - " << addrs[i]->toString();
+  }
+}
+
+void test_ip() {
+  auto v4 = ddg::IPAddress::Create("127.0.0.1", 80);
+  auto v6 = ddg::IPAddress::Create("::1", 8080);
+  auto v6_lookup = ddg::Address::LookupAny("[::1]:9090", AF_INET6);
+  DDG_LOG_INFO(g_logger) << v4->toString() << " " << v6->toString() << " "
+                         << v6_lookup->toString();
+
+  ddg::UnixAddress unix_addr("/tmp/ddg_test.sock");
+  ddg::UnixAddress abstract_addr(std::string("\0ddg_test", 9));
+  DDG_LOG_INFO(g_logger) << unix_addr.toString() << " "
+                         << abstract_addr.toString();
+}
+
+int main(int argc, char** argv) {
+  test_lookup();
+  test_ip();
+  return 0;
+}
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ddg/binlog.h"
+#include "ddg/config.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/thread.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+static const char* kFile = "/tmp/ddg_test_binlog.bin";
+
+// 收集输出的appender
+class StringLogAppender : public ddg::LogAppender {
+ public:
+  using ptr = std::shared_ptr<StringLogAppender>;
+
+  void log(ddg::Logger::ptr logger, ddg::LogLevel::Level level,
+           ddg::LogEvent::ptr event) override {
+    std::string str = m_formatter->format(logger, level, event);
+    write(str.c_str(), str.size());
+  }
+
+  void write(const char* data, size_t len) override {
+    MutexType::Lock lock(m_mutex);
+    m_data.append(data, len);
+  }
+
+  std::string toYamlString() const override { return "type: String"; }
+  std::string toString() const override { return toYamlString(); }
+
+  std::string data() {
+    MutexType::Lock lock(m_mutex);
+    return m_data;
+  }
+
+ private:
+  std::string m_data;
+};
+
+static ddg::Logger::ptr NewLogger(const std::string& name,
+                                  ddg::LogAppender::ptr appender) {
+  ddg::Logger::ptr logger = DDG_LOG_NAME(name);
+  logger->clearAppender();
+  appender->setFormatter(
+      ddg::LogFormatter::ptr(new ddg::LogFormatter("%m%n")));
+  logger->addAppender(appender);
+  logger->setLevel(ddg::LogLevel::DEBUG);
+  return logger;
+}
+
+static void LogOne(ddg::Logger::ptr logger, int i) {
+  std::string name = "conn_" + std::to_string(i);
+  DDG_BINLOG_INFO(logger, "i=%d u=%llu d=%.2f s=%s n=%-6s| x=%x c=%c %%",
+                  i, (unsigned long long)i * 1000000007ull, i / 4.0,
+                  name, "abc", i, 'a' + i % 26);
+}
+
+static std::string Expected(int i) {
+  char buf[256];
+  std::string name = "conn_" + std::to_string(i);
+  snprintf(buf, sizeof(buf), "i=%d u=%llu d=%.2f s=%s n=%-6s| x=%x c=%c %%",
+           i, (unsigned long long)i * 1000000007ull, i / 4.0, name.c_str(),
+           "abc", i, 'a' + i % 26);
+  return buf;
+}
+
+// 没有打开时走普通日志
+static void test_fallback() {
+  StringLogAppender::ptr appender(new StringLogAppender);
+  ddg::Logger::ptr logger = NewLogger("binlog_fallback", appender);
+  DDG_BINLOG_INFO(logger, "%s=%05.1f", std::string("pi"), 3.14159);
+  DDG_BINLOG_WARN(logger, "no args");
+  DDG_ASSERT(appender->data() == "pi=003.1\nno args\n");
+  DDG_LOG_INFO(g_logger) << "fallback ok";
+}
+
+static void test_roundtrip() {
+  StringLogAppender::ptr appender(new StringLogAppender);
+  ddg::Logger::ptr logger = NewLogger("binlog_test", appender);
+  DDG_ASSERT(ddg::BinLog::Open(kFile));
+
+  const int kThreads = 4;
+  const int kCount = 20000;
+  std::vector<ddg::Thread::ptr> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back(new ddg::Thread("binlog_" + std::to_string(t),
+                                         [logger, t]() {
+                                           for (int i = 0; i < kCount; ++i) {
+                                             LogOne(logger, t * kCount + i);
+                                           }
+                                         }));
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  DDG_BINLOG_DEBUG(logger, "done %s %p", std::string(5000, 'y'),
+                   (void*)0x1234);
+  logger->setLevel(ddg::LogLevel::INFO);
+  DDG_BINLOG_DEBUG(logger, "filtered");
+  ddg::BinLog::Close();
+  // 打开时不会写到普通日志里
+  DDG_ASSERT(appender->data().empty());
+
+  ddg::BinLogReader reader;
+  DDG_ASSERT(reader.open(kFile));
+  ddg::BinLogReader::Record record;
+  std::vector<int> last(kThreads, -1);
+  int n = 0;
+  std::string tail;
+  while (reader.next(record)) {
+    if (record.site->level == ddg::LogLevel::DEBUG) {
+      tail = record.message;
+      continue;
+    }
+    int i = atoi(record.message.c_str() + 2);
+    DDG_ASSERT(record.message == Expected(i));
+    // 同一个线程内的顺序不变
+    DDG_ASSERT(i > last[i / kCount]);
+    last[i / kCount] = i;
+    ++n;
+  }
+  DDG_ASSERT(!reader.isError());
+  DDG_ASSERT(n == kThreads * kCount);
+  DDG_ASSERT(tail == "done " + std::string(ddg::BinLog::kMaxStringSize, 'y') +
+                         " 0x1234");
+
+  std::stringstream ss;
+  DDG_ASSERT(ddg::BinLogReader::Decode(kFile, ss, "%p %c %m%n"));
+  std::string line;
+  std::getline(ss, line);
+  DDG_ASSERT(line.find("INFO binlog_test i=") == 0);
+  // 格式不对时返回false, 不抛异常
+  DDG_ASSERT(!ddg::BinLogReader::Decode(kFile, ss, "json{%H\"}"));
+  DDG_LOG_INFO(g_logger) << "roundtrip ok, records = " << n;
+}
+
+// 一边打日志一边反复Open/Close, 缓冲区很小经常写满:
+// 每条要么完整地写进某个文件, 要么走普通日志, 不会丢也不会卡住
+static void test_close_race() {
+  ddg::ConfigVar<uint32_t>::ptr buffer_size =
+      ddg::Config::Lookup<uint32_t>("binlog.buffer_size");
+  uint32_t old_size = buffer_size->getValue();
+  buffer_size->setValue(4096);
+  StringLogAppender::ptr appender(new StringLogAppender);
+  ddg::Logger::ptr logger = NewLogger("binlog_race", appender);
+
+  const int kThreads = 4;
+  const int kCount = 20000;
+  std::atomic<int> running(kThreads);
+  std::vector<ddg::Thread::ptr> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back(new ddg::Thread(
+        "binlog_race_" + std::to_string(t), [logger, t, &running]() {
+          for (int i = 0; i < kCount; ++i) {
+            LogOne(logger, t * kCount + i);
+          }
+          --running;
+        }));
+  }
+  std::vector<std::string> files;
+  while (running) {
+    files.push_back(std::string(kFile) + "." + std::to_string(files.size()));
+    DDG_ASSERT(ddg::BinLog::Open(files.back()));
+    usleep(2000);
+    ddg::BinLog::Close();
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  buffer_size->setValue(old_size);
+
+  int n = 0;
+  for (auto& file : files) {
+    ddg::BinLogReader reader;
+    DDG_ASSERT(reader.open(file));
+    ddg::BinLogReader::Record record;
+    while (reader.next(record)) {
+      int i = atoi(record.message.c_str() + 2);
+      DDG_ASSERT(record.message == Expected(i));
+      ++n;
+    }
+    DDG_ASSERT(!reader.isError());
+    unlink(file.c_str());
+  }
+  int fallback = 0;
+  std::stringstream ss(appender->data());
+  std::string line;
+  while (std::getline(ss, line)) {
+    DDG_ASSERT(line == Expected(atoi(line.c_str() + 2)));
+    ++fallback;
+  }
+  DDG_ASSERT(n + fallback == kThreads * kCount);
+  DDG_LOG_INFO(g_logger) << "close race ok, files = " << files.size()
+                         << " binlog = " << n << " fallback = " << fallback;
+}
+
+static void test_bench() {
+  const int kCount = 1000000;
+  ddg::Logger::ptr logger = DDG_LOG_NAME("binlog_bench");
+  logger->clearAppender();
+  logger->addAppender(
+      ddg::LogAppender::ptr(new ddg::FileLogAppender("/dev/null")));
+  logger->setLevel(ddg::LogLevel::INFO);
+
+  DDG_ASSERT(ddg::BinLog::Open("/dev/null"));
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kCount; ++i) {
+    DDG_BINLOG_INFO(logger, "recv %d bytes from fd %d, %s", i, 3, "ok");
+  }
+  uint64_t binlog = ddg::GetCurrentMicroSecond() - start;
+  ddg::BinLog::Close();
+
+  start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kCount; ++i) {
+    DDG_LOG_FMT_INFO(logger, "recv %d bytes from fd %d, %s", i, 3, "ok");
+  }
+  uint64_t text = ddg::GetCurrentMicroSecond() - start;
+  DDG_LOG_INFO(g_logger) << "binlog " << binlog * 1000 / kCount
+                         << "ns/call, text " << text * 1000 / kCount
+                         << "ns/call";
+}
+
+int main(int argc, char** argv) {
+  g_logger->setLevel(ddg::LogLevel::INFO);
+  test_fallback();
+  test_roundtrip();
+  test_close_race();
+  test_bench();
+  unlink(kFile);
+  DDG_LOG_INFO(g_logger) << "binlog ok";
+  return 0;
+}
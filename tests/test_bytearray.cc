@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ddg/bytearray.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+void test_rw() {
+#define XX(type, len, write_fun, read_fun, base_len)                \
+  {                                                                 \
+    std::vector<type> vec;                                          \
+    for (int i = 0; i < len; ++i) {                                 \
+      int r = rand() * (rand() % 2 ? 1 : -1);                       \
+      vec.push_back(static_cast<type>(r));                          \
+    }                                                               \
+    ddg::ByteArray::ptr ba(new ddg::ByteArray(base_len));           \
+    for (auto& i : vec) {                                           \
+      ba->write_fun(i);                                             \
+    }                                                               \
+    for (size_t i = 0; i < vec.size(); ++i) {                       \
+      type v = ba->read_fun();                                      \
+      DDG_ASSERT(v == vec[i]);                                      \
+    }                                                               \
+    DDG_ASSERT(ba->getReadSize() == 0);                             \
+    DDG_LOG_INFO(g_logger) << #write_fun "/" #read_fun " (" #type   \
+                           << ") len = " << len                     \
+                           << " base_len = " << base_len            \
+                           << " size = " << ba->getSize();          \
+  }
+
+  XX(int8_t, 100, writeFint8, readFint8, 1);
+  XX(uint8_t, 100, writeFuint8, readFuint8, 1);
+  XX(int16_t, 100, writeFint16, readFint16, 1);
+  XX(uint16_t, 100, writeFuint16, readFuint16, 1);
+  XX(int32_t, 100, writeFint32, readFint32, 3);
+  XX(uint32_t, 100, writeFuint32, readFuint32, 3);
+  XX(int64_t, 100, writeFint64, readFint64, 7);
+  XX(uint64_t, 100, writeFuint64, readFuint64, 7);
+
+  XX(int32_t, 100, writeInt32, readInt32, 1);
+  XX(uint32_t, 100, writeUint32, readUint32, 1);
+  XX(int64_t, 100, writeInt64, readInt64, 5);
+  XX(uint64_t, 100, writeUint64, readUint64, 5);
+#undef XX
+
+  ddg::ByteArray ba(5);
+  ba.writeDouble(3.1415926);
+  ba.writeFloat(2.5f);
+  ba.writeStringF16("hello");
+  ba.writeStringVint(std::string(100, 'x'));
+  ba.writeInt64(INT64_MIN);
+  DDG_ASSERT(ba.readDouble() == 3.1415926);
+  DDG_ASSERT(ba.readFloat() == 2.5f);
+  DDG_ASSERT(ba.readStringF16() == "hello");
+  DDG_ASSERT(ba.readStringVint() == std::string(100, 'x'));
+  DDG_ASSERT(ba.readInt64() == INT64_MIN);
+}
+
+void test_stream() {
+  // 一边追加一边消费, 已读的块会被回收
+  ddg::ByteArray ba(8);
+  uint64_t expect = 0;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    ba.writeUint64(i * 131);
+    if (i % 3 == 0) {
+      while (ba.getReadSize() > 0) {
+        DDG_ASSERT(ba.readUint64() == expect * 131);
+        ++expect;
+      }
+      ba.discardRead();
+    }
+  }
+  while (ba.getReadSize() > 0) {
+    DDG_ASSERT(ba.readUint64() == expect * 131);
+    ++expect;
+  }
+  DDG_ASSERT(expect == 1000);
+  DDG_LOG_INFO(g_logger) << "stream ok, capacity released size = "
+                         << ba.getSize();
+}
+
+void test_iovec() {
+  int fds[2];
+  DDG_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  ddg::ByteArray out(16);
+  for (int i = 0; i < 100; ++i) {
+    out.writeFuint32(i);
+  }
+
+  // 直接把内存块交给writev/readv, 中间不经过拷贝
+  std::vector<iovec> iovs;
+  uint64_t len = out.getReadBuffers(iovs);
+  DDG_ASSERT(len == out.getReadSize());
+  DDG_ASSERT(writev(fds[0], &iovs[0], iovs.size()) ==
+             static_cast<ssize_t>(len));
+
+  ddg::ByteArray in(16);
+  iovs.clear();
+  in.getWriteBuffers(iovs, len);
+  ssize_t n = readv(fds[1], &iovs[0], iovs.size());
+  DDG_ASSERT(n == static_cast<ssize_t>(len));
+  in.commitWrite(n);
+
+  for (int i = 0; i < 100; ++i) {
+    DDG_ASSERT(in.readFuint32() == static_cast<uint32_t>(i));
+  }
+  DDG_LOG_INFO(g_logger) << "iovec ok, len = " << len
+                         << " iov count = " << iovs.size();
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void test_file() {
+  ddg::ByteArray ba(3);
+  for (int i = 0; i < 100; ++i) {
+    ba.writeStringF32("line " + std::to_string(i));
+  }
+  DDG_ASSERT(ba.writeToFile("/tmp/ddg_bytearray.dat"));
+
+  ddg::ByteArray ba2(7);
+  DDG_ASSERT(ba2.readFromFile("/tmp/ddg_bytearray.dat"));
+  DDG_ASSERT(ba.toString() == ba2.toString());
+  DDG_LOG_INFO(g_logger) << "file ok, size = " << ba2.getSize();
+}
+
+int main(int argc, char** argv) {
+  test_rw();
+  test_stream();
+  test_iovec();
+  test_file();
+  return 0;
+}
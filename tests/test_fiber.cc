@@ -1,6 +1,7 @@
 #include <vector>
 #include "ddg/fiber.h"
 #include "ddg/log.h"
+#include "ddg/macro.h"
 #include "ddg/thread.h"
 
 static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
@@ -22,11 +23,13 @@ int main(int argc, char** argv) {
           DDG_LOG_DEBUG(g_logger)
               << "main fiber count: " << main_fiber.use_count();
           ddg::Fiber::ptr fiber = std::make_shared<ddg::Fiber>(run_in_fiber);
-          fiber->swapIn();
+          // YieldToHold切回来之后是HOLD, 可以再次swapIn
+          DDG_ASSERT(fiber->swapIn() == ddg::Fiber::State::HOLD);
+          DDG_ASSERT(fiber->getState() == ddg::Fiber::State::HOLD);
           DDG_LOG_INFO(g_logger) << "main after swapIn";
-          fiber->swapIn();
+          DDG_ASSERT(fiber->swapIn() == ddg::Fiber::State::HOLD);
           DDG_LOG_INFO(g_logger) << "main after end";
-          fiber->swapIn();
+          DDG_ASSERT(fiber->swapIn() == ddg::Fiber::State::TERM);
         }));
   }
 
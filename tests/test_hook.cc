@@ -0,0 +1,129 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ddg/fdmanager.h"
+#include "ddg/hook.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+void test_sleep() {
+  ddg::IOManager iom(1, true, "test_sleep");
+  iom.start();
+  uint64_t start = ddg::GetCurrentMilliSecond();
+
+  iom.schedule([]() {
+    sleep(2);
+    DDG_LOG_INFO(g_logger) << "sleep 2";
+  });
+
+  iom.schedule([]() {
+    sleep(3);
+    DDG_LOG_INFO(g_logger) << "sleep 3";
+  });
+
+  iom.stop();
+  // 两个协程并行睡眠, 总耗时应该在3秒左右而不是5秒
+  uint64_t used = ddg::GetCurrentMilliSecond() - start;
+  DDG_LOG_INFO(g_logger) << "test_sleep cost " << used << "ms";
+  DDG_ASSERT(used >= 3000 && used < 4000);
+}
+
+void test_sock() {
+  const int kPort = 18080;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr.s_addr);
+
+  ddg::IOManager iom(2, true, "test_sock");
+  iom.start();
+
+  iom.schedule([addr]() {
+    // 在协程里创建, 监听fd才有FdCtx, accept才会让出协程而不是阻塞线程
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    DDG_ASSERT(lfd >= 0);
+    DDG_ASSERT(ddg::FdMgr::GetInstance()->get(lfd));
+    DDG_ASSERT(fcntl_f(lfd, F_GETFL) & O_NONBLOCK);
+    int val = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    DDG_ASSERT(bind(lfd, reinterpret_cast<const sockaddr*>(&addr),
+                    sizeof(addr)) == 0);
+    DDG_ASSERT(listen(lfd, 16) == 0);
+
+    int cfd = accept(lfd, nullptr, nullptr);
+    DDG_ASSERT(cfd >= 0);
+    DDG_ASSERT(ddg::FdMgr::GetInstance()->get(cfd));
+
+    // 设置读超时, 对端不再发送时recv会在1秒后返回ETIMEDOUT
+    timeval tv{1, 0};
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char buf[64];
+    ssize_t n = recv(cfd, buf, sizeof(buf), 0);
+    DDG_ASSERT(n > 0);
+    DDG_LOG_INFO(g_logger) << "server recv " << std::string(buf, n);
+    send(cfd, buf, n, 0);
+
+    uint64_t start = ddg::GetCurrentMilliSecond();
+    n = recv(cfd, buf, sizeof(buf), 0);
+    uint64_t used = ddg::GetCurrentMilliSecond() - start;
+    DDG_LOG_INFO(g_logger) << "server recv ret = " << n << " errno = " << errno
+                           << " " << strerror(errno) << " used " << used
+                           << "ms";
+    DDG_ASSERT(n == -1 && errno == ETIMEDOUT);
+    DDG_ASSERT(used >= 1000 && used < 1500);
+    close(cfd);
+    close(lfd);
+    DDG_ASSERT(!ddg::FdMgr::GetInstance()->get(lfd));
+  });
+
+  iom.schedule([addr]() {
+    usleep(100 * 1000);  // 等服务端listen
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int ret = connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                      sizeof(addr));
+    DDG_LOG_INFO(g_logger) << "connect ret = " << ret;
+    DDG_ASSERT(ret == 0);
+
+    // 用户关掉非阻塞后, 内核里仍然是非阻塞的, 只是对用户表现为阻塞
+    int off = 0;
+    DDG_ASSERT(ioctl(fd, FIONBIO, &off) == 0);
+    DDG_ASSERT(fcntl_f(fd, F_GETFL) & O_NONBLOCK);
+    DDG_ASSERT(!(fcntl(fd, F_GETFL) & O_NONBLOCK));
+
+    const char msg[] = "hello hook";
+    send(fd, msg, sizeof(msg) - 1, 0);
+    char buf[64];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    DDG_LOG_INFO(g_logger) << "client recv " << std::string(buf, n);
+    sleep(2);
+    close(fd);
+  });
+
+  iom.stop();
+}
+
+// 没开hook的线程里close也要删掉FdCtx
+void test_close() {
+  DDG_ASSERT(!ddg::IsHookEnable());
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  DDG_ASSERT(fd >= 0);
+  DDG_ASSERT(ddg::FdMgr::GetInstance()->get(fd, true));
+  close(fd);
+  DDG_ASSERT(!ddg::FdMgr::GetInstance()->get(fd));
+}
+
+int main(int argc, char** argv) {
+  test_close();
+  test_sleep();
+  test_sock();
+  return 0;
+}
@@ -0,0 +1,198 @@
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+
+#include "ddg/config.h"
+#include "ddg/hotrestart.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/tcpserver.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+static const uint16_t kPort = 18096;
+static const char* kPath = "/tmp/ddg_test_hotrestart.sock";
+
+extern char** environ;
+
+static ddg::Address::ptr ServerAddress() {
+  return ddg::IPv4Address::Create("127.0.0.1", kPort);
+}
+
+// 每读到一行回复"pid\n", 客户端据此区分新旧进程
+class PidServer : public ddg::TcpServer {
+ protected:
+  void handleClient(ddg::Socket::ptr client) override {
+    std::string pid = std::to_string(getpid()) + "\n";
+    char buf[256];
+    while (client->recv(buf, sizeof(buf)) > 0) {
+      if (client->send(pid.c_str(), pid.size()) <= 0) {
+        break;
+      }
+    }
+  }
+};
+
+static std::atomic<bool> s_exit{false};
+
+// 旧进程: 监听并等待新进程接手, 连接处理完后退出
+// 新进程: 接手监听socket, 跑一段时间后退出
+static void run_server(bool inherit) {
+  ddg::HotRestart::ptr hr(new ddg::HotRestart(kPath));
+  if (inherit) {
+    DDG_ASSERT(hr->inherit());
+  }
+  ddg::TcpServer::ptr server(new PidServer);
+  DDG_ASSERT(server->bind(ServerAddress()));
+  server->start();
+  // 旧进程4个线程交过来4个监听socket, 新进程2个线程也要全部接着accept
+  DDG_ASSERT(!inherit || server->getSocks().size() == 4);
+  hr->addServer(server);
+  if (inherit) {
+    DDG_ASSERT(hr->ready());
+  }
+  DDG_ASSERT(hr->listen());
+  hr->setDrainedCallback([]() { s_exit = true; });
+  DDG_LOG_INFO(g_logger) << "pid " << getpid() << " serving";
+
+  uint64_t end = ddg::GetCurrentMilliSecond() + 5000;
+  while (!s_exit && (!inherit || ddg::GetCurrentMilliSecond() < end)) {
+    usleep(10 * 1000);
+  }
+  if (!s_exit) {
+    server->stop();
+  }
+  hr->close();
+}
+
+// waitpid不会让出协程, 轮询等待子进程退出
+static int Wait(pid_t pid) {
+  int status = 0;
+  while (waitpid(pid, &status, WNOHANG) == 0) {
+    usleep(10 * 1000);
+  }
+  DDG_ASSERT(WIFEXITED(status));
+  return WEXITSTATUS(status);
+}
+
+static pid_t Spawn(const char* mode) {
+  char exe[256] = {0};
+  DDG_ASSERT(readlink("/proc/self/exe", exe, sizeof(exe) - 1) > 0);
+  char* argv[] = {exe, const_cast<char*>(mode), nullptr};
+  // 测试进程里客户端的连接不能带到子进程里, 否则服务端等不到连接关闭
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+  pid_t pid = 0;
+  DDG_ASSERT(posix_spawn(&pid, exe, &actions, nullptr, argv, environ) == 0);
+  posix_spawn_file_actions_destroy(&actions);
+  return pid;
+}
+
+static std::atomic<bool> s_stop{false};
+static std::atomic<int> s_ok{0};
+static std::atomic<int> s_fail{0};
+static std::atomic<int> s_finished{0};
+
+// 短连接: 每次新建连接发一行收一行
+static void short_client(std::string* last) {
+  while (!s_stop) {
+    ddg::Socket::ptr sock = ddg::Socket::CreateTCP(ServerAddress());
+    char buf[64];
+    int rt = -1;
+    if (sock->connect(ServerAddress(), 1000)) {
+      sock->setRecvTimeout(1000);
+      rt = sock->send("x\n", 2) == 2 ? sock->recv(buf, sizeof(buf)) : -1;
+    }
+    if (rt > 0) {
+      ++s_ok;
+      *last = std::string(buf, rt - 1);
+    } else {
+      ++s_fail;
+    }
+    usleep(2 * 1000);
+  }
+  ++s_finished;
+}
+
+// 长连接: 交接期间一直在旧进程上发请求, 直到主动关闭
+static void long_client(std::string* pid) {
+  ddg::Socket::ptr sock = ddg::Socket::CreateTCP(ServerAddress());
+  DDG_ASSERT(sock->connect(ServerAddress(), 1000));
+  sock->setRecvTimeout(1000);
+  char buf[64];
+  for (int i = 0; i < 100; ++i) {
+    int rt = sock->send("x\n", 2) == 2 ? sock->recv(buf, sizeof(buf)) : -1;
+    if (rt <= 0) {
+      ++s_fail;
+      break;
+    }
+    std::string p(buf, rt - 1);
+    DDG_ASSERT(pid->empty() || *pid == p);
+    *pid = p;
+    ++s_ok;
+    usleep(20 * 1000);
+  }
+  ++s_finished;
+}
+
+static void run_test() {
+  unlink(kPath);
+  pid_t old_pid = Spawn("old");
+  usleep(300 * 1000);
+
+  ddg::IOManager* iom = ddg::IOManager::GetThis();
+  const int kShort = 4;
+  std::string last[kShort];
+  std::string long_pid;
+  for (int i = 0; i < kShort; ++i) {
+    iom->schedule(std::bind(short_client, &last[i]));
+  }
+  iom->schedule(std::bind(long_client, &long_pid));
+  usleep(300 * 1000);
+
+  pid_t new_pid = Spawn("new");
+  // 长连接结束后旧进程才会退出
+  DDG_ASSERT(Wait(old_pid) == 0);
+  usleep(200 * 1000);
+  s_stop = true;
+  while (s_finished < kShort + 1) {
+    usleep(1000);
+  }
+
+  DDG_LOG_INFO(g_logger) << "ok = " << s_ok << " fail = " << s_fail
+                         << " long conn served by " << long_pid;
+  DDG_ASSERT(s_fail == 0);
+  DDG_ASSERT(long_pid == std::to_string(old_pid));
+  for (int i = 0; i < kShort; ++i) {
+    DDG_ASSERT(last[i] == std::to_string(new_pid));
+  }
+  DDG_ASSERT(Wait(new_pid) == 0);
+  DDG_LOG_INFO(g_logger) << "hot restart ok, no connection dropped";
+}
+
+// 用法: test_hotrestart, 参数old/new由测试自己启动子进程时使用
+int main(int argc, char** argv) {
+  g_logger->setLevel(ddg::LogLevel::INFO);
+  DDG_LOG_NAME("system")->setLevel(ddg::LogLevel::INFO);
+  ddg::Config::Lookup<uint64_t>("hot_restart.drain_timeout", 0)
+      ->setValue(5000);
+  std::string mode = argc > 1 ? argv[1] : "";
+  // 旧进程线程多, 交过来的监听socket比新进程的线程多, 多出来的也要接着用
+  ddg::IOManager iom(mode == "old" ? 4 : 2, false,
+                     mode.empty() ? "test" : mode);
+  iom.start();
+  if (mode.empty()) {
+    iom.schedule(run_test);
+  } else {
+    iom.schedule(std::bind(run_server, mode == "new"));
+  }
+  iom.stop();
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <unistd.h>
+#include <atomic>
+
+#include "ddg/http/httpconnection.h"
+#include "ddg/http/httpserver.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+using namespace ddg::http;
+
+static const uint16_t kPort = 18091;
+
+static HttpServer::ptr StartServer() {
+  HttpServer::ptr server(new HttpServer);
+  ServletDispatch::ptr sd = server->getServletDispatch();
+  sd->addServlet("/ping", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                             HttpSession::ptr session) {
+    rsp->setBody("pong " + req->getHeader("Host"));
+    return 0;
+  });
+  sd->addServlet("/slow", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                             HttpSession::ptr session) {
+    usleep(300 * 1000);
+    rsp->setBody("slow");
+    return 0;
+  });
+  sd->addServlet("/echo", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                             HttpSession::ptr session) {
+    rsp->setBody(req->getParam("a") + ":" + req->getBody());
+    return 0;
+  });
+
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  DDG_ASSERT(server->bind(addr));
+  server->start();
+  return server;
+}
+
+void test_url() {
+  HttpUrl u;
+  DDG_ASSERT(HttpUrl::Parse("http://example.com:8080/a/b?x=1#top", u));
+  DDG_ASSERT(u.host == "example.com" && u.port == 8080 && u.path == "/a/b" &&
+             u.query == "x=1" && u.fragment == "top");
+  DDG_ASSERT(HttpUrl::Parse("http://[::1]?q", u));
+  DDG_ASSERT(u.host == "::1" && u.port == 80 && u.path == "/" &&
+             u.query == "q");
+  DDG_ASSERT(!HttpUrl::Parse("https://example.com/", u));
+  DDG_ASSERT(!HttpUrl::Parse("http://example.com:99999/", u));
+}
+
+void test_direct() {
+  HttpResult::ptr r = HttpConnection::DoGet(
+      "http://127.0.0.1:" + std::to_string(kPort) + "/ping", 1000);
+  DDG_LOG_INFO(g_logger) << r->toString();
+  DDG_ASSERT(r->result == 0 && r->response->getBody() == "pong 127.0.0.1");
+
+  r = HttpConnection::DoPost(
+      "http://127.0.0.1:" + std::to_string(kPort) + "/echo?a=1", 1000, {},
+      std::string(10000, 'b'));
+  DDG_ASSERT(r->result == 0);
+  DDG_ASSERT(r->response->getBody() == "1:" + std::string(10000, 'b'));
+}
+
+void test_pool() {
+  HttpConnectionPool::ptr pool = HttpConnectionPool::Create(
+      "http://127.0.0.1:" + std::to_string(kPort), "ddg.test", 4, 200, 2);
+
+  // 串行的请求都复用同一个连接
+  for (int i = 0; i < 10; ++i) {
+    HttpResult::ptr r = pool->doGet("/ping", 1000);
+    DDG_ASSERT(r->result == 0 && r->response->getBody() == "pong ddg.test");
+  }
+  DDG_ASSERT(pool->getConnectCount() == 1);
+  DDG_ASSERT(pool->getIdleCount() == 1);
+
+  // 超时: 定时器shutdown连接, 这个连接不再放回池子
+  HttpResult::ptr r = pool->doGet("/slow", 100);
+  DDG_LOG_INFO(g_logger) << r->toString();
+  DDG_ASSERT(r->result == static_cast<int>(HttpResult::Error::TIMEOUT));
+  DDG_ASSERT(pool->getIdleCount() == 0);
+
+  // 同时最多2个请求
+  static std::atomic<int> s_ok{0};
+  static std::atomic<int> s_busy{0};
+  static std::atomic<int> s_done{0};
+  for (int i = 0; i < 3; ++i) {
+    ddg::IOManager::GetThis()->schedule([pool]() {
+      HttpResult::ptr r = pool->doGet("/slow", 1000);
+      if (r->result == 0) {
+        ++s_ok;
+      } else if (r->result ==
+                 static_cast<int>(HttpResult::Error::TOO_MANY_INFLIGHT)) {
+        ++s_busy;
+      }
+      ++s_done;
+    });
+  }
+  while (s_done < 3) {
+    usleep(10 * 1000);
+  }
+  DDG_ASSERT(s_ok == 2 && s_busy == 1);
+  DDG_ASSERT(pool->getIdleCount() == 2);
+
+  // 空闲超过max_idle_time的连接被丢弃, 重新connect
+  uint64_t count = pool->getConnectCount();
+  usleep(300 * 1000);
+  r = pool->doGet("/ping", 1000);
+  DDG_ASSERT(r->result == 0);
+  DDG_ASSERT(pool->getConnectCount() == count + 1);
+  DDG_LOG_INFO(g_logger) << "pool connect count = " << pool->getConnectCount();
+
+  // 连接比池子活得久, 放回时直接关掉
+  HttpConnection::ptr conn = pool->getConnection(1000);
+  DDG_ASSERT(conn);
+  pool.reset();
+  conn.reset();
+}
+
+void run() {
+  HttpServer::ptr server = StartServer();
+  test_url();
+  test_direct();
+  test_pool();
+  server->stop();
+}
+
+int main(int argc, char** argv) {
+  ddg::IOManager iom(2, false, "http");
+  iom.start();
+  iom.schedule(run);
+  iom.stop();
+  return 0;
+}
@@ -0,0 +1,186 @@
+#include <string.h>
+
+#include "ddg/http/httpparser.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+using ddg::http::HttpParser;
+
+// 浏览器抓到的请求头
+static const char kChromeRequest[] =
+    "GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg "
+    "HTTP/1.1\r\n"
+    "Host: www.kittyhell.com\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10.6; ja-JP-mac; "
+    "rv:1.9.2.3) Gecko/20100401 Firefox/3.6.3 Pathtraq/0.9\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;"
+    "q=0.8\r\n"
+    "Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+    "Accept-Encoding: gzip,deflate\r\n"
+    "Accept-Charset: Shift_JIS,utf-8;q=0.7,*;q=0.7\r\n"
+    "Keep-Alive: 115\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: wp_ozh_wsa_visits=2; wp_ozh_wsa_visit_lasttime=xxxxxxxxxx; "
+    "__utma=xxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.x; "
+    "__utmz=xxxxxxxxx.xxxxxxxxxx.x.x.utmccn=(referral)|utmcsr=reader.livedoor."
+    "com|utmcct=/reader/|utmcmd=referral\r\n"
+    "\r\n";
+
+static const char kResponse[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: nginx/1.18.0\r\n"
+    "Date: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+    "Content-Type: text/plain\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "5\r\nhello\r\n"
+    "7;ext=1\r\n, world\r\n"
+    "0\r\n"
+    "X-Trailer: 1\r\n"
+    "\r\n"
+    "GET / HTTP/1.1\r\n";
+
+void test_request() {
+  HttpParser parser;
+  size_t len = sizeof(kChromeRequest) - 1;
+  int ret = parser.execute(kChromeRequest, len);
+  DDG_ASSERT(ret == static_cast<int>(len));
+  DDG_ASSERT(parser.getMethod() == ddg::http::HttpMethod::GET);
+  DDG_ASSERT(parser.getVersion() == 0x11);
+  DDG_ASSERT(parser.isKeepAlive());
+  DDG_ASSERT(parser.getHeaderCount() == 9);
+  DDG_ASSERT(parser.getHeader("host") == "www.kittyhell.com");
+  DDG_ASSERT(parser.getHeader("KEEP-ALIVE") == "115");
+
+  DDG_LOG_INFO(g_logger) << "method = " << parser.getMethodString()
+                         << " path = " << parser.getPath()
+                         << " headers = " << parser.getHeaderCount();
+
+  // 逐字节喂进去, 结果应该完全一样
+  HttpParser partial;
+  for (size_t i = 1; i <= len; ++i) {
+    ret = partial.execute(kChromeRequest, i);
+    DDG_ASSERT(ret == (i == len ? static_cast<int>(len) : 0));
+  }
+  DDG_ASSERT(partial.getHeaderCount() == parser.getHeaderCount());
+  DDG_ASSERT(partial.getHeader("Cookie") == parser.getHeader("Cookie"));
+
+  HttpParser uri;
+  const char req[] =
+      "POST http://example.com/a/b?x=1&y=2#top HTTP/1.0\r\n"
+      "Content-Length: 3\r\n\r\nabc";
+  ret = uri.execute(req, sizeof(req) - 1);
+  DDG_ASSERT(ret == static_cast<int>(sizeof(req) - 1 - 3));
+  DDG_ASSERT(uri.getPath() == "/a/b");
+  DDG_ASSERT(uri.getQuery() == "x=1&y=2");
+  DDG_ASSERT(uri.getFragment() == "top");
+  DDG_ASSERT(uri.getContentLength() == 3);
+  DDG_ASSERT(!uri.isKeepAlive());
+}
+
+void test_error() {
+  const char* bad[] = {
+      "GET / HTTP/2.0\r\n\r\n",
+      "FOO / HTTP/1.1\r\n\r\n",
+      "GET /\x01 HTTP/1.1\r\n\r\n",
+      "GET / HTTP/1.1\r\nHost : a\r\n\r\n",
+      "GET / HTTP/1.1\r\n folded\r\n\r\n",
+      "GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+      "GET / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+      "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n"
+      "Content-Length: 3\r\n\r\n",
+      "POST / HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n",
+      "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+      "Transfer-Encoding: identity\r\n\r\n",
+      "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+      "Content-Length: 3\r\n\r\n",
+  };
+  for (auto str : bad) {
+    HttpParser parser;
+    DDG_ASSERT(parser.execute(str, strlen(str)) == -1);
+    DDG_LOG_INFO(g_logger) << "error = " << parser.getError();
+  }
+
+  // 多个Transfer-Encoding头部合起来最后是chunked的可以接受
+  const char ok[] =
+      "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n";
+  HttpParser parser;
+  DDG_ASSERT(parser.execute(ok, sizeof(ok) - 1) > 0);
+  DDG_ASSERT(parser.isChunked());
+}
+
+void test_response() {
+  HttpParser parser(HttpParser::RESPONSE);
+  size_t len = sizeof(kResponse) - 1;
+  int ret = parser.execute(kResponse, len);
+  DDG_ASSERT(ret > 0);
+  DDG_ASSERT(parser.getStatus() == ddg::http::HttpStatus::OK);
+  DDG_ASSERT(parser.getReason() == "OK");
+  DDG_ASSERT(parser.isChunked());
+
+  // 每次喂几个字节, 检查跨越多次读取的chunked解码
+  std::string body = std::string(kResponse + ret, len - ret);
+  for (size_t step = 1; step < body.size(); ++step) {
+    ddg::http::HttpChunkedDecoder decoder;
+    std::string out;
+    ssize_t left = -2;
+    for (size_t pos = 0; pos < body.size() && left == -2; pos += step) {
+      std::string piece = body.substr(pos, step);
+      size_t n = piece.size();
+      left = decoder.decode(&piece[0], &n);
+      DDG_ASSERT(left != -1);
+      out.append(piece.c_str(), n);
+      if (left >= 0) {
+        // 多出来的是下一个请求
+        DDG_ASSERT(piece.substr(n, left) ==
+                   std::string("GET / HTTP/1.1\r\n").substr(0, left));
+      }
+    }
+    DDG_ASSERT(decoder.isFinished());
+    DDG_ASSERT(out == "hello, world");
+  }
+
+  // chunk-size后面跟的不是chunk-ext或者行尾
+  const char* bad[] = {"1x\r\na\r\n0\r\n\r\n", "1 \r\na\r\n0\r\n\r\n",
+                       "\r\na\r\n0\r\n\r\n"};
+  for (auto str : bad) {
+    ddg::http::HttpChunkedDecoder decoder;
+    std::string data = str;
+    size_t n = data.size();
+    DDG_ASSERT(decoder.decode(&data[0], &n) == -1);
+  }
+  DDG_LOG_INFO(g_logger) << "chunked ok";
+}
+
+void bench() {
+  size_t len = sizeof(kChromeRequest) - 1;
+  const int kLoops = 1000000;
+  HttpParser parser;
+
+  uint64_t start = ddg::GetCurrentMilliSecond();
+  for (int i = 0; i < kLoops; ++i) {
+    parser.reset();
+    DDG_ASSERT(parser.execute(kChromeRequest, len) > 0);
+  }
+  uint64_t used = ddg::GetCurrentMilliSecond() - start;
+  used = used ? used : 1;
+
+  double gb = static_cast<double>(len) * kLoops / (1024.0 * 1024 * 1024);
+  DDG_LOG_INFO(g_logger) << "bench " << kLoops << " requests, " << len
+                         << " bytes each, used " << used << "ms, "
+                         << (gb * 1000 / used) << " GB/s, "
+                         << (kLoops * 1000.0 / used) << " req/s";
+}
+
+int main(int argc, char** argv) {
+  test_request();
+  test_error();
+  test_response();
+  bench();
+  return 0;
+}
@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "ddg/http/httpserver.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+using namespace ddg::http;
+
+static const uint16_t kPort = 18090;
+
+static const char kPingRequest[] =
+    "GET /ping HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+// 读一个响应, 返回状态码, body放到body里
+static int ReadResponse(HttpStream& stream, std::string& body) {
+  HttpParser parser(HttpParser::RESPONSE);
+  int ret = stream.readHeader(parser, 8192);
+  if (ret <= 0) {
+    return ret;
+  }
+  stream.consume(ret);
+  if (stream.readBody(parser, body, 1024 * 1024) < 0) {
+    return -1;
+  }
+  return static_cast<int>(parser.getStatus());
+}
+
+static int DoRequest(HttpStream& stream, const std::string& req,
+                     std::string& body) {
+  stream.write(req.c_str(), req.size());
+  return ReadResponse(stream, body);
+}
+
+static HttpServer::ptr StartServer() {
+  HttpServer::ptr server(new HttpServer);
+  ServletDispatch::ptr sd = server->getServletDispatch();
+  sd->addServlet("/ping", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                             HttpSession::ptr session) {
+    rsp->setBody("pong");
+    return 0;
+  });
+  sd->addServlet("/echo", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                             HttpSession::ptr session) {
+    rsp->setBody(req->getParam("name") + ":" + req->getBody());
+    return 0;
+  });
+  sd->addPrefixServlet("/static", [](HttpRequest::ptr req,
+                                     HttpResponse::ptr rsp,
+                                     HttpSession::ptr session) {
+    rsp->setBody("static " + req->getPath());
+    return 0;
+  });
+  sd->addGlobServlet("/user/*/info", [](HttpRequest::ptr req,
+                                        HttpResponse::ptr rsp,
+                                        HttpSession::ptr session) {
+    rsp->setBody("user info");
+    return 0;
+  });
+  sd->addServlet("/big", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                            HttpSession::ptr session) {
+    rsp->setBody(std::string(1024 * 1024, 'x'));
+    return 0;
+  });
+
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  DDG_ASSERT(server->bind(addr));
+  server->start();
+  return server;
+}
+
+static ddg::Socket::ptr Connect() {
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  ddg::Socket::ptr sock = ddg::Socket::CreateTCP(addr);
+  DDG_ASSERT(sock->connect(addr, 1000));
+  return sock;
+}
+
+void test_route() {
+  HttpStream stream(Connect());
+  std::string body;
+  DDG_ASSERT(DoRequest(stream, kPingRequest, body) == 200);
+  DDG_ASSERT(body == "pong");
+
+  struct {
+    const char* path;
+    int status;
+    const char* body;
+  } cases[] = {
+      {"/ping/", 200, "pong"},
+      {"/static", 200, "static /static"},
+      {"/static/js/a.js", 200, "static /static/js/a.js"},
+      {"/user/42/info", 200, "user info"},
+      {"/user/42/x/info", 404, nullptr},
+      {"/pingx", 404, nullptr},
+  };
+  for (auto& c : cases) {
+    std::string req = std::string("GET ") + c.path + " HTTP/1.1\r\n\r\n";
+    DDG_ASSERT(DoRequest(stream, req, body) == c.status);
+    DDG_ASSERT(!c.body || body == c.body);
+  }
+
+  // 请求body和chunked
+  std::string req =
+      "POST /echo?name=a%20b HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n"
+      "3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n";
+  DDG_ASSERT(DoRequest(stream, req, body) == 200);
+  DDG_ASSERT(body == "a b:abcde");
+
+  DDG_ASSERT(DoRequest(stream, "GET /big HTTP/1.1\r\n\r\n", body) == 200);
+  DDG_ASSERT(body.size() == 1024 * 1024);
+  DDG_LOG_INFO(g_logger) << "route ok";
+}
+
+void test_pipeline() {
+  HttpStream stream(Connect());
+  // 三个请求一次发出去, 响应按顺序回来
+  std::string reqs = std::string(kPingRequest) +
+                     "GET /user/1/info HTTP/1.1\r\n\r\n" +
+                     "GET /echo?name=x HTTP/1.1\r\nConnection: close\r\n"
+                     "Content-Length: 2\r\n\r\nyz";
+  stream.write(reqs.c_str(), reqs.size());
+  DDG_ASSERT(stream.flush());
+
+  std::string body;
+  DDG_ASSERT(ReadResponse(stream, body) == 200 && body == "pong");
+  DDG_ASSERT(ReadResponse(stream, body) == 200 && body == "user info");
+  DDG_ASSERT(ReadResponse(stream, body) == 200 && body == "x:yz");
+  // Connection: close之后服务端关闭连接
+  DDG_ASSERT(ReadResponse(stream, body) == 0);
+
+  HttpStream bad(Connect());
+  DDG_ASSERT(DoRequest(bad, "GET / HTTP/9.9\r\n\r\n", body) == 400);
+  DDG_LOG_INFO(g_logger) << "pipeline ok";
+}
+
+// 声明了很大的Content-Length但只发几个字节, body不能按声明的长度分配
+void test_lying_length() {
+  int fds[2];
+  DDG_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  HttpStream stream(ddg::Socket::CreateFromFd(fds[0]));
+  const char rsp[] = "HTTP/1.1 200 OK\r\nContent-Length: 1000000\r\n\r\nabc";
+  DDG_ASSERT(write(fds[1], rsp, sizeof(rsp) - 1) == sizeof(rsp) - 1);
+  close(fds[1]);
+
+  std::string body;
+  DDG_ASSERT(ReadResponse(stream, body) == -1);
+  DDG_ASSERT(body.capacity() < 1000000);
+  DDG_LOG_INFO(g_logger) << "lying length ok, capacity = " << body.capacity();
+}
+
+static std::atomic<int> s_connected{0};
+static std::atomic<int> s_finished{0};
+static std::atomic<bool> s_measure{false};
+static std::atomic<bool> s_stop{false};
+static std::vector<uint64_t> s_latency;
+static ddg::Mutex s_mutex;
+
+void bench_client(int idx) {
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  ddg::Socket::ptr sock = ddg::Socket::CreateTCP(addr);
+  // 一个源地址最多几万个端口, 连接多时换不同的127.0.0.x
+  if (idx >= 20000) {
+    std::string ip = "127.0.0." + std::to_string(2 + idx / 20000);
+    sock->bind(ddg::IPv4Address::Create(ip.c_str(), 0));
+  }
+  std::vector<uint64_t> latency;
+  if (!sock->connect(addr, 10000)) {
+    DDG_LOG_ERROR(g_logger) << "connect fail idx = " << idx
+                            << " errno = " << errno;
+    ++s_connected;
+    ++s_finished;
+    return;
+  }
+  ++s_connected;
+
+  HttpStream stream(sock);
+  std::string body;
+  while (!s_stop) {
+    uint64_t start = ddg::GetCurrentMicroSecond();
+    if (DoRequest(stream, kPingRequest, body) != 200) {
+      break;
+    }
+    if (s_measure) {
+      latency.push_back(ddg::GetCurrentMicroSecond() - start);
+    }
+  }
+
+  ddg::Mutex::Lock lock(s_mutex);
+  s_latency.insert(s_latency.end(), latency.begin(), latency.end());
+  ++s_finished;
+}
+
+void bench(int conns, int seconds) {
+  s_connected = 0;
+  s_finished = 0;
+  s_measure = false;
+  s_stop = false;
+  s_latency.clear();
+
+  ddg::IOManager* iom = ddg::IOManager::GetThis();
+  for (int i = 0; i < conns; ++i) {
+    iom->schedule(std::bind(bench_client, i));
+  }
+  while (s_connected < conns) {
+    usleep(10 * 1000);
+  }
+
+  s_measure = true;
+  uint64_t start = ddg::GetCurrentMilliSecond();
+  sleep(seconds);
+  s_measure = false;
+  uint64_t used = ddg::GetCurrentMilliSecond() - start;
+  s_stop = true;
+  while (s_finished < conns) {
+    usleep(10 * 1000);
+  }
+
+  std::sort(s_latency.begin(), s_latency.end());
+  auto pct = [](double p) -> uint64_t {
+    if (s_latency.empty()) {
+      return 0;
+    }
+    return s_latency[std::min(s_latency.size() - 1,
+                              static_cast<size_t>(s_latency.size() * p))];
+  };
+  DDG_LOG_INFO(g_logger) << "bench conns = " << conns << " requests = "
+                         << s_latency.size() << " used = " << used << "ms "
+                         << (s_latency.size() * 1000.0 / used) << " req/s"
+                         << " p50 = " << pct(0.5) << "us"
+                         << " p90 = " << pct(0.9) << "us"
+                         << " p99 = " << pct(0.99) << "us"
+                         << " p999 = " << pct(0.999) << "us";
+}
+
+// 用法: test_httpserver [连接数...], 如 test_httpserver 1000 10000 100000
+// 连接数多时需要先调大ulimit -n(每个连接两端各占一个fd)
+void run(int argc, char** argv) {
+  HttpServer::ptr server = StartServer();
+  test_route();
+  test_pipeline();
+  test_lying_length();
+
+  std::vector<int> levels;
+  for (int i = 1; i < argc; ++i) {
+    levels.push_back(atoi(argv[i]));
+  }
+  if (levels.empty()) {
+    levels.push_back(1000);
+  }
+  for (int conns : levels) {
+    bench(conns, 3);
+  }
+  server->stop();
+}
+
+// 只要有精确或通配规则完整匹配就不用前缀规则, 前缀取最长的
+void test_dispatch() {
+  ServletDispatch sd;
+  auto make = []() {
+    return std::make_shared<FunctionServlet>(
+        [](HttpRequest::ptr, HttpResponse::ptr, HttpSession::ptr) {
+          return 0;
+        });
+  };
+  Servlet::ptr prefix_a = make();
+  Servlet::ptr prefix_ab = make();
+  Servlet::ptr glob = make();
+  Servlet::ptr exact = make();
+  sd.addPrefixServlet("/a", prefix_a);
+  sd.addPrefixServlet("/a/b", prefix_ab);
+  sd.addGlobServlet("/a/*/c", glob);
+  sd.addServlet("/a/b/c/d", exact);
+  DDG_ASSERT(sd.getMatchedServlet("/a/b/c") == glob);
+  DDG_ASSERT(sd.getMatchedServlet("/a/x/c") == glob);
+  DDG_ASSERT(sd.getMatchedServlet("/a/b/c/d") == exact);
+  DDG_ASSERT(sd.getMatchedServlet("/a/b/c/e") == prefix_ab);
+  DDG_ASSERT(sd.getMatchedServlet("/a/x/c/e") == prefix_a);
+  DDG_ASSERT(sd.getMatchedServlet("/a/b") == prefix_ab);
+  // 很长的段也做通配匹配
+  DDG_ASSERT(sd.getMatchedServlet("/a/" + std::string(300, 'x') + "/c") ==
+             glob);
+  DDG_ASSERT(sd.getMatchedServlet("/b") == sd.getDefault());
+}
+
+int main(int argc, char** argv) {
+  g_logger->setLevel(ddg::LogLevel::INFO);
+  test_dispatch();
+  DDG_LOG_NAME("system")->setLevel(ddg::LogLevel::INFO);
+  ddg::IOManager iom(1, false, "http");
+  iom.start();
+  iom.schedule(std::bind(run, argc, argv));
+  iom.stop();
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <atomic>
 #include "ddg/iomanager.h"
 #include "ddg/log.h"
 #include "ddg/macro.h"
@@ -86,7 +87,76 @@ void test_timer() {
   iom.stop();
 }
 
+void test_wait_timeout() {
+  ddg::IOManager iom(2, true, "iomanager");
+  iom.start();
+
+  int fds[2];
+  int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  DDG_ASSERT(ret == 0);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+  iom.schedule([fds]() {
+    uint64_t start = ddg::GetCurrentMilliSecond();
+    // 对端不写数据, 500ms后应该以WAIT_TIMEOUT返回
+    int rt = ddg::IOManager::GetThis()->waitEvent(fds[0], ddg::IOManager::READ,
+                                                  500);
+    DDG_LOG_DEBUG(g_logger)
+        << "wait result = " << rt << " cost "
+        << ddg::GetCurrentMilliSecond() - start << "ms";
+    DDG_ASSERT(rt == ddg::IOManager::WAIT_TIMEOUT);
+
+    // 有数据时在deadline之前返回WAIT_READY
+    ddg::IOManager::GetThis()->addTimer(
+        100, [fds]() { DDG_ASSERT(write(fds[1], "x", 1) == 1); });
+    rt = ddg::IOManager::GetThis()->waitEvent(fds[0], ddg::IOManager::READ,
+                                              1000);
+    DDG_LOG_DEBUG(g_logger) << "wait result = " << rt;
+    DDG_ASSERT(rt == ddg::IOManager::WAIT_READY);
+    close(fds[0]);
+    close(fds[1]);
+  });
+  iom.stop();
+}
+
+// 挂起之后应该在原来的线程上被唤醒
+void test_wakeup_thread() {
+  ddg::IOManager iom(4, false, "iomanager");
+  iom.start();
+
+  static std::atomic<int> s_done{0};
+  for (int i = 0; i < 16; ++i) {
+    iom.schedule([]() {
+      uint64_t tid = ddg::GetThreadId();
+      int fds[2];
+      DDG_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      fcntl(fds[0], F_SETFL, O_NONBLOCK);
+      for (int j = 0; j < 5; ++j) {
+        usleep(1000);
+        DDG_ASSERT(ddg::GetThreadId() == tid);
+
+        ddg::IOManager::GetThis()->addTimer(
+            1, [fds]() { DDG_ASSERT(write(fds[1], "x", 1) == 1); });
+        int rt = ddg::IOManager::GetThis()->waitEvent(
+            fds[0], ddg::IOManager::READ, 1000);
+        DDG_ASSERT(rt == ddg::IOManager::WAIT_READY);
+        DDG_ASSERT(ddg::GetThreadId() == tid);
+        char c;
+        DDG_ASSERT(read(fds[0], &c, 1) == 1);
+      }
+      close(fds[0]);
+      close(fds[1]);
+      ++s_done;
+    });
+  }
+  iom.stop();
+  DDG_ASSERT(s_done == 16);
+}
+
 int main() {
+  test_wait_timeout();
+  test_wakeup_thread();
+  // 连接本机80端口, 结果看环境, 放在最后不影响前面的用例
   test_iomanager2();
   // test_timer();
   return 0;
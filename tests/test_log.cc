@@ -0,0 +1,953 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "ddg/asynclog.h"
+#include "ddg/config.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/mmaplog.h"
+#include "ddg/thread.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+// 统计每个线程分配内存的次数
+static thread_local uint64_t t_allocs = 0;
+
+void* operator new(size_t size) {
+  ++t_allocs;
+  void* p = malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+// 收集输出的appender, 可以模拟慢磁盘
+class MemoryLogAppender : public ddg::LogAppender {
+ public:
+  using ptr = std::shared_ptr<MemoryLogAppender>;
+
+  explicit MemoryLogAppender(uint32_t write_delay_us = 0)
+      : m_delay(write_delay_us) {}
+
+  void log(ddg::Logger::ptr logger, ddg::LogLevel::Level level,
+           ddg::LogEvent::ptr event) override {
+    std::string str = m_formatter->format(logger, level, event);
+    write(str.c_str(), str.size());
+  }
+
+  void write(const char* data, size_t len) override {
+    if (m_delay) {
+      usleep(m_delay);
+    }
+    MutexType::Lock lock(m_mutex);
+    m_data.append(data, len);
+    ++m_writes;
+  }
+
+  std::string toYamlString() const override { return "type: Memory"; }
+  std::string toString() const override { return toYamlString(); }
+
+  std::vector<std::string> lines() {
+    MutexType::Lock lock(m_mutex);
+    std::vector<std::string> rt;
+    size_t pos = 0;
+    size_t end = 0;
+    while ((end = m_data.find('\n', pos)) != std::string::npos) {
+      rt.push_back(m_data.substr(pos, end - pos));
+      pos = end + 1;
+    }
+    return rt;
+  }
+
+  size_t writes() {
+    MutexType::Lock lock(m_mutex);
+    return m_writes;
+  }
+
+ private:
+  uint32_t m_delay;
+  std::string m_data;
+  size_t m_writes = 0;
+};
+
+static ddg::Logger::ptr NewLogger(const std::string& name,
+                                  ddg::LogAppender::ptr appender) {
+  ddg::Logger::ptr logger = DDG_LOG_NAME(name);
+  logger->clearAppender();
+  appender->setFormatter(std::make_shared<ddg::LogFormatter>("%m%n"));
+  logger->addAppender(appender);
+  return logger;
+}
+
+// 多个线程写, 一条不少, 每个线程内部保持顺序, 并且是批量写下去的
+static void test_async_block() {
+  MemoryLogAppender::ptr mem(new MemoryLogAppender(100));
+  ddg::AsyncLogAppender::ptr async(new ddg::AsyncLogAppender(mem, 256));
+  ddg::Logger::ptr logger = NewLogger("async_block", async);
+
+  const int kThreads = 4;
+  const int kLines = 20000;
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  std::vector<std::shared_ptr<ddg::Thread>> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back(new ddg::Thread("log_" + std::to_string(t),
+                                         [logger, t]() {
+      for (int i = 0; i < kLines; ++i) {
+        DDG_LOG_INFO(logger) << t << " " << i;
+      }
+    }));
+  }
+  for (auto& t : threads) {
+    t->join();
+  }
+  uint64_t used = ddg::GetCurrentMicroSecond() - start;
+  async->flush();
+
+  std::vector<std::string> lines = mem->lines();
+  DDG_ASSERT(lines.size() == kThreads * kLines);
+  std::vector<int> next(kThreads, 0);
+  for (auto& line : lines) {
+    int t = 0;
+    int i = 0;
+    DDG_ASSERT(sscanf(line.c_str(), "%d %d", &t, &i) == 2);
+    DDG_ASSERT(next[t] == i);
+    ++next[t];
+  }
+  DDG_LOG_INFO(g_logger) << "async block: " << lines.size() << " lines in "
+                         << mem->writes() << " writes, producers used "
+                         << used / 1000 << "ms";
+  DDG_ASSERT(mem->writes() < lines.size() / 10);
+  DDG_LOG_REMOVE("async_block");
+}
+
+// 队列满了丢弃, 输出里记录丢了多少条; FATAL不丢并且立即刷下去
+static void test_async_drop() {
+  MemoryLogAppender::ptr mem(new MemoryLogAppender(20 * 1000));
+  ddg::AsyncLogAppender::ptr async(new ddg::AsyncLogAppender(
+      mem, 16, ddg::AsyncLogAppender::DROP_REPORT));
+  ddg::Logger::ptr logger = NewLogger("async_drop", async);
+
+  const int kLines = 10000;
+  for (int i = 0; i < kLines; ++i) {
+    DDG_LOG_INFO(logger) << "line " << i;
+  }
+  DDG_LOG_FATAL(logger) << "fatal";
+  std::vector<std::string> lines = mem->lines();
+  DDG_ASSERT(!lines.empty() && lines.back() == "fatal");
+  uint64_t dropped = async->getDropped();
+  DDG_ASSERT(dropped > 0);
+
+  uint64_t reported = 0;
+  size_t kept = 0;
+  for (auto& line : lines) {
+    unsigned long long n = 0;
+    if (sscanf(line.c_str(), "AsyncLogAppender dropped %llu", &n) == 1) {
+      reported += n;
+    } else if (line != "fatal") {
+      ++kept;
+    }
+  }
+  DDG_LOG_INFO(g_logger) << "async drop: kept " << kept << " dropped "
+                         << dropped << " reported " << reported;
+  DDG_ASSERT(kept + dropped == kLines);
+  DDG_ASSERT(reported == dropped);
+  DDG_LOG_REMOVE("async_drop");
+}
+
+// 子进程exit时队列里的日志都要写到文件里
+static void test_async_exit() {
+  const char* file = "/tmp/ddg_test_asynclog.txt";
+  const int kLines = 50000;
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid == 0) {
+    ddg::FileLogAppender::ptr fa(new ddg::FileLogAppender(file));
+    ddg::Logger::ptr logger =
+        NewLogger("async_exit", std::make_shared<ddg::AsyncLogAppender>(fa));
+    for (int i = 0; i < kLines; ++i) {
+      DDG_LOG_INFO(logger) << "line " << i;
+    }
+    exit(0);
+  }
+  int status = 0;
+  DDG_ASSERT(waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+  std::ifstream ifs(file);
+  std::string line;
+  int n = 0;
+  while (std::getline(ifs, line)) {
+    DDG_ASSERT(line == "line " + std::to_string(n));
+    ++n;
+  }
+  DDG_LOG_INFO(g_logger) << "async exit: " << n << " lines flushed";
+  DDG_ASSERT(n == kLines);
+  unlink(file);
+}
+
+// 输出参数的时候又打了日志
+struct Nested {
+  ddg::Logger::ptr logger;
+};
+
+static std::ostream& operator<<(std::ostream& os, const Nested& n) {
+  DDG_LOG_INFO(n.logger) << "inner";
+  return os << "nested";
+}
+
+// 复用的LogEvent: 嵌套日志, 格式设置不带到下一条, 超长截断
+static void test_event_reuse() {
+  MemoryLogAppender::ptr mem(new MemoryLogAppender);
+  ddg::Logger::ptr logger = NewLogger("event_reuse", mem);
+  DDG_LOG_INFO(logger) << "outer " << Nested{logger} << " end";
+  DDG_LOG_INFO(logger) << std::hex << 255 << " " << std::setw(4) << 1;
+  DDG_LOG_INFO(logger) << 255 << " " << 1;
+  DDG_LOG_FMT_INFO(logger, "fmt %d %s", 42, "ok");
+  DDG_LOG_INFO(logger) << std::string(ddg::LogEvent::kMaxContentSize + 100,
+                                      'x');
+
+  std::vector<std::string> lines = mem->lines();
+  DDG_ASSERT(lines.size() == 6);
+  DDG_ASSERT(lines[0] == "inner");
+  DDG_ASSERT(lines[1] == "outer nested end");
+  DDG_ASSERT(lines[2] == "ff    1");
+  DDG_ASSERT(lines[3] == "255 1");
+  DDG_ASSERT(lines[4] == "fmt 42 ok");
+  DDG_ASSERT(lines[5] ==
+             std::string(ddg::LogEvent::kMaxContentSize, 'x') + "...");
+  DDG_LOG_REMOVE("event_reuse");
+}
+
+static int YieldInLog() {
+  ddg::Fiber::YieldToReady();
+  return 1;
+}
+
+// 协程在日志语句中间让出, 可能换一个线程继续, 期间别的协程也在打日志
+static void test_event_fiber() {
+  const int kFibers = 300;
+  MemoryLogAppender::ptr mem(new MemoryLogAppender);
+  ddg::Logger::ptr logger = NewLogger("event_fiber", mem);
+  ddg::IOManager iom(3, false, "log");
+  iom.start();
+  for (int i = 0; i < kFibers; ++i) {
+    iom.schedule([logger, i]() {
+      DDG_LOG_INFO(logger) << "a" << i << " " << YieldInLog() << " b" << i;
+      DDG_LOG_INFO(logger) << "c" << i;
+    });
+  }
+  iom.stop();
+
+  std::vector<std::string> lines = mem->lines();
+  DDG_ASSERT(lines.size() == kFibers * 2);
+  std::vector<int> seen(kFibers, 0);
+  for (auto& line : lines) {
+    int i = atoi(line.c_str() + 1);
+    DDG_ASSERT(i >= 0 && i < kFibers);
+    std::string n = std::to_string(i);
+    if (line[0] == 'a') {
+      DDG_ASSERT(line == "a" + n + " 1 b" + n);
+    } else {
+      DDG_ASSERT(line == "c" + n);
+    }
+    ++seen[i];
+  }
+  for (int i = 0; i < kFibers; ++i) {
+    DDG_ASSERT(seen[i] == 2);
+  }
+  DDG_LOG_REMOVE("event_fiber");
+}
+
+// 预热之后打日志不再分配内存
+static void test_no_alloc() {
+  const int kWarmUp = 300;
+  const int kLines = 10000;
+  ddg::FileLogAppender::ptr file(new ddg::FileLogAppender("/dev/null"));
+  ddg::Logger::ptr logger = DDG_LOG_NAME("no_alloc");
+  logger->clearAppender();
+  logger->addAppender(file);
+
+  for (int i = 0; i < kWarmUp; ++i) {
+    DDG_LOG_INFO(logger).kv("i", i).kv("ok", true) << "warm up " << i;
+  }
+  uint64_t allocs = t_allocs;
+  for (int i = 0; i < kLines; ++i) {
+    DDG_LOG_INFO(logger) << "line " << i << " " << 3.14;
+    DDG_LOG_INFO(logger).kv("i", i).kv("ok", true) << "kv";
+    DDG_LOG_FMT_INFO(logger, "fmt %d", i);
+  }
+  uint64_t sync_allocs = t_allocs - allocs;
+
+  logger->clearAppender();
+  ddg::AsyncLogAppender::ptr async(new ddg::AsyncLogAppender(file, 64));
+  logger->addAppender(async);
+  for (int i = 0; i < kWarmUp; ++i) {
+    DDG_LOG_INFO(logger) << "warm up " << i << " " << 3.14;
+  }
+  allocs = t_allocs;
+  for (int i = 0; i < kLines; ++i) {
+    DDG_LOG_INFO(logger) << "line " << i << " " << 3.14;
+  }
+  uint64_t async_allocs = t_allocs - allocs;
+
+  DDG_LOG_INFO(g_logger) << "allocations for " << kLines
+                         << " lines: sync = " << sync_allocs
+                         << " async = " << async_allocs;
+  DDG_ASSERT(sync_allocs == 0);
+  DDG_ASSERT(async_allocs == 0);
+  DDG_LOG_REMOVE("no_alloc");
+}
+
+// 关掉的级别不求值参数, 判断级别不加锁
+static void test_level() {
+  MemoryLogAppender::ptr mem(new MemoryLogAppender);
+  ddg::Logger::ptr logger = NewLogger("level", mem);
+  logger->setLevel(ddg::LogLevel::INFO);
+  int evaluated = 0;
+  auto arg = [&evaluated]() { return ++evaluated; };
+  DDG_LOG_DEBUG(logger) << arg();
+  DDG_LOG_FMT_DEBUG(logger, "%d", arg());
+  DDG_LOG_INFO(logger) << arg();
+  DDG_ASSERT(evaluated == 1);
+  DDG_ASSERT(mem->lines().size() == 1);
+
+  const int kLoops = 10 * 1000 * 1000;
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kLoops; ++i) {
+    DDG_LOG_DEBUG(logger) << i;
+  }
+  uint64_t disabled = ddg::GetCurrentMicroSecond() - start;
+
+  // 对比: 原来每次判断都要加一次读锁
+  ddg::RWMutex mutex;
+  start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kLoops; ++i) {
+    ddg::RWMutex::ReadLock lock(mutex);
+  }
+  uint64_t rwlock = ddg::GetCurrentMicroSecond() - start;
+  DDG_LOG_INFO(g_logger) << "disabled DEBUG: "
+                         << disabled * 1000.0 / kLoops << "ns/op, rwlock: "
+                         << rwlock * 1000.0 / kLoops << "ns/op";
+
+  // 其他线程在打日志的时候修改级别
+  std::atomic<bool> stop{false};
+  ddg::Thread writer("level_log", [logger, &stop]() {
+    while (!stop) {
+      DDG_LOG_DEBUG(logger) << "debug";
+    }
+  });
+  for (int i = 0; i < 1000; ++i) {
+    logger->setLevel(i % 2 ? ddg::LogLevel::DEBUG : ddg::LogLevel::INFO);
+  }
+  logger->setLevel(ddg::LogLevel::INFO);
+  stop = true;
+  writer.join();
+  DDG_LOG_REMOVE("level");
+}
+
+static std::string Strftime(const char* fmt, time_t t) {
+  struct tm tm;
+  localtime_r(&t, &tm);
+  char buf[64];
+  return std::string(buf, strftime(buf, sizeof(buf), fmt, &tm));
+}
+
+// 时间格式: 秒以下的部分, 缓存在秒变化/不同的格式之间切换时要更新, %r
+static void test_datetime() {
+  ddg::LogFormatter::ptr fmt1(new ddg::LogFormatter(
+      "%d{%Y-%m-%d %H:%M:%S.%3N}|%d{%6N}|%d{%N}|%d{%%N %S}|%r|%r{us}"));
+  ddg::LogFormatter::ptr fmt2(new ddg::LogFormatter("%d{%H:%M:%S}"));
+  ddg::LogEvent::ptr event(new ddg::LogEvent(
+      g_logger, ddg::LogLevel::INFO, __FILE__, __LINE__, 1234567, 0, 0,
+      1700000000, 5006007));
+  std::string expect = Strftime("%Y-%m-%d %H:%M:%S", 1700000000) +
+                       ".005|005006|005006007|%N " +
+                       Strftime("%S", 1700000000) + "|1234|1234567";
+  DDG_ASSERT(fmt1->format(g_logger, ddg::LogLevel::INFO, event) == expect);
+  DDG_ASSERT(fmt2->format(g_logger, ddg::LogLevel::INFO, event) ==
+             Strftime("%H:%M:%S", 1700000000));
+
+  ddg::LogEvent::ptr next(new ddg::LogEvent(g_logger, ddg::LogLevel::INFO,
+                                            __FILE__, __LINE__, 0, 0, 0,
+                                            1700000001, 999999999));
+  DDG_ASSERT(fmt2->format(g_logger, ddg::LogLevel::INFO, next) ==
+             Strftime("%H:%M:%S", 1700000001));
+  DDG_ASSERT(fmt1->format(g_logger, ddg::LogLevel::INFO, event) == expect);
+
+  // 宏打的日志带上了当前时间和elapse
+  MemoryLogAppender::ptr mem(new MemoryLogAppender);
+  ddg::Logger::ptr logger = NewLogger("datetime", mem);
+  mem->setFormatter(std::make_shared<ddg::LogFormatter>("%d{%s.%6N} %r{us}%n"));
+  uint64_t before = ddg::GetCurrentMicroSecond();
+  DDG_LOG_INFO(logger) << "now";
+  uint64_t after = ddg::GetCurrentMicroSecond();
+  unsigned long long sec = 0;
+  unsigned long long usec = 0;
+  unsigned long long elapse = 0;
+  DDG_ASSERT(sscanf(mem->lines()[0].c_str(), "%llu.%llu %llu", &sec, &usec,
+                    &elapse) == 3);
+  DDG_ASSERT(sec * 1000000 + usec >= before && sec * 1000000 + usec <= after);
+  DDG_ASSERT(elapse > 0);
+  DDG_LOG_REMOVE("datetime");
+
+  // 同一秒内的日志, 对比每条都localtime_r + strftime.
+  // 减掉只有%T时LogFormatter本身的开销
+  const int kLoops = 1000 * 1000;
+  ddg::LogStream os(256);
+  uint64_t used[2];
+  const char* patterns[] = {"%T", "%d{%Y-%m-%d %H:%M:%S}"};
+  for (int i = 0; i < 2; ++i) {
+    ddg::LogFormatter::ptr fmt(new ddg::LogFormatter(patterns[i]));
+    uint64_t start = ddg::GetCurrentMicroSecond();
+    for (int j = 0; j < kLoops; ++j) {
+      os.reset();
+      fmt->format(os, g_logger, ddg::LogLevel::INFO, event);
+    }
+    used[i] = ddg::GetCurrentMicroSecond() - start;
+  }
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kLoops; ++i) {
+    os.reset();
+    struct tm tm;
+    time_t t = event->getTime();
+    localtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    os << buf;
+  }
+  uint64_t uncached = ddg::GetCurrentMicroSecond() - start;
+  DDG_LOG_INFO(g_logger) << "datetime: cached "
+                         << (used[1] - used[0]) * 1000.0 / kLoops
+                         << "ns/op, strftime " << uncached * 1000.0 / kLoops
+                         << "ns/op";
+}
+
+// logs配置里appender加上async
+static void test_async_config() {
+  YAML::Node root = YAML::Load(R"(
+logs:
+  - name: async_yaml
+    level: info
+    appenders:
+      - type: StdoutLogAppender
+        async: true
+        queue_size: 1000
+        overflow: drop_report
+)");
+  ddg::Config::LoadFromYaml(root);
+  ddg::Logger::ptr logger = DDG_LOG_NAME("async_yaml");
+  DDG_ASSERT(logger->getAppenders().size() == 1);
+  auto async = std::dynamic_pointer_cast<ddg::AsyncLogAppender>(
+      logger->getAppenders().front());
+  DDG_ASSERT(async);
+  DDG_ASSERT(async->getOverflow() == ddg::AsyncLogAppender::DROP_REPORT);
+  DDG_LOG_INFO(logger) << "hello from async stdout appender";
+  DDG_LOG_INFO(g_logger) << "async config:\n" << logger->toYamlString();
+}
+
+static std::vector<std::string> ListLogFiles(const std::string& prefix) {
+  std::vector<std::string> files;
+  DIR* d = opendir("/tmp");
+  while (dirent* e = readdir(d)) {
+    std::string name = std::string("/tmp/") + e->d_name;
+    if (name.compare(0, prefix.size(), prefix) == 0) {
+      files.push_back(name);
+    }
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// 按大小切分, 旧文件在后台压缩, 只保留最新的3个
+static void test_rolling() {
+  const std::string file = "/tmp/ddg_test_rolling.log";
+  // 备用文件: 同一目录下的隐藏文件
+  const std::string spare = "/tmp/.ddg_test_rolling.log.next.";
+  for (auto& f : ListLogFiles(file)) {
+    unlink(f.c_str());
+  }
+  for (auto& f : ListLogFiles(spare)) {
+    unlink(f.c_str());
+  }
+  ddg::FileLogAppender::RollOptions options;
+  options.max_size = 1000;
+  options.max_files = 3;
+  options.compress = true;
+  ddg::FileLogAppender::ptr appender(
+      new ddg::FileLogAppender(file, options));
+  ddg::Logger::ptr logger = NewLogger("rolling", appender);
+  // 每行50字节, 一个文件20行
+  for (int i = 0; i < 200; ++i) {
+    DDG_LOG_INFO(logger) << std::setw(49) << i;
+  }
+  appender->flush();
+  std::vector<std::string> files;
+  for (int i = 0; i < 100; ++i) {
+    files = ListLogFiles(file);
+    if (files.size() == 4 && files[1].find(".gz") != std::string::npos &&
+        files[3].find(".gz") != std::string::npos) {
+      break;
+    }
+    usleep(20 * 1000);
+  }
+  DDG_ASSERT(files.size() == 4 && files[0] == file);
+  struct stat st;
+  DDG_ASSERT(stat(file.c_str(), &st) == 0 && st.st_size == 1000);
+  // 留下的是最新的3个: 120~179, 当前文件是180~199
+  std::vector<int> numbers;
+  for (size_t i = 1; i < files.size(); ++i) {
+    gzFile gz = gzopen(files[i].c_str(), "rb");
+    DDG_ASSERT(gz);
+    char buf[64];
+    while (gzgets(gz, buf, sizeof(buf))) {
+      numbers.push_back(atoi(buf));
+    }
+    gzclose(gz);
+  }
+  std::sort(numbers.begin(), numbers.end());
+  DDG_ASSERT(numbers.size() == 60 && numbers.front() == 120 &&
+             numbers.back() == 179);
+
+  // 外部把文件移走(logrotate), 一秒之后的日志触发后台线程重新打开
+  std::string moved = file + ".moved";
+  DDG_ASSERT(rename(file.c_str(), moved.c_str()) == 0);
+  sleep(1);
+  DDG_LOG_INFO(logger) << "after move";
+  for (int i = 0; i < 100 && access(file.c_str(), F_OK) != 0; ++i) {
+    usleep(10 * 1000);
+  }
+  DDG_LOG_INFO(logger) << "reopened";
+  appender->flush();
+  std::ifstream ifs(file);
+  std::string line;
+  DDG_ASSERT(std::getline(ifs, line) && line == "reopened");
+  unlink(moved.c_str());
+
+  DDG_ASSERT(appender->roll());
+  DDG_ASSERT(!appender->roll());
+  DDG_LOG_INFO(g_logger) << "rolling: " << files.size() - 1
+                         << " compressed segments kept";
+  DDG_LOG_REMOVE("rolling");
+  appender.reset();
+  logger.reset();
+  // 备用文件随着appender删掉, 后台任务可能还短暂持有它
+  for (int i = 0; i < 100 && !ListLogFiles(spare).empty(); ++i) {
+    usleep(10 * 1000);
+  }
+  DDG_ASSERT(ListLogFiles(spare).empty());
+  for (auto& f : ListLogFiles(file)) {
+    unlink(f.c_str());
+  }
+}
+
+static void test_rolling_config() {
+  YAML::Node root = YAML::Load(R"(
+logs:
+  - name: rolling_yaml
+    level: info
+    appenders:
+      - type: FileLogAppender
+        file: /tmp/ddg_test_rolling_yaml.log
+        max_size: 64M
+        rollover: hourly
+        max_files: 24
+        compress: true
+)");
+  ddg::Config::LoadFromYaml(root);
+  ddg::Logger::ptr logger = DDG_LOG_NAME("rolling_yaml");
+  DDG_ASSERT(logger->getAppenders().size() == 1);
+  auto appender = std::dynamic_pointer_cast<ddg::FileLogAppender>(
+      logger->getAppenders().front());
+  DDG_ASSERT(appender);
+  const ddg::FileLogAppender::RollOptions& options =
+      appender->getRollOptions();
+  DDG_ASSERT(options.max_size == 64 * 1024 * 1024);
+  DDG_ASSERT(options.rollover == ddg::FileLogAppender::HOURLY);
+  DDG_ASSERT(options.max_files == 24 && options.compress);
+  DDG_LOG_INFO(g_logger) << "rolling config:\n" << logger->toYamlString();
+  unlink("/tmp/ddg_test_rolling_yaml.log");
+}
+
+static std::vector<std::string> ReadLines(const std::string& file) {
+  std::vector<std::string> lines;
+  std::ifstream ifs(file);
+  std::string line;
+  while (std::getline(ifs, line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// 小chunk, 多个线程同时写, 频繁换映射
+static void test_mmap() {
+  const std::string file = "/tmp/ddg_test_mmap.log";
+  unlink(file.c_str());
+  const int kThreads = 4;
+  const int kLines = 20000;
+  {
+    ddg::MmapFileLogAppender::ptr appender(
+        new ddg::MmapFileLogAppender(file, 16 * 1024));
+    DDG_ASSERT(appender->isOpen());
+    ddg::Logger::ptr logger = NewLogger("mmap", appender);
+    uint64_t start = ddg::GetCurrentMicroSecond();
+    std::vector<std::shared_ptr<ddg::Thread>> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back(new ddg::Thread("mmap_" + std::to_string(t),
+                                           [logger, t]() {
+        for (int i = 0; i < kLines; ++i) {
+          DDG_LOG_INFO(logger) << t << " " << i;
+        }
+      }));
+    }
+    for (auto& t : threads) {
+      t->join();
+    }
+    DDG_LOG_INFO(g_logger) << "mmap: " << kThreads * kLines << " lines in "
+                           << (ddg::GetCurrentMicroSecond() - start) / 1000
+                           << "ms";
+    DDG_LOG_REMOVE("mmap");
+  }
+  std::vector<std::string> lines = ReadLines(file);
+  DDG_ASSERT(lines.size() == kThreads * kLines);
+  std::vector<int> next(kThreads, 0);
+  for (auto& line : lines) {
+    int t = 0;
+    int i = 0;
+    DDG_ASSERT(sscanf(line.c_str(), "%d %d", &t, &i) == 2);
+    DDG_ASSERT(next[t] == i);
+    ++next[t];
+  }
+
+  struct stat st;
+  DDG_ASSERT(stat(file.c_str(), &st) == 0);
+  off_t size = st.st_size;
+
+  // 子进程写完不析构直接退出, 文件末尾留着预分配的'\0'
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid == 0) {
+    ddg::MmapFileLogAppender* appender = new ddg::MmapFileLogAppender(file);
+    appender->write("crash\n", 6);
+    _exit(0);
+  }
+  int status = 0;
+  DDG_ASSERT(waitpid(pid, &status, 0) == pid);
+  {
+    ddg::MmapFileLogAppender appender(file);
+    // 接着子进程写的数据, 跳过预分配的部分
+    DDG_ASSERT(appender.getOffset() == static_cast<uint64_t>(size + 6));
+    appender.write("reopen\n", 7);
+  }
+  lines = ReadLines(file);
+  DDG_ASSERT(lines.size() == kThreads * kLines + 2);
+  DDG_ASSERT(lines[lines.size() - 2] == "crash");
+  DDG_ASSERT(lines.back() == "reopen");
+  unlink(file.c_str());
+
+  YAML::Node root = YAML::Load(R"(
+logs:
+  - name: mmap_yaml
+    appenders:
+      - type: MmapFileLogAppender
+        file: /tmp/ddg_test_mmap_yaml.log
+)");
+  ddg::Config::LoadFromYaml(root);
+  ddg::Logger::ptr logger = DDG_LOG_NAME("mmap_yaml");
+  DDG_ASSERT(logger->getAppenders().size() == 1);
+  DDG_ASSERT(std::dynamic_pointer_cast<ddg::MmapFileLogAppender>(
+      logger->getAppenders().front()));
+  DDG_LOG_INFO(g_logger) << "mmap config:\n" << logger->toYamlString();
+  unlink("/tmp/ddg_test_mmap_yaml.log");
+}
+
+using FormatItems = std::vector<ddg::LogFormatter::FormatItem::ptr>;
+
+// 原来的实现: 每行加读锁, 每个item一次虚函数调用, 参数按值传递
+static void FormatByItems(std::ostream& os, ddg::RWMutex& mutex,
+                          FormatItems& items, ddg::Logger::ptr logger,
+                          ddg::LogLevel::Level level,
+                          ddg::LogEvent::ptr event) {
+  ddg::RWMutex::ReadLock lock(mutex);
+  for (auto& i : items) {
+    i->format(os, logger, level, event);
+  }
+}
+
+// 编译后的formatter和原来逐个item输出的结果一样, 并比较两者的速度
+static void test_formatter() {
+  ddg::Logger::ptr logger = DDG_LOG_NAME("formatter");
+  ddg::LogEvent::ptr event(new ddg::LogEvent(logger, ddg::LogLevel::WARN,
+                                             __FILE__, __LINE__, 1234567,
+                                             4321, 99, time(0), 123456789));
+  event->getSS() << "hello formatter";
+  const char* patterns[] = {
+      "%d{%Y-%m-%d %H:%M:%S}%T%t%T%F%T[%p]%T<%f:%l>%T%m%n",
+      "%d{%H:%M:%S.%3N} %r %r{us} [%c] %N/%F %%%p%% %m",
+      "plain text only",
+      "%m%n",
+  };
+  ddg::RWMutex mutex;
+  for (auto pattern : patterns) {
+    ddg::LogFormatter::ptr formatter(new ddg::LogFormatter(pattern));
+    FormatItems items;
+    DDG_ASSERT(ddg::LogFormatter::initPattern(pattern, items));
+    std::stringstream old_ss;
+    FormatByItems(old_ss, mutex, items, logger, event->getLevel(), event);
+    std::string str = formatter->format(logger, event->getLevel(), event);
+    DDG_ASSERT(str == old_ss.str());
+  }
+  ddg::LogFormatter::ptr formatter(new ddg::LogFormatter("%m"));
+  formatter->setPattern("[%p] %m");
+  DDG_ASSERT(formatter->getPattern() == "[%p] %m");
+  DDG_ASSERT(formatter->format(logger, event->getLevel(), event) ==
+             "[WARN] hello formatter");
+
+  // 其他线程在格式化的时候反复修改pattern, 换下来的在读完之后释放
+  std::atomic<bool> stop{false};
+  ddg::Thread reader("format_log", [formatter, logger, event, &stop]() {
+    while (!stop) {
+      std::string str = formatter->format(logger, event->getLevel(), event);
+      DDG_ASSERT(str == "[WARN] hello formatter" || str == "hello formatter");
+    }
+  });
+  for (int i = 0; i < 10000; ++i) {
+    formatter->setPattern(i % 2 ? "[%p] %m" : "%m");
+  }
+  stop = true;
+  reader.join();
+
+  const int kCount = 1000000;
+  ddg::LogStream os(4096);
+  FormatItems items;
+  ddg::LogFormatter::initPattern(patterns[0], items);
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kCount; ++i) {
+    os.reset();
+    FormatByItems(os, mutex, items, logger, event->getLevel(), event);
+  }
+  uint64_t old_us = ddg::GetCurrentMicroSecond() - start;
+  formatter.reset(new ddg::LogFormatter(patterns[0]));
+  start = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < kCount; ++i) {
+    os.reset();
+    formatter->format(os, logger, event->getLevel(), event);
+  }
+  uint64_t new_us = ddg::GetCurrentMicroSecond() - start;
+  DDG_LOG_INFO(g_logger) << "formatter: items " << old_us * 1000 / kCount
+                         << "ns/line, compiled " << new_us * 1000 / kCount
+                         << "ns/line";
+}
+
+// 键值对: 文本格式的%K和json格式
+static void test_kv() {
+  MemoryLogAppender::ptr appender(new MemoryLogAppender);
+  ddg::Logger::ptr logger = NewLogger("kv", appender);
+  std::string name = "a \"b\"\n";
+  DDG_LOG_WARN(logger)
+      .kv("fd", 3)
+      .kv("bytes", 1024u)
+      .kv("ratio", 0.1)
+      .kv("big", -1e20)
+      .kv("ok", false)
+      .kv("user", "bob")
+      .kv(std::string("name"), name)
+      << "recv " << std::hex << 255;
+  DDG_LOG_INFO(logger) << "no fields";
+
+  appender->setFormatter(std::make_shared<ddg::LogFormatter>("%m%K%n"));
+  DDG_LOG_INFO(logger).kv("fd", 3).kv("user", "bob").kv("name", name)
+      << "text";
+  appender->setFormatter(std::make_shared<ddg::LogFormatter>("json{%H}"));
+  DDG_LOG_INFO(logger).kv("fd", 3) << "custom time";
+
+  std::vector<std::string> lines = appender->lines();
+  DDG_ASSERT(lines.size() == 4);
+  DDG_ASSERT(lines[0] == "recv ff");
+  DDG_ASSERT(lines[1] == "no fields");
+  DDG_ASSERT(lines[2] == "text fd=3 user=bob name=\"a \\\"b\\\"\\n\"");
+  DDG_ASSERT(lines[3].find("{\"time\":\"") == 0);
+  DDG_ASSERT(lines[3].find("\",\"level\":\"INFO\",\"logger\":\"kv\",") !=
+             std::string::npos);
+  DDG_ASSERT(lines[3].find(",\"msg\":\"custom time\",\"fd\":3}") !=
+             std::string::npos);
+
+  appender->setFormatter(std::make_shared<ddg::LogFormatter>("json"));
+  DDG_LOG_WARN(logger)
+      .kv("fd", 3)
+      .kv("bytes", 1024u)
+      .kv("ratio", 0.1)
+      .kv("big", -1e20)
+      .kv("huge", 1e300)
+      .kv("nan", 0.0 / 0.0)
+      .kv("ok", false)
+      .kv("user", "bob")
+      .kv(std::string("name"), name)
+      << "recv \x01\t" << std::hex << 255;
+  lines = appender->lines();
+  const std::string& json = lines.back();
+  DDG_LOG_INFO(g_logger) << json;
+  DDG_ASSERT(json.find("\"level\":\"WARN\"") != std::string::npos);
+  DDG_ASSERT(json.find(",\"line\":") != std::string::npos);
+  const char* tail =
+      ",\"msg\":\"recv \\u0001\\tff\",\"fd\":3,\"bytes\":1024,"
+      "\"ratio\":0.1,\"big\":-1e+20,\"huge\":1e+300,\"nan\":null,"
+      "\"ok\":false,\"user\":\"bob\",\"name\":\"a \\\"b\\\"\\n\"}";
+  DDG_ASSERT(json.size() > strlen(tail));
+  DDG_ASSERT(json.compare(json.size() - strlen(tail), strlen(tail), tail) == 0);
+
+  // json的时间格式里不能有引号
+  DDG_ASSERT(ddg::LogFormatter::checkValid("json{%H}"));
+  DDG_ASSERT(!ddg::LogFormatter::checkValid("json{%H\"}"));
+  DDG_LOG_REMOVE("kv");
+}
+
+// 从"suppressed N log lines ..."里取出N, 不是汇总行返回-1
+static int SuppressedCount(const std::string& line) {
+  int n = -1;
+  sscanf(line.c_str(), "suppressed %d log lines", &n);
+  return n;
+}
+
+static void LogStorm(ddg::Logger::ptr logger, int n) {
+  for (int i = 0; i < n; ++i) {
+    DDG_LOG_ERROR(logger) << "epoll_ctl failed " << i;
+  }
+}
+
+// 汇总线程一直在输出的时候退出进程, 它要在静态变量析构前停下
+static void test_limit_exit() {
+  for (int i = 0; i < 20; ++i) {
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+      YAML::Node root = YAML::Load("log:\n  limit_report_interval: 1");
+      ddg::Config::LoadFromYaml(root);
+      ddg::Logger::ptr logger = NewLogger(
+          "limit_exit", std::make_shared<ddg::FileLogAppender>("/dev/null"));
+      ddg::LogLimit limit;
+      limit.rate = 1;
+      logger->setLimit(limit);
+      LogStorm(logger, 10000);
+      usleep(i * 100);
+      exit(0);
+    }
+    int status = 0;
+    DDG_ASSERT(waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+               WEXITSTATUS(status) == 0);
+  }
+}
+
+// 每个调用点单独限速, 丢掉的条数汇总输出; 按概率抽样
+static void test_limit() {
+  // 汇总由测试自己调用, 后台线程不要插进来
+  YAML::Node root = YAML::Load("log:\n  limit_report_interval: 3600000");
+  ddg::Config::LoadFromYaml(root);
+
+  const int kStorm = 1000;
+  MemoryLogAppender::ptr appender(new MemoryLogAppender);
+  ddg::Logger::ptr logger = NewLogger("limit", appender);
+  ddg::LogLimit limit;
+  limit.rate = 10;
+  DDG_ASSERT(!logger->isLimited());
+  logger->setLimit(limit);
+  DDG_ASSERT(logger->isLimited());
+  LogStorm(logger, kStorm);
+  // 另一个调用点有自己的令牌桶
+  for (int i = 0; i < 5; ++i) {
+    DDG_LOG_WARN(logger) << "other site";
+  }
+  DDG_LOG_FATAL(logger) << "fatal is never limited";
+  std::vector<std::string> lines = appender->lines();
+  int storm = std::count_if(lines.begin(), lines.end(),
+                            [](const std::string& line) {
+                              return line.find("epoll_ctl") == 0;
+                            });
+  // 循环期间最多补充一两个令牌
+  DDG_ASSERT(storm >= 10 && storm <= 12);
+  DDG_ASSERT(std::count(lines.begin(), lines.end(), "other site") == 5);
+  DDG_ASSERT(lines.back() == "fatal is never limited");
+
+  ddg::LogSite::ReportSuppressed();
+  lines = appender->lines();
+  DDG_ASSERT(SuppressedCount(lines.back()) == kStorm - storm);
+  // 没有新丢的就不再输出
+  size_t size = lines.size();
+  ddg::LogSite::ReportSuppressed();
+  DDG_ASSERT(appender->lines().size() == size);
+
+  // 只抽样
+  const int kSampled = 100000;
+  limit.rate = 0;
+  limit.sample = 0.1;
+  logger->setLimit(limit);
+  LogStorm(logger, kSampled);
+  lines = appender->lines();
+  int kept = lines.size() - size;
+  DDG_ASSERT(kept > kSampled / 10 * 0.9 && kept < kSampled / 10 * 1.1);
+  ddg::LogSite::ReportSuppressed();
+  DDG_ASSERT(SuppressedCount(appender->lines().back()) == kSampled - kept);
+
+  // 去掉限制后全部输出
+  logger->setLimit(ddg::LogLimit());
+  DDG_ASSERT(!logger->isLimited());
+  size = appender->lines().size();
+  LogStorm(logger, kStorm);
+  DDG_ASSERT(appender->lines().size() == size + kStorm);
+  DDG_LOG_INFO(g_logger) << "limit: storm kept " << storm << ", sampled kept "
+                         << kept << "/" << kSampled;
+  DDG_LOG_REMOVE("limit");
+
+  root = YAML::Load(R"(
+logs:
+  - name: limit_yaml
+    rate_limit: 100
+    burst: 200
+    sample: 0.5
+)");
+  ddg::Config::LoadFromYaml(root);
+  logger = DDG_LOG_NAME("limit_yaml");
+  DDG_ASSERT(logger->isLimited());
+  DDG_ASSERT(logger->getLimit().rate == 100);
+  DDG_ASSERT(logger->getLimit().burst == 200);
+  DDG_ASSERT(logger->getLimit().sample == 0.5);
+  DDG_LOG_INFO(g_logger) << "limit config:\n" << logger->toYamlString();
+  DDG_ASSERT(logger->toYamlString().find("rate_limit: 100") !=
+             std::string::npos);
+}
+
+int main(int argc, char** argv) {
+  test_event_reuse();
+  test_event_fiber();
+  test_no_alloc();
+  test_level();
+  test_datetime();
+  test_formatter();
+  test_kv();
+  test_limit_exit();
+  test_limit();
+  test_async_block();
+  test_async_drop();
+  test_async_exit();
+  test_async_config();
+  test_rolling();
+  test_rolling_config();
+  test_mmap();
+  DDG_LOG_INFO(g_logger) << "log ok";
+  return 0;
+}
@@ -0,0 +1,178 @@
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <set>
+#include <string>
+
+#include "ddg/config.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/master.h"
+#include "ddg/tcpserver.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+static const uint16_t kPort = 18097;
+static const char* kConfig = "/tmp/ddg_test_master.yaml";
+static const char* kLogFile = "/tmp/ddg_test_master.log";
+static const int kWorkerLines = 100;
+
+extern char** environ;
+
+static ddg::ConfigVar<std::string>::ptr g_greeting =
+    ddg::Config::Lookup<std::string>("test_master.greeting", "hello",
+                                     "greeting");
+
+static ddg::Address::ptr ServerAddress() {
+  return ddg::IPv4Address::Create("127.0.0.1", kPort);
+}
+
+// 回复"greeting pid", 可以看出是哪个worker, 以及配置有没有重新加载
+class PidServer : public ddg::TcpServer {
+ protected:
+  void handleClient(ddg::Socket::ptr client) override {
+    char buf[256];
+    if (client->recv(buf, sizeof(buf)) > 0) {
+      std::string rsp =
+          g_greeting->getValue() + " " + std::to_string(getpid());
+      client->send(rsp.c_str(), rsp.size());
+    }
+  }
+};
+
+static int WorkerMain(int index) {
+  // 异步appender的队列比这些日志短, 后台线程必须在worker里
+  ddg::Logger::ptr logger = DDG_LOG_NAME("test_master.worker");
+  for (int i = 0; i < kWorkerLines; ++i) {
+    DDG_LOG_INFO(logger) << "worker " << getpid() << " line " << i;
+  }
+  ddg::IOManager iom(1, false, "worker_" + std::to_string(index));
+  iom.start();
+  iom.schedule([&iom]() {
+    ddg::TcpServer::ptr server(new PidServer);
+    DDG_ASSERT(server->bind(ServerAddress()));
+    server->start();
+    ddg::Master::WatchSignals(&iom, [server]() { server->stop(); });
+  });
+  iom.stop();
+  return 0;
+}
+
+static void WriteConfig(int workers, const std::string& greeting) {
+  std::ofstream ofs(kConfig);
+  ofs << "master:\n"
+      << "  worker_processes: " << workers << "\n"
+      << "  restart_delay: 200\n"
+      << "  stop_timeout: 3000\n"
+      << "test_master:\n"
+      << "  greeting: " << greeting << "\n"
+      << "logs:\n"
+      << "  - name: test_master.worker\n"
+      << "    level: info\n"
+      << "    appenders:\n"
+      << "      - type: FileLogAppender\n"
+      << "        file: " << kLogFile << "\n"
+      << "        async: true\n"
+      << "        queue_size: 16\n";
+}
+
+// 阻塞地请求一次, 返回"greeting pid"
+static std::string Request() {
+  for (int i = 0; i < 50; ++i) {
+    ddg::Socket::ptr sock = ddg::Socket::CreateTCP(ServerAddress());
+    char buf[256];
+    if (sock->connect(ServerAddress()) && sock->send("x", 1) == 1) {
+      int rt = sock->recv(buf, sizeof(buf));
+      if (rt > 0) {
+        return std::string(buf, rt);
+      }
+    }
+    usleep(20 * 1000);
+  }
+  return "";
+}
+
+// 多次请求, 收集回复了指定greeting的不同进程
+static std::set<std::string> Collect(const std::string& greeting, int n) {
+  std::set<std::string> pids;
+  for (int i = 0; i < n; ++i) {
+    std::string rsp = Request();
+    size_t pos = rsp.find(' ');
+    DDG_ASSERT(pos != std::string::npos);
+    if (rsp.substr(0, pos) == greeting) {
+      pids.insert(rsp.substr(pos + 1));
+    }
+  }
+  return pids;
+}
+
+static void run_test() {
+  unlink(kLogFile);
+  WriteConfig(2, "hello");
+  char exe[256] = {0};
+  DDG_ASSERT(readlink("/proc/self/exe", exe, sizeof(exe) - 1) > 0);
+  char* argv[] = {exe, const_cast<char*>("master"), nullptr};
+  pid_t master = 0;
+  DDG_ASSERT(posix_spawn(&master, exe, nullptr, nullptr, argv, environ) == 0);
+  usleep(300 * 1000);
+
+  // 连接由内核在两个worker之间分配
+  std::set<std::string> pids = Collect("hello", 200);
+  DDG_LOG_INFO(g_logger) << "workers = " << pids.size();
+  DDG_ASSERT(pids.size() == 2);
+
+  // 杀掉一个worker, master重新拉起一个新的
+  std::string dead = *pids.begin();
+  kill(atoi(dead.c_str()), SIGKILL);
+  usleep(500 * 1000);
+  std::set<std::string> after = Collect("hello", 200);
+  DDG_ASSERT(after.size() == 2 && !after.count(dead));
+  DDG_LOG_INFO(g_logger) << "worker " << dead << " restarted";
+
+  // 修改配置后SIGHUP, worker数增加到3, 原来的worker也用上了新配置
+  WriteConfig(3, "bonjour");
+  kill(master, SIGHUP);
+  usleep(500 * 1000);
+  std::set<std::string> reloaded = Collect("bonjour", 300);
+  DDG_ASSERT(reloaded.size() == 3);
+  for (auto& pid : after) {
+    DDG_ASSERT(reloaded.count(pid));
+  }
+  DDG_LOG_INFO(g_logger) << "reload ok, workers = " << reloaded.size();
+
+  kill(master, SIGTERM);
+  int status = 0;
+  DDG_ASSERT(waitpid(master, &status, 0) == master);
+  DDG_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  for (auto& pid : reloaded) {
+    DDG_ASSERT(kill(atoi(pid.c_str()), 0) != 0);
+  }
+  // 每个启动过的worker都写完了自己的日志: 2个, 重启的1个, 新增的1个
+  std::ifstream ifs(kLogFile);
+  std::string line;
+  int lines = 0;
+  while (std::getline(ifs, line)) {
+    ++lines;
+  }
+  DDG_LOG_INFO(g_logger) << "worker log lines = " << lines;
+  DDG_ASSERT(lines == 4 * kWorkerLines);
+  unlink(kLogFile);
+  unlink(kConfig);
+  DDG_LOG_INFO(g_logger) << "master/worker ok";
+}
+
+// 用法: test_master, 参数master由测试自己启动子进程时使用
+int main(int argc, char** argv) {
+  g_logger->setLevel(ddg::LogLevel::INFO);
+  DDG_LOG_NAME("system")->setLevel(ddg::LogLevel::INFO);
+  if (argc > 1 && std::string(argv[1]) == "master") {
+    ddg::Master master(kConfig, WorkerMain);
+    return master.run();
+  }
+  run_test();
+  return 0;
+}
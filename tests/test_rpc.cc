@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/rpc/rpcconnection.h"
+#include "ddg/rpc/rpcserver.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+using namespace ddg::rpc;
+
+static const uint16_t kPort = 18094;
+
+struct AddRequest {
+  int64_t a = 0;
+  int64_t b = 0;
+  DDG_SERIALIZE(DDG_FIELD(1, a) DDG_FIELD(2, b))
+};
+
+struct AddResponse {
+  int64_t sum = 0;
+  DDG_SERIALIZE(DDG_FIELD(1, sum))
+};
+
+static ddg::Address::ptr ServerAddress() {
+  return ddg::IPv4Address::Create("127.0.0.1", kPort);
+}
+
+static RpcServer::ptr StartServer() {
+  RpcServer::ptr server(new RpcServer);
+  server->registerMethod(
+      "echo", [](const std::string& req, std::string& rsp) {
+        rsp = req;
+        return 0;
+      });
+  // body是要睡的毫秒数
+  server->registerMethod(
+      "sleep", [](const std::string& req, std::string& rsp) {
+        usleep(atoi(req.c_str()) * 1000);
+        rsp = "awake";
+        return 0;
+      });
+  server->registerMethod(
+      "fail", [](const std::string& req, std::string& rsp) {
+        rsp = "bad request";
+        return -1;
+      });
+  server->registerMethod<AddRequest, AddResponse>(
+      "add", [](const AddRequest& req, AddResponse& rsp) {
+        rsp.sum = req.a + req.b;
+        return 0;
+      });
+  DDG_ASSERT(server->bind(ServerAddress()));
+  server->start();
+  return server;
+}
+
+static void test_call() {
+  RpcConnection::ptr conn = RpcConnection::Connect(ServerAddress(), 1000);
+  DDG_ASSERT(conn);
+
+  RpcResult::ptr r = conn->call("echo", "hello", 1000);
+  DDG_ASSERT(r->isOk() && r->body == "hello");
+  r = conn->call("nothing", "", 1000);
+  DDG_ASSERT(r->status == RpcStatus::METHOD_NOT_FOUND);
+  // 方法名超过一个字节能表示的长度, 不发送也不断开连接
+  r = conn->call(std::string(256, 'm'), "", 1000);
+  DDG_ASSERT(r->status == RpcStatus::INVALID_ARGUMENT);
+  r = conn->call("fail", "", 1000);
+  DDG_ASSERT(r->status == RpcStatus::HANDLER_ERROR && r->body == "bad request");
+  r = conn->call("sleep", "200", 50);
+  DDG_ASSERT(r->status == RpcStatus::TIMEOUT);
+
+  AddRequest add;
+  add.a = 40;
+  add.b = -2;
+  AddResponse sum;
+  DDG_ASSERT(conn->call("add", add, sum, 1000) == RpcStatus::OK);
+  DDG_ASSERT(sum.sum == 38);
+
+  std::string big(1024 * 1024, 'x');
+  r = conn->call("echo", big, 1000);
+  DDG_ASSERT(r->isOk() && r->body == big);
+
+  // 多个协程共用一个连接, 响应按seq交给各自的调用
+  const int kCalls = 200;
+  std::atomic<int> finished(0);
+  ddg::IOManager* iom = ddg::IOManager::GetThis();
+  for (int i = 0; i < kCalls; ++i) {
+    iom->schedule([conn, i, &finished]() {
+      std::string req = "req-" + std::to_string(i);
+      RpcResult::ptr r = conn->call("echo", req, 1000);
+      DDG_ASSERT(r->isOk() && r->body == req);
+      ++finished;
+    });
+  }
+  while (finished < kCalls) {
+    usleep(1000);
+  }
+
+  // 慢调用不会挡住后面的调用
+  std::atomic<bool> slow_done(false);
+  iom->schedule([conn, &slow_done]() {
+    RpcResult::ptr r = conn->call("sleep", "100", 1000);
+    DDG_ASSERT(r->isOk() && r->body == "awake");
+    slow_done = true;
+  });
+  usleep(10 * 1000);
+  r = conn->call("echo", "fast", 1000);
+  DDG_ASSERT(r->isOk() && !slow_done);
+  while (!slow_done) {
+    usleep(1000);
+  }
+
+  // 断开时等待中的调用返回CONNECTION_CLOSED
+  std::atomic<bool> closed(false);
+  iom->schedule([conn, &closed]() {
+    RpcResult::ptr r = conn->call("sleep", "1000", 0);
+    DDG_ASSERT(r->status == RpcStatus::CONNECTION_CLOSED);
+    closed = true;
+  });
+  usleep(10 * 1000);
+  DDG_ASSERT(conn->getInflight() == 1);
+  conn->shutdown();
+  while (!closed) {
+    usleep(1000);
+  }
+  DDG_ASSERT(conn->call("echo", "", 1000)->status ==
+             RpcStatus::CONNECTION_CLOSED);
+  DDG_LOG_INFO(g_logger) << "rpc call ok";
+}
+
+// 对端不读, 请求卡在发送里时超时: 超时不能把挂在写事件上的协程唤醒,
+// 对端开始读之后发送完成, 连接还能继续用
+static void test_send_timeout() {
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort + 1);
+  ddg::Socket::ptr listener = ddg::Socket::CreateTCP(addr);
+  DDG_ASSERT(listener->bind(addr) && listener->listen());
+  RpcConnection::ptr conn = RpcConnection::Connect(addr, 1000);
+  DDG_ASSERT(conn);
+  ddg::Socket::ptr peer = listener->accept();
+  DDG_ASSERT(peer);
+
+  const size_t kBody = 32 * 1024 * 1024;
+  std::atomic<size_t> received(0);
+  ddg::IOManager::GetThis()->schedule([peer, &received]() {
+    usleep(200 * 1000);
+    std::vector<char> buf(64 * 1024);
+    while (true) {
+      int n = peer->recv(&buf[0], buf.size());
+      if (n <= 0) {
+        break;
+      }
+      received += n;
+    }
+  });
+
+  uint64_t start = ddg::GetCurrentMilliSecond();
+  RpcResult::ptr r = conn->call("echo", std::string(kBody, 'x'), 50);
+  uint64_t used = ddg::GetCurrentMilliSecond() - start;
+  DDG_ASSERT(r->status == RpcStatus::TIMEOUT && used >= 150);
+  // 对端不回响应, 还是超时, 而不是发送失败
+  r = conn->call("echo", "again", 50);
+  DDG_ASSERT(r->status == RpcStatus::TIMEOUT);
+  DDG_ASSERT(received >= kBody);
+  conn->shutdown();
+  peer->close();
+  DDG_LOG_INFO(g_logger) << "rpc send timeout ok, used = " << used << "ms";
+}
+
+static std::atomic<bool> s_stop{false};
+static std::atomic<uint64_t> s_calls{0};
+static std::atomic<int> s_finished{0};
+
+static void bench_caller(RpcConnection::ptr conn) {
+  std::string req(32, 'a');
+  uint64_t calls = 0;
+  while (!s_stop) {
+    RpcResult::ptr r = conn->call("echo", req, 3000);
+    if (!r->isOk()) {
+      DDG_LOG_ERROR(g_logger) << "bench call fail " << r->toString();
+      break;
+    }
+    ++calls;
+  }
+  s_calls += calls;
+  ++s_finished;
+}
+
+// conns个连接, 每个连接上concurrency个协程不停地调用
+static void bench(int conns, int concurrency, int seconds) {
+  s_stop = false;
+  s_calls = 0;
+  s_finished = 0;
+  std::vector<RpcConnection::ptr> connections;
+  for (int i = 0; i < conns; ++i) {
+    RpcConnection::ptr conn = RpcConnection::Connect(ServerAddress(), 1000);
+    DDG_ASSERT(conn);
+    connections.push_back(conn);
+  }
+
+  ddg::IOManager* iom = ddg::IOManager::GetThis();
+  uint64_t start = ddg::GetCurrentMilliSecond();
+  for (auto& conn : connections) {
+    for (int i = 0; i < concurrency; ++i) {
+      iom->schedule(std::bind(bench_caller, conn));
+    }
+  }
+  sleep(seconds);
+  s_stop = true;
+  while (s_finished < conns * concurrency) {
+    usleep(1000);
+  }
+  uint64_t used = ddg::GetCurrentMilliSecond() - start;
+  for (auto& conn : connections) {
+    conn->shutdown();
+  }
+  DDG_LOG_INFO(g_logger) << "bench conns = " << conns
+                         << " concurrency = " << concurrency
+                         << " calls = " << s_calls << " used = " << used
+                         << "ms " << (s_calls * 1000.0 / used) << " calls/s";
+}
+
+// 用法: test_rpc [连接数 每个连接的并发数]
+void run(int argc, char** argv) {
+  RpcServer::ptr server = StartServer();
+  test_call();
+  test_send_timeout();
+
+  int conns = argc > 1 ? atoi(argv[1]) : 4;
+  int concurrency = argc > 2 ? atoi(argv[2]) : 64;
+  bench(1, 1, 2);
+  bench(conns, concurrency, 3);
+  server->stop();
+}
+
+int main(int argc, char** argv) {
+  g_logger->setLevel(ddg::LogLevel::INFO);
+  DDG_LOG_NAME("system")->setLevel(ddg::LogLevel::INFO);
+  ddg::IOManager iom(2, false, "rpc");
+  iom.start();
+  iom.schedule(std::bind(run, argc, argv));
+  iom.stop();
+  return 0;
+}
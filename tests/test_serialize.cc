@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ddg/bytearray.h"
+#include "ddg/lexicalcast.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/serialize.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+enum class Color { RED = 0, GREEN = 1, BLUE = 2 };
+
+struct Point {
+  int32_t x = 0;
+  int32_t y = 0;
+  DDG_SERIALIZE(DDG_FIELD(1, x) DDG_FIELD(2, y))
+
+  bool operator==(const Point& o) const { return x == o.x && y == o.y; }
+};
+
+struct Shape {
+  uint64_t id = 0;
+  std::string name;
+  bool visible = false;
+  double scale = 0;
+  float alpha = 0;
+  Color color = Color::RED;
+  Point origin;
+  std::vector<int32_t> values;
+  std::vector<std::string> tags;
+  std::vector<Point> points;
+  std::map<std::string, int64_t> attrs;
+  DDG_SERIALIZE(DDG_FIELD(1, id) DDG_FIELD(2, name) DDG_FIELD(3, visible)
+                    DDG_FIELD(4, scale) DDG_FIELD(5, alpha)
+                    DDG_FIELD(6, color) DDG_FIELD(7, origin)
+                    DDG_FIELD(8, values) DDG_FIELD(9, tags)
+                    DDG_FIELD(10, points) DDG_FIELD(11, attrs))
+
+  bool operator==(const Shape& o) const {
+    return id == o.id && name == o.name && visible == o.visible &&
+           scale == o.scale && alpha == o.alpha && color == o.color &&
+           origin == o.origin && values == o.values && tags == o.tags &&
+           points == o.points && attrs == o.attrs;
+  }
+};
+
+// Shape的旧版本, 只认识一部分字段
+struct ShapeV1 {
+  uint64_t id = 0;
+  std::string name;
+  std::vector<Point> points;
+  DDG_SERIALIZE(DDG_FIELD(1, id) DDG_FIELD(2, name) DDG_FIELD(10, points))
+};
+
+// 递归的结构体, 解码的嵌套层数有上限
+struct Tree {
+  int32_t value = 0;
+  std::vector<Tree> children;
+  DDG_SERIALIZE(DDG_FIELD(1, value) DDG_FIELD(2, children))
+};
+
+static Tree MakeChain(int depth) {
+  Tree t;
+  t.value = depth;
+  if (depth > 1) {
+    t.children.push_back(MakeChain(depth - 1));
+  }
+  return t;
+}
+
+static Shape MakeShape() {
+  Shape s;
+  s.id = 1ull << 40;
+  s.name = "triangle";
+  s.visible = true;
+  s.scale = 1.5;
+  s.alpha = 0.25f;
+  s.color = Color::BLUE;
+  s.origin.x = -3;
+  s.origin.y = 7;
+  for (int i = -50; i < 50; ++i) {
+    s.values.push_back(i * 1000);
+  }
+  s.tags = {"a", "", "long tag long tag long tag"};
+  for (int i = 0; i < 3; ++i) {
+    Point p;
+    p.x = i;
+    p.y = -i;
+    s.points.push_back(p);
+  }
+  s.attrs["width"] = 100;
+  s.attrs["height"] = -200;
+  return s;
+}
+
+void test_roundtrip() {
+  Shape s = MakeShape();
+
+  // base_size很小, 字段会跨很多个内存块
+  ddg::ByteArray ba(7);
+  ddg::Serialize(ba, s);
+  DDG_ASSERT(ba.getSize() == ddg::SerializedSize(s));
+  Shape out;
+  DDG_ASSERT(ddg::Deserialize(ba, out));
+  DDG_ASSERT(out == s);
+  DDG_ASSERT(ba.getReadSize() == 0);
+
+  std::string str = ddg::SerializeToString(s);
+  ba.setPosition(0);
+  DDG_ASSERT(str == ba.toString());
+  Shape out2;
+  DDG_ASSERT(ddg::DeserializeFromString(str, out2) && out2 == s);
+
+  // 旧版本跳过不认识的字段
+  ShapeV1 v1;
+  DDG_ASSERT(ddg::DeserializeFromString(str, v1));
+  DDG_ASSERT(v1.id == s.id && v1.name == s.name && v1.points == s.points);
+
+  // 截断在字段中间, 以及长度超过剩余数据
+  DDG_ASSERT(
+      !ddg::DeserializeFromString(str.substr(0, str.size() - 1), out2));
+  DDG_ASSERT(
+      !ddg::DeserializeFromString(std::string("\x12\xff\x01" "ab"), out2));
+
+  Shape empty;
+  DDG_ASSERT(ddg::SerializeToString(empty).size() == 2);  // 只有origin
+
+  int max_depth = ddg::serialize_detail::kMaxMessageDepth;
+  Tree tree;
+  DDG_ASSERT(ddg::DeserializeFromString(
+      ddg::SerializeToString(MakeChain(max_depth)), tree));
+  DDG_ASSERT(tree.value == max_depth && tree.children.size() == 1);
+  DDG_ASSERT(!ddg::DeserializeFromString(
+      ddg::SerializeToString(MakeChain(max_depth + 1)), tree));
+  DDG_ASSERT(ddg::DeserializeFromString(
+      ddg::SerializeToString(MakeChain(3)), tree));
+  DDG_ASSERT(tree.value == 3 && tree.children[0].children.size() == 1);
+  DDG_LOG_INFO(g_logger) << "roundtrip ok, size = " << str.size();
+}
+
+struct Bench {
+  int32_t id = 0;
+  std::string name;
+  std::vector<int32_t> values;
+  std::map<std::string, int64_t> attrs;
+  DDG_SERIALIZE(DDG_FIELD(1, id) DDG_FIELD(2, name) DDG_FIELD(3, values)
+                    DDG_FIELD(4, attrs))
+};
+
+void bench(int n) {
+  Bench b;
+  b.id = 12345;
+  b.name = "bench message";
+  for (int i = 0; i < 16; ++i) {
+    b.values.push_back(i * 37);
+  }
+  b.attrs["a"] = 1;
+  b.attrs["b"] = 2;
+  b.attrs["c"] = 3;
+
+  uint64_t ts = ddg::GetCurrentMicroSecond();
+  ddg::ByteArray ba;
+  for (int i = 0; i < n; ++i) {
+    ba.clear();
+    ddg::Serialize(ba, b);
+    Bench out;
+    DDG_ASSERT(ddg::Deserialize(ba, out) && out.id == b.id);
+  }
+  uint64_t used_ba = ddg::GetCurrentMicroSecond() - ts;
+
+  ts = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < n; ++i) {
+    std::string s = ddg::SerializeToString(b);
+    Bench out;
+    DDG_ASSERT(ddg::DeserializeFromString(s, out) && out.id == b.id);
+  }
+  uint64_t used_str = ddg::GetCurrentMicroSecond() - ts;
+
+  // 同样的数据用lexicalcast.h逐个字段转成字符串再转回来
+  int m = std::max(n / 100, 1);
+  ts = ddg::GetCurrentMicroSecond();
+  for (int i = 0; i < m; ++i) {
+    std::string id = ddg::LexicalCast<int32_t, std::string>()(b.id);
+    std::string values =
+        ddg::LexicalCast<std::vector<int32_t>, std::string>()(b.values);
+    std::string attrs =
+        ddg::LexicalCast<std::map<std::string, int64_t>, std::string>()(
+            b.attrs);
+    Bench out;
+    out.id = ddg::LexicalCast<std::string, int32_t>()(id);
+    out.name = b.name;
+    out.values =
+        ddg::LexicalCast<std::string, std::vector<int32_t>>()(values);
+    out.attrs =
+        ddg::LexicalCast<std::string, std::map<std::string, int64_t>>()(
+            attrs);
+    DDG_ASSERT(out.values == b.values && out.attrs == b.attrs);
+  }
+  uint64_t used_lc = ddg::GetCurrentMicroSecond() - ts;
+
+  auto ns = [](uint64_t us, int count) { return us * 1000.0 / count; };
+  DDG_LOG_INFO(g_logger) << "roundtrip ByteArray: " << ns(used_ba, n)
+                         << "ns/op, string: " << ns(used_str, n)
+                         << "ns/op, lexicalcast: " << ns(used_lc, m)
+                         << "ns/op (" << ns(used_lc, m) / ns(used_ba, n)
+                         << "x)";
+}
+
+// 用法: test_serialize [次数]
+int main(int argc, char** argv) {
+  test_roundtrip();
+  bench(argc > 1 ? atoi(argv[1]) : 100000);
+  return 0;
+}
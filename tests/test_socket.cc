@@ -0,0 +1,71 @@
+#include <string.h>
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/socket.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+static ddg::Address::ptr s_addr =
+    ddg::IPv4Address::Create("127.0.0.1", 18081);
+
+void run_server() {
+  ddg::Socket::ptr listener = ddg::Socket::CreateTCP(s_addr);
+  DDG_ASSERT(listener->bind(s_addr));
+  DDG_ASSERT(listener->listen());
+  DDG_LOG_INFO(g_logger) << "listen " << *listener;
+
+  ddg::Socket::ptr client = listener->accept();
+  DDG_ASSERT(client);
+  DDG_LOG_INFO(g_logger) << "accept " << *client;
+
+  // 分散读: 前5个字节一个缓冲区, 后面的一个缓冲区
+  char head[5];
+  char body[64];
+  iovec iov[2];
+  iov[0].iov_base = head;
+  iov[0].iov_len = sizeof(head);
+  iov[1].iov_base = body;
+  iov[1].iov_len = sizeof(body);
+  int n = client->recv(iov, 2);
+  DDG_ASSERT(n > static_cast<int>(sizeof(head)));
+  DDG_LOG_INFO(g_logger) << "server recv head = " << std::string(head, 5)
+                         << " body = "
+                         << std::string(body, n - sizeof(head));
+  iov[1].iov_len = n - sizeof(head);
+  client->send(iov, 2);  // 聚集写回显
+  client->close();
+}
+
+void run_client() {
+  ddg::Socket::ptr sock = ddg::Socket::CreateTCP(s_addr);
+  DDG_ASSERT(sock->connect(s_addr, 1000));
+  DDG_LOG_INFO(g_logger) << "connect " << *sock;
+
+  const char head[] = "HELLO";
+  const char body[] = " ddg socket";
+  iovec iov[2];
+  iov[0].iov_base = const_cast<char*>(head);
+  iov[0].iov_len = sizeof(head) - 1;
+  iov[1].iov_base = const_cast<char*>(body);
+  iov[1].iov_len = sizeof(body) - 1;
+  sock->send(iov, 2);
+
+  sock->setRecvTimeout(1000);
+  std::string buf(128, '\0');
+  int n = sock->recv(&buf[0], buf.size());
+  DDG_LOG_INFO(g_logger) << "client recv " << buf.substr(0, n > 0 ? n : 0);
+  // -1表示不超时
+  sock->setRecvTimeout(-1);
+  DDG_ASSERT(sock->getRecvTimeout() == -1);
+  DDG_ASSERT(sock->close());
+}
+
+int main(int argc, char** argv) {
+  ddg::IOManager iom(2, true, "test_socket");
+  iom.start();
+  iom.schedule(run_server);
+  iom.schedule(run_client);
+  iom.stop();
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "ddg/http/httpconnection.h"
+#include "ddg/http/httpserver.h"
+#include "ddg/http/staticservlet.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+using namespace ddg::http;
+
+static const uint16_t kPort = 18092;
+
+// 服务器停止后servlet还活着, IOManager::stop也要能返回
+static StaticServlet::ptr s_servlet;
+
+static void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream ofs(path, std::ios::trunc | std::ios::binary);
+  ofs << content;
+}
+
+void run(const std::string& root) {
+  std::string big(1024 * 1024, '\0');
+  for (size_t i = 0; i < big.size(); ++i) {
+    big[i] = 'a' + i % 26;
+  }
+  WriteFile(root + "/small.txt", "hello static");
+  WriteFile(root + "/big.bin", big);
+  mkdir((root + "/sub").c_str(), 0755);
+  WriteFile(root + "/sub/index.html", "<html>index</html>");
+
+  StaticServlet::ptr slt(new StaticServlet(root, "/static"));
+  s_servlet = slt;
+  HttpServer::ptr server(new HttpServer);
+  server->getServletDispatch()->addPrefixServlet("/static", slt);
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  DDG_ASSERT(server->bind(addr));
+  server->start();
+
+  HttpConnectionPool::ptr pool = HttpConnectionPool::Create(
+      "http://127.0.0.1:" + std::to_string(kPort), "", 4, 10000, 8);
+
+  // 小文件: mmap + writev
+  HttpResult::ptr r = pool->doGet("/static/small.txt", 1000);
+  DDG_ASSERT(r->result == 0 && r->response->getBody() == "hello static");
+  DDG_ASSERT(r->response->getHeader("Content-Type") == "text/plain");
+  std::string etag = r->response->getHeader("ETag");
+  std::string last_modified = r->response->getHeader("Last-Modified");
+  DDG_LOG_INFO(g_logger) << "etag = " << etag
+                         << " last-modified = " << last_modified;
+
+  // 大文件: sendfile
+  r = pool->doGet("/static/big.bin", 1000);
+  DDG_ASSERT(r->result == 0 && r->response->getBody() == big);
+
+  r = pool->doGet("/static/sub/", 1000);
+  DDG_ASSERT(r->result == 0 && r->response->getBody() == "<html>index</html>");
+
+  HttpRequest::ptr head(new HttpRequest(0x11, false));
+  head->setMethod(ddg::http::HttpMethod::HEAD);
+  head->setPath("/static/big.bin");
+  r = pool->doRequest(head, 1000);
+  DDG_ASSERT(r->result == 0 && r->response->getBody().empty());
+  DDG_ASSERT(r->response->getHeader("Content-Length") ==
+             std::to_string(big.size()));
+
+  // 条件请求
+  r = pool->doGet("/static/small.txt", 1000, {{"If-None-Match", etag}});
+  DDG_ASSERT(r->result == 0 && r->response->getStatus() ==
+                                   ddg::http::HttpStatus::NOT_MODIFIED);
+  r = pool->doGet("/static/small.txt", 1000,
+                  {{"If-Modified-Since", last_modified}});
+  DDG_ASSERT(r->result == 0 && r->response->getStatus() ==
+                                   ddg::http::HttpStatus::NOT_MODIFIED);
+  DDG_ASSERT(slt->getFileCache()->size() == 3);
+
+  // 修改文件, inotify让缓存失效
+  WriteFile(root + "/small.txt", "hello again");
+  usleep(50 * 1000);
+  r = pool->doGet("/static/small.txt", 1000, {{"If-None-Match", etag}});
+  DDG_ASSERT(r->result == 0 && r->response->getBody() == "hello again");
+  DDG_ASSERT(r->response->getHeader("ETag") != etag);
+
+  unlink((root + "/small.txt").c_str());
+  usleep(50 * 1000);
+  r = pool->doGet("/static/small.txt", 1000);
+  DDG_ASSERT(r->response->getStatus() == ddg::http::HttpStatus::NOT_FOUND);
+
+  r = pool->doGet("/static/../etc/passwd", 1000);
+  DDG_ASSERT(r->response->getStatus() == ddg::http::HttpStatus::FORBIDDEN);
+  r = pool->doPost("/static/big.bin", 1000);
+  DDG_ASSERT(r->response->getStatus() ==
+             ddg::http::HttpStatus::METHOD_NOT_ALLOWED);
+
+  DDG_LOG_INFO(g_logger) << "static servlet ok, pool connect count = "
+                         << pool->getConnectCount();
+  server->stop();
+
+  // 停止后不再监听, 每次get时检查inotify事件
+  FileCache::ptr cache = slt->getFileCache();
+  DDG_ASSERT(cache->get("/sub/index.html"));
+  WriteFile(root + "/sub/index.html", "<html>new</html>");
+  FileCache::File::ptr file = cache->get("/sub/index.html");
+  DDG_ASSERT(file && std::string(file->data, file->size) == "<html>new</html>");
+}
+
+int main(int argc, char** argv) {
+  char tmpl[] = "/tmp/ddg_static_XXXXXX";
+  DDG_ASSERT(mkdtemp(tmpl));
+  std::string root = tmpl;
+  {
+    ddg::IOManager iom(1, false, "static");
+    iom.start();
+    iom.schedule(std::bind(run, root));
+    iom.stop();
+  }
+  s_servlet.reset();
+  std::string cmd = "rm -rf " + root;
+  return system(cmd.c_str());
+}
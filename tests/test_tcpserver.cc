@@ -0,0 +1,90 @@
+#include <atomic>
+
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/tcpserver.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+static const int kClientCount = 10;
+
+class EchoServer : public ddg::TcpServer {
+ public:
+  EchoServer(ddg::IOManager* worker, ddg::IOManager* accept_worker)
+      : ddg::TcpServer(worker, accept_worker) {}
+
+ protected:
+  void handleClient(ddg::Socket::ptr client) override {
+    char buf[256];
+    while (true) {
+      int n = client->recv(buf, sizeof(buf));
+      if (n <= 0) {
+        DDG_LOG_INFO(g_logger) << "client " << *client << " closed, n = " << n
+                               << " errno = " << errno;
+        break;
+      }
+      client->send(buf, n);
+    }
+  }
+};
+
+static std::atomic<int> s_done{0};
+
+void run_client(ddg::Address::ptr addr, ddg::TcpServer::ptr server, int i) {
+  ddg::Socket::ptr sock = ddg::Socket::CreateTCP(addr);
+  DDG_ASSERT(sock->connect(addr, 1000));
+
+  std::string msg = "hello " + std::to_string(i);
+  sock->send(msg.c_str(), msg.size());
+  std::string buf(64, '\0');
+  int n = sock->recv(&buf[0], buf.size());
+  DDG_ASSERT(n == static_cast<int>(msg.size()));
+  DDG_ASSERT(buf.substr(0, n) == msg);
+  sock->close();
+
+  if (++s_done == kClientCount) {
+    // 留一个空闲连接, 验证stop超时后会被shutdown
+    ddg::Socket::ptr idle = ddg::Socket::CreateTCP(addr);
+    DDG_ASSERT(idle->connect(addr, 1000));
+    usleep(100 * 1000);
+    DDG_LOG_INFO(g_logger) << server->toString();
+    server->stop(500);
+    n = idle->recv(&buf[0], buf.size());
+    DDG_LOG_INFO(g_logger) << "idle client recv n = " << n;
+  }
+}
+
+void test_server(ddg::IOManager* worker, ddg::IOManager* accept_worker,
+                 uint16_t port) {
+  s_done = 0;
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", port);
+  ddg::TcpServer::ptr server(new EchoServer(worker, accept_worker));
+  DDG_ASSERT(server->bind(addr));
+  server->start();
+
+  for (int i = 0; i < kClientCount; ++i) {
+    worker->schedule(std::bind(run_client, addr, server, i));
+  }
+}
+
+int main(int argc, char** argv) {
+  {
+    // accept和连接处理分开
+    ddg::IOManager worker(2, true, "worker");
+    ddg::IOManager acceptor(1, false, "accept");
+    worker.start();
+    acceptor.start();
+    worker.schedule(std::bind(test_server, &worker, &acceptor, 18082));
+    worker.stop();
+    acceptor.stop();
+  }
+  DDG_LOG_INFO(g_logger) << "---------- thread per core ----------";
+  {
+    ddg::IOManager iom(3, false, "per_core");
+    iom.start();
+    iom.schedule(std::bind(test_server, &iom, &iom, 18083));
+    iom.stop();
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/udpsocket.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+static const uint16_t kPort = 18095;
+static std::atomic<bool> s_stop{false};
+
+static ddg::Address::ptr ServerAddress() {
+  return ddg::IPv4Address::Create("127.0.0.1", kPort);
+}
+
+// 回显服务: 收一批, 原样发回各自的来源地址
+static void run_echo(ddg::UdpSocket::ptr sock) {
+  ddg::UdpRecvBatch rb(64, 64 * 1024);
+  ddg::UdpSendBatch sb(64 * 64);
+  while (!s_stop) {
+    if (sock->recvBatch(rb) <= 0) {
+      continue;
+    }
+    rb.forEach([&](const char* data, size_t len, size_t slot) {
+      sb.add(data, len, rb.getAddr(slot), rb.getAddrLen(slot));
+    });
+    DDG_ASSERT(sock->sendBatch(sb) == static_cast<int>(sb.size()));
+    sb.clear();
+  }
+}
+
+static void test_batch() {
+  ddg::UdpSocket::ptr sock = ddg::UdpSocket::Create();
+  sock->setRecvTimeout(1000);
+  DDG_LOG_INFO(g_logger) << "gso supported = " << sock->isGsoSupported()
+                         << " gro = " << sock->setGro(true);
+
+  // 同样大小的报文会被合并, 最后一个短报文也可以并进去
+  ddg::UdpSendBatch sb(64);
+  ddg::Address::ptr to = ServerAddress();
+  std::string expect;
+  for (int i = 0; i < 32; ++i) {
+    std::string data(1000, 'a' + i % 26);
+    DDG_ASSERT(sb.add(data.c_str(), data.size(), to));
+    expect += data;
+  }
+  DDG_ASSERT(sb.add("tail", 4, to));
+  expect += "tail";
+  DDG_ASSERT(sb.add("x", 1, to));  // 短报文之后另起一条
+  expect += "x";
+  DDG_ASSERT(sb.size() == 34);
+  DDG_ASSERT(sock->sendBatch(sb) == 34);
+
+  ddg::UdpRecvBatch rb(64, 64 * 1024);
+  std::string got;
+  size_t datagrams = 0;
+  while (datagrams < 34) {
+    DDG_ASSERT(sock->recvBatch(rb) > 0);
+    rb.forEach([&](const char* data, size_t len, size_t slot) {
+      DDG_ASSERT(!rb.isTruncated(slot));
+      got.append(data, len);
+      ++datagrams;
+    });
+  }
+  DDG_ASSERT(got == expect);
+  DDG_LOG_INFO(g_logger) << "batch echo ok, last recv slots = " << rb.size()
+                         << " segment = " << rb.getSegmentSize(0);
+}
+
+// 每轮发window个报文, 全部收回来再发下一轮
+static void bench_batch(int rounds, int window, size_t size) {
+  ddg::UdpSocket::ptr sock = ddg::UdpSocket::Create();
+  sock->setRecvTimeout(1000);
+  sock->setGro(true);
+  ddg::Address::ptr to = ServerAddress();
+  std::string data(size, 'b');
+  ddg::UdpSendBatch sb(window);
+  ddg::UdpRecvBatch rb(window, 64 * 1024);
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  for (int r = 0; r < rounds; ++r) {
+    sb.clear();
+    for (int i = 0; i < window; ++i) {
+      sb.add(data.c_str(), data.size(), to);
+    }
+    DDG_ASSERT(sock->sendBatch(sb) == window);
+    int got = 0;
+    while (got < window) {
+      DDG_ASSERT(sock->recvBatch(rb) > 0);
+      rb.forEach([&](const char*, size_t, size_t) { ++got; });
+    }
+  }
+  uint64_t used = ddg::GetCurrentMicroSecond() - start;
+  DDG_LOG_INFO(g_logger) << "batch: " << rounds * window
+                         << " datagrams used = " << used / 1000 << "ms "
+                         << (rounds * window * 1000000.0 / used) << " pkt/s";
+}
+
+// unix域的数据报socket, 工厂函数返回时已经可以直接收发
+static void test_unix() {
+  const std::string path = "/tmp/ddg_test_udpsocket.sock";
+  unlink(path.c_str());
+  ddg::Address::ptr addr(new ddg::UnixAddress(path));
+  ddg::Socket::ptr server = ddg::Socket::CreateUnixUDPSocket();
+  DDG_ASSERT(server->isValid() && server->bind(addr));
+  ddg::Socket::ptr client = ddg::Socket::CreateUnixUDPSocket();
+  DDG_ASSERT(client->isValid());
+  DDG_ASSERT(client->sendTo("unix", 4, addr) == 4);
+  char buf[16];
+  ddg::Address::ptr from(new ddg::UnixAddress);
+  DDG_ASSERT(server->recvFrom(buf, sizeof(buf), from) == 4);
+  DDG_ASSERT(memcmp(buf, "unix", 4) == 0);
+  unlink(path.c_str());
+}
+
+// 对照: 一次一个报文的sendTo/recvFrom
+static void bench_single(int rounds, int window, size_t size) {
+  ddg::Socket::ptr sock = ddg::Socket::CreateUDPSocket();
+  sock->setRecvTimeout(1000);
+  ddg::Address::ptr to = ServerAddress();
+  ddg::Address::ptr from = ddg::IPv4Address::Create("0.0.0.0");
+  std::string data(size, 'b');
+  std::string buf(64 * 1024, '\0');
+  uint64_t start = ddg::GetCurrentMicroSecond();
+  for (int r = 0; r < rounds; ++r) {
+    for (int i = 0; i < window; ++i) {
+      DDG_ASSERT(sock->sendTo(data.c_str(), data.size(), to) ==
+                 static_cast<int>(size));
+    }
+    for (int i = 0; i < window; ++i) {
+      DDG_ASSERT(sock->recvFrom(&buf[0], buf.size(), from) ==
+                 static_cast<int>(size));
+    }
+  }
+  uint64_t used = ddg::GetCurrentMicroSecond() - start;
+  DDG_LOG_INFO(g_logger) << "single: " << rounds * window
+                         << " datagrams used = " << used / 1000 << "ms "
+                         << (rounds * window * 1000000.0 / used) << " pkt/s";
+}
+
+// 用法: test_udpsocket [轮数 每轮报文数 报文大小]
+void run(int argc, char** argv) {
+  ddg::UdpSocket::ptr server = ddg::UdpSocket::Create();
+  DDG_ASSERT(server->bind(ServerAddress()));
+  server->setGro(true);
+  ddg::IOManager::GetThis()->schedule(std::bind(run_echo, server));
+
+  test_batch();
+  test_unix();
+
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  int window = argc > 2 ? atoi(argv[2]) : 32;
+  size_t size = argc > 3 ? atoi(argv[3]) : 512;
+  bench_single(rounds, window, size);
+  bench_batch(rounds, window, size);
+
+  s_stop = true;
+  server->close();
+}
+
+int main(int argc, char** argv) {
+  g_logger->setLevel(ddg::LogLevel::INFO);
+  DDG_LOG_NAME("system")->setLevel(ddg::LogLevel::INFO);
+  ddg::IOManager iom(2, false, "udp");
+  iom.start();
+  iom.schedule(std::bind(run, argc, argv));
+  iom.stop();
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "ddg/config.h"
+#include "ddg/http/httpconnection.h"
+#include "ddg/http/httpserver.h"
+#include "ddg/http/wsservlet.h"
+#include "ddg/iomanager.h"
+#include "ddg/log.h"
+#include "ddg/macro.h"
+#include "ddg/utils.h"
+
+static ddg::Logger::ptr g_logger = DDG_LOG_ROOT();
+
+using namespace ddg::http;
+
+static const uint16_t kPort = 18093;
+
+static std::atomic<int> s_done(0);
+
+// 服务器停止后servlet还活着, 没有连接时不能有定时器挡住IOManager::stop
+static WSServlet::ptr s_servlet;
+
+// 握手, 用RFC 6455里的例子校验Sec-WebSocket-Accept
+static WSSession::ptr Connect() {
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  ddg::Socket::ptr sock = ddg::Socket::CreateTCP(addr);
+  DDG_ASSERT(sock->connect(addr));
+  HttpConnection::ptr conn(new HttpConnection(sock));
+
+  HttpRequest::ptr req(new HttpRequest(0x11, false));
+  req->setPath("/ws");
+  req->setWebsocket(true);
+  req->setHeader("Upgrade", "websocket");
+  req->setHeader("Connection", "Upgrade");
+  req->setHeader("Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ==");
+  req->setHeader("Sec-WebSocket-Version", "13");
+  DDG_ASSERT(conn->sendRequest(req) > 0);
+  HttpResponse::ptr rsp = conn->recvResponse(false);
+  DDG_ASSERT(rsp && rsp->getStatus() == HttpStatus::SWITCHING_PROTOCOLS);
+  DDG_ASSERT(rsp->getHeader("Sec-WebSocket-Accept") ==
+             "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+  return WSSession::ptr(new WSSession(conn, true));
+}
+
+static void TestEcho() {
+  WSSession::ptr ws = Connect();
+  DDG_ASSERT(ws->sendMessage("hello") > 0);
+  WSFrameMessage::ptr msg = ws->recvMessage();
+  DDG_ASSERT(msg && msg->toString() == "hello");
+
+  // 分片的消息在服务端拼成一个
+  DDG_ASSERT(ws->sendMessage("abc", WSFrameHead::TEXT_FRAME, false) > 0);
+  DDG_ASSERT(ws->sendMessage("def", WSFrameHead::CONTINUE, true) > 0);
+  msg = ws->recvMessage();
+  DDG_ASSERT(msg && msg->toString() == "abcdef");
+
+  // pong在recvMessage内部被跳过
+  DDG_ASSERT(ws->ping() > 0);
+  DDG_ASSERT(ws->sendMessage("x") > 0);
+  msg = ws->recvMessage();
+  DDG_ASSERT(msg && msg->toString() == "x");
+
+  // 大消息, 跨多个ByteArray内存块去掩码
+  std::string big(1024 * 1024 + 7, '\0');
+  for (size_t i = 0; i < big.size(); ++i) {
+    big[i] = static_cast<char>(i * 131);
+  }
+  uint64_t ts = ddg::GetCurrentMicroSecond();
+  DDG_ASSERT(ws->sendMessage(big, WSFrameHead::BIN_FRAME) > 0);
+  msg = ws->recvMessage();
+  DDG_ASSERT(msg && msg->getOpcode() == WSFrameHead::BIN_FRAME);
+  DDG_ASSERT(msg->toString() == big);
+  DDG_LOG_INFO(g_logger) << "1MB echo used "
+                         << ddg::GetCurrentMicroSecond() - ts << "us";
+
+  DDG_ASSERT(ws->close() > 0);
+  DDG_ASSERT(!ws->recvMessage());
+  ++s_done;
+}
+
+static void TestBroadcast(WSServlet::ptr slt) {
+  const int kClients = 3;
+  std::atomic<int> received(0);
+  for (int i = 0; i < kClients; ++i) {
+    WSSession::ptr ws = Connect();
+    ddg::IOManager::GetThis()->schedule([ws, &received]() {
+      WSFrameMessage::ptr msg = ws->recvMessage();
+      DDG_ASSERT(msg && msg->toString() == "news");
+      ++received;
+      ws->close();
+    });
+  }
+  while (slt->getSessionCount() < kClients) {
+    usleep(1000);
+  }
+  slt->broadcast("news");
+  while (received < kClients) {
+    usleep(1000);
+  }
+  ++s_done;
+}
+
+// 分片消息的后续帧声明了超大的64位长度, 服务端不能溢出也不能按它分配内存
+static void TestHugeLength() {
+  const uint8_t kLengths[2] = {0xFF, 0x7F};  // 最高位置1的非法长度, 超过上限
+  for (uint8_t first : kLengths) {
+    WSSession::ptr ws = Connect();
+    DDG_ASSERT(ws->sendMessage("abc", WSFrameHead::TEXT_FRAME, false) > 0);
+    uint8_t frame[14] = {0x80 | WSFrameHead::CONTINUE, 0x80 | 127, first};
+    memset(frame + 3, 0xFF, 7);
+    DDG_ASSERT(ws->getStream()->getSocket()->send(frame, sizeof(frame)) ==
+               sizeof(frame));
+    DDG_ASSERT(!ws->recvMessage());
+  }
+  ++s_done;
+}
+
+// 一个协程收, 另一个协程同时发, 收的一方不能去flush发送方的写缓冲
+static void TestConcurrentSend() {
+  const int kCount = 200;
+  WSSession::ptr ws = Connect();
+  std::atomic<bool> sent(false);
+  ddg::IOManager::GetThis()->schedule([ws, &sent]() {
+    for (int i = 0; i < kCount; ++i) {
+      std::string data(64 * 1024, static_cast<char>('a' + i % 26));
+      DDG_ASSERT(ws->sendMessage(std::to_string(i) + data) > 0);
+    }
+    sent = true;
+  });
+  for (int i = 0; i < kCount; ++i) {
+    WSFrameMessage::ptr msg = ws->recvMessage();
+    std::string prefix = std::to_string(i);
+    DDG_ASSERT(msg && msg->toString() ==
+                          prefix + std::string(64 * 1024, 'a' + i % 26));
+  }
+  while (!sent) {
+    usleep(1000);
+  }
+  DDG_ASSERT(ws->close() > 0);
+  DDG_ASSERT(!ws->recvMessage());
+  ++s_done;
+}
+
+// 只收不回pong的连接, 超过ping_timeout会被断开
+static void TestTimeout() {
+  WSSession::ptr ws = Connect();
+  ddg::Socket::ptr sock = ws->getStream()->getSocket();
+  uint64_t ts = ddg::GetCurrentMilliSecond();
+  char buf[64];
+  int pings = 0;
+  int n;
+  while ((n = sock->recv(buf, sizeof(buf))) > 0) {
+    pings += (buf[0] & 0x0F) == WSFrameHead::PING;
+  }
+  uint64_t used = ddg::GetCurrentMilliSecond() - ts;
+  DDG_LOG_INFO(g_logger) << "idle connection closed after " << used
+                         << "ms, pings = " << pings;
+  DDG_ASSERT(used >= 300 && pings > 0);
+  ++s_done;
+}
+
+void run() {
+  ddg::Config::Lookup<uint32_t>("websocket.ping_interval")->setValue(100);
+  ddg::Config::Lookup<uint32_t>("websocket.ping_timeout")->setValue(300);
+
+  WSServlet::ptr slt(new WSServlet(
+      [](HttpRequest::ptr req, WSFrameMessage::ptr msg, WSSession::ptr ws) {
+        return ws->sendMessage(msg) > 0 ? 0 : -1;
+      }));
+  HttpServer::ptr server(new HttpServer);
+  server->getServletDispatch()->addServlet("/ws", slt);
+  ddg::Address::ptr addr = ddg::IPv4Address::Create("127.0.0.1", kPort);
+  DDG_ASSERT(server->bind(addr));
+  server->start();
+
+  // 不是Upgrade请求
+  HttpResult::ptr r = HttpConnection::DoGet(
+      "http://127.0.0.1:" + std::to_string(kPort) + "/ws", 1000);
+  DDG_ASSERT(r->result == 0 && r->response->getStatus() ==
+                                   HttpStatus::UPGRADE_REQUIRED);
+
+  TestEcho();
+  TestBroadcast(slt);
+  TestConcurrentSend();
+  TestHugeLength();
+  TestTimeout();
+  DDG_ASSERT(s_done == 5);
+  while (slt->getSessionCount()) {
+    usleep(1000);
+  }
+  DDG_LOG_INFO(g_logger) << "websocket ok";
+  s_servlet = slt;
+  server->stop();
+}
+
+int main(int argc, char** argv) {
+  ddg::IOManager iom(2, false, "ws");
+  iom.start();
+  iom.schedule(run);
+  iom.stop();
+  s_servlet.reset();
+  return 0;
+}
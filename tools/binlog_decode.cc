@@ -0,0 +1,22 @@
+#include <iostream>
+#include <string>
+
+#include "ddg/binlog.h"
+
+// 用法: binlog_decode <file> [pattern]
+// pattern是LogFormatter的格式, 默认和Logger的默认格式一样
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <file> [pattern]" << std::endl;
+    return 1;
+  }
+  std::string pattern = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%F%T[%p]%T<%f:%l>%T%m%n";
+  if (argc > 2) {
+    pattern = argv[2];
+  }
+  if (!ddg::BinLogReader::Decode(argv[1], std::cout, pattern)) {
+    std::cerr << "decode " << argv[1] << " failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}